@@ -9,6 +9,7 @@
 #include "runtime_d3d12.hpp"
 #include "runtime_config.hpp"
 #include "runtime_objects.hpp"
+#include "effect_cache.hpp"
 #include "dxgi/format_utils.hpp"
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -170,6 +171,8 @@ bool reshade::d3d12::runtime_d3d12::on_init(const DXGI_SWAP_CHAIN_DESC &swap_des
 	for (UINT i = 0; i < swap_desc.BufferCount; ++i)
 		if (FAILED(_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&_fence[i]))))
 			return false;
+	if (FAILED(_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&_retire_fence))))
+		return false;
 
 	// Allocate descriptor heaps
 	{   D3D12_DESCRIPTOR_HEAP_DESC desc = { D3D12_DESCRIPTOR_HEAP_TYPE_RTV };
@@ -310,6 +313,13 @@ bool reshade::d3d12::runtime_d3d12::on_init(const DXGI_SWAP_CHAIN_DESC &swap_des
 			return false;
 	}
 
+	// Load the HLSL compiler here already, since shaders are compiled on the worker threads, which must not race on loading it
+	if (_d3d_compiler == nullptr)
+		_d3d_compiler = LoadLibraryW(L"d3dcompiler_47.dll");
+
+	if (_d3d_compiler == nullptr)
+		LOG(ERROR) << "Unable to load HLSL compiler (\"d3dcompiler_47.dll\").";
+
 #if RESHADE_GUI
 	if (!init_imgui_resources())
 		return false;
@@ -325,6 +335,10 @@ void reshade::d3d12::runtime_d3d12::on_reset()
 	if (!_fence.empty() && !_fence_value.empty())
 		wait_for_command_queue();
 
+	_retired_objects.clear();
+	_retire_fence.reset();
+	_retire_fence_value = 0;
+
 	_cmd_list.reset();
 	_cmd_alloc.clear();
 
@@ -386,6 +400,8 @@ void reshade::d3d12::runtime_d3d12::on_present()
 	// Reset command allocator before using it this frame again
 	_cmd_alloc[_swap_index]->Reset();
 
+	release_retired_objects();
+
 	if (!begin_command_list())
 		return;
 
@@ -410,6 +426,10 @@ void reshade::d3d12::runtime_d3d12::on_present()
 	if (const UINT64 sync_value = _fence_value[_swap_index] + 1;
 		SUCCEEDED(_commandqueue->Signal(_fence[_swap_index].get(), sync_value)))
 		_fence_value[_swap_index] = sync_value;
+
+	// Objects retired up to this point are no longer in use once the GPU gets here
+	if (SUCCEEDED(_commandqueue->Signal(_retire_fence.get(), _retire_fence_value + 1)))
+		_retire_fence_value++;
 }
 
 bool reshade::d3d12::runtime_d3d12::capture_screenshot(uint8_t *buffer) const
@@ -493,48 +513,69 @@ bool reshade::d3d12::runtime_d3d12::capture_screenshot(uint8_t *buffer) const
 	return true;
 }
 
-bool reshade::d3d12::runtime_d3d12::init_effect(size_t index)
-{
-	if (_d3d_compiler == nullptr)
-		_d3d_compiler = LoadLibraryW(L"d3dcompiler_47.dll");
+static constexpr UINT compile_flags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
 
-	if (_d3d_compiler == nullptr)
+void reshade::d3d12::runtime_d3d12::init_compile_jobs(const effect &effect, std::vector<shader_compile_job> &jobs) const
+{
+	// Identify the compiler library by its path and modification time, so that byte code compiled by a different version of it is never used
+	reshadefx::effect_cache::key compiler_key;
+	if (WCHAR compiler_path[MAX_PATH]; _d3d_compiler != nullptr && GetModuleFileNameW(_d3d_compiler, compiler_path, MAX_PATH) != 0)
 	{
-		LOG(ERROR) << "Unable to load HLSL compiler (\"d3dcompiler_47.dll\").";
-		return false;
+		std::error_code ec;
+		compiler_key.add(std::filesystem::path(compiler_path).u8string());
+		compiler_key.add(static_cast<uint64_t>(std::filesystem::last_write_time(compiler_path, ec).time_since_epoch().count()));
 	}
 
-	effect &effect = _effects[index];
+	for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
+	{
+		shader_compile_job &job = jobs.emplace_back();
+		job.entry_point = entry_point.name;
+		job.is_pixel_shader = entry_point.is_pixel_shader;
+		job.profile = entry_point.is_pixel_shader ? "ps_5_0" : "vs_5_0";
+
+		// Only compile the code this entry point actually uses if the code generator provided it
+		job.source = effect.preamble + (entry_point.hlsl.empty() ? effect.module.hlsl : entry_point.hlsl);
+		job.cache_key = reshadefx::effect_cache::key(compiler_key).add(job.source).add(job.entry_point).add(job.profile).add(compile_flags).value();
+	}
+}
+bool reshade::d3d12::runtime_d3d12::compile_entry_point(shader_compile_job &job) const
+{
+	if (_d3d_compiler == nullptr)
+		return false;
 
 	const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3d_compiler, "D3DCompile"));
 	const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(_d3d_compiler, "D3DDisassemble"));
 
-	const std::string hlsl = effect.preamble + effect.module.hlsl;
-	std::unordered_map<std::string, com_ptr<ID3DBlob>> entry_points;
+	com_ptr<ID3DBlob> d3d_compiled, d3d_errors;
+	const HRESULT hr = D3DCompile(
+		job.source.c_str(), job.source.size(),
+		nullptr, nullptr, nullptr,
+		job.entry_point.c_str(),
+		job.profile.c_str(),
+		compile_flags, 0,
+		&d3d_compiled, &d3d_errors);
+
+	if (d3d_errors != nullptr)
+		job.errors.assign(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
+	if (FAILED(hr))
+		return false;
 
-	// Compile the generated HLSL source code to DX byte code
-	for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
-	{
-		com_ptr<ID3DBlob> d3d_errors;
+	job.code.assign(static_cast<const char *>(d3d_compiled->GetBufferPointer()), d3d_compiled->GetBufferSize());
 
-		const HRESULT hr = D3DCompile(
-			hlsl.c_str(), hlsl.size(),
-			nullptr, nullptr, nullptr,
-			entry_point.name.c_str(),
-			entry_point.is_pixel_shader ? "ps_5_0" : "vs_5_0",
-			D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
-			&entry_points[entry_point.name], &d3d_errors);
+	if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(job.code.data(), job.code.size(), 0, nullptr, &d3d_disassembled)))
+		job.assembly.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()));
 
-		if (d3d_errors != nullptr) // Append warnings to the output error string as well
-			effect.errors.append(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
+	return true;
+}
 
-		// No need to setup resources if any of the shaders failed to compile
-		if (FAILED(hr))
-			return false;
+bool reshade::d3d12::runtime_d3d12::init_effect(size_t index)
+{
+	effect &effect = _effects[index];
 
-		if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(entry_points[entry_point.name]->GetBufferPointer(), entry_points[entry_point.name]->GetBufferSize(), 0, nullptr, &d3d_disassembled)))
-			effect.assembly[entry_point.name] = std::string(static_cast<const char *>(d3d_disassembled->GetBufferPointer()));
-	}
+	// Get the DX byte code compiled on the worker threads, which is referenced when creating pipeline states below
+	std::unordered_map<std::string, std::string_view> entry_points;
+	for (const shader_compile_job &job : effect.shaders->jobs)
+		entry_points[job.entry_point] = job.code;
 
 	if (index >= _effect_data.size())
 		_effect_data.resize(index + 1);
@@ -725,9 +766,9 @@ bool reshade::d3d12::runtime_d3d12::init_effect(size_t index)
 			pso_desc.pRootSignature = effect_data.signature.get();
 
 			const auto &VS = entry_points.at(pass_info.vs_entry_point);
-			pso_desc.VS = { VS->GetBufferPointer(), VS->GetBufferSize() };
+			pso_desc.VS = { VS.data(), VS.size() };
 			const auto &PS = entry_points.at(pass_info.ps_entry_point);
-			pso_desc.PS = { PS->GetBufferPointer(), PS->GetBufferSize() };
+			pso_desc.PS = { PS.data(), PS.size() };
 
 			pso_desc.NumRenderTargets = 1;
 			pso_desc.RTVFormats[0] = pass_info.srgb_write_enable ?
@@ -890,15 +931,13 @@ bool reshade::d3d12::runtime_d3d12::init_effect(size_t index)
 }
 void reshade::d3d12::runtime_d3d12::unload_effect(size_t index)
 {
-	// Make sure no effect resources are currently in use
-	wait_for_command_queue();
-
+	// Frames that are still executing may use the effect resources, so keep them alive until those finished instead of waiting for the GPU here
 	for (technique &tech : _techniques)
 	{
 		if (tech.effect_index != index)
 			continue;
 
-		delete static_cast<d3d12_technique_data *>(tech.impl);
+		retire_object(std::shared_ptr<d3d12_technique_data>(static_cast<d3d12_technique_data *>(tech.impl)));
 		tech.impl = nullptr;
 	}
 
@@ -906,13 +945,8 @@ void reshade::d3d12::runtime_d3d12::unload_effect(size_t index)
 
 	if (index < _effect_data.size())
 	{
-		d3d12_effect_data &effect_data = _effect_data[index];
-		effect_data.cb.reset();
-		effect_data.signature.reset();
-		effect_data.srv_heap.reset();
-		effect_data.rtv_heap.reset();
-		effect_data.sampler_heap.reset();
-		effect_data.depth_texture_binding = { 0 };
+		retire_object(std::make_shared<d3d12_effect_data>(std::move(_effect_data[index])));
+		_effect_data[index] = {};
 	}
 }
 void reshade::d3d12::runtime_d3d12::unload_effects()
@@ -929,6 +963,9 @@ void reshade::d3d12::runtime_d3d12::unload_effects()
 	runtime::unload_effects();
 
 	_effect_data.clear();
+
+	// Nothing was submitted since waiting above, so the textures that were just retired can be released right away
+	_retired_objects.clear();
 }
 
 bool reshade::d3d12::runtime_d3d12::init_texture(texture &texture)
@@ -1143,10 +1180,8 @@ void reshade::d3d12::runtime_d3d12::upload_texture(const texture &texture, const
 }
 void reshade::d3d12::runtime_d3d12::destroy_texture(texture &texture)
 {
-	// Make sure texture is not still in use before destroying it
-	wait_for_command_queue();
-
-	delete static_cast<d3d12_tex_data *>(texture.impl);
+	// The texture may still be in use by frames that are executing, so only release it once those finished
+	retire_object(std::shared_ptr<d3d12_tex_data>(static_cast<d3d12_tex_data *>(texture.impl)));
 	texture.impl = nullptr;
 }
 void reshade::d3d12::runtime_d3d12::generate_mipmaps(const texture &texture)
@@ -1370,6 +1405,20 @@ bool reshade::d3d12::runtime_d3d12::wait_for_command_queue() const
 	_fence_value[_swap_index] = sync_value;
 	return true;
 }
+void reshade::d3d12::runtime_d3d12::retire_object(std::shared_ptr<void> object)
+{
+	// Commands referencing the object may still be recorded this frame, so it is in use until the next signal of the retire fence at the end of it
+	_retired_objects.emplace_back(_retire_fence_value + 1, std::move(object));
+}
+void reshade::d3d12::runtime_d3d12::release_retired_objects()
+{
+	if (_retire_fence == nullptr)
+		return;
+
+	const UINT64 completed_value = _retire_fence->GetCompletedValue();
+	_retired_objects.erase(std::remove_if(_retired_objects.begin(), _retired_objects.end(),
+		[completed_value](const std::pair<UINT64, std::shared_ptr<void>> &object) { return object.first <= completed_value; }), _retired_objects.end());
+}
 
 com_ptr<ID3D12RootSignature> reshade::d3d12::runtime_d3d12::create_root_signature(const D3D12_ROOT_SIGNATURE_DESC &desc) const
 {
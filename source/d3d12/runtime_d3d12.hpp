@@ -30,6 +30,9 @@ namespace reshade::d3d12
 		bool capture_screenshot(uint8_t *buffer) const override;
 
 	private:
+		void init_compile_jobs(const effect &effect, std::vector<shader_compile_job> &jobs) const override;
+		bool compile_entry_point(shader_compile_job &job) const override;
+
 		bool init_effect(size_t index) override;
 		void unload_effect(size_t index) override;
 		void unload_effects() override;
@@ -44,6 +47,8 @@ namespace reshade::d3d12
 		bool begin_command_list(const com_ptr<ID3D12PipelineState> &state = nullptr) const;
 		void execute_command_list() const;
 		bool wait_for_command_queue() const;
+		void retire_object(std::shared_ptr<void> object);
+		void release_retired_objects();
 
 		com_ptr<ID3D12RootSignature> create_root_signature(const D3D12_ROOT_SIGNATURE_DESC &desc) const;
 
@@ -63,6 +68,10 @@ namespace reshade::d3d12
 		mutable bool _cmd_list_is_recording = false;
 		com_ptr<ID3D12GraphicsCommandList> _cmd_list;
 		std::vector<com_ptr<ID3D12CommandAllocator>> _cmd_alloc;
+		// Objects that frames which are still executing may reference, along with the value of the retire fence after which they are no longer in use
+		com_ptr<ID3D12Fence> _retire_fence;
+		UINT64 _retire_fence_value = 0;
+		std::vector<std::pair<UINT64, std::shared_ptr<void>>> _retired_objects;
 
 		DXGI_FORMAT _backbuffer_format = DXGI_FORMAT_UNKNOWN;
 		std::vector<com_ptr<ID3D12Resource>> _backbuffers;
@@ -7,6 +7,7 @@
 #include "runtime_d3d9.hpp"
 #include "runtime_config.hpp"
 #include "runtime_objects.hpp"
+#include "effect_cache.hpp"
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <d3dcompiler.h>
@@ -158,6 +159,15 @@ bool reshade::d3d9::runtime_d3d9::on_init(const D3DPRESENT_PARAMETERS &pp)
 	if (!_app_state.init_state_block())
 		return false;
 
+	// Load the HLSL compiler here already, since shaders are compiled on the worker threads, which must not race on loading it
+	if (_d3d_compiler == nullptr)
+		_d3d_compiler = LoadLibraryW(L"d3dcompiler_47.dll");
+	if (_d3d_compiler == nullptr)
+		_d3d_compiler = LoadLibraryW(L"d3dcompiler_43.dll");
+
+	if (_d3d_compiler == nullptr)
+		LOG(ERROR) << "Unable to load HLSL compiler (\"d3dcompiler_47.dll\"). Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.";
+
 #if RESHADE_GUI
 	if (!init_imgui_resources())
 		return false;
@@ -301,69 +311,86 @@ bool reshade::d3d9::runtime_d3d9::capture_screenshot(uint8_t *buffer) const
 	return true;
 }
 
-bool reshade::d3d9::runtime_d3d9::init_effect(size_t index)
-{
-	if (_d3d_compiler == nullptr)
-		_d3d_compiler = LoadLibraryW(L"d3dcompiler_47.dll");
-	if (_d3d_compiler == nullptr)
-		_d3d_compiler = LoadLibraryW(L"d3dcompiler_43.dll");
-
-	if (_d3d_compiler == nullptr)
-	{
-		LOG(ERROR) << "Unable to load HLSL compiler (\"d3dcompiler_47.dll\"). Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.";
-		return false;
-	}
-
-	effect &effect = _effects[index];
-
-	const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3d_compiler, "D3DCompile"));
-	const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(_d3d_compiler, "D3DDisassemble"));
+static constexpr UINT compile_flags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
 
+void reshade::d3d9::runtime_d3d9::init_compile_jobs(const effect &effect, std::vector<shader_compile_job> &jobs) const
+{
 	// Add specialization constant defines to source code
-	effect.preamble +=
+	const std::string preamble = effect.preamble +
 		"#define COLOR_PIXEL_SIZE 1.0 / " + std::to_string(_width) + ", 1.0 / " + std::to_string(_height) + "\n"
 		"#define DEPTH_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
 		"#define SV_DEPTH_PIXEL_SIZE DEPTH_PIXEL_SIZE\n"
 		"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n";
 
-	const std::string hlsl_vs = effect.preamble + effect.module.hlsl;
-	const std::string hlsl_ps = effect.preamble + "#define POSITION VPOS\n" + effect.module.hlsl;
-
-	std::unordered_map<std::string, com_ptr<IUnknown>> entry_points;
+	// Identify the compiler library by its path and modification time, so that byte code compiled by a different version of it is never used
+	reshadefx::effect_cache::key compiler_key;
+	if (WCHAR compiler_path[MAX_PATH]; _d3d_compiler != nullptr && GetModuleFileNameW(_d3d_compiler, compiler_path, MAX_PATH) != 0)
+	{
+		std::error_code ec;
+		compiler_key.add(std::filesystem::path(compiler_path).u8string());
+		compiler_key.add(static_cast<uint64_t>(std::filesystem::last_write_time(compiler_path, ec).time_since_epoch().count()));
+	}
 
-	// Compile the generated HLSL source code to DX byte code
 	for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
 	{
-		com_ptr<ID3DBlob> compiled, d3d_errors;
-		const std::string &hlsl = entry_point.is_pixel_shader ? hlsl_ps : hlsl_vs;
+		shader_compile_job &job = jobs.emplace_back();
+		job.entry_point = entry_point.name;
+		job.is_pixel_shader = entry_point.is_pixel_shader;
+		job.profile = entry_point.is_pixel_shader ? "ps_3_0" : "vs_3_0";
+
+		// Only compile the code this entry point actually uses if the code generator provided it
+		job.source = preamble + (entry_point.is_pixel_shader ? "#define POSITION VPOS\n" : "") + (entry_point.hlsl.empty() ? effect.module.hlsl : entry_point.hlsl);
+		job.cache_key = reshadefx::effect_cache::key(compiler_key).add(job.source).add(job.entry_point).add(job.profile).add(compile_flags).value();
+	}
+}
+bool reshade::d3d9::runtime_d3d9::compile_entry_point(shader_compile_job &job) const
+{
+	if (_d3d_compiler == nullptr)
+		return false;
 
-		HRESULT hr = D3DCompile(
-			hlsl.c_str(), hlsl.size(),
-			nullptr, nullptr, nullptr,
-			entry_point.name.c_str(),
-			entry_point.is_pixel_shader ? "ps_3_0" : "vs_3_0",
-			D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
-			&compiled, &d3d_errors);
+	const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3d_compiler, "D3DCompile"));
+	const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(_d3d_compiler, "D3DDisassemble"));
 
-		if (d3d_errors != nullptr) // Append warnings to the output error string as well
-			effect.errors.append(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
+	com_ptr<ID3DBlob> d3d_compiled, d3d_errors;
+	const HRESULT hr = D3DCompile(
+		job.source.c_str(), job.source.size(),
+		nullptr, nullptr, nullptr,
+		job.entry_point.c_str(),
+		job.profile.c_str(),
+		compile_flags, 0,
+		&d3d_compiled, &d3d_errors);
+
+	if (d3d_errors != nullptr)
+		job.errors.assign(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
+	if (FAILED(hr))
+		return false;
 
-		// No need to setup resources if any of the shaders failed to compile
-		if (FAILED(hr))
-			return false;
+	job.code.assign(static_cast<const char *>(d3d_compiled->GetBufferPointer()), d3d_compiled->GetBufferSize());
+
+	if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(job.code.data(), job.code.size(), 0, nullptr, &d3d_disassembled)))
+		job.assembly.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()));
+
+	return true;
+}
 
-		if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(compiled->GetBufferPointer(), compiled->GetBufferSize(), 0, nullptr, &d3d_disassembled)))
-			effect.assembly[entry_point.name] = std::string(static_cast<const char *>(d3d_disassembled->GetBufferPointer()));
+bool reshade::d3d9::runtime_d3d9::init_effect(size_t index)
+{
+	effect &effect = _effects[index];
 
-		// Create runtime shader objects from the compiled DX byte code
-		if (entry_point.is_pixel_shader)
-			hr = _device->CreatePixelShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), reinterpret_cast<IDirect3DPixelShader9 **>(&entry_points[entry_point.name]));
+	std::unordered_map<std::string, com_ptr<IUnknown>> entry_points;
+
+	// Create runtime shader objects from the DX byte code compiled on the worker threads
+	for (const shader_compile_job &job : effect.shaders->jobs)
+	{
+		HRESULT hr;
+		if (job.is_pixel_shader)
+			hr = _device->CreatePixelShader(reinterpret_cast<const DWORD *>(job.code.data()), reinterpret_cast<IDirect3DPixelShader9 **>(&entry_points[job.entry_point]));
 		else
-			hr = _device->CreateVertexShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), reinterpret_cast<IDirect3DVertexShader9 **>(&entry_points[entry_point.name]));
+			hr = _device->CreateVertexShader(reinterpret_cast<const DWORD *>(job.code.data()), reinterpret_cast<IDirect3DVertexShader9 **>(&entry_points[job.entry_point]));
 
 		if (FAILED(hr))
 		{
-			LOG(ERROR) << "Failed to create shader for entry point '" << entry_point.name << "'. "
+			LOG(ERROR) << "Failed to create shader for entry point '" << job.entry_point << "'. "
 				"HRESULT is " << hr << '.';
 			return false;
 		}
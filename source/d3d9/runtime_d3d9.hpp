@@ -24,6 +24,9 @@ namespace reshade::d3d9
 		bool capture_screenshot(uint8_t *buffer) const override;
 
 	private:
+		void init_compile_jobs(const effect &effect, std::vector<shader_compile_job> &jobs) const override;
+		bool compile_entry_point(shader_compile_job &job) const override;
+
 		bool init_effect(size_t index) override;
 		void unload_effect(size_t index) override;
 		void unload_effects() override;
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_cache.hpp"
+#include "effect_serialization.hpp"
+#include <chrono>
+#include <thread>
+#include <cstring> // std::memcpy
+#include <algorithm> // std::sort
+
+// Identifies cache entry files and the layout of the data in them, which has to be increased whenever the format written below changes
+static constexpr uint32_t s_entry_magic = 0x43584652; // "RFXC"
+static constexpr uint32_t s_entry_version = 1;
+static constexpr size_t s_entry_header_size = 4 + 4 + 8 + 8 + 8;
+
+reshadefx::effect_cache::key &reshadefx::effect_cache::key::add(const void *data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		_value = (_value ^ static_cast<const uint8_t *>(data)[i]) * 1099511628211ull;
+	return *this;
+}
+reshadefx::effect_cache::key &reshadefx::effect_cache::key::add(uint64_t value)
+{
+	// Hash the bytes in little-endian order, so that keys are the same on all platforms
+	for (int i = 0; i < 8; ++i, value >>= 8)
+		_value = (_value ^ (value & 0xFF)) * 1099511628211ull;
+	return *this;
+}
+
+reshadefx::effect_cache::effect_cache(const std::filesystem::path &directory, uint64_t max_size) :
+	_directory(directory), _max_size(max_size)
+{
+}
+
+bool reshadefx::effect_cache::load(uint64_t key, std::string &data)
+{
+	const std::filesystem::path path = entry_path(key);
+
+	std::error_code ec;
+	const uintmax_t file_size = std::filesystem::file_size(path, ec);
+	if (ec || file_size < s_entry_header_size)
+		return _misses++, false;
+
+#ifdef _WIN32
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
+		return _misses++, false;
+#else
+	FILE *const file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return _misses++, false;
+#endif
+
+	char header_data[s_entry_header_size];
+	data.resize(static_cast<size_t>(file_size - s_entry_header_size));
+	const bool read_success =
+		fread(header_data, 1, s_entry_header_size, file) == s_entry_header_size &&
+		fread(data.data(), 1, data.size(), file) == data.size();
+
+	fclose(file);
+
+	binary_reader header(std::string_view(header_data, s_entry_header_size));
+	const bool valid = read_success &&
+		header.read_uint32() == s_entry_magic &&
+		header.read_uint32() == s_entry_version &&
+		header.read_uint64() == key &&
+		header.read_uint64() == data.size() &&
+		header.read_uint64() == effect_cache::key().add(data.data(), data.size()).value();
+	if (!valid)
+	{
+		// Entries from an older version or that were damaged are never going to be valid, so make room for a new one
+		if (read_success)
+			std::filesystem::remove(path, ec);
+
+		data.clear();
+		return _misses++, false;
+	}
+
+	// The modification time is used to find the least recently used entries during eviction
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+	return _hits++, true;
+}
+
+bool reshadefx::effect_cache::store(uint64_t key, std::string_view data)
+{
+	std::string header_data;
+	header_data.reserve(s_entry_header_size);
+	binary_writer header(header_data);
+	header.write(s_entry_magic);
+	header.write(s_entry_version);
+	header.write(key);
+	header.write(static_cast<uint64_t>(data.size()));
+	header.write(effect_cache::key().add(data.data(), data.size()).value());
+
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+
+	const std::filesystem::path path = entry_path(key);
+	// Temporary file names have to be unique across all threads and processes writing to the cache directory
+	std::filesystem::path temp_path = path;
+	temp_path += '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^ std::chrono::steady_clock::now().time_since_epoch().count()) + '.' + std::to_string(_temp_index++) + ".tmp";
+
+#ifdef _WIN32
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, temp_path.c_str(), L"wb") != 0)
+		return false;
+#else
+	FILE *const file = fopen(temp_path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+#endif
+
+	const bool write_success =
+		fwrite(header_data.data(), 1, header_data.size(), file) == header_data.size() &&
+		fwrite(data.data(), 1, data.size(), file) == data.size();
+
+	if (fclose(file) != 0 || !write_success)
+	{
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	const uintmax_t previous_size = std::filesystem::file_size(path, ec);
+	const bool replaced = !ec;
+
+	// Renaming replaces any existing entry in one step, so readers either see the old or the new entry
+	std::filesystem::rename(temp_path, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	_total_size += header_data.size() + data.size() - (replaced ? previous_size : 0);
+
+	if (!_total_size_known || _total_size > _max_size)
+		evict();
+
+	return true;
+}
+
+std::filesystem::path reshadefx::effect_cache::entry_path(uint64_t key) const
+{
+	char name[16 + 7];
+	for (int i = 15; i >= 0; --i, key >>= 4)
+		name[i] = "0123456789abcdef"[key & 0xF];
+	std::memcpy(name + 16, ".cache", 7);
+
+	return _directory / name;
+}
+
+void reshadefx::effect_cache::evict()
+{
+	struct entry
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type last_write_time;
+		uintmax_t size;
+	};
+
+	std::vector<entry> entries;
+	uint64_t total_size = 0;
+
+	std::error_code ec;
+	const auto now = std::filesystem::file_time_type::clock::now();
+
+	for (const std::filesystem::directory_entry &it : std::filesystem::directory_iterator(_directory, ec))
+	{
+		const std::filesystem::path extension = it.path().extension();
+		const auto last_write_time = it.last_write_time(ec);
+		if (ec)
+			continue;
+
+		// Remove temporary files that were left behind by a process that exited while writing them
+		if (extension == ".tmp")
+		{
+			if (now - last_write_time > std::chrono::hours(1))
+				std::filesystem::remove(it.path(), ec);
+			continue;
+		}
+
+		if (extension != ".cache")
+			continue;
+
+		const uintmax_t size = it.file_size(ec);
+		if (ec)
+			continue;
+
+		entries.push_back({ it.path(), last_write_time, size });
+		total_size += size;
+	}
+
+	_total_size = total_size;
+	_total_size_known = true;
+
+	if (_total_size <= _max_size)
+		return;
+
+	std::sort(entries.begin(), entries.end(),
+		[](const entry &lhs, const entry &rhs) { return lhs.last_write_time < rhs.last_write_time; });
+
+	// Evict down to three quarters of the limit, so that the directory does not have to be scanned again on every new entry
+	for (const entry &entry : entries)
+	{
+		if (_total_size <= _max_size / 4 * 3)
+			break;
+
+		if (std::filesystem::remove(entry.path, ec))
+			_total_size -= entry.size;
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// A thread-safe cache of compiled effect data on disk, which persists between runs.
+	/// Entries are addressed by a hash of everything that went into producing them, so they never have to be invalidated, and the least recently used ones are evicted once the total size exceeds a limit.
+	/// </summary>
+	class effect_cache
+	{
+	public:
+		/// <summary>
+		/// A 64-bit FNV-1a hash that is built up from all inputs that identify a cache entry.
+		/// </summary>
+		class key
+		{
+		public:
+			key &add(const void *data, size_t size);
+			// Strings are prefixed with their length, so that different splits of the same characters result in different keys
+			key &add(std::string_view data) { return add(static_cast<uint64_t>(data.size())).add(data.data(), data.size()); }
+			key &add(uint64_t value);
+
+			uint64_t value() const { return _value; }
+
+		private:
+			uint64_t _value = 14695981039346656037ull;
+		};
+
+		/// <summary>
+		/// Construct a cache that stores its entries in the specified directory, which is created on demand.
+		/// </summary>
+		/// <param name="directory">The directory to store cache entries in.</param>
+		/// <param name="max_size">The maximum total size of all cache entries in bytes.</param>
+		effect_cache(const std::filesystem::path &directory, uint64_t max_size);
+
+		const std::filesystem::path &directory() const { return _directory; }
+		uint64_t max_size() const { return _max_size; }
+
+		/// <summary>
+		/// Get the data stored for the specified key and mark the entry as recently used.
+		/// </summary>
+		/// <param name="key">The key the data was stored with.</param>
+		/// <param name="data">Receives the stored data.</param>
+		/// <returns><c>true</c> if an intact entry was found, <c>false</c> otherwise.</returns>
+		bool load(uint64_t key, std::string &data);
+		/// <summary>
+		/// Store data for the specified key, replacing any previous entry for it.
+		/// The entry is written to a temporary file first and then renamed, so that other processes and threads never see a partially written entry.
+		/// </summary>
+		/// <param name="key">The key to store the data with.</param>
+		/// <param name="data">The data to store.</param>
+		/// <returns><c>true</c> if the entry was written, <c>false</c> otherwise.</returns>
+		bool store(uint64_t key, std::string_view data);
+
+		/// <summary>
+		/// Get the number of requests that were answered from disk since this cache was created.
+		/// </summary>
+		size_t hits() const { return _hits; }
+		/// <summary>
+		/// Get the number of requests for which no intact entry existed since this cache was created.
+		/// </summary>
+		size_t misses() const { return _misses; }
+
+	private:
+		std::filesystem::path entry_path(uint64_t key) const;
+		void evict();
+
+		std::mutex _mutex;
+		std::filesystem::path _directory;
+		uint64_t _max_size;
+		// Total size of all entries, which is only known after the directory was scanned for the first time
+		uint64_t _total_size = 0;
+		bool _total_size_known = false;
+		std::atomic<size_t> _hits = 0;
+		std::atomic<size_t> _misses = 0;
+		std::atomic<unsigned int> _temp_index = 0;
+	};
+}
@@ -8,6 +8,7 @@
 #include "effect_module.hpp"
 #include <memory> // std::unique_ptr
 #include <algorithm> // std::find_if
+#include <unordered_map>
 
 namespace reshadefx
 {
@@ -28,6 +29,12 @@ namespace reshadefx
 		/// <param name="module">The target module to fill.</param>
 		virtual void write_result(module &module) = 0;
 
+		/// <summary>
+		/// Set the table used to resolve the source file paths of locations passed to this back-end.
+		/// </summary>
+		/// <param name="source_files">The source file table, which has to stay alive as long as code is generated.</param>
+		void set_source_files(const source_file_table *source_files) { _source_files = source_files; }
+
 	public:
 		/// <summary>
 		/// An opaque ID referring to a SSA value or basic block.
@@ -267,8 +274,7 @@ namespace reshadefx
 		/// <returns>A reference to the struct description.</returns>
 		struct_info &find_struct(id id)
 		{
-			return *std::find_if(_structs.begin(), _structs.end(),
-				[id](const auto &it) { return it.definition == id; });
+			return _structs[_struct_lookup.at(id)];
 		}
 		/// <summary>
 		/// Look up an existing texture definition.
@@ -277,8 +283,7 @@ namespace reshadefx
 		/// <returns>A reference to the texture description.</returns>
 		texture_info &find_texture(id id)
 		{
-			return *std::find_if(_module.textures.begin(), _module.textures.end(),
-				[id](const auto &it) { return it.id == id; });
+			return _module.textures[_texture_lookup.at(id)];
 		}
 		/// <summary>
 		/// Look up an existing function definition.
@@ -287,8 +292,7 @@ namespace reshadefx
 		/// <returns>A reference to the function description.</returns>
 		function_info &find_function(id id)
 		{
-			return *std::find_if(_functions.begin(), _functions.end(),
-				[id](const auto &it) { return it->definition == id; })->get();
+			return *_functions[_function_lookup.at(id)];
 		}
 
 	protected:
@@ -305,8 +309,13 @@ namespace reshadefx
 		}
 
 		module _module;
+		const source_file_table *_source_files = nullptr;
 		std::vector<struct_info> _structs;
 		std::vector<std::unique_ptr<function_info>> _functions;
+		// Indices into the lists above by ID, which derived classes have to update whenever they add a definition
+		std::unordered_map<id, size_t> _struct_lookup;
+		std::unordered_map<id, size_t> _texture_lookup;
+		std::unordered_map<id, size_t> _function_lookup;
 		id _next_id = 1;
 		id _last_block = 0;
 		id _current_block = 0;
@@ -317,14 +326,16 @@ namespace reshadefx
 	/// </summary>
 	/// <param name="debug_info">Whether to append debug information like line directives to the generated code.</param>
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
-	codegen *create_codegen_glsl(bool debug_info, bool uniforms_to_spec_constants);
+	/// <param name="trim_entry_points">Whether to additionally write the code of each entry point on its own, containing only the definitions it references (see <see cref="entry_point::hlsl"/>).</param>
+	codegen *create_codegen_glsl(bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points = false);
 	/// <summary>
 	/// Create a back-end implementation for HLSL code generation.
 	/// </summary>
 	/// <param name="shader_model">The HLSL shader model version (e.g. 30, 41, 50, 60, ...)</param>
 	/// <param name="debug_info">Whether to append debug information like line directives to the generated code.</param>
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
-	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants);
+	/// <param name="trim_entry_points">Whether to additionally write the code of each entry point on its own, containing only the definitions it references (see <see cref="entry_point::hlsl"/>).</param>
+	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points = false);
 	/// <summary>
 	/// Create a back-end implementation for SPIR-V code generation.
 	/// </summary>
@@ -332,5 +343,13 @@ namespace reshadefx
 	/// <param name="debug_info">Whether to append debug information like line directives to the generated code.</param>
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="invert_y">Insert code to invert the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y = false);
+	/// <param name="optimize">Run the generated SPIR-V through <see cref="optimize_spirv"/> before returning it.</param>
+	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y = false, bool optimize = false);
+
+	/// <summary>
+	/// Optimize a SPIR-V module generated by the SPIR-V code generation back-end, by promoting local variables to SSA values, folding constants, removing redundant loads and common subexpressions and eliminating dead code and functions.
+	/// </summary>
+	/// <param name="spirv">The SPIR-V module to optimize in place.</param>
+	/// <returns><c>true</c> if the module was optimized, <c>false</c> if it contains instructions the optimizer does not support, in which case it is left unchanged.</returns>
+	bool optimize_spirv(std::vector<uint32_t> &spirv);
 }
@@ -5,6 +5,7 @@
 
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
+#include "effect_codegen_text.hpp"
 #include <cmath> // signbit, isinf, isnan
 #include <cstdio> // snprintf
 #include <cassert>
@@ -16,12 +17,12 @@ using namespace reshadefx;
 class codegen_glsl final : public codegen
 {
 public:
-	codegen_glsl(bool debug_info, bool uniforms_to_spec_constants)
-		: _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants)
+	codegen_glsl(bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points)
+		: _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants), _trim_entry_points(trim_entry_points)
 	{
-		// Create default block and reserve a memory block to avoid frequent reallocations
-		std::string &block = _blocks.emplace(0, std::string()).first->second;
-		block.reserve(8192);
+		// Create default block and reserve a memory block for the text of all blocks to avoid frequent reallocations
+		_text.reserve(8192);
+		_blocks.emplace(0, text_block(_text));
 	}
 
 private:
@@ -37,11 +38,24 @@ private:
 		expression,
 	};
 
-	std::string _ubo_block;
+	std::string _text;
+	text_block _ubo_block { _text };
 	std::unordered_map<id, std::string> _names;
-	std::unordered_map<id, std::string> _blocks;
+	// Number of ids using each name in '_names', so that clashes can be detected without searching through all of them
+	std::unordered_map<std::string, size_t> _name_counts;
+	std::unordered_map<id, text_block> _blocks;
 	bool _debug_info = false;
 	bool _uniforms_to_spec_constants = false;
+	bool _trim_entry_points = false;
+	// Top-level code is split into separate definitions when entry points are trimmed, otherwise it stays in the default block
+	text_definitions _definitions;
+	// Declarations of the uniforms in the uniform block, split around their name (only filled when entry points are trimmed)
+	struct uniform_declaration
+	{
+		id uniform_id;
+		text_block before_name, after_name;
+	};
+	std::vector<uniform_declaration> _uniform_declarations;
 	std::unordered_map<id, id> _remapped_sampler_variables;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
@@ -55,8 +69,31 @@ private:
 	{
 		module = std::move(_module);
 
+		const text_block &main_block = _blocks.at(0);
+
+		write_header(module.hlsl);
+
+		// Write remaining code into the string with a single allocation
+		module.hlsl.reserve(module.hlsl.size() + main_block.size());
+
+		_definitions.write(module.hlsl);
+		main_block.write(module.hlsl);
+
+		if (_trim_entry_points)
+		{
+			for (size_t i = 0; i < module.entry_points.size(); ++i)
+			{
+				const std::vector<bool> reachable = _definitions.reachable(i);
+
+				write_header(module.entry_points[i].hlsl, &reachable);
+				_definitions.write(module.entry_points[i].hlsl, reachable);
+			}
+		}
+	}
+	void write_header(std::string &s, const std::vector<bool> *reachable = nullptr) const
+	{
 		if (_uses_fmod)
-			module.hlsl += "float fmodHLSL(float x, float y) { return x - y * trunc(x / y); }\n"
+			s += "float fmodHLSL(float x, float y) { return x - y * trunc(x / y); }\n"
 				"vec2 fmodHLSL(vec2 x, vec2 y) { return x - y * trunc(x / y); }\n"
 				"vec3 fmodHLSL(vec3 x, vec3 y) { return x - y * trunc(x / y); }\n"
 				"vec4 fmodHLSL(vec4 x, vec4 y) { return x - y * trunc(x / y); }\n"
@@ -64,30 +101,54 @@ private:
 				"mat3 fmodHLSL(mat3 x, mat3 y) { return x - matrixCompMult(y, mat3(trunc(x[0] / y[0]), trunc(x[1] / y[1]), trunc(x[2] / y[2]))); }\n"
 				"mat4 fmodHLSL(mat4 x, mat4 y) { return x - matrixCompMult(y, mat4(trunc(x[0] / y[0]), trunc(x[1] / y[1]), trunc(x[2] / y[2]), trunc(x[3] / y[3]))); }\n";
 		if (_uses_componentwise_or)
-			module.hlsl +=
+			s +=
 				"bvec2 compOr(bvec2 a, bvec2 b) { return bvec2(a.x || b.x, a.y || b.y); }\n"
 				"bvec3 compOr(bvec3 a, bvec3 b) { return bvec3(a.x || b.x, a.y || b.y, a.z || b.z); }\n"
 				"bvec4 compOr(bvec4 a, bvec4 b) { return bvec4(a.x || b.x, a.y || b.y, a.z || b.z, a.w || b.w); }\n";
 		if (_uses_componentwise_and)
-			module.hlsl +=
+			s +=
 				"bvec2 compAnd(bvec2 a, bvec2 b) { return bvec2(a.x && b.x, a.y && b.y); }\n"
 				"bvec3 compAnd(bvec3 a, bvec3 b) { return bvec3(a.x && b.x, a.y && b.y, a.z && b.z); }\n"
 				"bvec4 compAnd(bvec4 a, bvec4 b) { return bvec4(a.x && b.x, a.y && b.y, a.z && b.z, a.w && b.w); }\n";
 		if (_uses_componentwise_cond)
-			module.hlsl +=
+			s +=
 				"vec2 compCond(bvec2 cond, vec2 a, vec2 b) { return vec2(cond.x ? a.x : b.x, cond.y ? a.y : b.y); }\n"
 				"vec3 compCond(bvec3 cond, vec3 a, vec3 b) { return vec3(cond.x ? a.x : b.x, cond.y ? a.y : b.y, cond.z ? a.z : b.z); }\n"
 				"vec4 compCond(bvec4 cond, vec4 a, vec4 b) { return vec4(cond.x ? a.x : b.x, cond.y ? a.y : b.y, cond.z ? a.z : b.z, cond.w ? a.w : b.w); }\n";
 
 		if (!_ubo_block.empty())
+		{
+			s.reserve(s.size() + 64 + _ubo_block.size());
+
 			// Read matrices in column major layout, even though they are actually row major, to avoid transposing them on every access (since GLSL uses column matrices)
 			// TODO: This technically only works with square matrices
-			module.hlsl += "layout(std140, column_major, binding = 0) uniform _Globals {\n" + _ubo_block + "};\n";
-		module.hlsl += _blocks.at(0);
+			s += "layout(std140, column_major, binding = 0) uniform _Globals {\n";
+			write_uniforms(s, reachable);
+			s += "};\n";
+		}
+	}
+	void write_uniforms(std::string &s, const std::vector<bool> *reachable) const
+	{
+		if (reachable == nullptr)
+		{
+			_ubo_block.write(s);
+			return;
+		}
+
+		// The uniform block layout must not change between shaders, so keep a placeholder for each uniform an entry point does not use
+		for (const uniform_declaration &decl : _uniform_declarations)
+		{
+			decl.before_name.write(s);
+			if (_definitions.is_reachable(*reachable, decl.uniform_id))
+				s += ' ' + _names.at(decl.uniform_id);
+			else
+				s += " _unused" + std::to_string(decl.uniform_id);
+			decl.after_name.write(s);
+		}
 	}
 
-	template <bool is_param = false, bool is_decl = true, bool is_interface = false>
-	void write_type(std::string &s, const type &type) const
+	template <bool is_param = false, bool is_decl = true, bool is_interface = false, typename T>
+	void write_type(T &s, const type &type) const
 	{
 		if constexpr (is_decl)
 		{
@@ -164,7 +225,8 @@ private:
 			assert(false);
 		}
 	}
-	void write_constant(std::string &s, const type &type, const constant &data) const
+	template <typename T>
+	void write_constant(T &s, const type &type, const constant &data) const
 	{
 		if (type.is_array())
 		{
@@ -218,6 +280,8 @@ private:
 				std::snprintf(temp, sizeof(temp), "%1.8e", data.as_float[i]);
 				s += temp;
 				break;
+			default:
+				assert(false);
 			}
 
 			if (i < components - 1)
@@ -227,22 +291,24 @@ private:
 		if (!type.is_scalar())
 			s += ')';
 	}
-	void write_location(std::string &s, const location &loc) const
+	void write_location(text_block &s, const location &loc) const
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source_id == 0 || !_debug_info)
 			return;
 
 		s += "#line " + std::to_string(loc.line) + '\n';
 	}
 
-	std::string id_to_name(id id) const
+	text_name id_to_name(id id) const
 	{
 		if (const auto it = _remapped_sampler_variables.find(id); it != _remapped_sampler_variables.end())
 			id = it->second;
 		assert(id != 0);
+		if (_trim_entry_points)
+			_definitions.reference(id);
 		if (const auto it = _names.find(id); it != _names.end())
-			return it->second;
-		return '_' + std::to_string(id);
+			return text_name(it->second);
+		return text_name(id);
 	}
 
 	template <naming naming_type = naming::general>
@@ -255,9 +321,20 @@ private:
 		if constexpr (naming_type != naming::reserved)
 			name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (const auto it = _name_counts.find(name); it != _name_counts.end() && it->second != 0)
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &existing_name = _names[id];
+		if (!existing_name.empty())
+			_name_counts[existing_name]--;
+		_name_counts[name]++;
+		existing_name = std::move(name);
+	}
+
+	void finish_definition(id id)
+	{
+		if (_trim_entry_points)
+			_definitions.finish(_blocks.at(0), id);
 	}
 
 	static std::string escape_name(std::string name)
@@ -285,25 +362,15 @@ private:
 		return name;
 	}
 
-	static void increase_indentation_level(std::string &block)
-	{
-		if (block.empty())
-			return;
-
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
-
-		block.insert(block.begin(), '\t');
-	}
-
 	id   define_struct(const location &loc, struct_info &info) override
 	{
 		info.definition = make_id();
 		define_name<naming::unique>(info.definition, info.unique_name);
 
+		_struct_lookup.emplace(info.definition, _structs.size());
 		_structs.push_back(info);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -325,12 +392,15 @@ private:
 
 		code += "};\n";
 
+		finish_definition(info.definition);
+
 		return info.definition;
 	}
 	id   define_texture(const location &, texture_info &info) override
 	{
 		info.id = make_id();
 
+		_texture_lookup.emplace(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
 		return info.id;
@@ -344,12 +414,14 @@ private:
 
 		_module.samplers.push_back(info);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
 		code += "layout(binding = " + std::to_string(info.binding) + ") uniform sampler2D " + id_to_name(info.id) + ";\n";
 
+		finish_definition(info.id);
+
 		return info.id;
 	}
 	id   define_uniform(const location &loc, uniform_info &info) override
@@ -364,7 +436,7 @@ private:
 			if (info.type.is_array())
 				info.size *= info.type.array_length;
 
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			write_location(code, loc);
 
@@ -376,6 +448,8 @@ private:
 			code += "(SPEC_CONSTANT_" + info.name + ");\n";
 
 			_module.spec_constants.push_back(info);
+
+			finish_definition(res);
 		}
 		else
 		{
@@ -401,17 +475,28 @@ private:
 			info.offset = align_up(info.offset, alignment);
 			_module.total_uniform_size = info.offset + info.size;
 
-			write_location(_ubo_block, loc);
+			text_block before_name { _text }, after_name { _text };
+
+			write_location(before_name, loc);
 
-			_ubo_block += '\t';
+			before_name += '\t';
 			// Note: All matrices are floating-point, even if the uniform type says different!!
-			write_type(_ubo_block, info.type);
-			_ubo_block += ' ' + id_to_name(res);
+			write_type(before_name, info.type);
 
 			if (info.type.is_array())
-				_ubo_block += '[' + std::to_string(info.type.array_length) + ']';
+				after_name += '[' + std::to_string(info.type.array_length) + ']';
+
+			after_name += ";\n";
+
+			_ubo_block += before_name;
+			_ubo_block += ' ' + id_to_name(res);
+			_ubo_block += after_name;
 
-			_ubo_block += ";\n";
+			if (_trim_entry_points)
+			{
+				_definitions.add_external(_text, res);
+				_uniform_declarations.push_back({ res, std::move(before_name), std::move(after_name) });
+			}
 
 			_module.uniforms.push_back(info);
 		}
@@ -429,7 +514,7 @@ private:
 		if (!name.empty())
 			define_name<naming::general>(res, name);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -447,6 +532,9 @@ private:
 
 		code += ";\n";
 
+		if (global)
+			finish_definition(res);
+
 		return res;
 	}
 	id   define_function(const location &loc, function_info &info) override
@@ -465,7 +553,7 @@ private:
 		else
 			define_name<naming::reserved>(info.definition, "main");
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -496,6 +584,7 @@ private:
 
 		code += ")\n";
 
+		_function_lookup.emplace(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -507,7 +596,9 @@ private:
 			[&func](const auto &ep) { return ep.name == func.unique_name; }); it != _module.entry_points.end())
 			return;
 
-		_module.entry_points.push_back({ func.unique_name, is_ps });
+		_module.entry_points.push_back({ func.unique_name, is_ps, {} });
+
+		const size_t first_definition = _definitions.size();
 
 		_blocks.at(0) += "#ifdef ENTRY_POINT_" + func.unique_name + '\n';
 		if (is_ps)
@@ -533,7 +624,7 @@ private:
 			if (type.base == type::t_bool)
 				type.base  = type::t_float;
 
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			for (int i = 0, array_length = std::max(1, type.array_length); i < array_length; ++i)
 			{
@@ -588,7 +679,7 @@ private:
 		define_function({}, entry_point, true);
 		enter_block(create_block());
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		// Handle input parameters
 		for (size_t i = 0; i < num_params; ++i)
@@ -614,20 +705,19 @@ private:
 
 					const struct_info &definition = find_struct(param_type.definition);
 
-					for (const struct_member_info &member : definition.member_list)
+					for (size_t m = 0, num_members = definition.member_list.size(); m < num_members; ++m)
 					{
+						const struct_member_info &member = definition.member_list[m];
+
 						if (param_type.is_array())
 							code += semantic_to_builtin(param_name + '_' + member.name + '_' + std::to_string(a), member.semantic);
 						else
 							code += semantic_to_builtin(param_name + '_' + member.name, member.semantic);
 
-						code += ", ";
+						if (m < num_members - 1)
+							code += ", ";
 					}
 
-					// There can be no empty structs, so can assume that the last two characters are always ", "
-					code.pop_back();
-					code.pop_back();
-
 					code += ");\n";
 				}
 			}
@@ -735,6 +825,13 @@ private:
 		leave_function();
 
 		_blocks.at(0) += "#endif\n";
+
+		if (_trim_entry_points)
+		{
+			// The "main" function was already split off in 'leave_function', so this only contains the end of the preprocessor block around it
+			finish_definition(0);
+			_definitions.add_entry_point(first_definition);
+		}
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -811,7 +908,7 @@ private:
 		if (force_new_id)
 		{
 			// Need to store value in a new variable to comply with request for a new ID
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			code += '\t';
 			write_type(code, exp.type);
@@ -835,7 +932,7 @@ private:
 			return;
 		}
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, exp.location);
 
@@ -879,6 +976,8 @@ private:
 						code += "xyzw"[op.swizzle[i]];
 				}
 				break;
+			default:
+				assert(false);
 			}
 		}
 
@@ -898,7 +997,7 @@ private:
 
 		if (type.is_array() || type.is_struct())
 		{
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			code += '\t';
 
@@ -934,7 +1033,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -968,7 +1067,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1099,7 +1198,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1129,7 +1228,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1169,7 +1268,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1208,7 +1307,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1245,13 +1344,13 @@ private:
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_statement_block != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
+		text_block &true_statement_data = _blocks.at(true_statement_block);
+		text_block &false_statement_data = _blocks.at(false_statement_block);
 
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
+		true_statement_data.increase_indentation_level();
+		false_statement_data.increase_indentation_level();
 
 		code += _blocks.at(condition_block);
 
@@ -1277,13 +1376,13 @@ private:
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_value != 0 && true_statement_block != 0 && false_value != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
+		text_block &true_statement_data = _blocks.at(true_statement_block);
+		text_block &false_statement_data = _blocks.at(false_statement_block);
 
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
+		true_statement_data.increase_indentation_level();
+		false_statement_data.increase_indentation_level();
 
 		const id res = make_id();
 
@@ -1296,10 +1395,12 @@ private:
 		write_location(code, loc);
 
 		code += "\tif (" + id_to_name(condition_value) + ")\n\t{\n";
-		code += (true_statement_block != condition_block ? true_statement_data : std::string());
+		if (true_statement_block != condition_block)
+			code += true_statement_data;
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(true_value) + ";\n";
 		code += "\t}\n\telse\n\t{\n";
-		code += (false_statement_block != condition_block ? false_statement_data : std::string());
+		if (false_statement_block != condition_block)
+			code += false_statement_data;
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(false_value) + ";\n";
 		code += "\t}\n";
 
@@ -1314,17 +1415,17 @@ private:
 	{
 		assert(prev_block != 0 && header_block != 0 && loop_block != 0 && continue_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &loop_data = _blocks.at(loop_block);
-		std::string &continue_data = _blocks.at(continue_block);
+		text_block &loop_data = _blocks.at(loop_block);
+		text_block &continue_data = _blocks.at(continue_block);
 
 		// Condition value can be missing in infinite loop constructs like "for (;;)"
-		const std::string condition_name = condition_value != 0 ? id_to_name(condition_value) : "true";
+		const std::string condition_name = condition_value != 0 ? std::string(id_to_name(condition_value)) : "true";
 
-		increase_indentation_level(loop_data);
-		increase_indentation_level(loop_data);
-		increase_indentation_level(continue_data);
+		loop_data.increase_indentation_level();
+		loop_data.increase_indentation_level();
+		continue_data.increase_indentation_level();
 
 		code += _blocks.at(prev_block);
 
@@ -1340,14 +1441,10 @@ private:
 		if (condition_block == 0)
 		{
 			// Convert variable initializer to assignment statement
-			auto pos_assign = continue_data.rfind(condition_name);
-			auto pos_prev_assign = continue_data.rfind('\t', pos_assign);
-			continue_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
+			continue_data.erase_before_last(condition_name, '\t');
 
 			// We need to add the continue block to all "continue" statements as well
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data);
+			loop_data.replace_placeholders(continue_block, continue_data);
 
 			code += "do\n\t{\n\t\t{\n";
 			code += loop_data; // Encapsulate loop body into another scope, so not to confuse any local variables with the current iteration variable accessed in the continue block below
@@ -1357,18 +1454,16 @@ private:
 		}
 		else
 		{
-			std::string &condition_data = _blocks.at(condition_block);
+			text_block &condition_data = _blocks.at(condition_block);
 
-			increase_indentation_level(condition_data);
+			condition_data.increase_indentation_level();
 
 			// Convert variable initializer to assignment statement
-			auto pos_assign = condition_data.rfind(condition_name);
-			auto pos_prev_assign = condition_data.rfind('\t', pos_assign);
-			condition_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
+			condition_data.erase_before_last(condition_name, '\t');
 
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data + condition_data);
+			text_block continue_and_condition_data = continue_data;
+			continue_and_condition_data += condition_data;
+			loop_data.replace_placeholders(continue_block, continue_and_condition_data);
 
 			code += "while (" + condition_name + ")\n\t{\n\t\t{\n";
 			code += loop_data;
@@ -1390,7 +1485,7 @@ private:
 	{
 		assert(selector_value != 0 && selector_block != 0 && default_label != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += _blocks.at(selector_block);
 
@@ -1402,9 +1497,9 @@ private:
 		{
 			assert(case_literal_and_labels[i + 1] != 0);
 
-			std::string &case_data = _blocks.at(case_literal_and_labels[i + 1]);
+			text_block &case_data = _blocks.at(case_literal_and_labels[i + 1]);
 
-			increase_indentation_level(case_data);
+			case_data.increase_indentation_level();
 
 			code += "\tcase " + std::to_string(case_literal_and_labels[i]) + ": {\n";
 			code += case_data;
@@ -1413,9 +1508,9 @@ private:
 
 		if (default_label != _current_block)
 		{
-			std::string &default_data = _blocks.at(default_label);
+			text_block &default_data = _blocks.at(default_label);
 
-			increase_indentation_level(default_data);
+			default_data.increase_indentation_level();
 
 			code += "\tdefault: {\n";
 			code += default_data;
@@ -1436,9 +1531,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &block = _blocks.emplace(res, std::string()).first->second;
-		// Reserve a decently big enough memory block to avoid frequent reallocations
-		block.reserve(4096);
+		_blocks.emplace(res, text_block(_text));
 
 		return res;
 	}
@@ -1458,7 +1551,7 @@ private:
 		if (!is_in_block())
 			return 0;
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += "\tdiscard;\n";
 
@@ -1482,7 +1575,7 @@ private:
 		if (!_functions.back()->return_type.is_void() && value == 0)
 			return set_block(0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += "\treturn";
 
@@ -1505,7 +1598,7 @@ private:
 		if (!is_in_block())
 			return _last_block;
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		switch (loop_flow)
 		{
@@ -1513,7 +1606,8 @@ private:
 			code += "\tbreak;\n";
 			break;
 		case 2: // Keep track of continue target block, so we can insert its code here later
-			code += "__CONTINUE__" + std::to_string(target) + "\tcontinue;\n";
+			code.add_placeholder(target);
+			code += "\tcontinue;\n";
 			break;
 		}
 
@@ -1530,11 +1624,17 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		text_block &code = _blocks.at(0);
+
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		finish_definition(_functions.back()->definition);
 	}
 };
 
-codegen *reshadefx::create_codegen_glsl(bool debug_info, bool uniforms_to_spec_constants)
+codegen *reshadefx::create_codegen_glsl(bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points)
 {
-	return new codegen_glsl(debug_info, uniforms_to_spec_constants);
+	return new codegen_glsl(debug_info, uniforms_to_spec_constants, trim_entry_points);
 }
@@ -5,6 +5,7 @@
 
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
+#include "effect_codegen_text.hpp"
 #include <cmath> // signbit, isinf, isnan
 #include <cstdio> // snprintf
 #include <cassert>
@@ -16,12 +17,12 @@ using namespace reshadefx;
 class codegen_hlsl final : public codegen
 {
 public:
-	codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
-		: _shader_model(shader_model), _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants)
+	codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points)
+		: _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants), _trim_entry_points(trim_entry_points), _shader_model(shader_model)
 	{
-		// Create default block and reserve a memory block to avoid frequent reallocations
-		std::string &block = _blocks.emplace(0, std::string()).first->second;
-		block.reserve(8192);
+		// Create default block and reserve a memory block for the text of all blocks to avoid frequent reallocations
+		_text.reserve(8192);
+		_blocks.emplace(0, text_block(_text));
 	}
 
 private:
@@ -35,41 +36,106 @@ private:
 		expression,
 	};
 
-	std::string _cbuffer_block;
-	std::string _current_location;
+	std::string _text;
+	text_block _cbuffer_block { _text };
+	uint32_t _current_location = 0;
 	std::unordered_map<id, std::string> _names;
-	std::unordered_map<id, std::string> _blocks;
+	// Number of ids using each name in '_names', so that clashes can be detected without searching through all of them
+	std::unordered_map<std::string, size_t> _name_counts;
+	std::unordered_map<id, text_block> _blocks;
 	bool _debug_info = false;
 	bool _uniforms_to_spec_constants = false;
+	bool _trim_entry_points = false;
 	unsigned int _shader_model = 0;
+	// Top-level code is split into separate definitions when entry points are trimmed, otherwise it stays in the default block
+	text_definitions _definitions;
+	// Declarations of the uniforms in the constant buffer, split around their name (only filled when entry points are trimmed)
+	struct uniform_declaration
+	{
+		id uniform_id;
+		text_block before_name, after_name;
+	};
+	std::vector<uniform_declaration> _uniform_declarations;
+	// Definitions of the sampler state objects, indexed by their binding (only used in shader model 4 and up)
+	std::vector<id> _sampler_state_ids;
 
 	void write_result(module &module) override
 	{
 		module = std::move(_module);
 
+		const text_block &main_block = _blocks.at(0);
+
+		// Write all code into a single string that is allocated once (with some room for the declarations added below)
+		module.hlsl.reserve(module.hlsl.size() + 128 + _cbuffer_block.size() + main_block.size());
+
+		write_header(module.hlsl);
+		_definitions.write(module.hlsl);
+		main_block.write(module.hlsl);
+
+		if (_trim_entry_points)
+		{
+			for (size_t i = 0; i < module.entry_points.size(); ++i)
+			{
+				const std::vector<bool> reachable = _definitions.reachable(i);
+
+				write_header(module.entry_points[i].hlsl, &reachable);
+				_definitions.write(module.entry_points[i].hlsl, reachable);
+			}
+		}
+
+		// Offsets were multiplied in 'define_uniform', so adjust total size here accordingly
+		if (_shader_model < 40)
+			module.total_uniform_size *= 4;
+	}
+	void write_header(std::string &s, const std::vector<bool> *reachable = nullptr) const
+	{
 		if (_shader_model >= 40)
 		{
-			module.hlsl += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
+			s += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
 
 			if (!_cbuffer_block.empty())
-				module.hlsl += "cbuffer _Globals {\n" + _cbuffer_block + "};\n";
+			{
+				s += "cbuffer _Globals {\n";
+				write_uniforms(s, reachable);
+				s += "};\n";
+			}
 		}
 		else
 		{
-			module.hlsl += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
+			s += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
 
-			if (!_cbuffer_block.empty())
-				module.hlsl += _cbuffer_block;
-
-			// Offsets were multiplied in 'define_uniform', so adjust total size here accordingly
-			module.total_uniform_size *= 4;
+			write_uniforms(s, reachable);
+		}
+	}
+	void write_uniforms(std::string &s, const std::vector<bool> *reachable) const
+	{
+		if (reachable == nullptr)
+		{
+			_cbuffer_block.write(s);
+			return;
 		}
 
-		module.hlsl += _blocks.at(0);
+		for (const uniform_declaration &decl : _uniform_declarations)
+		{
+			if (_definitions.is_reachable(*reachable, decl.uniform_id))
+			{
+				decl.before_name.write(s);
+				s += ' ';
+				s += _names.at(decl.uniform_id);
+				decl.after_name.write(s);
+			}
+			// Uniforms have explicit registers in shader model 3, but the constant buffer layout must not change between shaders, so keep a placeholder for each unused one
+			else if (_shader_model >= 40)
+			{
+				decl.before_name.write(s);
+				s += " _unused" + std::to_string(decl.uniform_id);
+				decl.after_name.write(s);
+			}
+		}
 	}
 
-	template <bool is_param = false, bool is_decl = true>
-	void write_type(std::string &s, const type &type) const
+	template <bool is_param = false, bool is_decl = true, typename T>
+	void write_type(T &s, const type &type) const
 	{
 		if constexpr (is_decl)
 		{
@@ -129,7 +195,8 @@ private:
 		if (type.cols > 1)
 			s += 'x' + std::to_string(type.cols);
 	}
-	void write_constant(std::string &s, const type &type, const constant &data) const
+	template <typename T>
+	void write_constant(T &s, const type &type, const constant &data) const
 	{
 		if (type.is_array())
 		{
@@ -190,6 +257,8 @@ private:
 				std::snprintf(temp, sizeof(temp), "%1.8e", data.as_float[i]);
 				s += temp;
 				break;
+			default:
+				assert(false);
 			}
 
 			if (i < components - 1)
@@ -200,9 +269,9 @@ private:
 			s += ')';
 	}
 	template <bool force_source = false>
-	void write_location(std::string &s, const location &loc)
+	void write_location(text_block &s, const location &loc)
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source_id == 0 || !_debug_info)
 			return;
 
 		s += "#line " + std::to_string(loc.line);
@@ -210,23 +279,25 @@ private:
 		// Avoid writing the file name every time to reduce output text size
 		if constexpr (force_source)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + _source_files->path(loc.source_id) + '\"';
 		}
-		else if (loc.source != _current_location)
+		else if (loc.source_id != _current_location)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + _source_files->path(loc.source_id) + '\"';
 
-			_current_location = loc.source;
+			_current_location = loc.source_id;
 		}
 
 		s += '\n';
 	}
 
-	std::string id_to_name(id id) const
+	text_name id_to_name(id id) const
 	{
+		if (_trim_entry_points)
+			_definitions.reference(id);
 		if (const auto it = _names.find(id); it != _names.end())
-			return it->second;
-		return '_' + std::to_string(id);
+			return text_name(it->second);
+		return text_name(id);
 	}
 
 	template <naming naming_type = naming::general>
@@ -238,9 +309,14 @@ private:
 				return; // Filter out names that may clash with automatic ones
 		name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (const auto it = _name_counts.find(name); it != _name_counts.end() && it->second != 0)
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &existing_name = _names[id];
+		if (!existing_name.empty())
+			_name_counts[existing_name]--;
+		_name_counts[name]++;
+		existing_name = std::move(name);
 	}
 
 	std::string convert_semantic(const std::string &semantic) const
@@ -269,6 +345,17 @@ private:
 		return semantic;
 	}
 
+	void finish_definition(id id)
+	{
+		if (!_trim_entry_points)
+			return;
+
+		_definitions.finish(_blocks.at(0), id);
+
+		// The code of a definition may end up without the definitions preceding it, so the next line directive has to name its source file again
+		_current_location = 0;
+	}
+
 	static std::string escape_name(std::string name)
 	{
 		static const auto stringicmp = [](const std::string &a, const std::string &b) {
@@ -287,25 +374,15 @@ private:
 		return name;
 	}
 
-	static void increase_indentation_level(std::string &block)
-	{
-		if (block.empty())
-			return;
-
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
-
-		block.insert(block.begin(), '\t');
-	}
-
 	id   define_struct(const location &loc, struct_info &info) override
 	{
 		info.definition = make_id();
 		define_name<naming::unique>(info.definition, info.unique_name);
 
+		_struct_lookup.emplace(info.definition, _structs.size());
 		_structs.push_back(info);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -325,6 +402,8 @@ private:
 
 		code += "};\n";
 
+		finish_definition(info.definition);
+
 		return info.definition;
 	}
 	id   define_texture(const location &loc, texture_info &info) override
@@ -332,9 +411,10 @@ private:
 		info.id = make_id();
 		info.binding = _module.num_texture_bindings;
 
+		_texture_lookup.emplace(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		if (_shader_model >= 40)
 		{
@@ -346,6 +426,8 @@ private:
 			_module.num_texture_bindings += 2;
 		}
 
+		finish_definition(info.id);
+
 		return info.id;
 	}
 	id   define_sampler(const location &loc, sampler_info &info) override
@@ -358,7 +440,7 @@ private:
 			[&info](const auto &it) { return it.unique_name == info.texture_name; });
 		assert(texture != _module.textures.end());
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		if (_shader_model >= 40)
 		{
@@ -375,8 +457,15 @@ private:
 				info.binding = _module.num_sampler_bindings++;
 
 				code += "SamplerState __s" + std::to_string(info.binding) + " : register(s" + std::to_string(info.binding) + ");\n";
+
+				// The sampler state object is a separate definition, so that samplers sharing it do not pull in the sampler that declared it first
+				_sampler_state_ids.push_back(make_id());
+				finish_definition(_sampler_state_ids.back());
 			}
 
+			if (_trim_entry_points)
+				_definitions.reference(_sampler_state_ids[info.binding]);
+
 			assert(info.srgb == 0 || info.srgb == 1);
 			info.texture_binding = texture->binding + info.srgb; // Offset binding by one to choose the SRGB variant
 
@@ -402,8 +491,13 @@ private:
 			code += ") }; \n";
 		}
 
+		if (_trim_entry_points)
+			_definitions.reference(texture->id);
+
 		_module.samplers.push_back(info);
 
+		finish_definition(info.id);
+
 		return info.id;
 	}
 	id   define_uniform(const location &loc, uniform_info &info) override
@@ -418,7 +512,7 @@ private:
 			if (info.type.is_array())
 				info.size *= info.type.array_length;
 
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			write_location(code, loc);
 
@@ -430,6 +524,8 @@ private:
 			code += "(SPEC_CONSTANT_" + info.name + ");\n";
 
 			_module.spec_constants.push_back(info);
+
+			finish_definition(res);
 		}
 		else
 		{
@@ -450,12 +546,14 @@ private:
 				info.offset += remaining;
 			_module.total_uniform_size = info.offset + info.size;
 
-			write_location<true>(_cbuffer_block, loc);
+			text_block before_name { _text }, after_name { _text };
+
+			write_location<true>(before_name, loc);
 
 			if (_shader_model >= 40)
-				_cbuffer_block += '\t';
+				before_name += '\t';
 			if (info.type.is_matrix()) // Force row major matrices
-				_cbuffer_block += "row_major ";
+				before_name += "row_major ";
 
 			type type = info.type;
 			if (_shader_model < 40)
@@ -468,20 +566,29 @@ private:
 				info.offset *= 4;
 			}
 
-			write_type(_cbuffer_block, type);
-			_cbuffer_block += ' ' + id_to_name(res);
+			write_type(before_name, type);
 
 			if (info.type.is_array())
-				_cbuffer_block += '[' + std::to_string(info.type.array_length) + ']';
+				after_name += '[' + std::to_string(info.type.array_length) + ']';
 
 			if (_shader_model < 40)
 			{
 				// Every constant register is 16 bytes wide, so divide memory offset by 16 to get the constant register index
 				// Note: All uniforms are floating-point in shader model 3, even if the uniform type says different!!
-				_cbuffer_block += " : register(c" + std::to_string(info.offset / 16) + ')';
+				after_name += " : register(c" + std::to_string(info.offset / 16) + ')';
 			}
 
-			_cbuffer_block += ";\n";
+			after_name += ";\n";
+
+			_cbuffer_block += before_name;
+			_cbuffer_block += ' ' + id_to_name(res);
+			_cbuffer_block += after_name;
+
+			if (_trim_entry_points)
+			{
+				_definitions.add_external(_text, res);
+				_uniform_declarations.push_back({ res, std::move(before_name), std::move(after_name) });
+			}
 
 			_module.uniforms.push_back(info);
 		}
@@ -495,7 +602,7 @@ private:
 		if (!name.empty())
 			define_name<naming::general>(res, name);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -513,6 +620,9 @@ private:
 
 		code += ";\n";
 
+		if (global)
+			finish_definition(res);
+
 		return res;
 	}
 	id   define_function(const location &loc, function_info &info) override
@@ -528,7 +638,7 @@ private:
 		info.definition = make_id();
 		define_name<naming::unique>(info.definition, std::move(name));
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -565,6 +675,7 @@ private:
 
 		code += '\n';
 
+		_function_lookup.emplace(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -576,11 +687,17 @@ private:
 			[&func](const auto &ep) { return ep.name == func.unique_name; }); it != _module.entry_points.end())
 			return;
 
-		_module.entry_points.push_back({ func.unique_name, is_ps });
+		_module.entry_points.push_back({ func.unique_name, is_ps, {} });
 
 		// Only have to rewrite the entry point function signature in shader model 3
 		if (_shader_model >= 40)
+		{
+			if (_trim_entry_points)
+				_definitions.add_entry_point_function(func.definition);
 			return;
+		}
+
+		const size_t first_definition = _definitions.size();
 
 		auto entry_point = func;
 
@@ -618,16 +735,18 @@ private:
 			if (is_color_semantic(param.semantic))
 				param.type.rows = 4;
 			else if (is_position_semantic(param.semantic))
+			{
 				if (is_ps) // Change the position input semantic in pixel shaders
 					param.semantic = "VPOS";
 				else // Keep track of the position output variable
 					position_variable_name = param.name;
+			}
 		}
 
 		define_function({}, entry_point, true);
 		enter_block(create_block());
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		// Clear all color output parameters so no component is left uninitialized
 		for (auto &param : entry_point.parameter_list)
@@ -676,6 +795,9 @@ private:
 
 		leave_block_and_return(func.return_type.is_void() ? 0 : ret);
 		leave_function();
+
+		if (_trim_entry_points)
+			_definitions.add_entry_point(first_definition);
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -734,7 +856,7 @@ private:
 		if (force_new_id)
 		{
 			// Need to store value in a new variable to comply with request for a new ID
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			code += '\t';
 			write_type(code, exp.type);
@@ -750,7 +872,7 @@ private:
 	}
 	void emit_store(const expression &exp, id value) override
 	{
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, exp.location);
 
@@ -785,6 +907,8 @@ private:
 					else
 						code += "xyzw"[op.swizzle[i]];
 				break;
+			default:
+				assert(false);
 			}
 		}
 
@@ -797,7 +921,7 @@ private:
 
 		if (type.is_array())
 		{
-			std::string &code = _blocks.at(_current_block);
+			text_block &code = _blocks.at(_current_block);
 
 			// Array constants need to be stored in a constant variable as they cannot be used in-place
 			code += "\tconst ";
@@ -821,7 +945,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -842,7 +966,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -954,7 +1078,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -978,7 +1102,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1018,7 +1142,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1063,7 +1187,7 @@ private:
 
 		const id res = make_id();
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1103,13 +1227,13 @@ private:
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_statement_block != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
+		text_block &true_statement_data = _blocks.at(true_statement_block);
+		text_block &false_statement_data = _blocks.at(false_statement_block);
 
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
+		true_statement_data.increase_indentation_level();
+		false_statement_data.increase_indentation_level();
 
 		code += _blocks.at(condition_block);
 
@@ -1140,13 +1264,13 @@ private:
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_value != 0 && true_statement_block != 0 && false_value != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
+		text_block &true_statement_data = _blocks.at(true_statement_block);
+		text_block &false_statement_data = _blocks.at(false_statement_block);
 
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
+		true_statement_data.increase_indentation_level();
+		false_statement_data.increase_indentation_level();
 
 		const id res = make_id();
 
@@ -1159,10 +1283,12 @@ private:
 		write_location(code, loc);
 
 		code += "\tif (" + id_to_name(condition_value) + ")\n\t{\n";
-		code += (true_statement_block != condition_block ? true_statement_data : std::string());
+		if (true_statement_block != condition_block)
+			code += true_statement_data;
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(true_value) + ";\n";
 		code += "\t}\n\telse\n\t{\n";
-		code += (false_statement_block != condition_block ? false_statement_data : std::string());
+		if (false_statement_block != condition_block)
+			code += false_statement_data;
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(false_value) + ";\n";
 		code += "\t}\n";
 
@@ -1177,17 +1303,17 @@ private:
 	{
 		assert(prev_block != 0 && header_block != 0 && loop_block != 0 && continue_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
-		std::string &loop_data = _blocks.at(loop_block);
-		std::string &continue_data = _blocks.at(continue_block);
+		text_block &loop_data = _blocks.at(loop_block);
+		text_block &continue_data = _blocks.at(continue_block);
 
 		// Condition value can be missing in infinite loop constructs like "for (;;)"
-		const std::string condition_name = condition_value != 0 ? id_to_name(condition_value) : "true";
+		const std::string condition_name = condition_value != 0 ? std::string(id_to_name(condition_value)) : "true";
 
-		increase_indentation_level(loop_data);
-		increase_indentation_level(loop_data);
-		increase_indentation_level(continue_data);
+		loop_data.increase_indentation_level();
+		loop_data.increase_indentation_level();
+		continue_data.increase_indentation_level();
 
 		code += _blocks.at(prev_block);
 
@@ -1206,14 +1332,10 @@ private:
 		if (condition_block == 0)
 		{
 			// Convert variable initializer to assignment statement
-			auto pos_assign = continue_data.rfind(condition_name);
-			auto pos_prev_assign = continue_data.rfind('\t', pos_assign);
-			continue_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
+			continue_data.erase_before_last(condition_name, '\t');
 
 			// We need to add the continue block to all "continue" statements as well
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data);
+			loop_data.replace_placeholders(continue_block, continue_data);
 
 			code += "do\n\t{\n\t\t{\n";
 			code += loop_data; // Encapsulate loop body into another scope, so not to confuse any local variables with the current iteration variable accessed in the continue block below
@@ -1223,18 +1345,16 @@ private:
 		}
 		else
 		{
-			std::string &condition_data = _blocks.at(condition_block);
+			text_block &condition_data = _blocks.at(condition_block);
 
-			increase_indentation_level(condition_data);
+			condition_data.increase_indentation_level();
 
 			// Convert variable initializer to assignment statement
-			auto pos_assign = condition_data.rfind(condition_name);
-			auto pos_prev_assign = condition_data.rfind('\t', pos_assign);
-			condition_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
+			condition_data.erase_before_last(condition_name, '\t');
 
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data + condition_data);
+			text_block continue_and_condition_data = continue_data;
+			continue_and_condition_data += condition_data;
+			loop_data.replace_placeholders(continue_block, continue_and_condition_data);
 
 			code += "while (" + condition_name + ")\n\t{\n\t\t{\n";
 			code += loop_data;
@@ -1256,7 +1376,7 @@ private:
 	{
 		assert(selector_value != 0 && selector_block != 0 && default_label != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += _blocks.at(selector_block);
 
@@ -1275,9 +1395,9 @@ private:
 			{
 				assert(case_literal_and_labels[i + 1] != 0);
 
-				std::string &case_data = _blocks.at(case_literal_and_labels[i + 1]);
+				text_block &case_data = _blocks.at(case_literal_and_labels[i + 1]);
 
-				increase_indentation_level(case_data);
+				case_data.increase_indentation_level();
 
 				code += "\tcase " + std::to_string(case_literal_and_labels[i]) + ": {\n";
 				code += case_data;
@@ -1286,9 +1406,9 @@ private:
 
 			if (default_label != _current_block)
 			{
-				std::string &default_data = _blocks.at(default_label);
+				text_block &default_data = _blocks.at(default_label);
 
-				increase_indentation_level(default_data);
+				default_data.increase_indentation_level();
 
 				code += "\tdefault: {\n";
 				code += default_data;
@@ -1312,9 +1432,9 @@ private:
 			{
 				assert(case_literal_and_labels[i + 1] != 0);
 
-				std::string &case_data = _blocks.at(case_literal_and_labels[i + 1]);
+				text_block &case_data = _blocks.at(case_literal_and_labels[i + 1]);
 
-				increase_indentation_level(case_data);
+				case_data.increase_indentation_level();
 
 				code += "if (" + id_to_name(selector_value) + " == " + std::to_string(case_literal_and_labels[i]) + ")\n\t{\n";
 				code += case_data;
@@ -1326,9 +1446,9 @@ private:
 
 			if (default_label != _current_block)
 			{
-				std::string &default_data = _blocks.at(default_label);
+				text_block &default_data = _blocks.at(default_label);
 
-				increase_indentation_level(default_data);
+				default_data.increase_indentation_level();
 
 				code += default_data;
 
@@ -1348,9 +1468,7 @@ private:
 	{
 		const id res = make_id();
 
-		std::string &block = _blocks.emplace(res, std::string()).first->second;
-		// Reserve a decently big enough memory block to avoid frequent reallocations
-		block.reserve(4096);
+		_blocks.emplace(res, text_block(_text));
 
 		return res;
 	}
@@ -1370,7 +1488,7 @@ private:
 		if (!is_in_block())
 			return 0;
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += "\tdiscard;\n";
 
@@ -1396,7 +1514,7 @@ private:
 		if (!_functions.back()->return_type.is_void() && value == 0)
 			return set_block(0);
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		code += "\treturn";
 
@@ -1419,7 +1537,7 @@ private:
 		if (!is_in_block())
 			return _last_block;
 
-		std::string &code = _blocks.at(_current_block);
+		text_block &code = _blocks.at(_current_block);
 
 		switch (loop_flow)
 		{
@@ -1427,7 +1545,8 @@ private:
 			code += "\tbreak;\n";
 			break;
 		case 2: // Keep track of continue target block, so we can insert its code here later
-			code += "__CONTINUE__" + std::to_string(target) + "\tcontinue;\n";
+			code.add_placeholder(target);
+			code += "\tcontinue;\n";
 			break;
 		}
 
@@ -1444,11 +1563,17 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		text_block &code = _blocks.at(0);
+
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		finish_definition(_functions.back()->definition);
 	}
 };
 
-codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
+codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool trim_entry_points)
 {
-	return new codegen_hlsl(shader_model, debug_info, uniforms_to_spec_constants);
+	return new codegen_hlsl(shader_model, debug_info, uniforms_to_spec_constants, trim_entry_points);
 }
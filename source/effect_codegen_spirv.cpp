@@ -6,7 +6,7 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
-#include <cstring> // memcmp
+#include <cstring> // std::memcmp, std::memcpy
 #include <algorithm> // std::find_if, std::max
 #include <unordered_set>
 
@@ -19,25 +19,95 @@ namespace spv {
 using namespace reshadefx;
 
 /// <summary>
-/// A single instruction in a SPIR-V module
+/// A list of instructions forming a basic block in the SPIR-V module, stored directly in their binary encoding
+/// </summary>
+struct spirv_basic_block
+{
+	std::vector<uint32_t> words;
+
+	/// <summary>
+	/// Append another basic block the end of this one.
+	/// </summary>
+	void append(const spirv_basic_block &block)
+	{
+		words.insert(words.end(), block.words.begin(), block.words.end());
+	}
+	/// <summary>
+	/// Move the contents of another basic block to the end of this one, leaving it empty.
+	/// </summary>
+	void append(spirv_basic_block &&block)
+	{
+		if (words.empty())
+			words = std::move(block.words);
+		else
+			words.insert(words.end(), block.words.begin(), block.words.end());
+		block.words.clear();
+	}
+
+	/// <summary>
+	/// Get the last instruction in this basic block, which has to have the specified opcode and word count.
+	/// </summary>
+	/// <returns>A pointer to the words of the instruction, starting with the opcode. This is invalidated when the basic block is modified.</returns>
+	const uint32_t *back(spv::Op op, uint32_t num_words) const
+	{
+		assert(words.size() >= num_words && words[words.size() - num_words] == ((num_words << spv::WordCountShift) | op));
+		return words.data() + words.size() - num_words;
+	}
+	/// <summary>
+	/// Remove the last instruction from this basic block, which has to have the specified opcode and word count.
+	/// </summary>
+	void pop_back(spv::Op op, uint32_t num_words)
+	{
+		assert(words.size() >= num_words && words[words.size() - num_words] == ((num_words << spv::WordCountShift) | op));
+		words.resize(words.size() - num_words);
+	}
+};
+
+/// <summary>
+/// A single instruction in a SPIR-V module, which is encoded into the basic block it was added to as operands are added
 /// </summary>
 struct spirv_instruction
 {
-	spv::Op op;
-	spv::Id type;
-	spv::Id result;
-	std::vector<spv::Id> operands;
+	spv::Op op = spv::OpNop;
+	spv::Id type = 0;
+	spv::Id result = 0;
+
+	spirv_instruction() = default;
+	spirv_instruction(spirv_basic_block &block, spv::Op op, spv::Id type = 0, spv::Id result = 0) : op(op), type(type), result(result), _block(&block), _offset(block.words.size())
+	{
+		// See: https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
+		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
+		// 1             | Optional instruction type <id>
+		// .             | Optional instruction Result <id>
+		// .             | Operand 1 (if needed)
+		// .             | Operand 2 (if needed)
+		// ...           | ...
+		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
+
+		block.words.push_back(op);
+
+		// Optional instruction type ID
+		if (type != 0) block.words.push_back(type);
+
+		// Optional instruction result ID
+		if (result != 0) block.words.push_back(result);
+
+		update_word_count();
+	}
 
-	explicit spirv_instruction(spv::Op op = spv::OpNop) : op(op), type(0), result(0) { }
-	spirv_instruction(spv::Op op, spv::Id result) : op(op), type(result), result(0) { }
-	spirv_instruction(spv::Op op, spv::Id type, spv::Id result) : op(op), type(type), result(result) { }
+	/// <summary>
+	/// Get the offset of the first word of this instruction in its basic block.
+	/// </summary>
+	size_t offset() const { return _offset; }
 
 	/// <summary>
 	/// Add a single operand to the instruction.
 	/// </summary>
 	spirv_instruction &add(spv::Id operand)
 	{
-		operands.push_back(operand);
+		assert(is_last());
+		_block->words.push_back(operand);
+		update_word_count();
 		return *this;
 	}
 
@@ -47,7 +117,9 @@ struct spirv_instruction
 	template <typename It>
 	spirv_instruction &add(It begin, It end)
 	{
-		operands.insert(operands.end(), begin, end);
+		assert(is_last());
+		_block->words.insert(_block->words.end(), begin, end);
+		update_word_count();
 		return *this;
 	}
 
@@ -67,55 +139,58 @@ struct spirv_instruction
 	}
 
 	/// <summary>
-	/// Write this instruction to a SPIR-V module.
+	/// Change the result type of the instruction.
 	/// </summary>
-	/// <param name="output">The output stream to append this instruction to.</param>
-	void write(std::vector<uint32_t> &output) const
+	void set_type(spv::Id new_type)
 	{
-		// See: https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
-		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
-		// 1             | Optional instruction type <id>
-		// .             | Optional instruction Result <id>
-		// .             | Operand 1 (if needed)
-		// .             | Operand 2 (if needed)
-		// ...           | ...
-		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
-
-		const uint32_t num_words = 1 + (type != 0) + (result != 0) + static_cast<uint32_t>(operands.size());
-		output.push_back((num_words << spv::WordCountShift) | op);
-
-		// Optional instruction type ID
-		if (type != 0) output.push_back(type);
-
-		// Optional instruction result ID
-		if (result != 0) output.push_back(result);
+		assert(new_type != 0);
+		set_word(_offset + 1, type != 0, new_type);
+		type = new_type;
+	}
+	/// <summary>
+	/// Change the result ID of the instruction.
+	/// </summary>
+	void set_result(spv::Id new_result)
+	{
+		assert(new_result != 0);
+		set_word(_offset + 1 + (type != 0), result != 0, new_result);
+		result = new_result;
+	}
 
-		// Write out the operands
-		output.insert(output.end(), operands.begin(), operands.end());
+private:
+	bool is_last() const
+	{
+		return _block != nullptr && (_block->words[_offset] >> spv::WordCountShift) == _block->words.size() - _offset;
 	}
-};
 
-/// <summary>
-/// A list of instructions forming a basic block in the SPIR-V module
-/// </summary>
-struct spirv_basic_block
-{
-	std::vector<spirv_instruction> instructions;
+	void set_word(size_t index, bool exists, uint32_t value)
+	{
+		if (exists)
+		{
+			_block->words[index] = value;
+		}
+		else
+		{
+			assert(is_last());
+			_block->words.insert(_block->words.begin() + index, value);
+			update_word_count();
+		}
+	}
 
-	/// <summary>
-	/// Append another basic block the end of this one.
-	/// </summary>
-	void append(const spirv_basic_block &block)
+	void update_word_count()
 	{
-		instructions.insert(instructions.end(), block.instructions.begin(), block.instructions.end());
+		_block->words[_offset] = (static_cast<uint32_t>(_block->words.size() - _offset) << spv::WordCountShift) | op;
 	}
+
+	spirv_basic_block *_block = nullptr;
+	size_t _offset = 0;
 };
 
 class codegen_spirv final : public codegen
 {
 public:
-	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y)
-		: _invert_y(invert_y), _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants)
+	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y, bool optimize)
+		: _invert_y(invert_y), _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _optimize(optimize)
 	{
 		_glsl_ext = make_id();
 	}
@@ -132,16 +207,46 @@ private:
 		{
 			return lhs.type == rhs.type && lhs.is_ptr == rhs.is_ptr && lhs.array_stride == rhs.array_stride && lhs.storage == rhs.storage;
 		}
+
+		struct hash
+		{
+			size_t operator()(const type_lookup &lookup) const
+			{
+				const uint32_t words[3] = { lookup.is_ptr, lookup.array_stride, static_cast<uint32_t>(lookup.storage) };
+				return hash_words(words, 3, hash_type(lookup.type));
+			}
+		};
 	};
-	struct function_blocks
+	struct constant_lookup
+	{
+		reshadefx::type type;
+		reshadefx::constant data;
+
+		// Only the values of the components of the type are emitted (array elements are taken from the array data instead), so any others may be uninitialized and must not be compared
+		static unsigned int num_values(const reshadefx::type &type) { return type.is_array() || type.is_struct() ? 0 : type.components(); }
+
+		friend bool operator==(const constant_lookup &lhs, const constant_lookup &rhs)
+		{
+			return lhs.type == rhs.type && std::memcmp(&lhs.data.as_uint[0], &rhs.data.as_uint[0], sizeof(uint32_t) * num_values(lhs.type)) == 0 && lhs.data.array_data == rhs.data.array_data;
+		}
+
+		struct hash
+		{
+			size_t operator()(const constant_lookup &lookup) const
+			{
+				size_t hash = hash_words(lookup.data.as_uint, num_values(lookup.type), hash_type(lookup.type));
+				if (!lookup.data.array_data.empty())
+					hash = hash_words(lookup.data.array_data.data(), lookup.data.array_data.size() * lookup.data.array_data.stride(), hash);
+				return hash;
+			}
+		};
+	};
+	struct function_type_lookup
 	{
-		spirv_basic_block declaration;
-		spirv_basic_block variables;
-		spirv_basic_block definition;
 		type return_type;
 		std::vector<type> param_types;
 
-		friend bool operator==(const function_blocks &lhs, const function_blocks &rhs)
+		friend bool operator==(const function_type_lookup &lhs, const function_type_lookup &rhs)
 		{
 			if (lhs.param_types.size() != rhs.param_types.size())
 				return false;
@@ -150,8 +255,41 @@ private:
 					return false;
 			return lhs.return_type == rhs.return_type;
 		}
+
+		struct hash
+		{
+			size_t operator()(const function_type_lookup &lookup) const
+			{
+				size_t hash = hash_type(lookup.return_type);
+				for (const type &param_type : lookup.param_types)
+					hash = hash_type(param_type, hash);
+				return hash;
+			}
+		};
+	};
+	struct function_blocks
+	{
+		spirv_basic_block declaration;
+		spirv_basic_block variables;
+		spirv_basic_block definition;
+		type return_type;
+		std::vector<type> param_types;
 	};
 
+	// FNV-1a hash over a sequence of words, used to index the type and constant lookup tables
+	static size_t hash_words(const uint32_t *words, size_t count, size_t hash = 2166136261u)
+	{
+		for (size_t i = 0; i < count; ++i)
+			hash = (hash ^ words[i]) * 16777619u;
+		return hash;
+	}
+	// Only hashes the fields that are compared by the equality operator of the type (so not the qualifiers)
+	static size_t hash_type(const type &type, size_t hash = 2166136261u)
+	{
+		const uint32_t words[5] = { type.base, type.rows, type.cols, static_cast<uint32_t>(type.array_length), type.definition };
+		return hash_words(words, 5, hash);
+	}
+
 	spirv_basic_block _entries;
 	spirv_basic_block _execution_modes;
 	spirv_basic_block _debug_a;
@@ -160,12 +298,12 @@ private:
 	spirv_basic_block _types_and_constants;
 	spirv_basic_block _variables;
 
-	std::unordered_set<spv::Id> _spec_constants;
+	std::unordered_map<spv::Id, size_t> _spec_constants;
 	std::unordered_set<spv::Capability> _capabilities;
-	std::vector<std::pair<type_lookup, spv::Id>> _type_lookup;
-	std::vector<std::tuple<type, constant, spv::Id>> _constant_lookup;
-	std::vector<std::pair<function_blocks, spv::Id>> _function_type_lookup;
-	std::unordered_map<std::string, spv::Id> _string_lookup;
+	std::unordered_map<type_lookup, spv::Id, type_lookup::hash> _type_lookup;
+	std::unordered_map<constant_lookup, spv::Id, constant_lookup::hash> _constant_lookup;
+	std::unordered_map<function_type_lookup, spv::Id, function_type_lookup::hash> _function_type_lookup;
+	std::unordered_map<uint32_t, spv::Id> _string_lookup;
 	std::unordered_map<spv::Id, spv::StorageClass> _storage_lookup;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
@@ -177,6 +315,7 @@ private:
 	bool _debug_info = false;
 	bool _vulkan_semantics = false;
 	bool _uniforms_to_spec_constants = false;
+	bool _optimize = false;
 	id _glsl_ext = 0;
 	id _global_ubo_type = 0;
 	id _global_ubo_variable = 0;
@@ -185,15 +324,14 @@ private:
 
 	inline void add_location(const location &loc, spirv_basic_block &block)
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source_id == 0 || !_debug_info)
 			return;
 
-		spv::Id file = _string_lookup[loc.source];
+		spv::Id &file = _string_lookup[loc.source_id];
 		if (file == 0) {
 			file = add_instruction(spv::OpString, 0, _debug_a)
-				.add_string(loc.source.c_str())
+				.add_string(_source_files->path(loc.source_id).c_str())
 				.result;
-			_string_lookup[loc.source] = file;
 		}
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpLine
@@ -202,26 +340,24 @@ private:
 			.add(loc.line)
 			.add(loc.column);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type = 0)
+	// Instructions are encoded into the basic block as they are built, so operands can only be added until the next instruction is added to the same block
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type = 0)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction(op, type, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = make_id();
-		return instruction;
+		return spirv_instruction(block, op, type, make_id());
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op)
+	inline spirv_instruction add_instruction_without_result(spv::Op op)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction_without_result(op, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	inline spirv_instruction add_instruction_without_result(spv::Op op, spirv_basic_block &block)
 	{
-		return block.instructions.emplace_back(op);
+		return spirv_instruction(block, op);
 	}
 
 	void write_result(module &module) override
@@ -231,91 +367,96 @@ private:
 		{
 			add_instruction(spv::OpTypeStruct, 0, _types_and_constants)
 				.add(_global_ubo_types.begin(), _global_ubo_types.end())
-				.result = _global_ubo_type;
+				.set_result(_global_ubo_type);
 
 			define_variable(_global_ubo_variable, {}, { type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, "$Globals", spv::StorageClassUniform);
 		}
 
 		module = std::move(_module);
 
-		// Write SPIRV header info
-		module.spirv.push_back(spv::MagicNumber);
-		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
-		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
-		module.spirv.push_back(_next_id); // Maximum ID
-		module.spirv.push_back(0u); // Reserved for instruction schema
+		spirv_basic_block preamble;
 
 		// All capabilities
-		spirv_instruction(spv::OpCapability)
-			.add(spv::CapabilityShader) // Implicitly declares the Matrix capability too
-			.write(module.spirv);
+		add_instruction_without_result(spv::OpCapability, preamble)
+			.add(spv::CapabilityShader); // Implicitly declares the Matrix capability too
 
 		for (spv::Capability capability : _capabilities)
-			spirv_instruction(spv::OpCapability)
-				.add(capability)
-				.write(module.spirv);
+			add_instruction_without_result(spv::OpCapability, preamble)
+				.add(capability);
 
 		// Optional extension instructions
-		spirv_instruction(spv::OpExtInstImport, _glsl_ext)
-			.add_string("GLSL.std.450") // Import GLSL extension
-			.write(module.spirv);
+		add_instruction_without_result(spv::OpExtInstImport, preamble)
+			.add(_glsl_ext)
+			.add_string("GLSL.std.450"); // Import GLSL extension
 
 		// Single required memory model instruction
-		spirv_instruction(spv::OpMemoryModel)
+		add_instruction_without_result(spv::OpMemoryModel, preamble)
 			.add(spv::AddressingModelLogical)
-			.add(spv::MemoryModelGLSL450)
-			.write(module.spirv);
+			.add(spv::MemoryModelGLSL450);
 
 		// All entry point declarations
-		for (const auto &node : _entries.instructions)
-			node.write(module.spirv);
+		preamble.append(_entries);
 
 		// All execution mode declarations
-		for (const auto &node : _execution_modes.instructions)
-			node.write(module.spirv);
+		preamble.append(_execution_modes);
 
-		spirv_instruction(spv::OpSource)
+		add_instruction_without_result(spv::OpSource, preamble)
 			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
-			.add(0) // Language version, TODO: Maybe fill in ReShade version here?
-			.write(module.spirv);
+			.add(0); // Language version, TODO: Maybe fill in ReShade version here?
 
-		if (_debug_info)
-		{
+		// Sections are already encoded, so only need to be concatenated in the right order
+		const spirv_basic_block *const sections[] = {
+			&preamble,
 			// All debug instructions
-			for (const auto &node : _debug_a.instructions)
-				node.write(module.spirv);
-			for (const auto &node : _debug_b.instructions)
-				node.write(module.spirv);
-		}
+			_debug_info ? &_debug_a : nullptr,
+			_debug_info ? &_debug_b : nullptr,
+			// All annotation instructions
+			&_annotations,
+			// All type declarations
+			&_types_and_constants,
+			&_variables,
+		};
+
+		size_t num_words = 5;
+		for (const spirv_basic_block *section : sections)
+			if (section != nullptr)
+				num_words += section->words.size();
+		for (const function_blocks &function : _functions_blocks)
+			if (!function.definition.words.empty())
+				num_words += function.declaration.words.size() + function.variables.words.size() + function.definition.words.size();
 
-		// All annotation instructions
-		for (const auto &node : _annotations.instructions)
-			node.write(module.spirv);
+		module.spirv.reserve(num_words);
+
+		// Write SPIRV header info
+		module.spirv.push_back(spv::MagicNumber);
+		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
+		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
+		module.spirv.push_back(_next_id); // Maximum ID
+		module.spirv.push_back(0u); // Reserved for instruction schema
 
-		// All type declarations
-		for (const auto &node : _types_and_constants.instructions)
-			node.write(module.spirv);
-		for (const auto &node : _variables.instructions)
-			node.write(module.spirv);
+		for (const spirv_basic_block *section : sections)
+			if (section != nullptr)
+				module.spirv.insert(module.spirv.end(), section->words.begin(), section->words.end());
 
 		// All function definitions
-		for (const auto &function : _functions_blocks)
+		for (const function_blocks &function : _functions_blocks)
 		{
-			if (function.definition.instructions.empty())
+			if (function.definition.words.empty())
 				continue;
 
-			for (const auto &node : function.declaration.instructions)
-				node.write(module.spirv);
+			module.spirv.insert(module.spirv.end(), function.declaration.words.begin(), function.declaration.words.end());
 
 			// Grab first label and move it in front of variable declarations
-			function.definition.instructions.front().write(module.spirv);
-			assert(function.definition.instructions.front().op == spv::OpLabel);
+			const auto label_end = function.definition.words.begin() + 2;
+			assert(function.definition.words.front() == ((2u << spv::WordCountShift) | spv::OpLabel));
+			module.spirv.insert(module.spirv.end(), function.definition.words.begin(), label_end);
 
-			for (const auto &node : function.variables.instructions)
-				node.write(module.spirv);
-			for (auto it = function.definition.instructions.begin() + 1; it != function.definition.instructions.end(); ++it)
-				it->write(module.spirv);
+			module.spirv.insert(module.spirv.end(), function.variables.words.begin(), function.variables.words.end());
+			module.spirv.insert(module.spirv.end(), label_end, function.definition.words.end());
 		}
+
+		if (_optimize)
+			optimize_spirv(module.spirv);
 	}
 
 	spv::Id convert_type(const type &info, bool is_ptr = false, spv::StorageClass storage = spv::StorageClassFunction, uint32_t array_stride = 0)
@@ -330,8 +471,7 @@ private:
 			storage = spv::StorageClassUniformConstant;
 
 		const type_lookup lookup = { info, is_ptr, array_stride, storage };
-		if (const auto it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-			[&lookup](const auto &lookup_it) { return lookup_it.first == lookup; }); it != _type_lookup.end())
+		if (const auto it = _type_lookup.find(lookup); it != _type_lookup.end())
 			return it->second;
 
 		spv::Id type;
@@ -439,14 +579,14 @@ private:
 			}
 		}
 
-		_type_lookup.push_back({ lookup, type });
+		_type_lookup.emplace(lookup, type);
 
 		return type;
 	}
 	spv::Id convert_type(const function_blocks &info)
 	{
-		if (auto it = std::find_if(_function_type_lookup.begin(), _function_type_lookup.end(),
-			[&info](const auto &lookup) { return lookup.first == info; }); it != _function_type_lookup.end())
+		function_type_lookup lookup = { info.return_type, info.param_types };
+		if (const auto it = _function_type_lookup.find(lookup); it != _function_type_lookup.end())
 			return it->second;
 
 		auto return_type = convert_type(info.return_type);
@@ -457,11 +597,11 @@ private:
 		for (const type &param_type : info.param_types)
 			param_type_ids.push_back(convert_type(param_type, true));
 
-		spirv_instruction &inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
+		spirv_instruction inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
 		inst.add(return_type);
 		inst.add(param_type_ids.begin(), param_type_ids.end());
 
-		_function_type_lookup.push_back({ info, inst.result });;
+		_function_type_lookup.emplace(std::move(lookup), inst.result);
 
 		return inst.result;
 	}
@@ -546,6 +686,7 @@ private:
 		for (uint32_t index = 0; index < info.member_list.size(); ++index)
 			add_member_name(info.definition, index, info.member_list[index].name.c_str());
 
+		_struct_lookup.emplace(info.definition, _structs.size());
 		_structs.push_back(info);
 
 		return info.definition;
@@ -554,6 +695,7 @@ private:
 	{
 		info.id = make_id();
 
+		_texture_lookup.emplace(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
 		return info.id;
@@ -581,7 +723,20 @@ private:
 
 			add_name(res, info.name.c_str());
 
-			const auto add_spec_constant = [this](const spirv_instruction &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
+			// Specialization constants always have a result type and ID, followed by the literal value or the constituents
+			struct spec_constant_instruction
+			{
+				spv::Op op;
+				spv::Id result;
+				const uint32_t *operands;
+				size_t num_operands;
+			};
+
+			const auto find_spec_constant = [this](spv::Id id) {
+				const uint32_t *const inst = _types_and_constants.words.data() + _spec_constants.at(id);
+				return spec_constant_instruction { static_cast<spv::Op>(inst[0] & spv::OpCodeMask), inst[2], inst + 3, (inst[0] >> spv::WordCountShift) - 3u };
+			};
+			const auto add_spec_constant = [this](const spec_constant_instruction &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
 				assert(inst.op == spv::OpSpecConstant || inst.op == spv::OpSpecConstantTrue || inst.op == spv::OpSpecConstantFalse);
 
 				const uint32_t spec_id = static_cast<uint32_t>(_module.spec_constants.size());
@@ -598,7 +753,7 @@ private:
 				_module.spec_constants.push_back(scalar_info);
 			};
 
-			const spirv_instruction &base_inst = _types_and_constants.instructions.back();
+			const spec_constant_instruction base_inst = find_spec_constant(res);
 			assert(base_inst.result == res);
 
 			// External specialization constants need to be scalars
@@ -611,24 +766,29 @@ private:
 				assert(base_inst.op == spv::OpSpecConstantComposite);
 
 				// Add each individual scalar component of the constant as a separate external specialization constant
-				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operands.size() : 1); ++i)
+				for (size_t i = 0; i < (info.type.is_array() ? base_inst.num_operands : 1); ++i)
 				{
-					spirv_instruction elem_inst = base_inst;
+					spec_constant_instruction elem_inst = base_inst;
 					reshadefx::constant initializer_value = info.initializer_value;
 
 					if (info.type.is_array())
 					{
-						elem_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = base_inst.operands[i]](const auto &it) { return it.result == elem; });
+						elem_inst = find_spec_constant(base_inst.operands[i]);
 
-						assert(initializer_value.array_data.size() == base_inst.operands.size());
+						assert(initializer_value.array_data.size() == base_inst.num_operands);
 						initializer_value = initializer_value.array_data[i];
+
+						// Elements of scalar arrays are not composites themselves
+						if (elem_inst.op != spv::OpSpecConstantComposite)
+						{
+							add_spec_constant(elem_inst, info, initializer_value, 0);
+							continue;
+						}
 					}
 
-					for (size_t row = 0; row < elem_inst.operands.size(); ++row)
+					for (size_t row = 0; row < elem_inst.num_operands; ++row)
 					{
-						const spirv_instruction &row_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = elem_inst.operands[row]](const auto &it) { return it.result == elem; });
+						const spec_constant_instruction row_inst = find_spec_constant(elem_inst.operands[row]);
 
 						if (row_inst.op != spv::OpSpecConstantComposite)
 						{
@@ -636,10 +796,9 @@ private:
 							continue;
 						}
 
-						for (size_t col = 0; col < row_inst.operands.size(); ++col)
+						for (size_t col = 0; col < row_inst.num_operands; ++col)
 						{
-							const spirv_instruction &col_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-								[elem = row_inst.operands[col]](const auto &it) { return it.result == elem; });
+							const spec_constant_instruction col_inst = find_spec_constant(row_inst.operands[col]);
 
 							add_spec_constant(col_inst, info, initializer_value, row * info.type.cols + col);
 						}
@@ -730,9 +889,9 @@ private:
 		add_location(loc, block);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpVariable
-		spirv_instruction &inst = add_instruction_without_result(spv::OpVariable, block);
-		inst.type = convert_type(type, true, storage);
-		inst.result = id;
+		spirv_instruction inst = add_instruction_without_result(spv::OpVariable, block);
+		inst.set_type(convert_type(type, true, storage));
+		inst.set_result(id);
 		inst.add(storage);
 
 		if (initializer_value != 0)
@@ -786,6 +945,7 @@ private:
 			add_name(param.definition, param.name.c_str());
 		}
 
+		_function_lookup.emplace(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -797,7 +957,7 @@ private:
 			[&func](const auto &ep) { return ep.name == func.unique_name; }); it != _module.entry_points.end())
 			return;
 
-		_module.entry_points.push_back({ func.unique_name, is_ps });
+		_module.entry_points.push_back({ func.unique_name, is_ps, {} });
 
 		id position_variable = 0;
 		std::vector<uint32_t> inputs_and_outputs;
@@ -1042,7 +1202,7 @@ private:
 				it != _storage_lookup.end())
 				storage = it->second;
 
-			spirv_instruction *access_chain = nullptr;
+			spirv_instruction access_chain;
 
 			// Check if this is a uniform variable (see 'define_uniform' function above) and dereference it
 			if (result & 0xF0000000)
@@ -1055,7 +1215,7 @@ private:
 				if (is_uniform_bool)
 					base_type.base = type::t_uint;
 
-				access_chain = &add_instruction(spv::OpAccessChain)
+				access_chain = add_instruction(spv::OpAccessChain)
 					.add(_global_ubo_variable)
 					.add(emit_constant(member_index));
 			}
@@ -1070,15 +1230,15 @@ private:
 				assert(_current_block_data != &_types_and_constants);
 
 				// Use access chain from uniform if possible, otherwise create new one
-				if (access_chain == nullptr) access_chain =
-					&add_instruction(spv::OpAccessChain).add(result); // Base
+				if (access_chain.op == spv::OpNop) access_chain =
+					add_instruction(spv::OpAccessChain).add(result); // Base
 
 				// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 				if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
 					i = 1;
 
 				do {
-					access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+					access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 						exp.chain[i].index :
 						emit_constant(exp.chain[i].index)); // Indexes
 					base_type = exp.chain[i++].to;
@@ -1087,13 +1247,13 @@ private:
 					exp.chain[i].op == expression::operation::op_dynamic_index ||
 					exp.chain[i].op == expression::operation::op_constant_index));
 
-				access_chain->type = convert_type(exp.chain[i - 1].to, true, storage); // Last type is the result
-				result = access_chain->result;
+				access_chain.set_type(convert_type(exp.chain[i - 1].to, true, storage)); // Last type is the result
+				result = access_chain.result;
 			}
-			else if (access_chain != nullptr)
+			else if (access_chain.op != spv::OpNop)
 			{
-				access_chain->type = convert_type(base_type, true, storage, base_type.is_array() ? 16u : 0u);
-				result = access_chain->result;
+				access_chain.set_type(convert_type(base_type, true, storage, base_type.is_array() ? 16u : 0u));
+				result = access_chain.result;
 			}
 
 			result = add_instruction(spv::OpLoad, convert_type(base_type))
@@ -1204,7 +1364,7 @@ private:
 							scalar_type.cols = 1;
 
 							assert(result != 0);
-							spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
+							spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
 								.add(result);
 
 							if (op.from.rows > 1) // Matrix types with a single row are actually vectors, so they don't need the extra index
@@ -1215,7 +1375,7 @@ private:
 							components[c] = node.result;
 						}
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
 							node.add(components[c]);
@@ -1225,7 +1385,7 @@ private:
 					}
 					else if (op.from.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
 							.add(result) // Vector 1
 							.add(result); // Vector 2
 
@@ -1237,7 +1397,7 @@ private:
 					}
 					else
 					{
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 
 						for (unsigned int c = 0; c < op.to.rows; ++c)
 							node.add(result);
@@ -1249,7 +1409,7 @@ private:
 				else if (op.from.is_matrix() && op.to.is_scalar())
 				{
 					assert(result != 0 && op.swizzle[1] < 0);
-					spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
+					spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
 						.add(result); // Composite
 
 					if (op.from.rows > 1)
@@ -1299,14 +1459,14 @@ private:
 			// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
 			assert(_current_block_data != &_types_and_constants);
 
-			spirv_instruction *access_chain = &add_instruction(spv::OpAccessChain).add(target); // Base
+			spirv_instruction access_chain = add_instruction(spv::OpAccessChain).add(target); // Base
 
 			// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 			if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
 				i = 1;
 
 			do {
-				access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+				access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 					exp.chain[i].index :
 					emit_constant(exp.chain[i].index)); // Indexes
 				base_type = exp.chain[i++].to;
@@ -1315,8 +1475,8 @@ private:
 				exp.chain[i].op == expression::operation::op_dynamic_index ||
 				exp.chain[i].op == expression::operation::op_constant_index));
 
-			access_chain->type = convert_type(exp.chain[i - 1].to, true, storage); // Last type is the result
-			target = access_chain->result;
+			access_chain.set_type(convert_type(exp.chain[i - 1].to, true, storage)); // Last type is the result
+			target = access_chain.result;
 		}
 
 		// TODO: Complex access chains like float4x4[0].m00m10[0] = 0;
@@ -1343,7 +1503,7 @@ private:
 
 					if (base_type.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
 							.add(result) // Vector 1
 							.add(value); // Vector 2
 
@@ -1360,7 +1520,7 @@ private:
 					{
 						assert(op.swizzle[1] < 0);
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
 							.add(value) // Object
 							.add(result); // Composite
 
@@ -1415,17 +1575,11 @@ private:
 	id   emit_constant(const type &type, const constant &data, bool spec_constant)
 	{
 		if (!spec_constant) // Specialization constants cannot reuse other constants
-			if (auto it = std::find_if(_constant_lookup.begin(), _constant_lookup.end(), [&type, &data](auto &x) {
-				if (!(std::get<0>(x) == type && std::memcmp(&std::get<1>(x).as_uint[0], &data.as_uint[0], sizeof(uint32_t) * 16) == 0 && std::get<1>(x).array_data.size() == data.array_data.size()))
-					return false;
-				for (size_t i = 0; i < data.array_data.size(); ++i)
-					if (std::memcmp(&std::get<1>(x).array_data[i].as_uint[0], &data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
-						return false;
-				return true;
-			}); it != _constant_lookup.end())
-				return std::get<2>(*it);
+			if (const auto it = _constant_lookup.find({ type, data }); it != _constant_lookup.end())
+				return it->second;
 
 		spv::Id result = 0;
+		spirv_instruction inst;
 
 		if (type.is_array())
 		{
@@ -1438,22 +1592,22 @@ private:
 			elements.reserve(type.array_length);
 
 			// Fill up elements with constant array data
-			for (const constant &elem : data.array_data)
-				elements.push_back(emit_constant(elem_type, elem, spec_constant));
+			for (size_t i = 0; i < data.array_data.size(); ++i)
+				elements.push_back(emit_constant(elem_type, data.array_data[i], spec_constant));
 			// Fill up any remaining elements with a default value (when the array data did not specify them)
 			for (size_t i = elements.size(); i < static_cast<size_t>(type.array_length); ++i)
 				elements.push_back(emit_constant(elem_type, {}, spec_constant));
 
-			result = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants)
-				.add(elements.begin(), elements.end())
-				.result;
+			inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants)
+				.add(elements.begin(), elements.end());
+			result = inst.result;
 		}
 		else if (type.is_struct())
 		{
 			assert(!spec_constant); // Structures cannot be specialization constants
 
-			result = add_instruction(spv::OpConstantNull, convert_type(type), _types_and_constants)
-				.result;
+			inst = add_instruction(spv::OpConstantNull, convert_type(type), _types_and_constants);
+			result = inst.result;
 		}
 		else if (type.is_vector() || type.is_matrix())
 		{
@@ -1480,34 +1634,34 @@ private:
 			}
 			else
 			{
-				spirv_instruction &node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
+				inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
 
 				for (unsigned int i = 0; i < type.rows; ++i)
-					node.add(rows[i]);
+					inst.add(rows[i]);
 
-				result = node.result;
+				result = inst.result;
 			}
 		}
 		else if (type.is_boolean())
 		{
-			result = add_instruction(data.as_uint[0] ?
+			inst = add_instruction(data.as_uint[0] ?
 				(spec_constant ? spv::OpSpecConstantTrue : spv::OpConstantTrue) :
-				(spec_constant ? spv::OpSpecConstantFalse : spv::OpConstantFalse), convert_type(type), _types_and_constants)
-				.result;
+				(spec_constant ? spv::OpSpecConstantFalse : spv::OpConstantFalse), convert_type(type), _types_and_constants);
+			result = inst.result;
 		}
 		else
 		{
 			assert(type.is_scalar());
 
-			result = add_instruction(spec_constant ? spv::OpSpecConstant : spv::OpConstant, convert_type(type), _types_and_constants)
-				.add(data.as_uint[0])
-				.result;
+			inst = add_instruction(spec_constant ? spv::OpSpecConstant : spv::OpConstant, convert_type(type), _types_and_constants)
+				.add(data.as_uint[0]);
+			result = inst.result;
 		}
 
-		if (spec_constant) // Keep track of all specialization constants
-			_spec_constants.insert(result);
+		if (spec_constant) // Keep track of all specialization constants and where they are in the binary, so they can be inspected again later
+			_spec_constants.emplace(result, inst.offset());
 		else
-			_constant_lookup.push_back({ type, data, result });
+			_constant_lookup.emplace(constant_lookup { type, data }, result);
 
 		return result;
 	}
@@ -1533,7 +1687,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(type));
 		inst.add(val); // Operand
 
 		return inst.result;
@@ -1622,7 +1776,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 		inst.add(lhs); // Operand 1
 		inst.add(rhs); // Operand 2
 
@@ -1638,7 +1792,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv::OpSelect, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpSelect, convert_type(type));
 		inst.add(condition); // Condition
 		inst.add(true_value); // Object 1
 		inst.add(false_value); // Object 2
@@ -1655,7 +1809,7 @@ private:
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpFunctionCall
-		spirv_instruction &inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
 		inst.add(function); // Function
 		for (const auto &arg : args)
 			inst.add(arg.base); // Arguments
@@ -1708,7 +1862,7 @@ private:
 			// Turn the list of scalar arguments into a list of column vectors
 			for (size_t arg = 0; arg < args.size(); arg += type.rows)
 			{
-				spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
 				for (size_t row = 0; row < type.rows; ++row)
 					inst.add(args[arg + row].base);
 
@@ -1726,7 +1880,7 @@ private:
 				ids.push_back(arg.base);
 		}
 
-		spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
 		inst.add(ids.begin(), ids.end());
 
 		return inst.result;
@@ -1734,45 +1888,44 @@ private:
 
 	void emit_if(const location &loc, id, id condition_block, id true_statement_block, id false_statement_block, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->back(spv::OpLabel, 2)[1];
+		_current_block_data->pop_back(spv::OpLabel, 2);
 
 		// Add previous block containing the condition value first
-		_current_block_data->append(_block_data[condition_block]);
+		_current_block_data->append(std::move(_block_data[condition_block]));
 
-		spirv_instruction branch_inst = _current_block_data->instructions.back();
-		assert(branch_inst.op == spv::OpBranchConditional);
-		_current_block_data->instructions.pop_back();
+		uint32_t branch_inst[4];
+		std::memcpy(branch_inst, _current_block_data->back(spv::OpBranchConditional, 4), sizeof(branch_inst));
+		_current_block_data->pop_back(spv::OpBranchConditional, 4);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Append all blocks belonging to the branch
-		_current_block_data->instructions.push_back(branch_inst);
-		_current_block_data->append(_block_data[true_statement_block]);
-		_current_block_data->append(_block_data[false_statement_block]);
+		add_instruction_without_result(spv::OpBranchConditional)
+			.add(branch_inst + 1, branch_inst + 4);
+		_current_block_data->append(std::move(_block_data[true_statement_block]));
+		_current_block_data->append(std::move(_block_data[false_statement_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 	id   emit_phi(const location &loc, id, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->back(spv::OpLabel, 2)[1];
+		_current_block_data->pop_back(spv::OpLabel, 2);
 
 		// Add previous block containing the condition value first
-		_current_block_data->append(_block_data[condition_block]);
+		_current_block_data->append(std::move(_block_data[condition_block]));
 
 		if (true_statement_block != condition_block)
-			_current_block_data->append(_block_data[true_statement_block]);
+			_current_block_data->append(std::move(_block_data[true_statement_block]));
 		if (false_statement_block != condition_block)
-			_current_block_data->append(_block_data[false_statement_block]);
+			_current_block_data->append(std::move(_block_data[false_statement_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 
 		add_location(loc, *_current_block_data);
 
@@ -1786,69 +1939,69 @@ private:
 	}
 	void emit_loop(const location &loc, id, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int loop_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->back(spv::OpLabel, 2)[1];
+		_current_block_data->pop_back(spv::OpLabel, 2);
 
 		// Add previous block first
-		_current_block_data->append(_block_data[prev_block]);
+		_current_block_data->append(std::move(_block_data[prev_block]));
 
-		// Fill header block
-		assert(_block_data[header_block].instructions.size() == 2);
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[0]);
-		assert(_current_block_data->instructions.back().op == spv::OpLabel);
+		// Fill header block, which consists of just a label followed by a branch
+		const spirv_basic_block &header_block_data = _block_data[header_block];
+		assert(header_block_data.words.size() == 4);
+		const uint32_t *const header_label = header_block_data.words.data();
+		assert(header_label[0] == ((2u << spv::WordCountShift) | spv::OpLabel));
+		_current_block_data->words.insert(_current_block_data->words.end(), header_label, header_label + 2);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpLoopMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(continue_block)
 			.add(loop_control); // 'LoopControl' happens to match the flags produced by the parser
 
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[1]);
-		assert(_current_block_data->instructions.back().op == spv::OpBranch);
+		const uint32_t *const header_branch = header_block_data.back(spv::OpBranch, 2);
+		_current_block_data->words.insert(_current_block_data->words.end(), header_branch, header_branch + 2);
 
 		// Add condition block if it exists
 		if (condition_block != 0)
-			_current_block_data->append(_block_data[condition_block]);
+			_current_block_data->append(std::move(_block_data[condition_block]));
 
 		// Append loop body block before continue block
-		_current_block_data->append(_block_data[loop_block]);
-		_current_block_data->append(_block_data[continue_block]);
+		_current_block_data->append(std::move(_block_data[loop_block]));
+		_current_block_data->append(std::move(_block_data[continue_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 	void emit_switch(const location &loc, id, id selector_block, id default_label, const std::vector<id> &case_literal_and_labels, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->back(spv::OpLabel, 2)[1];
+		_current_block_data->pop_back(spv::OpLabel, 2);
 
 		// Add previous block containing the selector value first
-		_current_block_data->append(_block_data[selector_block]);
+		_current_block_data->append(std::move(_block_data[selector_block]));
 
-		spirv_instruction switch_inst = _current_block_data->instructions.back();
-		assert(switch_inst.op == spv::OpSwitch);
-		_current_block_data->instructions.pop_back();
+		const spv::Id selector_value = _current_block_data->back(spv::OpSwitch, 3)[1];
+		_current_block_data->pop_back(spv::OpSwitch, 3);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Update switch instruction to contain all case labels
-		switch_inst.operands[1] = default_label;
-		switch_inst.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
+		add_instruction_without_result(spv::OpSwitch)
+			.add(selector_value)
+			.add(default_label)
+			.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
 
 		// Append all blocks belonging to the switch
-		_current_block_data->instructions.push_back(switch_inst);
 		for (size_t i = 0; i < case_literal_and_labels.size(); i += 2)
-			_current_block_data->append(_block_data[case_literal_and_labels[i + 1]]);
-		if (default_label != merge_label.result)
-			_current_block_data->append(_block_data[default_label]);
+			_current_block_data->append(std::move(_block_data[case_literal_and_labels[i + 1]]));
+		if (default_label != merge_label)
+			_current_block_data->append(std::move(_block_data[default_label]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 
 	bool is_in_function() const override { return _current_function != nullptr; }
@@ -1870,7 +2023,7 @@ private:
 		set_block(id);
 
 		add_instruction_without_result(spv::OpLabel)
-			.result = id;
+			.set_result(id);
 	}
 	id   leave_block_and_kill() override
 	{
@@ -1951,7 +2104,7 @@ private:
 	{
 		assert(is_in_function()); // Can only leave if there was a function to begin with
 
-		_current_function->definition = _block_data[_last_block];
+		_current_function->definition = std::move(_block_data[_last_block]);
 
 		// Append function end instruction
 		add_instruction_without_result(spv::OpFunctionEnd, _current_function->definition);
@@ -1960,7 +2113,7 @@ private:
 	}
 };
 
-codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y)
+codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool invert_y, bool optimize)
 {
-	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, invert_y);
+	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, invert_y, optimize);
 }
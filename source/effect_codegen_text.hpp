@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cassert>
+#include <cstdint>
+#include <cstring> // std::memchr
+#include <utility> // std::move
+#include <algorithm> // std::none_of
+
+namespace reshadefx
+{
+	/// <summary>
+	/// A view of the name of a value or definition in generated code.
+	/// Names that were defined explicitly are referenced in place, automatic ones are formatted into a small inline buffer, so resolving a name never allocates.
+	/// </summary>
+	class text_name
+	{
+	public:
+		explicit text_name(const std::string &name) : _data(name.data()), _size(name.size()) { }
+		explicit text_name(uint32_t id) : _data(nullptr), _size(1)
+		{
+			char digits[10];
+			size_t num_digits = 0;
+			do
+				digits[num_digits++] = '0' + (id % 10);
+			while ((id /= 10) != 0);
+
+			_buffer[0] = '_';
+			while (num_digits != 0)
+				_buffer[_size++] = digits[--num_digits];
+		}
+
+		std::string_view view() const { return { _data != nullptr ? _data : _buffer, _size }; }
+
+		operator std::string() const { return std::string(view()); }
+		operator std::string_view() const { return view(); }
+
+	private:
+		const char *_data;
+		size_t _size;
+		char _buffer[12];
+	};
+
+	/// <summary>
+	/// A concatenation of code snippets built by the '+' operators below, which is appended to a block or string in one go without allocating intermediate strings.
+	/// It references its parts in place, so it must not outlive the full expression it was created in.
+	/// </summary>
+	class text_concat
+	{
+	public:
+		text_concat &operator+=(std::string_view text)
+		{
+			if (_num_parts < max_parts && _overflow.empty())
+				_parts[_num_parts++] = { text.data(), text.size() };
+			else
+				_overflow += text;
+			return *this;
+		}
+		text_concat &operator+=(char c)
+		{
+			if (_num_parts < max_parts && _overflow.empty())
+				_parts[_num_parts++] = { nullptr, static_cast<unsigned char>(c) };
+			else
+				_overflow += c;
+			return *this;
+		}
+
+		size_t size() const
+		{
+			size_t size = _overflow.size();
+			for (size_t i = 0; i < _num_parts; ++i)
+				size += _parts[i].data != nullptr ? _parts[i].size : 1;
+			return size;
+		}
+
+		template <typename T>
+		void write(T &s) const
+		{
+			for (size_t i = 0; i < _num_parts; ++i)
+				if (_parts[i].data != nullptr)
+					s.append(_parts[i].data, _parts[i].size);
+				else
+					s.push_back(static_cast<char>(_parts[i].size));
+			s.append(_overflow);
+		}
+
+		operator std::string() const
+		{
+			std::string s;
+			s.reserve(size());
+			write(s);
+			return s;
+		}
+
+	private:
+		static constexpr size_t max_parts = 32;
+
+		// Single characters are stored in the size field of a part with a null data pointer
+		struct part { const char *data; size_t size; } _parts[max_parts];
+		size_t _num_parts = 0;
+		// Parts beyond the fixed limit are copied here (only happens for a few very long intrinsic expansions)
+		std::string _overflow;
+	};
+
+	inline text_concat operator+(std::string_view lhs, const text_name &rhs) { text_concat res; res += lhs; res += rhs.view(); return res; }
+	inline text_concat operator+(const char *lhs, const text_name &rhs) { return std::string_view(lhs) + rhs; }
+	inline text_concat operator+(const std::string &lhs, const text_name &rhs) { return std::string_view(lhs) + rhs; }
+	inline text_concat operator+(const text_name &lhs, const text_name &rhs) { return lhs.view() + rhs; }
+	inline text_concat operator+(char lhs, const text_name &rhs) { text_concat res; res += lhs; res += rhs.view(); return res; }
+	inline text_concat operator+(const text_name &lhs, std::string_view rhs) { text_concat res; res += lhs.view(); res += rhs; return res; }
+	inline text_concat operator+(const text_name &lhs, const char *rhs) { return lhs + std::string_view(rhs); }
+	inline text_concat operator+(const text_name &lhs, const std::string &rhs) { return lhs + std::string_view(rhs); }
+	inline text_concat operator+(const text_name &lhs, char rhs) { text_concat res; res += lhs.view(); res += rhs; return res; }
+
+	inline text_concat &&operator+(text_concat &&lhs, std::string_view rhs) { lhs += rhs; return std::move(lhs); }
+	inline text_concat &&operator+(text_concat &&lhs, const char *rhs) { lhs += std::string_view(rhs); return std::move(lhs); }
+	inline text_concat &&operator+(text_concat &&lhs, const std::string &rhs) { lhs += std::string_view(rhs); return std::move(lhs); }
+	inline text_concat &&operator+(text_concat &&lhs, const text_name &rhs) { lhs += rhs.view(); return std::move(lhs); }
+	inline text_concat &&operator+(text_concat &&lhs, char rhs) { lhs += rhs; return std::move(lhs); }
+
+	inline std::string &operator+=(std::string &lhs, const text_concat &rhs)
+	{
+		lhs.reserve(lhs.size() + rhs.size());
+		rhs.write(lhs);
+		return lhs;
+	}
+
+	/// <summary>
+	/// A block of generated code, stored as a list of segments referencing an append-only text arena that is shared by all blocks of a code generator.
+	/// Nesting a block into another only copies its segment list and indentation is tracked per segment, so text is copied just once, when the final code is written.
+	/// </summary>
+	class text_block
+	{
+	public:
+		explicit text_block(std::string &arena) : _arena(&arena) { }
+
+		bool empty() const { return _segments.empty(); }
+		void clear() { _segments.clear(); }
+
+		text_block &operator+=(std::string_view text)
+		{
+			if (text.empty())
+				return *this;
+			const size_t offset = _arena->size();
+			_arena->append(text);
+			return extend(offset);
+		}
+		text_block &operator+=(const char *text) { return *this += std::string_view(text); }
+		text_block &operator+=(const std::string &text) { return *this += std::string_view(text); }
+		text_block &operator+=(const text_name &name) { return *this += name.view(); }
+		text_block &operator+=(char c) { return *this += std::string_view(&c, 1); }
+		text_block &operator+=(const text_concat &text)
+		{
+			const size_t offset = _arena->size();
+			text.write(*_arena);
+			return offset != _arena->size() ? extend(offset) : *this;
+		}
+		text_block &operator+=(const text_block &block)
+		{
+			assert(block._arena == _arena && &block != this);
+			_segments.insert(_segments.end(), block._segments.begin(), block._segments.end());
+			return *this;
+		}
+
+		/// <summary>
+		/// Indent every line of this block that starts with a tab by one more level, as well as the first line.
+		/// </summary>
+		void increase_indentation_level()
+		{
+			for (size_t i = 0; i < _segments.size(); ++i)
+			{
+				segment &seg = _segments[i];
+				// Lines within a segment are indented when it is written, but the first line depends on what precedes it
+				if (i == 0 || (ends_with_newline(_segments[i - 1]) && (seg.leading_tabs != 0 || starts_with_tab(seg))))
+					seg.leading_tabs++;
+				seg.indentation++;
+			}
+		}
+
+		/// <summary>
+		/// Add a placeholder that is later replaced with the contents of another block via <see cref="replace_placeholders"/>.
+		/// </summary>
+		/// <param name="target">An identifier to select the placeholder by.</param>
+		void add_placeholder(uint32_t target)
+		{
+			_segments.push_back({ target, 0, 0, 0 });
+		}
+		/// <summary>
+		/// Replace all placeholders that were added with the specified identifier with the contents of the specified block.
+		/// </summary>
+		void replace_placeholders(uint32_t target, const text_block &block)
+		{
+			assert(block._arena == _arena && &block != this);
+
+			if (std::none_of(_segments.begin(), _segments.end(), [target](const segment &seg) { return is_placeholder(seg) && seg.offset == target; }))
+				return;
+
+			std::vector<segment> segments;
+			segments.reserve(_segments.size() + block._segments.size());
+
+			uint32_t leading_tabs = 0;
+			for (const segment &seg : _segments)
+			{
+				if (is_placeholder(seg) && seg.offset == target)
+				{
+					// Any indentation added to the placeholder applies to the inserted text instead
+					leading_tabs += seg.leading_tabs;
+					for (segment inserted : block._segments)
+						inserted.leading_tabs += leading_tabs, leading_tabs = 0, segments.push_back(inserted);
+					continue;
+				}
+
+				segments.push_back(seg);
+				segments.back().leading_tabs += leading_tabs;
+				leading_tabs = 0;
+			}
+
+			_segments = std::move(segments);
+		}
+
+		/// <summary>
+		/// Erase the text between the last occurrence of the specified text and the last delimiter character preceding it (used to turn a variable declaration into an assignment).
+		/// </summary>
+		void erase_before_last(std::string_view text, char delimiter)
+		{
+			for (size_t i = _segments.size(); i-- != 0;)
+			{
+				segment &seg = _segments[i];
+				if (is_placeholder(seg))
+					continue;
+
+				const std::string_view seg_text(_arena->data() + seg.offset, seg.length);
+				const size_t pos = seg_text.rfind(text);
+				if (pos == std::string_view::npos)
+					continue;
+
+				// The delimiter may also be one of the tabs added in front of the segment by an indentation change
+				const size_t delimiter_pos = seg_text.rfind(delimiter, pos);
+				assert(delimiter_pos != std::string_view::npos || (delimiter == '\t' && seg.leading_tabs != 0));
+				const size_t erase_begin = delimiter_pos != std::string_view::npos ? delimiter_pos + 1 : 0;
+
+				if (erase_begin == 0)
+				{
+					seg.offset += static_cast<uint32_t>(pos);
+					seg.length -= static_cast<uint32_t>(pos);
+				}
+				else if (erase_begin != pos)
+				{
+					segment tail = seg;
+					tail.offset += static_cast<uint32_t>(pos);
+					tail.length -= static_cast<uint32_t>(pos);
+					tail.leading_tabs = 0;
+					seg.length = static_cast<uint32_t>(erase_begin);
+					_segments.insert(_segments.begin() + i + 1, tail);
+				}
+				return;
+			}
+		}
+
+		/// <summary>
+		/// Calculate the length of the text in this block after indentation was applied.
+		/// </summary>
+		size_t size() const
+		{
+			size_t size = 0;
+			for (const segment &seg : _segments)
+			{
+				size += seg.leading_tabs + seg.length;
+
+				if (seg.indentation != 0 && !is_placeholder(seg))
+					for (const char *it = _arena->data() + seg.offset, *end = it + seg.length - 1; it < end; ++it)
+						if (it[0] == '\n' && it[1] == '\t')
+							size += seg.indentation;
+			}
+			return size;
+		}
+
+		/// <summary>
+		/// Append the text in this block to the specified string, applying indentation.
+		/// </summary>
+		void write(std::string &s) const
+		{
+			for (const segment &seg : _segments)
+			{
+				s.append(seg.leading_tabs, '\t');
+
+				if (is_placeholder(seg))
+					continue;
+
+				const char *it = _arena->data() + seg.offset, *const end = it + seg.length;
+				if (seg.indentation != 0)
+				{
+					for (const char *line_end; it < end && (line_end = static_cast<const char *>(std::memchr(it, '\n', end - it))) != nullptr && line_end + 1 < end; it = line_end + 1)
+					{
+						s.append(it, line_end + 1);
+						if (line_end[1] == '\t')
+							s.append(seg.indentation, '\t');
+					}
+				}
+
+				s.append(it, end);
+			}
+		}
+
+	private:
+		struct segment
+		{
+			// Offset of the text in the arena, or the target identifier of a placeholder
+			uint32_t offset;
+			// Length of the text in the arena, which is zero for placeholders
+			uint32_t length;
+			// Number of tabs to add after every new line in this segment that starts with a tab
+			uint32_t indentation;
+			// Number of tabs to add in front of this segment
+			uint32_t leading_tabs;
+		};
+
+		static bool is_placeholder(const segment &seg) { return seg.length == 0; }
+
+		bool ends_with_newline(const segment &seg) const { return !is_placeholder(seg) && (*_arena)[seg.offset + seg.length - 1] == '\n'; }
+		bool starts_with_tab(const segment &seg) const { return !is_placeholder(seg) && (*_arena)[seg.offset] == '\t'; }
+
+		text_block &extend(size_t offset)
+		{
+			const uint32_t length = static_cast<uint32_t>(_arena->size() - offset);
+
+			// Continue the last segment if it ends right where the new text was added
+			if (!_segments.empty())
+				if (segment &last = _segments.back(); !is_placeholder(last) && last.indentation == 0 && last.offset + last.length == offset)
+					return last.length += length, *this;
+
+			_segments.push_back({ static_cast<uint32_t>(offset), length, 0, 0 });
+			return *this;
+		}
+
+		std::string *_arena;
+		std::vector<segment> _segments;
+	};
+
+	/// <summary>
+	/// A list of the top-level definitions (structs, resources, global variables and functions) in generated code and the definitions each of them references.
+	/// This is used to write only the code that is transitively reachable from an entry point, so that back-end compilers do not have to parse the whole effect for every shader.
+	/// </summary>
+	class text_definitions
+	{
+	public:
+		/// <summary>
+		/// Record that the definition currently being written references the definition with the specified identifier (references to anything else are ignored).
+		/// </summary>
+		void reference(uint32_t id) const
+		{
+			if (const auto it = _lookup.find(id); it != _lookup.end())
+				_pending_references.push_back(it->second);
+		}
+
+		/// <summary>
+		/// Move all code written to the specified block so far into a new definition, together with all references recorded since the last one.
+		/// </summary>
+		/// <param name="id">The identifier other code references this definition by, or zero if there is none.</param>
+		void finish(text_block &code, uint32_t id)
+		{
+			std::sort(_pending_references.begin(), _pending_references.end());
+			_pending_references.erase(std::unique(_pending_references.begin(), _pending_references.end()), _pending_references.end());
+
+			if (id != 0)
+				_lookup.emplace(id, _definitions.size());
+
+			const size_t size = code.size();
+			_definitions.push_back({ std::move(code), size, std::move(_pending_references) });
+
+			code.clear();
+			_pending_references.clear();
+		}
+
+		/// <summary>
+		/// Add a definition without any code for the specified identifier, so that references to it are recorded (e.g. for uniforms, which are written separately into a constant buffer).
+		/// This does not affect the references recorded for the definition currently being written.
+		/// </summary>
+		void add_external(std::string &arena, uint32_t id)
+		{
+			_lookup.emplace(id, _definitions.size());
+			_definitions.push_back({ text_block(arena), 0, {} });
+		}
+
+		/// <summary>
+		/// Add an entry point whose code consists of the definitions that were added since the specified index (see <see cref="size"/>).
+		/// </summary>
+		void add_entry_point(size_t first_definition)
+		{
+			_entry_points.push_back({ first_definition, _definitions.size() });
+		}
+		/// <summary>
+		/// Add an entry point whose code consists of the definition with the specified identifier.
+		/// </summary>
+		void add_entry_point_function(uint32_t id)
+		{
+			const size_t index = _lookup.at(id);
+			_entry_points.push_back({ index, index + 1 });
+		}
+
+		/// <summary>
+		/// Get the number of definitions that were added so far.
+		/// </summary>
+		size_t size() const { return _definitions.size(); }
+
+		/// <summary>
+		/// Append the code of all definitions to the specified string.
+		/// </summary>
+		void write(std::string &s) const
+		{
+			size_t total_size = s.size();
+			for (const definition &def : _definitions)
+				total_size += def.size;
+			s.reserve(total_size);
+
+			for (const definition &def : _definitions)
+				def.code.write(s);
+		}
+		/// <summary>
+		/// Get which definitions the specified entry point transitively references, indexed in the order they were added.
+		/// </summary>
+		/// <param name="entry_point">The index of the entry point, in the order they were added.</param>
+		std::vector<bool> reachable(size_t entry_point) const
+		{
+			std::vector<bool> reachable(_definitions.size());
+			std::vector<size_t> stack;
+			for (size_t i = _entry_points[entry_point].first; i < _entry_points[entry_point].second; ++i)
+				reachable[i] = true, stack.push_back(i);
+
+			while (!stack.empty())
+			{
+				const size_t index = stack.back();
+				stack.pop_back();
+
+				for (const size_t referenced : _definitions[index].references)
+					if (!reachable[referenced])
+						reachable[referenced] = true, stack.push_back(referenced);
+			}
+
+			return reachable;
+		}
+		/// <summary>
+		/// Check whether the definition with the specified identifier is marked in a list returned by <see cref="reachable"/>.
+		/// </summary>
+		bool is_reachable(const std::vector<bool> &reachable, uint32_t id) const
+		{
+			const auto it = _lookup.find(id);
+			return it != _lookup.end() && reachable[it->second];
+		}
+
+		/// <summary>
+		/// Append the code of the definitions that are marked in a list returned by <see cref="reachable"/> to the specified string, in the order they were added.
+		/// </summary>
+		void write(std::string &s, const std::vector<bool> &reachable) const
+		{
+			size_t total_size = s.size();
+			for (size_t i = 0; i < _definitions.size(); ++i)
+				if (reachable[i])
+					total_size += _definitions[i].size;
+			s.reserve(total_size);
+
+			for (size_t i = 0; i < _definitions.size(); ++i)
+				if (reachable[i])
+					_definitions[i].code.write(s);
+		}
+
+	private:
+		struct definition
+		{
+			text_block code;
+			size_t size;
+			// Indices of the definitions this one references, which always precede it
+			std::vector<size_t> references;
+		};
+
+		std::vector<definition> _definitions;
+		std::vector<std::pair<size_t, size_t>> _entry_points;
+		std::unordered_map<uint32_t, size_t> _lookup;
+		// References are recorded while names are resolved, which happens in const methods of the code generators
+		mutable std::vector<size_t> _pending_references;
+	};
+}
@@ -96,6 +96,42 @@ std::string reshadefx::type::description() const
 	return result;
 }
 
+uint32_t *reshadefx::constant_array::mutable_data()
+{
+	if (_data == nullptr)
+		return nullptr;
+
+	// Other constants may still reference the same storage, so need to make a copy before modifying it
+	if (_data.use_count() > 1)
+		_data = std::make_shared<std::vector<uint32_t>>(*_data);
+
+	return _data->data();
+}
+
+reshadefx::constant reshadefx::constant_array::operator[](size_t index) const
+{
+	assert(index < _size);
+
+	constant element = {};
+	if (_stride != 0)
+		std::memcpy(element.as_uint, _data->data() + index * _stride, _stride * sizeof(uint32_t));
+	return element;
+}
+
+void reshadefx::constant_array::push_back(const constant &element, unsigned int components)
+{
+	assert(components <= 16 && (_size == 0 || components == _stride));
+
+	if (_data == nullptr)
+		_data = std::make_shared<std::vector<uint32_t>>();
+	else if (_data.use_count() > 1)
+		_data = std::make_shared<std::vector<uint32_t>>(*_data);
+
+	_data->insert(_data->end(), element.as_uint, element.as_uint + components);
+	_stride = components;
+	_size++;
+}
+
 void reshadefx::expression::reset_to_lvalue(const reshadefx::location &loc, uint32_t in_base, const reshadefx::type &in_type)
 {
 	type = in_type;
@@ -211,8 +247,20 @@ void reshadefx::expression::add_cast_operation(const reshadefx::type &cast_type)
 					constant.as_float[i] = static_cast<float>(constant.as_int[i]);
 		};
 
-		for (auto &element : constant.array_data)
-			cast_constant(element, type, cast_type);
+		// Only need to touch array elements if their values actually change, to avoid copying storage shared with other constants
+		if (!constant.array_data.empty() && type.base != cast_type.base && type.is_floating_point() != cast_type.is_floating_point())
+		{
+			const unsigned int stride = constant.array_data.stride();
+			uint32_t *const data = constant.array_data.mutable_data();
+
+			for (size_t i = 0; i < constant.array_data.size(); ++i)
+			{
+				reshadefx::constant element;
+				std::memcpy(element.as_uint, data + i * stride, stride * sizeof(uint32_t));
+				cast_constant(element, type, cast_type);
+				std::memcpy(data + i * stride, element.as_uint, stride * sizeof(uint32_t));
+			}
+		}
 
 		cast_constant(constant, type, cast_type);
 	}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <memory> // std::shared_ptr
 
 namespace reshadefx
 {
@@ -94,6 +95,56 @@ namespace reshadefx
 		uint32_t definition = 0; // ID of the matching struct if this is a struct type
 	};
 
+	/// <summary>
+	/// Flat storage for the elements of an array constant, which is shared between copies until one of them is modified
+	/// </summary>
+	class constant_array
+	{
+	public:
+		bool empty() const { return _size == 0; }
+		size_t size() const { return _size; }
+
+		/// <summary>
+		/// Get the number of values each element takes up in the flat storage.
+		/// </summary>
+		unsigned int stride() const { return _stride; }
+
+		/// <summary>
+		/// Get the values of all elements, with each element taking up <see cref="stride"/> values.
+		/// </summary>
+		const uint32_t *data() const { return _data != nullptr ? _data->data() : nullptr; }
+		/// <summary>
+		/// Get the values of all elements for modification, which creates a separate copy first if the storage is currently shared.
+		/// </summary>
+		uint32_t *mutable_data();
+
+		/// <summary>
+		/// Get a copy of the element at the specified <paramref name="index"/>.
+		/// </summary>
+		struct constant operator[](size_t index) const;
+
+		/// <summary>
+		/// Append an element to the end of the array.
+		/// </summary>
+		/// <param name="element">The constant to take the element values from.</param>
+		/// <param name="components">The number of values in the element. This has to be the same for all elements.</param>
+		void push_back(const struct constant &element, unsigned int components);
+
+		friend inline bool operator==(const constant_array &lhs, const constant_array &rhs)
+		{
+			return lhs._size == rhs._size && lhs._stride == rhs._stride && (lhs._data == rhs._data || (lhs._data != nullptr && rhs._data != nullptr && *lhs._data == *rhs._data));
+		}
+		friend inline bool operator!=(const constant_array &lhs, const constant_array &rhs)
+		{
+			return !operator==(lhs, rhs);
+		}
+
+	private:
+		size_t _size = 0;
+		unsigned int _stride = 0;
+		std::shared_ptr<std::vector<uint32_t>> _data;
+	};
+
 	/// <summary>
 	/// Structure which encapsulates a parsed constant value
 	/// </summary>
@@ -109,7 +160,7 @@ namespace reshadefx
 		// Optional string associated with this constant
 		std::string string_data = {};
 		// Optional additional elements if this is an array constant
-		std::vector<constant> array_data = {};
+		constant_array array_data = {};
 	};
 
 	/// <summary>
@@ -134,13 +185,60 @@ namespace reshadefx
 			signed char swizzle[4] = {};
 		};
 
+		/// <summary>
+		/// List of operations which stores short chains inline and only allocates for chains longer than that
+		/// </summary>
+		class access_chain
+		{
+		public:
+			bool empty() const { return _size == 0; }
+			size_t size() const { return _size; }
+
+			operation *begin() { return _size > INLINE_CAPACITY ? _overflow.data() : _inline; }
+			operation *end() { return begin() + _size; }
+			const operation *begin() const { return _size > INLINE_CAPACITY ? _overflow.data() : _inline; }
+			const operation *end() const { return begin() + _size; }
+
+			operation &operator[](size_t index) { return begin()[index]; }
+			const operation &operator[](size_t index) const { return begin()[index]; }
+
+			void push_back(const operation &op)
+			{
+				if (_size < INLINE_CAPACITY)
+				{
+					_inline[_size++] = op;
+					return;
+				}
+
+				// Move all operations to the overflow storage once the inline storage is exhausted
+				if (_size == INLINE_CAPACITY)
+					_overflow.assign(_inline, _inline + INLINE_CAPACITY);
+
+				_overflow.push_back(op);
+				_size++;
+			}
+
+			void clear()
+			{
+				_size = 0;
+				_overflow.clear();
+			}
+
+		private:
+			static constexpr size_t INLINE_CAPACITY = 4;
+
+			size_t _size = 0;
+			operation _inline[INLINE_CAPACITY];
+			std::vector<operation> _overflow;
+		};
+
 		uint32_t base = 0;
 		reshadefx::type type = {};
 		reshadefx::constant constant = {};
 		bool is_lvalue = false;
 		bool is_constant = false;
 		reshadefx::location location;
-		std::vector<operation> chain;
+		access_chain chain;
 
 		/// <summary>
 		/// Initialize the expression to a l-value.
@@ -5,6 +5,17 @@
 
 #include "effect_lexer.hpp"
 #include <unordered_map> // Used for static lookup tables
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h> // Used for SIMD scanning kernels
+#define SCAN_KERNELS_X86 1
+#define SCAN_KERNELS_TARGET_AVX2
+#elif (defined(__i386__) || defined(__x86_64__)) && defined(__SSE2__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SCAN_KERNELS_X86 1
+// GCC and Clang only allow AVX2 intrinsics in functions that are compiled for it
+#define SCAN_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
 using namespace reshadefx;
 
@@ -159,7 +170,62 @@ static const std::unordered_map<tokenid, std::string> token_lookup = {
 	{ tokenid::texture, "texture" },
 	{ tokenid::sampler, "sampler" },
 };
-static const std::unordered_map<std::string, tokenid> keyword_lookup = {
+
+// Compile-time generated hash tables which translate a given identifier to a keyword token
+// Looking up an identifier only costs hashing it and a few string comparisons, without any allocations
+struct keyword_entry
+{
+	std::string_view name;
+	tokenid id = tokenid::unknown;
+};
+
+static constexpr uint32_t hash_keyword(std::string_view name)
+{
+	// FNV-1a hash
+	uint32_t hash = 2166136261u;
+	for (const char c : name)
+		hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+	return hash;
+}
+
+template <size_t TABLE_SIZE>
+class keyword_table
+{
+	static_assert((TABLE_SIZE & (TABLE_SIZE - 1)) == 0, "table size has to be a power of two");
+
+public:
+	template <size_t N>
+	constexpr keyword_table(const keyword_entry (&entries)[N]) : _slots()
+	{
+		static_assert(N * 2 <= TABLE_SIZE, "table size is too small for the amount of entries");
+
+		for (size_t i = 0; i < N; ++i)
+		{
+			// Resolve collisions with linear probing (the load factor is kept low enough so that this rarely happens)
+			size_t slot = hash_keyword(entries[i].name) & (TABLE_SIZE - 1);
+			while (!_slots[slot].name.empty())
+				slot = (slot + 1) & (TABLE_SIZE - 1);
+			_slots[slot] = entries[i];
+		}
+	}
+
+	/// <summary>
+	/// Look up the token associated with the specified identifier.
+	/// </summary>
+	/// <returns>The token of the keyword or <see cref="tokenid::unknown"/> if the identifier is not in this table.</returns>
+	constexpr tokenid find(std::string_view name) const
+	{
+		for (size_t slot = hash_keyword(name) & (TABLE_SIZE - 1); !_slots[slot].name.empty(); slot = (slot + 1) & (TABLE_SIZE - 1))
+			if (_slots[slot].name == name)
+				return _slots[slot].id;
+		return tokenid::unknown;
+	}
+
+private:
+	keyword_entry _slots[TABLE_SIZE];
+};
+
+static constexpr keyword_entry keyword_entries[] = {
 	{ "asm", tokenid::reserved },
 	{ "asm_fragment", tokenid::reserved },
 	{ "auto", tokenid::reserved },
@@ -322,7 +388,7 @@ static const std::unordered_map<std::string, tokenid> keyword_lookup = {
 	{ "volatile", tokenid::volatile_ },
 	{ "while", tokenid::while_ }
 };
-static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+static constexpr keyword_entry pp_directive_entries[] = {
 	{ "define", tokenid::hash_def },
 	{ "undef", tokenid::hash_undef },
 	{ "if", tokenid::hash_if },
@@ -337,6 +403,12 @@ static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
 	{ "include", tokenid::hash_include },
 };
 
+static constexpr keyword_table<512> keyword_lookup(keyword_entries);
+static constexpr keyword_table<32> pp_directive_lookup(pp_directive_entries);
+
+static_assert(keyword_lookup.find("float4x4") == tokenid::float4x4 && keyword_lookup.find("float5") == tokenid::unknown);
+static_assert(pp_directive_lookup.find("include") == tokenid::hash_include && pp_directive_lookup.find("line") == tokenid::unknown);
+
 static inline bool is_octal_digit(char c)
 {
 	return static_cast<unsigned>(c - '0') < 8;
@@ -385,6 +457,390 @@ static long long octal_to_decimal(long long n)
 	return n;
 }
 
+// Walk the contents of a string literal (starting after the opening quote) and return a pointer to the character that terminated it
+// The value of the string literal is only built if an output string is provided
+static const char *scan_string_literal(const char *end, const char *const input_end, bool escape, unsigned int &num_continuations, std::string *value)
+{
+	for (auto c = *end; c != '"'; c = *++end)
+	{
+		if (c == '\n' || end >= input_end)
+		{
+			// Line feed reached, the string literal is done
+			break;
+		}
+
+		if (c == '\r')
+		{
+			// Silently ignore carriage return characters
+			continue;
+		}
+
+		if (unsigned int n = (end[1] == '\r' && end + 2 < input_end) ? 2 : 1;
+			c == '\\' && end[n] == '\n')
+		{
+			// Escape character found at end of line, the string literal continues on to the next line
+			end += n;
+			num_continuations++;
+			continue;
+		}
+
+		// Handle escape sequences
+		if (c == '\\' && escape)
+		{
+			unsigned int n = 0;
+
+			// Any character following the '\' is not parsed as usual, so increment pointer here (this makes sure '\"' does not abort the outer loop as well)
+			switch (c = *++end)
+			{
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+				for (unsigned int i = 0; i < 3 && is_octal_digit(*end) && end < input_end; i++)
+				{
+					c = *end++;
+					n = (n << 3) | (c - '0');
+				}
+				// For simplicity the number is limited to what fits in a single character
+				c = n & 0xFF;
+				// The octal parsing loop above incremented one pass the escape sequence, so step back
+				end--;
+				break;
+			case 'a':
+				c = '\a';
+				break;
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'v':
+				c = '\v';
+				break;
+			case 'x':
+				if (is_hexadecimal_digit(*++end))
+				{
+					while (is_hexadecimal_digit(*end) && end < input_end)
+					{
+						c = *end++;
+						n = (n << 4) | (is_decimal_digit(c) ? (c - '0') : (c - 55 - 32 * (c & 0x20)));
+					}
+
+					// For simplicity the number is limited to what fits in a single character
+					c = n & 0xFF;
+				}
+				// The hexadecimal parsing loop and check above incremented one pass the escape sequence, so step back
+				end--;
+				break;
+			}
+		}
+
+		if (value != nullptr)
+			*value += c;
+	}
+
+	return end;
+}
+
+// Scanning kernels which find the end of character runs the lexer skips over in bulk (whitespace, comments and identifiers)
+// Each kernel returns a pointer to the first character not part of the run, or the end of the input
+// The SIMD variants process 16 (SSE2) or 32 (AVX2) characters at once and fall back to the scalar variant for the remaining tail
+static const char *scan_space_scalar(const char *cur, const char *end)
+{
+	while (cur < end && type_lookup[uint8_t(*cur)] == SPACE)
+		cur++;
+	return cur;
+}
+static const char *scan_line_end_scalar(const char *cur, const char *end)
+{
+	while (cur < end && *cur != '\n')
+		cur++;
+	return cur;
+}
+static const char *scan_comment_end_scalar(const char *cur, const char *end, unsigned int &num_lines)
+{
+	// Returns a pointer to the '*' of the closing "*/" sequence and counts the line feeds before it
+	for (; cur < end; cur++)
+	{
+		if (*cur == '\n')
+			num_lines++;
+		else if (cur[0] == '*' && cur[1] == '/')
+			return cur;
+	}
+	return end;
+}
+static const char *scan_identifier_scalar(const char *cur, const char *end)
+{
+	while (cur < end && (type_lookup[uint8_t(*cur)] == IDENT || type_lookup[uint8_t(*cur)] == DIGIT))
+		cur++;
+	return cur;
+}
+
+#ifdef SCAN_KERNELS_X86
+static inline unsigned int count_bits(uint32_t mask)
+{
+	// Not using the POPCNT instruction here, since it is not guaranteed to be available together with SSE2
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+static inline unsigned int first_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static const char *scan_space_sse2(const char *cur, const char *end)
+{
+	const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), line_feed = _mm_set1_epi8('\n'), four = _mm_set1_epi8(4);
+
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		// The control characters '\t', '\n', '\v', '\f' and '\r' map to 0 to 4 after subtracting '\t', of which all but '\n' are whitespace
+		const __m128i control = _mm_sub_epi8(c, tab);
+		const __m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_andnot_si128(_mm_cmpeq_epi8(c, line_feed), _mm_cmpeq_epi8(_mm_min_epu8(control, four), control)));
+
+		if (const uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(is_space)) & 0xFFFF)
+			return cur + first_bit(mask);
+	}
+
+	return scan_space_scalar(cur, end);
+}
+static const char *scan_line_end_sse2(const char *cur, const char *end)
+{
+	const __m128i line_feed = _mm_set1_epi8('\n');
+
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+
+		if (const uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(c, line_feed)))
+			return cur + first_bit(mask);
+	}
+
+	return scan_line_end_scalar(cur, end);
+}
+static const char *scan_comment_end_sse2(const char *cur, const char *end, unsigned int &num_lines)
+{
+	const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/'), line_feed = _mm_set1_epi8('\n');
+
+	// Compare against the characters at the current position and the one after it, so need one additional character of input
+	for (; end - cur >= 17; cur += 16)
+	{
+		const __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		const __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + 1));
+
+		const uint32_t line_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(c0, line_feed));
+		if (const uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(c0, star), _mm_cmpeq_epi8(c1, slash))))
+		{
+			const unsigned int index = first_bit(mask);
+			num_lines += count_bits(line_mask & ((1u << index) - 1));
+			return cur + index;
+		}
+
+		num_lines += count_bits(line_mask);
+	}
+
+	return scan_comment_end_scalar(cur, end, num_lines);
+}
+static const char *scan_identifier_sse2(const char *cur, const char *end)
+{
+	const __m128i lower_a = _mm_set1_epi8('a'), zero = _mm_set1_epi8('0'), underscore = _mm_set1_epi8('_'), case_bit = _mm_set1_epi8(0x20), nine = _mm_set1_epi8(9), twenty_five = _mm_set1_epi8(25);
+
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		// Identifiers consist of [A-Za-z0-9_], so fold upper case letters to lower case and do unsigned range checks for letters and digits
+		const __m128i letter = _mm_sub_epi8(_mm_or_si128(c, case_bit), lower_a);
+		const __m128i digit = _mm_sub_epi8(c, zero);
+		const __m128i is_identifier = _mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(_mm_min_epu8(letter, twenty_five), letter),
+			_mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit)),
+			_mm_cmpeq_epi8(c, underscore));
+
+		if (const uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(is_identifier)) & 0xFFFF)
+			return cur + first_bit(mask);
+	}
+
+	return scan_identifier_scalar(cur, end);
+}
+
+SCAN_KERNELS_TARGET_AVX2 static const char *scan_space_avx2(const char *cur, const char *end)
+{
+	const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), line_feed = _mm256_set1_epi8('\n'), four = _mm256_set1_epi8(4);
+
+	for (; end - cur >= 32; cur += 32)
+	{
+		const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur));
+		const __m256i control = _mm256_sub_epi8(c, tab);
+		const __m256i is_space = _mm256_or_si256(_mm256_cmpeq_epi8(c, space), _mm256_andnot_si256(_mm256_cmpeq_epi8(c, line_feed), _mm256_cmpeq_epi8(_mm256_min_epu8(control, four), control)));
+
+		if (const uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(is_space)))
+			return cur + first_bit(mask);
+	}
+
+	return scan_space_sse2(cur, end);
+}
+SCAN_KERNELS_TARGET_AVX2 static const char *scan_line_end_avx2(const char *cur, const char *end)
+{
+	const __m256i line_feed = _mm256_set1_epi8('\n');
+
+	for (; end - cur >= 32; cur += 32)
+	{
+		const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur));
+
+		if (const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, line_feed)))
+			return cur + first_bit(mask);
+	}
+
+	return scan_line_end_sse2(cur, end);
+}
+SCAN_KERNELS_TARGET_AVX2 static const char *scan_comment_end_avx2(const char *cur, const char *end, unsigned int &num_lines)
+{
+	const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/'), line_feed = _mm256_set1_epi8('\n');
+
+	for (; end - cur >= 33; cur += 32)
+	{
+		const __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur));
+		const __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur + 1));
+
+		const uint32_t line_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c0, line_feed));
+		if (const uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(c0, star), _mm256_cmpeq_epi8(c1, slash))))
+		{
+			const unsigned int index = first_bit(mask);
+			num_lines += count_bits(line_mask & ((1u << index) - 1));
+			return cur + index;
+		}
+
+		num_lines += count_bits(line_mask);
+	}
+
+	return scan_comment_end_sse2(cur, end, num_lines);
+}
+#endif
+
+struct scan_kernels
+{
+	const char *(*scan_space)(const char *cur, const char *end);
+	const char *(*scan_line_end)(const char *cur, const char *end);
+	const char *(*scan_comment_end)(const char *cur, const char *end, unsigned int &num_lines);
+	const char *(*scan_identifier)(const char *cur, const char *end);
+};
+
+// Indexed by 'lexer::scan_kernel_set'
+static const scan_kernels s_scan_kernel_sets[] = {
+	{ scan_space_scalar, scan_line_end_scalar, scan_comment_end_scalar, scan_identifier_scalar },
+#ifdef SCAN_KERNELS_X86
+	{ scan_space_sse2, scan_line_end_sse2, scan_comment_end_sse2, scan_identifier_sse2 },
+	// Identifiers are usually shorter than 16 characters, so the wider AVX2 kernel would only waste work for those
+	{ scan_space_avx2, scan_line_end_avx2, scan_comment_end_avx2, scan_identifier_sse2 },
+#endif
+};
+
+static const lexer::scan_kernel_set s_supported_scan_kernels = []() {
+#ifdef SCAN_KERNELS_X86
+	int cpu_info[4];
+#ifdef _MSC_VER
+	__cpuid(cpu_info, 0);
+#else
+	__cpuid(0, cpu_info[0], cpu_info[1], cpu_info[2], cpu_info[3]);
+#endif
+	const int max_function_id = cpu_info[0];
+#ifdef _MSC_VER
+	__cpuid(cpu_info, 1);
+#else
+	__cpuid(1, cpu_info[0], cpu_info[1], cpu_info[2], cpu_info[3]);
+#endif
+	const bool has_sse2 = (cpu_info[3] & (1 << 26)) != 0;
+	// AVX2 needs the OS to save the YMM registers (OSXSAVE and AVX bits set and XCR0 enabling SSE and AVX state)
+	bool has_avx = (cpu_info[2] & (1 << 27)) != 0 && (cpu_info[2] & (1 << 28)) != 0;
+	if (has_avx)
+	{
+#ifdef _MSC_VER
+		has_avx = (_xgetbv(0) & 0x6) == 0x6;
+#else
+		unsigned int xcr0_low, xcr0_high;
+		__asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+		has_avx = (xcr0_low & 0x6) == 0x6;
+#endif
+	}
+	bool has_avx2 = false;
+	if (has_avx && max_function_id >= 7)
+	{
+#ifdef _MSC_VER
+		__cpuidex(cpu_info, 7, 0);
+#else
+		__cpuid_count(7, 0, cpu_info[0], cpu_info[1], cpu_info[2], cpu_info[3]);
+#endif
+		has_avx2 = (cpu_info[1] & (1 << 5)) != 0;
+	}
+
+	if (has_avx2)
+		return lexer::scan_kernel_set::avx2;
+	if (has_sse2)
+		return lexer::scan_kernel_set::sse2;
+#endif
+	return lexer::scan_kernel_set::scalar;
+}();
+
+static lexer::scan_kernel_set s_active_scan_kernels = s_supported_scan_kernels;
+static scan_kernels s_scan_kernels = s_scan_kernel_sets[static_cast<size_t>(s_supported_scan_kernels)];
+
+lexer::scan_kernel_set reshadefx::lexer::supported_scan_kernels()
+{
+	return s_supported_scan_kernels;
+}
+lexer::scan_kernel_set reshadefx::lexer::active_scan_kernels()
+{
+	return s_active_scan_kernels;
+}
+bool reshadefx::lexer::select_scan_kernels(scan_kernel_set kernels)
+{
+	// Each instruction set level includes the ones below it
+	if (kernels > s_supported_scan_kernels)
+		return false;
+
+	s_active_scan_kernels = kernels;
+	s_scan_kernels = s_scan_kernel_sets[static_cast<size_t>(kernels)];
+	return true;
+}
+
+// Most whitespace runs and identifiers are only a few characters long, so handle those inline and only call into a kernel for longer ones
+static inline const char *scan_space(const char *cur, const char *end)
+{
+	for (unsigned int i = 0; i < 4; ++i, ++cur)
+		if (cur >= end || type_lookup[uint8_t(*cur)] != SPACE)
+			return cur;
+	return s_scan_kernels.scan_space(cur, end);
+}
+static inline const char *scan_identifier(const char *cur, const char *end)
+{
+	for (unsigned int i = 0; i < 8; ++i, ++cur)
+		if (cur >= end || (type_lookup[uint8_t(*cur)] != IDENT && type_lookup[uint8_t(*cur)] != DIGIT))
+			return cur;
+	return s_scan_kernels.scan_identifier(cur, end);
+}
+
 std::string reshadefx::token::id_to_name(tokenid id)
 {
 	const auto it = token_lookup.find(id);
@@ -393,18 +849,32 @@ std::string reshadefx::token::id_to_name(tokenid id)
 	return "unknown";
 }
 
+std::string reshadefx::token::unescape_literal() const
+{
+	std::string value;
+	value.reserve(literal_as_string.size());
+	unsigned int num_continuations = 0;
+	scan_string_literal(literal_as_string.data(), literal_as_string.data() + literal_as_string.size(), escape_literal, num_continuations, &value);
+	return value;
+}
+
 reshadefx::token reshadefx::lexer::lex()
 {
 	bool is_at_line_begin = _cur_location.column <= 1;
 
 	token tok;
 next_token:
+	// The line map can change the location in the middle of a line too (where compact preprocessor output collapsed whitespace), so check it before every token
+	if (_line_map != nullptr && _line_map_index < _line_map->entries.size() && _line_map->entries[_line_map_index].offset <= static_cast<size_t>(_cur - _input->data()))
+		apply_line_map();
+
 	// Reset token data
 	tok.location = _cur_location;
-	tok.offset = _cur - _input.data();
+	tok.offset = _cur - _input->data();
 	tok.length = 1;
 	tok.literal_as_double = 0;
-	tok.literal_as_string.clear();
+	tok.literal_as_string = {};
+	tok.escape_literal = false;
 
 	// Do a character type lookup for the current character
 	switch (type_lookup[uint8_t(*_cur)])
@@ -417,7 +887,7 @@ next_token:
 		if (_ignore_whitespace || is_at_line_begin || *_cur == '\n')
 			goto next_token;
 		tok.id = tokenid::space;
-		tok.length = _cur - _input.data() - tok.offset;
+		tok.length = _cur - _input->data() - tok.offset;
 		return tok;
 	case '\n':
 		_cur++;
@@ -531,29 +1001,35 @@ next_token:
 			if (_ignore_comments)
 				goto next_token;
 			tok.id = tokenid::single_line_comment;
-			tok.length = _cur - _input.data() - tok.offset;
+			tok.length = _cur - _input->data() - tok.offset;
 			return tok;
 		}
 		else if (_cur[1] == '*')
 		{
-			while (_cur < _end)
+			unsigned int num_lines = 0;
+			const char *const comment_end = s_scan_kernels.scan_comment_end(_cur + 1, _end, num_lines);
+			const char *const next = comment_end < _end ? comment_end + 2 : _end;
+
+			if (num_lines != 0)
 			{
-				if (*_cur == '\n')
-				{
-					_cur_location.line++;
-					_cur_location.column = 1;
-				}
-				else if (_cur[0] == '*' && _cur[1] == '/')
-				{
-					skip(2);
-					break;
-				}
-				skip(1);
+				// Column is counted from the last line feed in the comment, including that line feed
+				const char *line_feed = comment_end;
+				while (*line_feed != '\n')
+					line_feed--;
+
+				_cur_location.line += num_lines;
+				_cur_location.column = static_cast<unsigned int>(next - line_feed) + 1;
+			}
+			else
+			{
+				_cur_location.column += static_cast<unsigned int>(next - _cur);
 			}
+
+			_cur = next;
 			if (_ignore_comments)
 				goto next_token;
 			tok.id = tokenid::multi_line_comment;
-			tok.length = _cur - _input.data() - tok.offset;
+			tok.length = _cur - _input->data() - tok.offset;
 			return tok;
 		}
 		else if (_cur[1] == '=')
@@ -666,34 +1142,45 @@ void reshadefx::lexer::skip(size_t length)
 void reshadefx::lexer::skip_space()
 {
 	// Skip each character until a space is found
-	while (type_lookup[uint8_t(*_cur)] == SPACE && _cur < _end)
-		skip(1);
+	skip(scan_space(_cur, _end) - _cur);
 }
 void reshadefx::lexer::skip_to_next_line()
 {
 	// Skip each character until a new line feed is found
-	while (*_cur != '\n' && _cur < _end)
-		skip(1);
+	skip(s_scan_kernels.scan_line_end(_cur, _end) - _cur);
+}
+void reshadefx::lexer::apply_line_map()
+{
+	const size_t offset = _cur - _input->data();
+
+	// Entries are sorted by offset and the input is processed front to back, so only ever need to look at the next one
+	for (; _line_map_index < _line_map->entries.size() && _line_map->entries[_line_map_index].offset <= offset; ++_line_map_index)
+	{
+		const source_line_map::entry &entry = _line_map->entries[_line_map_index];
+		_cur_location.line = entry.location.line;
+		_cur_location.source_id = entry.location.source_id;
+		// Continue counting columns from the entry, in case it is not exactly at the start of a token
+		_cur_location.column = entry.location.column + static_cast<unsigned int>(offset - entry.offset);
+	}
 }
 
 void reshadefx::lexer::parse_identifier(token &tok) const
 {
-	auto *const begin = _cur, *end = begin;
+	auto *const begin = _cur;
 
 	// Skip to the end of the identifier sequence
-	do end++; while (type_lookup[uint8_t(*end)] == IDENT || type_lookup[uint8_t(*end)] == DIGIT);
+	auto *const end = scan_identifier(begin + 1, _end);
 
 	tok.id = tokenid::identifier;
-	tok.offset = begin - _input.data();
+	tok.offset = begin - _input->data();
 	tok.length = end - begin;
-	tok.literal_as_string.assign(begin, end);
+	tok.literal_as_string = std::string_view(begin, tok.length);
 
 	if (_ignore_keywords)
 		return;
 
-	const auto it = keyword_lookup.find(tok.literal_as_string);
-	if (it != keyword_lookup.end())
-		tok.id = it->second;
+	if (const tokenid id = keyword_lookup.find(tok.literal_as_string); id != tokenid::unknown)
+		tok.id = id;
 }
 bool reshadefx::lexer::parse_pp_directive(token &tok)
 {
@@ -701,10 +1188,9 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 	skip_space(); // Skip any space between the '#' and directive
 	parse_identifier(tok);
 
-	const auto it = pp_directive_lookup.find(tok.literal_as_string);
-	if (it != pp_directive_lookup.end())
+	if (const tokenid id = pp_directive_lookup.find(tok.literal_as_string); id != tokenid::unknown)
 	{
-		tok.id = it->second;
+		tok.id = id;
 		return true;
 	}
 	else if (!_ignore_line_directives && tok.literal_as_string == "line") // The #line directive needs special handling
@@ -728,7 +1214,9 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 			token temptok;
 			parse_string_literal(temptok, false);
 
-			_cur_location.source = std::move(temptok.literal_as_string);
+			// File names can only be tracked if there is a table to add them to
+			if (_source_files != nullptr)
+				_cur_location.source_id = _source_files->intern(temptok.unescape_literal());
 		}
 
 		// Do not return the #line directive as token to the caller
@@ -741,103 +1229,26 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 }
 void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 {
-	auto *const begin = _cur, *end = begin + 1; // Skip first quote character right away
+	auto *const begin = _cur;
 
-	for (auto c = *end; c != '"'; c = *++end)
-	{
-		if (c == '\n' || end >= _end)
-		{
-			// Line feed reached, the string literal is done (technically this should be an error, but the lexer does not report errors, so ignore it)
-			end--;
-			if (end[0] == '\r') end--;
-			break;
-		}
+	// Only find the end of the string literal here, its value is created on demand from the raw contents (see 'token::unescape_literal')
+	unsigned int num_continuations = 0;
+	auto *end = scan_string_literal(begin + 1, _end, escape, num_continuations, nullptr);
 
-		if (c == '\r')
-		{
-			// Silently ignore carriage return characters
-			continue;
-		}
-
-		if (unsigned int n = (end[1] == '\r' && end + 2 < _end) ? 2 : 1;
-			c == '\\' && end[n] == '\n')
-		{
-			// Escape character found at end of line, the string literal continues on to the next line
-			end += n;
-			_cur_location.line++;
-			continue;
-		}
-
-		// Handle escape sequences
-		if (c == '\\' && escape)
-		{
-			unsigned int n = 0;
-
-			// Any character following the '\' is not parsed as usual, so increment pointer here (this makes sure '\"' does not abort the outer loop as well)
-			switch (c = *++end)
-			{
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-				for (unsigned int i = 0; i < 3 && is_octal_digit(*end) && end < _end; i++)
-				{
-					c = *end++;
-					n = (n << 3) | (c - '0');
-				}
-				// For simplicity the number is limited to what fits in a single character
-				c = n & 0xFF;
-				// The octal parsing loop above incremented one pass the escape sequence, so step back
-				end--;
-				break;
-			case 'a':
-				c = '\a';
-				break;
-			case 'b':
-				c = '\b';
-				break;
-			case 'f':
-				c = '\f';
-				break;
-			case 'n':
-				c = '\n';
-				break;
-			case 'r':
-				c = '\r';
-				break;
-			case 't':
-				c = '\t';
-				break;
-			case 'v':
-				c = '\v';
-				break;
-			case 'x':
-				if (is_hexadecimal_digit(*++end))
-				{
-					while (is_hexadecimal_digit(*end) && end < _end)
-					{
-						c = *end++;
-						n = (n << 4) | (is_decimal_digit(c) ? (c - '0') : (c - 55 - 32 * (c & 0x20)));
-					}
-
-					// For simplicity the number is limited to what fits in a single character
-					c = n & 0xFF;
-				}
-				// The hexadecimal parsing loop and check above incremented one pass the escape sequence, so step back
-				end--;
-				break;
-			}
-		}
+	tok.id = tokenid::string_literal;
+	tok.literal_as_string = std::string_view(begin + 1, end - (begin + 1));
+	tok.escape_literal = escape;
 
-		tok.literal_as_string += c;
+	if (*end != '"')
+	{
+		// Line feed reached, the string literal is done (technically this should be an error, but the lexer does not report errors, so ignore it)
+		end--;
+		if (end[0] == '\r') end--;
 	}
 
-	tok.id = tokenid::string_literal;
 	tok.length = end - begin + 1;
+
+	_cur_location.line += num_continuations;
 }
 void reshadefx::lexer::parse_numeric_literal(token &tok) const
 {
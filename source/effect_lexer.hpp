@@ -6,6 +6,7 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <memory> // std::shared_ptr
 
 namespace reshadefx
 {
@@ -23,9 +24,28 @@ namespace reshadefx
 			bool ignore_line_directives = false,
 			bool ignore_keywords = false,
 			bool escape_string_literals = true,
-			const location &start_location = location()) :
+			const location &start_location = location(),
+			source_file_table *source_files = nullptr,
+			const source_line_map *line_map = nullptr) :
+			lexer(std::make_shared<const std::string>(std::move(input)), ignore_comments, ignore_whitespace, ignore_pp_directives, ignore_line_directives, ignore_keywords, escape_string_literals, start_location, source_files, line_map)
+		{
+		}
+		// Construct a lexer working directly on an input string that may be shared with others (e.g. file contents from a source cache)
+		explicit lexer(
+			std::shared_ptr<const std::string> input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location(),
+			source_file_table *source_files = nullptr,
+			const source_line_map *line_map = nullptr) :
 			_input(std::move(input)),
 			_cur_location(start_location),
+			_source_files(source_files),
+			_line_map(line_map),
 			_ignore_comments(ignore_comments),
 			_ignore_whitespace(ignore_whitespace),
 			_ignore_pp_directives(ignore_pp_directives),
@@ -33,32 +53,19 @@ namespace reshadefx
 			_ignore_keywords(ignore_keywords),
 			_escape_string_literals(escape_string_literals)
 		{
-			_cur = _input.data();
-			_end = _cur + _input.size();
+			_cur = _input->data();
+			_end = _cur + _input->size();
 		}
 
-		lexer(const lexer &lexer) { operator=(lexer); }
-		lexer &operator=(const lexer &lexer)
-		{
-			_input = lexer._input;
-			_cur_location = lexer._cur_location;
-			_cur = _input.data() + (lexer._cur - lexer._input.data());
-			_end = _input.data() + _input.size();
-			_ignore_comments = lexer._ignore_comments;
-			_ignore_whitespace = lexer._ignore_whitespace;
-			_ignore_pp_directives = lexer._ignore_pp_directives;
-			_ignore_keywords = lexer._ignore_keywords;
-			_escape_string_literals = lexer._escape_string_literals;
-			_ignore_line_directives = lexer._ignore_line_directives;
-
-			return *this;
-		}
+		// Copies share the same immutable input string, so that tokens (which reference it) stay valid as long as any copy is alive
+		lexer(const lexer &lexer) = default;
+		lexer &operator=(const lexer &lexer) = default;
 
 		/// <summary>
 		/// Get the input string this lexical analyzer works on.
 		/// </summary>
 		/// <returns>A constant reference to the input string.</returns>
-		const std::string &input_string() const { return _input; }
+		const std::string &input_string() const { return *_input; }
 
 		/// <summary>
 		/// Perform lexical analysis on the input string and return the next token in sequence.
@@ -75,20 +82,53 @@ namespace reshadefx
 		/// </summary>
 		void skip_to_next_line();
 
+		/// <summary>
+		/// The instruction sets the kernels that skip over whitespace, comments and identifiers are implemented with.
+		/// </summary>
+		enum class scan_kernel_set
+		{
+			scalar,
+			sse2,
+			avx2
+		};
+
+		/// <summary>
+		/// Get the best kernel set supported by the CPU, which is the one used by default.
+		/// </summary>
+		static scan_kernel_set supported_scan_kernels();
+		/// <summary>
+		/// Get the kernel set that is currently used by all lexer instances.
+		/// </summary>
+		static scan_kernel_set active_scan_kernels();
+		/// <summary>
+		/// Force all lexer instances to use the specified kernel set, so that the implementations can be compared against each other.
+		/// This must not be called while another thread is lexing.
+		/// </summary>
+		/// <param name="kernels">The kernel set to use.</param>
+		/// <returns><see langword="true"/> if the kernel set was selected, or <see langword="false"/> if the CPU does not support it.</returns>
+		static bool select_scan_kernels(scan_kernel_set kernels);
+
 	private:
 		/// <summary>
 		/// Skips an arbitrary amount of characters in the input string.
 		/// </summary>
 		/// <param name="length">The number of input characters to skip.</param>
 		void skip(size_t length);
+		/// <summary>
+		/// Updates the current location from all entries in the line map up to the current character.
+		/// </summary>
+		void apply_line_map();
 
 		void parse_identifier(token &tok) const;
 		bool parse_pp_directive(token &tok);
 		void parse_string_literal(token &tok, bool escape);
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::shared_ptr<const std::string> _input;
 		location _cur_location;
+		source_file_table *_source_files;
+		const source_line_map *_line_map;
+		size_t _line_map_index = 0;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_comments;
 		bool _ignore_whitespace;
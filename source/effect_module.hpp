@@ -218,6 +218,8 @@ namespace reshadefx
 	{
 		std::string name;
 		bool is_pixel_shader;
+		// Code containing only the definitions used by this entry point, which can be compiled instead of the full module code (empty unless requested from the code generator)
+		std::string hlsl;
 	};
 
 	/// <summary>
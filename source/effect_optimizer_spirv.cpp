@@ -0,0 +1,2026 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_codegen.hpp"
+#include <cassert>
+#include <cmath> // std::isnan, std::isinf
+#include <cstring> // std::memcpy
+#include <unordered_set>
+
+// Use the C++ variant of the SPIR-V headers
+#include <spirv.hpp>
+namespace spv {
+#include <GLSL.std.450.h>
+}
+
+using namespace reshadefx;
+
+namespace
+{
+	/// <summary>
+	/// A single decoded instruction in a SPIR-V module. Instructions that are removed by a pass are turned into 'OpNop' and dropped when the module is written back.
+	/// </summary>
+	struct spirv_instruction
+	{
+		spv::Op op = spv::OpNop;
+		spv::Id type = 0;
+		spv::Id result = 0;
+		std::vector<uint32_t> operands;
+	};
+
+	/// <summary>
+	/// A basic block in a function, consisting of a label followed by a list of instructions ending with a terminator.
+	/// </summary>
+	struct spirv_basic_block
+	{
+		spv::Id label = 0;
+		std::vector<spirv_instruction> instructions;
+	};
+
+	/// <summary>
+	/// A function definition, consisting of the function declaration and parameters, followed by a list of basic blocks.
+	/// </summary>
+	struct spirv_function
+	{
+		std::vector<spirv_instruction> declaration;
+		std::vector<spirv_basic_block> blocks;
+	};
+
+	/// <summary>
+	/// The control flow graph and dominator tree of a function.
+	/// </summary>
+	struct spirv_control_flow
+	{
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		std::vector<std::vector<size_t>> predecessors, successors;
+		// Reachable blocks in reverse post-order, starting with the entry block
+		std::vector<size_t> order;
+		// Immediate dominator of each block, or 'npos' if the block is unreachable
+		std::vector<size_t> idom;
+		std::vector<std::vector<size_t>> children;
+		std::vector<std::vector<size_t>> frontier;
+	};
+
+	struct words_hash
+	{
+		size_t operator()(const std::vector<uint32_t> &words) const
+		{
+			size_t hash = 2166136261u;
+			for (const uint32_t word : words)
+				hash = (hash ^ word) * 16777619u;
+			return hash;
+		}
+	};
+
+	/// <summary>
+	/// Determine whether an instruction with the specified opcode has a result ID and a result type ID.
+	/// </summary>
+	/// <returns><c>true</c> if the opcode is known to the optimizer, <c>false</c> otherwise.</returns>
+	bool get_result_and_type(spv::Op op, bool &has_result, bool &has_type)
+	{
+		has_result = has_type = false;
+
+		switch (op)
+		{
+		case spv::OpNop:
+		case spv::OpSource:
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpLine:
+		case spv::OpMemoryModel:
+		case spv::OpEntryPoint:
+		case spv::OpExecutionMode:
+		case spv::OpCapability:
+		case spv::OpFunctionEnd:
+		case spv::OpStore:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpLoopMerge:
+		case spv::OpSelectionMerge:
+		case spv::OpBranch:
+		case spv::OpBranchConditional:
+		case spv::OpSwitch:
+		case spv::OpKill:
+		case spv::OpReturn:
+		case spv::OpReturnValue:
+			return true;
+		case spv::OpString:
+		case spv::OpExtInstImport:
+		case spv::OpTypeVoid:
+		case spv::OpTypeBool:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpTypeSampledImage:
+		case spv::OpTypeArray:
+		case spv::OpTypeStruct:
+		case spv::OpTypePointer:
+		case spv::OpTypeFunction:
+		case spv::OpLabel:
+			has_result = true;
+			return true;
+		case spv::OpUndef:
+		case spv::OpExtInst:
+		case spv::OpConstantTrue:
+		case spv::OpConstantFalse:
+		case spv::OpConstant:
+		case spv::OpConstantComposite:
+		case spv::OpConstantNull:
+		case spv::OpSpecConstantTrue:
+		case spv::OpSpecConstantFalse:
+		case spv::OpSpecConstant:
+		case spv::OpSpecConstantComposite:
+		case spv::OpFunction:
+		case spv::OpFunctionParameter:
+		case spv::OpFunctionCall:
+		case spv::OpVariable:
+		case spv::OpLoad:
+		case spv::OpAccessChain:
+		case spv::OpVectorExtractDynamic:
+		case spv::OpVectorShuffle:
+		case spv::OpCompositeConstruct:
+		case spv::OpCompositeExtract:
+		case spv::OpCompositeInsert:
+		case spv::OpTranspose:
+		case spv::OpImageSampleImplicitLod:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageFetch:
+		case spv::OpImageGather:
+		case spv::OpImage:
+		case spv::OpImageQuerySizeLod:
+		case spv::OpConvertFToU:
+		case spv::OpConvertFToS:
+		case spv::OpConvertSToF:
+		case spv::OpConvertUToF:
+		case spv::OpBitcast:
+		case spv::OpSNegate:
+		case spv::OpFNegate:
+		case spv::OpIAdd:
+		case spv::OpFAdd:
+		case spv::OpISub:
+		case spv::OpFSub:
+		case spv::OpIMul:
+		case spv::OpFMul:
+		case spv::OpUDiv:
+		case spv::OpSDiv:
+		case spv::OpFDiv:
+		case spv::OpUMod:
+		case spv::OpSRem:
+		case spv::OpFRem:
+		case spv::OpVectorTimesScalar:
+		case spv::OpMatrixTimesScalar:
+		case spv::OpVectorTimesMatrix:
+		case spv::OpMatrixTimesVector:
+		case spv::OpMatrixTimesMatrix:
+		case spv::OpDot:
+		case spv::OpAny:
+		case spv::OpAll:
+		case spv::OpIsNan:
+		case spv::OpIsInf:
+		case spv::OpLogicalEqual:
+		case spv::OpLogicalNotEqual:
+		case spv::OpLogicalOr:
+		case spv::OpLogicalAnd:
+		case spv::OpLogicalNot:
+		case spv::OpSelect:
+		case spv::OpIEqual:
+		case spv::OpINotEqual:
+		case spv::OpUGreaterThan:
+		case spv::OpSGreaterThan:
+		case spv::OpUGreaterThanEqual:
+		case spv::OpSGreaterThanEqual:
+		case spv::OpULessThan:
+		case spv::OpSLessThan:
+		case spv::OpULessThanEqual:
+		case spv::OpSLessThanEqual:
+		case spv::OpFOrdEqual:
+		case spv::OpFOrdNotEqual:
+		case spv::OpFOrdLessThan:
+		case spv::OpFOrdGreaterThan:
+		case spv::OpFOrdLessThanEqual:
+		case spv::OpFOrdGreaterThanEqual:
+		case spv::OpShiftRightLogical:
+		case spv::OpShiftRightArithmetic:
+		case spv::OpShiftLeftLogical:
+		case spv::OpBitwiseOr:
+		case spv::OpBitwiseXor:
+		case spv::OpBitwiseAnd:
+		case spv::OpNot:
+		case spv::OpDPdx:
+		case spv::OpDPdy:
+		case spv::OpFwidth:
+		case spv::OpPhi:
+			has_result = has_type = true;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/// <summary>
+	/// Get the number of words a literal string in the operands of an instruction occupies.
+	/// </summary>
+	size_t string_length(const std::vector<uint32_t> &operands, size_t offset)
+	{
+		size_t length = 0;
+		while (offset + length < operands.size())
+		{
+			const uint32_t word = operands[offset + length++];
+			if ((word & 0xFF) == 0 || (word & 0xFF00) == 0 || (word & 0xFF0000) == 0 || (word & 0xFF000000) == 0)
+				break;
+		}
+		return length;
+	}
+
+	/// <summary>
+	/// Call the specified function for every ID referenced by an instruction (including its result type, but not its result ID), so that literal operands are skipped.
+	/// </summary>
+	template <typename F>
+	void for_each_id(spirv_instruction &inst, F func)
+	{
+		if (inst.type != 0)
+			func(inst.type);
+
+		std::vector<uint32_t> &operands = inst.operands;
+		size_t first = 0, last = operands.size();
+
+		switch (inst.op)
+		{
+		case spv::OpNop:
+		case spv::OpSource:
+		case spv::OpString:
+		case spv::OpMemoryModel:
+		case spv::OpCapability:
+		case spv::OpExtInstImport:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpConstant:
+		case spv::OpSpecConstant:
+			return;
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpLine:
+		case spv::OpExecutionMode:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpCompositeExtract:
+		case spv::OpSelectionMerge:
+			last = std::min<size_t>(last, 1);
+			break;
+		case spv::OpCompositeInsert:
+		case spv::OpVectorShuffle:
+		case spv::OpLoopMerge:
+			last = std::min<size_t>(last, 2);
+			break;
+		case spv::OpTypePointer:
+		case spv::OpVariable:
+		case spv::OpFunction:
+			first = 1;
+			break;
+		case spv::OpExtInst:
+			func(operands[0]); // Set
+			first = 2;
+			break;
+		case spv::OpImageSampleImplicitLod:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageFetch:
+			// The image operands mask is a literal that is followed by more IDs
+			for (size_t i = 0; i < std::min<size_t>(last, 2); ++i)
+				func(operands[i]);
+			first = 3;
+			break;
+		case spv::OpImageGather:
+			for (size_t i = 0; i < std::min<size_t>(last, 3); ++i)
+				func(operands[i]);
+			first = 4;
+			break;
+		case spv::OpSwitch:
+			func(operands[0]); // Selector
+			func(operands[1]); // Default
+			for (size_t i = 3; i < last; i += 2)
+				func(operands[i]); // Targets
+			return;
+		case spv::OpEntryPoint:
+			func(operands[1]); // Entry point
+			first = 2 + string_length(operands, 2);
+			break;
+		default:
+			break; // All other instructions only reference IDs in their operands
+		}
+
+		for (size_t i = first; i < last; ++i)
+			func(operands[i]);
+	}
+
+	/// <summary>
+	/// Check whether an instruction can be removed when its result is not used.
+	/// </summary>
+	bool is_removable_if_unused(const spirv_instruction &inst)
+	{
+		switch (inst.op)
+		{
+		case spv::OpNop:
+		case spv::OpLabel:
+		case spv::OpVariable:
+		case spv::OpFunctionCall:
+			return false;
+		case spv::OpExtInst:
+			// These write to the pointer passed in as the last operand
+			return inst.operands[1] != spv::GLSLstd450Modf && inst.operands[1] != spv::GLSLstd450Frexp;
+		default:
+			return inst.result != 0;
+		}
+	}
+
+	union scalar_value
+	{
+		uint32_t u;
+		int32_t i;
+		float f;
+	};
+
+	/// <summary>
+	/// A simple optimizer for the SPIR-V modules produced by the SPIR-V code generation back-end. It promotes function local variables to SSA values, forwards stored values to later loads, folds constant expressions, removes common subexpressions and finally gets rid of any dead code and functions.
+	/// </summary>
+	class spirv_optimizer
+	{
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+	public:
+		bool parse(const std::vector<uint32_t> &spirv)
+		{
+			if (spirv.size() < 5 || spirv[0] != spv::MagicNumber)
+				return false;
+
+			std::memcpy(_header, spirv.data(), sizeof(_header));
+			_next_id = _header[3];
+			// IDs are dense, so lookup tables can simply be indexed by them
+			_global_lookup.assign(_next_id, npos);
+			_replacements.assign(_next_id, 0);
+
+			std::vector<spirv_instruction> pending_lines;
+			spirv_function *function = nullptr;
+
+			for (size_t offset = 5; offset < spirv.size();)
+			{
+				const uint32_t num_words = spirv[offset] >> spv::WordCountShift;
+				if (num_words == 0 || offset + num_words > spirv.size())
+					return false;
+
+				spirv_instruction inst;
+				inst.op = static_cast<spv::Op>(spirv[offset] & spv::OpCodeMask);
+
+				bool has_result, has_type;
+				if (!get_result_and_type(inst.op, has_result, has_type) || num_words < 1u + has_type + has_result)
+					return false; // Do not touch modules with instructions the optimizer does not know about
+
+				size_t word = offset + 1;
+				if (has_type)
+					inst.type = spirv[word++];
+				if (has_result)
+					inst.result = spirv[word++];
+				inst.operands.assign(spirv.begin() + word, spirv.begin() + offset + num_words);
+				offset += num_words;
+
+				if (inst.result >= _next_id || inst.type >= _next_id)
+					return false;
+
+				if (function == nullptr)
+				{
+					// Debug line instructions in front of a function declaration belong to that function
+					if (inst.op == spv::OpLine)
+					{
+						pending_lines.push_back(std::move(inst));
+						continue;
+					}
+
+					if (inst.op == spv::OpFunction)
+					{
+						function = &_functions.emplace_back();
+						function->declaration = std::move(pending_lines);
+						function->declaration.push_back(std::move(inst));
+					}
+					else
+					{
+						for (spirv_instruction &line : pending_lines)
+							_globals.push_back(std::move(line));
+						if (inst.result != 0)
+							_global_lookup[inst.result] = _globals.size();
+						_globals.push_back(std::move(inst));
+					}
+
+					pending_lines.clear();
+					continue;
+				}
+
+				if (inst.op == spv::OpFunctionEnd)
+				{
+					if (function->blocks.empty())
+						return false; // Function declarations without a body are not supported
+					function = nullptr;
+					continue;
+				}
+
+				if (inst.op == spv::OpLabel)
+				{
+					function->blocks.emplace_back().label = inst.result;
+					continue;
+				}
+
+				if (function->blocks.empty())
+					function->declaration.push_back(std::move(inst));
+				else
+					function->blocks.back().instructions.push_back(std::move(inst));
+			}
+
+			if (function != nullptr)
+				return false;
+
+			_globals.insert(_globals.end(), std::make_move_iterator(pending_lines.begin()), std::make_move_iterator(pending_lines.end()));
+
+			// Keep track of existing constants, so that folded values can reuse them
+			for (const spirv_instruction &inst : _globals)
+			{
+				switch (inst.op)
+				{
+				case spv::OpConstantTrue:
+				case spv::OpConstantFalse:
+				case spv::OpConstant:
+				case spv::OpConstantComposite:
+					_constant_lookup.emplace(constant_key(inst.op, inst.type, inst.operands), inst.result);
+					break;
+				case spv::OpUndef:
+					_undef_lookup.emplace(inst.type, inst.result);
+					break;
+				default:
+					break;
+				}
+			}
+
+			return true;
+		}
+
+		void run()
+		{
+			remove_dead_functions();
+
+			for (spirv_function &function : _functions)
+			{
+				const spirv_control_flow cfg = analyze_control_flow(function);
+
+				promote_variables(function, cfg);
+				remove_trivial_phis(function);
+				forward_loads(function);
+				apply_replacements(function);
+				fold_and_reuse_values(function, cfg);
+				apply_replacements(function);
+				remove_dead_code(function);
+			}
+
+			remove_dead_globals();
+		}
+
+		void write(std::vector<uint32_t> &spirv) const
+		{
+			spirv.clear();
+			spirv.insert(spirv.end(), std::begin(_header), std::end(_header));
+			spirv[3] = _next_id; // Update bound, since new IDs may have been allocated
+
+			for (const spirv_instruction &inst : _globals)
+				write(spirv, inst);
+
+			for (const spirv_function &function : _functions)
+			{
+				for (const spirv_instruction &inst : function.declaration)
+					write(spirv, inst);
+
+				for (const spirv_basic_block &block : function.blocks)
+				{
+					spirv.push_back((2u << spv::WordCountShift) | spv::OpLabel);
+					spirv.push_back(block.label);
+
+					for (const spirv_instruction &inst : block.instructions)
+						write(spirv, inst);
+				}
+
+				spirv.push_back((1u << spv::WordCountShift) | spv::OpFunctionEnd);
+			}
+		}
+
+		size_t count_instructions() const
+		{
+			size_t count = 0;
+			for (const spirv_instruction &inst : _globals)
+				count += inst.op != spv::OpNop;
+			for (const spirv_function &function : _functions)
+			{
+				count += function.declaration.size() + 1;
+				for (const spirv_basic_block &block : function.blocks)
+				{
+					count += 1;
+					for (const spirv_instruction &inst : block.instructions)
+						count += inst.op != spv::OpNop;
+				}
+			}
+			return count;
+		}
+
+	private:
+		static void write(std::vector<uint32_t> &spirv, const spirv_instruction &inst)
+		{
+			if (inst.op == spv::OpNop)
+				return;
+
+			const uint32_t num_words = 1 + (inst.type != 0) + (inst.result != 0) + static_cast<uint32_t>(inst.operands.size());
+			spirv.push_back((num_words << spv::WordCountShift) | inst.op);
+			if (inst.type != 0)
+				spirv.push_back(inst.type);
+			if (inst.result != 0)
+				spirv.push_back(inst.result);
+			spirv.insert(spirv.end(), inst.operands.begin(), inst.operands.end());
+		}
+
+		static std::vector<uint32_t> constant_key(spv::Op op, spv::Id type, const std::vector<uint32_t> &operands)
+		{
+			std::vector<uint32_t> key;
+			key.reserve(2 + operands.size());
+			key.push_back(op);
+			key.push_back(type);
+			key.insert(key.end(), operands.begin(), operands.end());
+			return key;
+		}
+
+		const spirv_instruction *find_global(spv::Id id) const
+		{
+			if (id < _global_lookup.size() && _global_lookup[id] != npos)
+				return &_globals[_global_lookup[id]];
+			return nullptr;
+		}
+
+		spv::Id resolve(spv::Id id) const
+		{
+			while (id < _replacements.size() && _replacements[id] != 0)
+				id = _replacements[id];
+			return id;
+		}
+		void replace(spv::Id id, spv::Id value)
+		{
+			assert(id != value);
+			_replacements[id] = value;
+		}
+
+		spv::Id make_id()
+		{
+			_global_lookup.push_back(npos);
+			_replacements.push_back(0);
+			return _next_id++;
+		}
+
+		spv::Id add_global(spv::Op op, spv::Id type, std::vector<uint32_t> operands)
+		{
+			spirv_instruction &inst = _globals.emplace_back();
+			inst.op = op;
+			inst.type = type;
+			inst.result = make_id();
+			inst.operands = std::move(operands);
+
+			_global_lookup[inst.result] = _globals.size() - 1;
+
+			return inst.result;
+		}
+		spv::Id add_constant(spv::Op op, spv::Id type, std::vector<uint32_t> operands)
+		{
+			const auto it = _constant_lookup.emplace(constant_key(op, type, operands), 0);
+			if (it.second)
+				it.first->second = add_global(op, type, std::move(operands));
+			return it.first->second;
+		}
+		spv::Id add_undef(spv::Id type)
+		{
+			const auto it = _undef_lookup.emplace(type, 0);
+			if (it.second)
+				it.first->second = add_global(spv::OpUndef, type, {});
+			return it.first->second;
+		}
+
+		enum class scalar_kind
+		{
+			none,
+			boolean,
+			int32,
+			uint32,
+			float32
+		};
+
+		/// <summary>
+		/// Get the scalar type and number of components of a scalar or vector type.
+		/// </summary>
+		scalar_kind get_scalar_kind(spv::Id type, unsigned int *num_components = nullptr, spv::Id *scalar_type = nullptr) const
+		{
+			const spirv_instruction *inst = find_global(type);
+			if (inst == nullptr)
+				return scalar_kind::none;
+
+			if (num_components != nullptr)
+				*num_components = 1;
+
+			if (inst->op == spv::OpTypeVector)
+			{
+				if (num_components != nullptr)
+					*num_components = inst->operands[1];
+				type = inst->operands[0];
+				inst = find_global(type);
+				if (inst == nullptr)
+					return scalar_kind::none;
+			}
+
+			if (scalar_type != nullptr)
+				*scalar_type = type;
+
+			switch (inst->op)
+			{
+			case spv::OpTypeBool:
+				return scalar_kind::boolean;
+			case spv::OpTypeInt:
+				if (inst->operands[0] == 32)
+					return inst->operands[1] ? scalar_kind::int32 : scalar_kind::uint32;
+				break;
+			case spv::OpTypeFloat:
+				if (inst->operands[0] == 32)
+					return scalar_kind::float32;
+				break;
+			default:
+				break;
+			}
+
+			return scalar_kind::none;
+		}
+
+		/// <summary>
+		/// Get the values of all components of a scalar or vector constant.
+		/// </summary>
+		bool get_constant_components(spv::Id id, std::vector<scalar_value> &components) const
+		{
+			const spirv_instruction *const inst = find_global(id);
+			if (inst == nullptr)
+				return false;
+
+			switch (inst->op)
+			{
+			case spv::OpConstantTrue:
+			case spv::OpConstantFalse:
+				components.push_back({ inst->op == spv::OpConstantTrue ? 1u : 0u });
+				return true;
+			case spv::OpConstant:
+				if (inst->operands.size() != 1)
+					return false;
+				components.push_back({ inst->operands[0] });
+				return true;
+			case spv::OpConstantComposite:
+				if (find_global(inst->type)->op != spv::OpTypeVector)
+					return false;
+				for (const spv::Id element : inst->operands)
+					if (!get_constant_components(element, components))
+						return false;
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/// <summary>
+		/// Create a scalar or vector constant with the specified component values.
+		/// </summary>
+		spv::Id make_constant(spv::Id type, const std::vector<scalar_value> &components)
+		{
+			unsigned int num_components = 0;
+			spv::Id scalar_type = 0;
+			const scalar_kind kind = get_scalar_kind(type, &num_components, &scalar_type);
+			assert(kind != scalar_kind::none && num_components == components.size());
+
+			const auto make_scalar = [this, kind, scalar_type](scalar_value value) {
+				if (kind == scalar_kind::boolean)
+					return add_constant(value.u ? spv::OpConstantTrue : spv::OpConstantFalse, scalar_type, {});
+				else
+					return add_constant(spv::OpConstant, scalar_type, { value.u });
+			};
+
+			if (type == scalar_type)
+				return make_scalar(components[0]);
+
+			std::vector<uint32_t> elements;
+			for (const scalar_value value : components)
+				elements.push_back(make_scalar(value));
+			return add_constant(spv::OpConstantComposite, type, std::move(elements));
+		}
+
+		spv::Id type_of(spv::Id id, const std::vector<const spirv_instruction *> &local_defs) const
+		{
+			if (id < local_defs.size() && local_defs[id] != nullptr)
+				return local_defs[id]->type;
+			if (const spirv_instruction *const inst = find_global(id))
+				return inst->type;
+			return 0;
+		}
+
+		/// <summary>
+		/// Try to evaluate an instruction at compile time.
+		/// </summary>
+		/// <returns>The ID of an equivalent value (usually a constant), or zero if the instruction cannot be folded.</returns>
+		spv::Id fold(const spirv_instruction &inst, const std::vector<const spirv_instruction *> &local_defs)
+		{
+			switch (inst.op)
+			{
+			case spv::OpCompositeExtract:
+				return fold_extract(inst, local_defs);
+			case spv::OpVectorShuffle:
+				return fold_shuffle(inst, local_defs);
+			case spv::OpCompositeConstruct:
+				return fold_construct(inst);
+			case spv::OpSelect:
+				return fold_select(inst);
+			case spv::OpVectorTimesScalar:
+			case spv::OpDot:
+				return fold_vector_arithmetic(inst);
+			default:
+				return fold_component_wise(inst);
+			}
+		}
+
+		spv::Id fold_extract(const spirv_instruction &inst, const std::vector<const spirv_instruction *> &local_defs)
+		{
+			spv::Id composite = inst.operands[0];
+
+			for (size_t i = 1; i < inst.operands.size(); ++i)
+			{
+				const uint32_t index = inst.operands[i];
+
+				if (const spirv_instruction *const constant = find_global(composite);
+					constant != nullptr && constant->op == spv::OpConstantComposite && index < constant->operands.size())
+				{
+					composite = constant->operands[index];
+					continue;
+				}
+
+				// Extracting from a composite that was just constructed can refer to the constituent directly, as long as there is exactly one constituent per element
+				if (composite < local_defs.size() && local_defs[composite] != nullptr && local_defs[composite]->op == spv::OpCompositeConstruct && index < local_defs[composite]->operands.size())
+				{
+					const spirv_instruction &construct = *local_defs[composite];
+
+					unsigned int num_components = 0;
+					if (get_scalar_kind(construct.type, &num_components) != scalar_kind::none && num_components != construct.operands.size())
+						return 0;
+
+					composite = construct.operands[index];
+					continue;
+				}
+
+				return 0;
+			}
+
+			return composite;
+		}
+
+		spv::Id fold_shuffle(const spirv_instruction &inst, const std::vector<const spirv_instruction *> &local_defs)
+		{
+			unsigned int num_components = 0;
+			get_scalar_kind(type_of(inst.operands[0], local_defs), &num_components);
+
+			// A shuffle that picks all components of the first vector in order is a no-op
+			if (inst.type == type_of(inst.operands[0], local_defs) && inst.operands.size() == 2 + num_components)
+			{
+				bool identity = true;
+				for (uint32_t i = 0; i < num_components; ++i)
+					identity &= inst.operands[2 + i] == i;
+				if (identity)
+					return inst.operands[0];
+			}
+
+			std::vector<scalar_value> components, vector1, vector2;
+			if (!get_constant_components(inst.operands[0], vector1) || !get_constant_components(inst.operands[1], vector2))
+				return 0;
+
+			for (size_t i = 2; i < inst.operands.size(); ++i)
+			{
+				const uint32_t index = inst.operands[i];
+				if (index < vector1.size())
+					components.push_back(vector1[index]);
+				else if (index - vector1.size() < vector2.size())
+					components.push_back(vector2[index - vector1.size()]);
+				else
+					return 0; // Undefined component
+			}
+
+			return make_constant(inst.type, components);
+		}
+
+		spv::Id fold_construct(const spirv_instruction &inst)
+		{
+			const spirv_instruction *const type = find_global(inst.type);
+			if (type == nullptr)
+				return 0;
+
+			// Constant composites need exactly one constituent per element (unlike construction of vectors, which can be concatenated from smaller vectors)
+			if (type->op == spv::OpTypeVector && inst.operands.size() != type->operands[1])
+				return 0;
+
+			for (const spv::Id element : inst.operands)
+			{
+				const spirv_instruction *const constant = find_global(element);
+				if (constant == nullptr || (constant->op != spv::OpConstant && constant->op != spv::OpConstantTrue && constant->op != spv::OpConstantFalse && constant->op != spv::OpConstantComposite))
+					return 0;
+			}
+
+			return add_constant(spv::OpConstantComposite, inst.type, inst.operands);
+		}
+
+		spv::Id fold_select(const spirv_instruction &inst)
+		{
+			std::vector<scalar_value> condition;
+			if (!get_constant_components(inst.operands[0], condition))
+				return 0;
+
+			if (condition.size() == 1)
+				return condition[0].u ? inst.operands[1] : inst.operands[2];
+
+			std::vector<scalar_value> true_value, false_value;
+			if (!get_constant_components(inst.operands[1], true_value) || !get_constant_components(inst.operands[2], false_value) || true_value.size() != condition.size() || false_value.size() != condition.size())
+				return 0;
+
+			for (size_t i = 0; i < condition.size(); ++i)
+				if (!condition[i].u)
+					true_value[i] = false_value[i];
+
+			return make_constant(inst.type, true_value);
+		}
+
+		spv::Id fold_vector_arithmetic(const spirv_instruction &inst)
+		{
+			std::vector<scalar_value> a, b;
+			if (!get_constant_components(inst.operands[0], a) || !get_constant_components(inst.operands[1], b) || get_scalar_kind(inst.type) != scalar_kind::float32)
+				return 0;
+
+			if (inst.op == spv::OpVectorTimesScalar)
+			{
+				if (b.size() != 1)
+					return 0;
+				for (scalar_value &value : a)
+					value.f *= b[0].f;
+				return make_constant(inst.type, a);
+			}
+			else
+			{
+				if (a.size() != b.size())
+					return 0;
+				scalar_value sum;
+				sum.f = 0.0f;
+				for (size_t i = 0; i < a.size(); ++i)
+					sum.f += a[i].f * b[i].f;
+				return make_constant(inst.type, { sum });
+			}
+		}
+
+		spv::Id fold_component_wise(const spirv_instruction &inst)
+		{
+			unsigned int num_components = 0;
+			if (inst.operands.empty() || inst.operands.size() > 2 || get_scalar_kind(inst.type, &num_components) == scalar_kind::none)
+				return 0;
+
+			std::vector<scalar_value> a, b;
+			if (!get_constant_components(inst.operands[0], a))
+				return 0;
+			if (inst.operands.size() == 2 && (!get_constant_components(inst.operands[1], b) || b.size() != a.size()))
+				return 0;
+
+			// Reductions
+			if (inst.op == spv::OpAny || inst.op == spv::OpAll)
+			{
+				bool any = false, all = true;
+				for (const scalar_value value : a)
+					any |= value.u != 0, all &= value.u != 0;
+				return make_constant(inst.type, { { (inst.op == spv::OpAny ? any : all) ? 1u : 0u } });
+			}
+
+			if (a.size() != num_components)
+				return 0;
+
+			std::vector<scalar_value> result(num_components);
+
+			for (size_t i = 0; i < num_components; ++i)
+			{
+				const scalar_value x = a[i];
+				const scalar_value y = b.empty() ? scalar_value { 0 } : b[i];
+				scalar_value &r = result[i];
+
+				switch (inst.op)
+				{
+				case spv::OpFNegate:
+					r.f = -x.f;
+					break;
+				case spv::OpSNegate:
+					r.u = 0u - x.u;
+					break;
+				case spv::OpNot:
+					r.u = ~x.u;
+					break;
+				case spv::OpLogicalNot:
+					r.u = !x.u;
+					break;
+				case spv::OpIsNan:
+					r.u = std::isnan(x.f);
+					break;
+				case spv::OpIsInf:
+					r.u = std::isinf(x.f);
+					break;
+				case spv::OpBitcast:
+					r = x;
+					break;
+				case spv::OpConvertSToF:
+					r.f = static_cast<float>(x.i);
+					break;
+				case spv::OpConvertUToF:
+					r.f = static_cast<float>(x.u);
+					break;
+				case spv::OpConvertFToS:
+					if (!(x.f > -2147483649.0f && x.f < 2147483648.0f))
+						return 0; // Result is undefined if the value does not fit
+					r.i = static_cast<int32_t>(x.f);
+					break;
+				case spv::OpConvertFToU:
+					if (!(x.f > -1.0f && x.f < 4294967296.0f))
+						return 0;
+					r.u = static_cast<uint32_t>(x.f);
+					break;
+				case spv::OpFAdd:
+					r.f = x.f + y.f;
+					break;
+				case spv::OpFSub:
+					r.f = x.f - y.f;
+					break;
+				case spv::OpFMul:
+					r.f = x.f * y.f;
+					break;
+				case spv::OpFDiv:
+					r.f = x.f / y.f;
+					break;
+				case spv::OpIAdd:
+					r.u = x.u + y.u;
+					break;
+				case spv::OpISub:
+					r.u = x.u - y.u;
+					break;
+				case spv::OpIMul:
+					r.u = x.u * y.u;
+					break;
+				case spv::OpUDiv:
+					if (y.u == 0)
+						return 0;
+					r.u = x.u / y.u;
+					break;
+				case spv::OpUMod:
+					if (y.u == 0)
+						return 0;
+					r.u = x.u % y.u;
+					break;
+				case spv::OpSDiv:
+				case spv::OpSRem:
+					if (y.i == 0 || (x.u == 0x80000000 && y.i == -1))
+						return 0;
+					r.i = inst.op == spv::OpSDiv ? x.i / y.i : x.i % y.i;
+					break;
+				case spv::OpShiftLeftLogical:
+				case spv::OpShiftRightLogical:
+				case spv::OpShiftRightArithmetic:
+					if (y.u >= 32)
+						return 0; // Result is undefined if shift is larger than the bit width
+					if (inst.op == spv::OpShiftLeftLogical)
+						r.u = x.u << y.u;
+					else if (inst.op == spv::OpShiftRightLogical)
+						r.u = x.u >> y.u;
+					else
+						r.u = static_cast<uint32_t>(x.i < 0 ? ~(~x.i >> y.u) : x.i >> y.u);
+					break;
+				case spv::OpBitwiseAnd:
+					r.u = x.u & y.u;
+					break;
+				case spv::OpBitwiseOr:
+					r.u = x.u | y.u;
+					break;
+				case spv::OpBitwiseXor:
+					r.u = x.u ^ y.u;
+					break;
+				case spv::OpLogicalAnd:
+					r.u = x.u && y.u;
+					break;
+				case spv::OpLogicalOr:
+					r.u = x.u || y.u;
+					break;
+				case spv::OpLogicalEqual:
+					r.u = (x.u != 0) == (y.u != 0);
+					break;
+				case spv::OpLogicalNotEqual:
+					r.u = (x.u != 0) != (y.u != 0);
+					break;
+				case spv::OpIEqual:
+					r.u = x.u == y.u;
+					break;
+				case spv::OpINotEqual:
+					r.u = x.u != y.u;
+					break;
+				case spv::OpUGreaterThan:
+					r.u = x.u > y.u;
+					break;
+				case spv::OpUGreaterThanEqual:
+					r.u = x.u >= y.u;
+					break;
+				case spv::OpULessThan:
+					r.u = x.u < y.u;
+					break;
+				case spv::OpULessThanEqual:
+					r.u = x.u <= y.u;
+					break;
+				case spv::OpSGreaterThan:
+					r.u = x.i > y.i;
+					break;
+				case spv::OpSGreaterThanEqual:
+					r.u = x.i >= y.i;
+					break;
+				case spv::OpSLessThan:
+					r.u = x.i < y.i;
+					break;
+				case spv::OpSLessThanEqual:
+					r.u = x.i <= y.i;
+					break;
+				// Ordered comparisons are false if either operand is NaN, which matches the C++ operators except for inequality
+				case spv::OpFOrdEqual:
+					r.u = x.f == y.f;
+					break;
+				case spv::OpFOrdNotEqual:
+					r.u = x.f < y.f || x.f > y.f;
+					break;
+				case spv::OpFOrdLessThan:
+					r.u = x.f < y.f;
+					break;
+				case spv::OpFOrdGreaterThan:
+					r.u = x.f > y.f;
+					break;
+				case spv::OpFOrdLessThanEqual:
+					r.u = x.f <= y.f;
+					break;
+				case spv::OpFOrdGreaterThanEqual:
+					r.u = x.f >= y.f;
+					break;
+				default:
+					return 0;
+				}
+			}
+
+			return make_constant(inst.type, result);
+		}
+
+		/// <summary>
+		/// Remove all functions that cannot be reached from any entry point.
+		/// </summary>
+		void remove_dead_functions()
+		{
+			std::unordered_map<spv::Id, size_t> function_lookup;
+			for (size_t i = 0; i < _functions.size(); ++i)
+				for (const spirv_instruction &inst : _functions[i].declaration)
+					if (inst.op == spv::OpFunction)
+						function_lookup[inst.result] = i;
+
+			std::vector<bool> live(_functions.size());
+			std::vector<size_t> worklist;
+			const auto mark = [&](spv::Id id) {
+				if (const auto it = function_lookup.find(id); it != function_lookup.end() && !live[it->second])
+					live[it->second] = true, worklist.push_back(it->second);
+			};
+
+			for (const spirv_instruction &inst : _globals)
+				if (inst.op == spv::OpEntryPoint)
+					mark(inst.operands[1]);
+
+			while (!worklist.empty())
+			{
+				const size_t index = worklist.back();
+				worklist.pop_back();
+
+				for (const spirv_basic_block &block : _functions[index].blocks)
+					for (const spirv_instruction &inst : block.instructions)
+						if (inst.op == spv::OpFunctionCall)
+							mark(inst.operands[0]);
+			}
+
+			for (size_t i = _functions.size(); i-- > 0;)
+				if (!live[i])
+					_functions.erase(_functions.begin() + i);
+		}
+
+		/// <summary>
+		/// Get the last instruction in a basic block that is not a debug instruction.
+		/// </summary>
+		static const spirv_instruction *find_terminator(const spirv_basic_block &block)
+		{
+			for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it)
+				if (it->op != spv::OpLine && it->op != spv::OpNop)
+					return &*it;
+			return nullptr;
+		}
+
+		/// <summary>
+		/// Build the control flow graph of a function and compute its dominator tree and dominance frontiers.
+		/// </summary>
+		static spirv_control_flow analyze_control_flow(const spirv_function &function)
+		{
+			const size_t num_blocks = function.blocks.size();
+			constexpr size_t npos = spirv_control_flow::npos;
+
+			spirv_control_flow cfg;
+			cfg.predecessors.resize(num_blocks);
+			cfg.successors.resize(num_blocks);
+			cfg.idom.assign(num_blocks, npos);
+			cfg.children.resize(num_blocks);
+			cfg.frontier.resize(num_blocks);
+
+			std::unordered_map<spv::Id, size_t> block_lookup;
+			for (size_t i = 0; i < num_blocks; ++i)
+				block_lookup[function.blocks[i].label] = i;
+
+			for (size_t i = 0; i < num_blocks; ++i)
+			{
+				const spirv_instruction *const terminator = find_terminator(function.blocks[i]);
+				if (terminator == nullptr)
+					continue;
+
+				const auto add_edge = [&](spv::Id target) {
+					const size_t target_index = block_lookup.at(target);
+					if (std::find(cfg.successors[i].begin(), cfg.successors[i].end(), target_index) != cfg.successors[i].end())
+						return;
+					cfg.successors[i].push_back(target_index);
+					cfg.predecessors[target_index].push_back(i);
+				};
+
+				switch (terminator->op)
+				{
+				case spv::OpBranch:
+					add_edge(terminator->operands[0]);
+					break;
+				case spv::OpBranchConditional:
+					add_edge(terminator->operands[1]);
+					add_edge(terminator->operands[2]);
+					break;
+				case spv::OpSwitch:
+					add_edge(terminator->operands[1]);
+					for (size_t k = 3; k < terminator->operands.size(); k += 2)
+						add_edge(terminator->operands[k]);
+					break;
+				default:
+					break;
+				}
+			}
+
+			// Compute reverse post-order of all reachable blocks
+			std::vector<size_t> post_order;
+			std::vector<bool> visited(num_blocks);
+			std::vector<std::pair<size_t, size_t>> stack;
+			stack.emplace_back(0, 0);
+			visited[0] = true;
+			while (!stack.empty())
+			{
+				auto &[block, next] = stack.back();
+				if (next < cfg.successors[block].size())
+				{
+					const size_t successor = cfg.successors[block][next++];
+					if (!visited[successor])
+						visited[successor] = true, stack.emplace_back(successor, 0);
+				}
+				else
+				{
+					post_order.push_back(block);
+					stack.pop_back();
+				}
+			}
+
+			cfg.order.assign(post_order.rbegin(), post_order.rend());
+
+			std::vector<size_t> order_index(num_blocks, npos);
+			for (size_t i = 0; i < cfg.order.size(); ++i)
+				order_index[cfg.order[i]] = i;
+
+			// See "A Simple, Fast Dominance Algorithm" by Keith D. Cooper, Timothy J. Harvey and Ken Kennedy
+			cfg.idom[0] = 0;
+			for (bool changed = true; changed;)
+			{
+				changed = false;
+
+				for (size_t i = 1; i < cfg.order.size(); ++i)
+				{
+					const size_t block = cfg.order[i];
+
+					size_t new_idom = npos;
+					for (size_t predecessor : cfg.predecessors[block])
+					{
+						if (cfg.idom[predecessor] == npos)
+							continue; // Skip predecessors that were not processed yet or are unreachable
+
+						if (new_idom == npos)
+						{
+							new_idom = predecessor;
+							continue;
+						}
+
+						size_t finger1 = predecessor, finger2 = new_idom;
+						while (finger1 != finger2)
+						{
+							while (order_index[finger1] > order_index[finger2])
+								finger1 = cfg.idom[finger1];
+							while (order_index[finger2] > order_index[finger1])
+								finger2 = cfg.idom[finger2];
+						}
+						new_idom = finger1;
+					}
+
+					if (cfg.idom[block] != new_idom)
+						cfg.idom[block] = new_idom, changed = true;
+				}
+			}
+
+			for (size_t i = 1; i < cfg.order.size(); ++i)
+				cfg.children[cfg.idom[cfg.order[i]]].push_back(cfg.order[i]);
+
+			for (const size_t block : cfg.order)
+			{
+				if (cfg.predecessors[block].size() < 2)
+					continue;
+
+				for (size_t runner : cfg.predecessors[block])
+				{
+					if (cfg.idom[runner] == npos)
+						continue;
+
+					while (runner != cfg.idom[block])
+					{
+						auto &frontier = cfg.frontier[runner];
+						if (std::find(frontier.begin(), frontier.end(), block) == frontier.end())
+							frontier.push_back(block);
+						runner = cfg.idom[runner];
+					}
+				}
+			}
+
+			return cfg;
+		}
+
+		/// <summary>
+		/// Check whether a type can be held in a SSA value (which excludes images and samplers).
+		/// </summary>
+		bool is_promotable_type(spv::Id type) const
+		{
+			const spirv_instruction *const inst = find_global(type);
+			if (inst == nullptr)
+				return false;
+
+			switch (inst->op)
+			{
+			case spv::OpTypeBool:
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+				return true;
+			case spv::OpTypeVector:
+			case spv::OpTypeMatrix:
+			case spv::OpTypeArray:
+				return is_promotable_type(inst->operands[0]);
+			case spv::OpTypeStruct:
+				for (const spv::Id member : inst->operands)
+					if (!is_promotable_type(member))
+						return false;
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/// <summary>
+		/// Replace function local variables that are only ever loaded and stored as a whole with SSA values, inserting phi instructions where control flow merges (see "Efficiently Computing Static Single Assignment Form and the Control Dependence Graph" by Ron Cytron et al.).
+		/// </summary>
+		void promote_variables(spirv_function &function, const spirv_control_flow &cfg)
+		{
+			constexpr size_t npos = spirv_control_flow::npos;
+
+			// Collect candidates, which all have to be declared at the beginning of the first block
+			std::unordered_map<spv::Id, size_t> variable_lookup;
+			std::vector<spv::Id> variable_types;
+
+			for (const spirv_instruction &inst : function.blocks[0].instructions)
+			{
+				if (inst.op != spv::OpVariable || inst.operands[0] != spv::StorageClassFunction || inst.operands.size() != 1)
+					continue;
+
+				const spirv_instruction *const pointer_type = find_global(inst.type);
+				if (pointer_type == nullptr || pointer_type->op != spv::OpTypePointer || !is_promotable_type(pointer_type->operands[1]))
+					continue;
+
+				variable_lookup.emplace(inst.result, variable_types.size());
+				variable_types.push_back(pointer_type->operands[1]);
+			}
+
+			if (variable_lookup.empty())
+				return;
+
+			// Variables with decorations or any uses other than direct loads and stores (e.g. access chains or function call arguments) cannot be promoted
+			for (const spirv_instruction &inst : _globals)
+				if (inst.op == spv::OpDecorate || inst.op == spv::OpMemberDecorate)
+					variable_lookup.erase(inst.operands[0]);
+
+			for (spirv_basic_block &block : function.blocks)
+			{
+				for (spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpLoad)
+						continue;
+					if (inst.op == spv::OpStore)
+					{
+						variable_lookup.erase(inst.operands[1]);
+						continue;
+					}
+
+					for_each_id(inst, [&](uint32_t id) { variable_lookup.erase(id); });
+				}
+			}
+
+			if (variable_lookup.empty())
+				return;
+
+			const size_t num_variables = variable_types.size();
+
+			// Insert phi instructions at the iterated dominance frontier of all blocks that store to each variable
+			std::vector<std::vector<spirv_instruction>> phis(function.blocks.size());
+			std::unordered_map<spv::Id, size_t> phi_variables;
+			{
+				std::vector<std::vector<size_t>> store_blocks(num_variables);
+				for (const size_t block : cfg.order)
+				{
+					for (const spirv_instruction &inst : function.blocks[block].instructions)
+					{
+						if (inst.op != spv::OpStore)
+							continue;
+						if (const auto it = variable_lookup.find(inst.operands[0]); it != variable_lookup.end())
+							if (store_blocks[it->second].empty() || store_blocks[it->second].back() != block)
+								store_blocks[it->second].push_back(block);
+					}
+				}
+
+				std::vector<size_t> has_phi(function.blocks.size(), npos), in_worklist(function.blocks.size(), npos);
+				std::vector<size_t> worklist;
+
+				for (size_t variable = 0; variable < num_variables; ++variable)
+				{
+					worklist = store_blocks[variable];
+					for (const size_t block : worklist)
+						in_worklist[block] = variable;
+
+					while (!worklist.empty())
+					{
+						const size_t block = worklist.back();
+						worklist.pop_back();
+
+						for (const size_t frontier_block : cfg.frontier[block])
+						{
+							if (has_phi[frontier_block] == variable)
+								continue;
+							has_phi[frontier_block] = variable;
+
+							spirv_instruction &phi = phis[frontier_block].emplace_back();
+							phi.op = spv::OpPhi;
+							phi.type = variable_types[variable];
+							phi.result = make_id();
+							phi_variables.emplace(phi.result, variable);
+
+							if (in_worklist[frontier_block] != variable)
+								in_worklist[frontier_block] = variable, worklist.push_back(frontier_block);
+						}
+					}
+				}
+			}
+
+			// Rename loads and stores by walking the dominator tree, keeping track of the current value of each variable
+			std::vector<spv::Id> current_value(num_variables);
+			std::vector<std::pair<size_t, spv::Id>> undo_log;
+
+			const auto get_current_value = [&](size_t variable) {
+				if (current_value[variable] == 0)
+					return add_undef(variable_types[variable]);
+				return current_value[variable];
+			};
+			const auto set_current_value = [&](size_t variable, spv::Id value) {
+				undo_log.emplace_back(variable, current_value[variable]);
+				current_value[variable] = value;
+			};
+
+			struct stack_entry { size_t block, next_child, undo_mark; };
+			std::vector<stack_entry> stack;
+			stack.push_back({ 0, 0, 0 });
+
+			std::vector<bool> renamed(function.blocks.size());
+
+			while (!stack.empty())
+			{
+				stack_entry &entry = stack.back();
+
+				if (entry.next_child == 0 && !renamed[entry.block])
+				{
+					renamed[entry.block] = true;
+					entry.undo_mark = undo_log.size();
+
+					for (const spirv_instruction &phi : phis[entry.block])
+						set_current_value(phi_variables.at(phi.result), phi.result);
+
+					for (spirv_instruction &inst : function.blocks[entry.block].instructions)
+					{
+						if (inst.op == spv::OpLoad)
+						{
+							if (const auto it = variable_lookup.find(inst.operands[0]); it != variable_lookup.end())
+							{
+								replace(inst.result, get_current_value(it->second));
+								inst.op = spv::OpNop;
+							}
+						}
+						else if (inst.op == spv::OpStore)
+						{
+							if (const auto it = variable_lookup.find(inst.operands[0]); it != variable_lookup.end())
+							{
+								set_current_value(it->second, resolve(inst.operands[1]));
+								inst.op = spv::OpNop;
+							}
+						}
+					}
+
+					for (const size_t successor : cfg.successors[entry.block])
+					{
+						for (spirv_instruction &phi : phis[successor])
+						{
+							phi.operands.push_back(get_current_value(phi_variables.at(phi.result)));
+							phi.operands.push_back(function.blocks[entry.block].label);
+						}
+					}
+				}
+
+				if (entry.next_child < cfg.children[entry.block].size())
+				{
+					const size_t child = cfg.children[entry.block][entry.next_child++];
+					stack.push_back({ child, 0, 0 });
+					continue;
+				}
+
+				for (size_t i = undo_log.size(); i-- > entry.undo_mark;)
+					current_value[undo_log[i].first] = undo_log[i].second;
+				undo_log.resize(entry.undo_mark);
+
+				stack.pop_back();
+			}
+
+			for (size_t block = 0; block < function.blocks.size(); ++block)
+			{
+				if (renamed[block])
+				{
+					if (phis[block].empty())
+						continue;
+
+					// Unreachable predecessors still need an entry in every phi instruction
+					for (const size_t predecessor : cfg.predecessors[block])
+						if (!renamed[predecessor])
+							for (spirv_instruction &phi : phis[block])
+								phi.operands.push_back(add_undef(phi.type)), phi.operands.push_back(function.blocks[predecessor].label);
+
+					auto &instructions = function.blocks[block].instructions;
+					instructions.insert(instructions.begin(), std::make_move_iterator(phis[block].begin()), std::make_move_iterator(phis[block].end()));
+				}
+				else
+				{
+					// Remove accesses in unreachable blocks too, since the variables are gone
+					for (spirv_instruction &inst : function.blocks[block].instructions)
+					{
+						if (inst.op == spv::OpLoad)
+						{
+							if (const auto it = variable_lookup.find(inst.operands[0]); it != variable_lookup.end())
+								replace(inst.result, add_undef(variable_types[it->second])), inst.op = spv::OpNop;
+						}
+						else if (inst.op == spv::OpStore)
+						{
+							if (variable_lookup.find(inst.operands[0]) != variable_lookup.end())
+								inst.op = spv::OpNop;
+						}
+					}
+				}
+			}
+
+			for (spirv_instruction &inst : function.blocks[0].instructions)
+				if (inst.op == spv::OpVariable && variable_lookup.find(inst.result) != variable_lookup.end())
+					inst.op = spv::OpNop;
+		}
+
+		/// <summary>
+		/// Replace phi instructions that only ever see a single value with that value.
+		/// </summary>
+		void remove_trivial_phis(spirv_function &function)
+		{
+			for (bool changed = true; changed;)
+			{
+				changed = false;
+
+				for (spirv_basic_block &block : function.blocks)
+				{
+					for (spirv_instruction &inst : block.instructions)
+					{
+						if (inst.op != spv::OpPhi)
+							continue;
+
+						spv::Id unique_value = 0;
+						for (size_t i = 0; i < inst.operands.size(); i += 2)
+						{
+							const spv::Id value = resolve(inst.operands[i]);
+							if (value == inst.result || value == unique_value)
+								continue;
+							if (unique_value != 0)
+							{
+								unique_value = 0;
+								break;
+							}
+							unique_value = value;
+						}
+
+						if (unique_value == 0)
+							continue;
+
+						replace(inst.result, unique_value);
+						inst.op = spv::OpNop;
+						changed = true;
+					}
+				}
+			}
+		}
+
+		/// <summary>
+		/// Forward stored and previously loaded values to loads from the same pointer within a basic block.
+		/// </summary>
+		void forward_loads(spirv_function &function)
+		{
+			enum class root_kind { local, global, read_only, other };
+
+			std::unordered_map<spv::Id, const spirv_instruction *> access_chains;
+			std::unordered_set<spv::Id> local_variables;
+			for (const spirv_basic_block &block : function.blocks)
+			{
+				for (const spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpAccessChain)
+						access_chains[inst.result] = &inst;
+					else if (inst.op == spv::OpVariable)
+						local_variables.insert(inst.result);
+				}
+			}
+
+			const auto find_root = [&](spv::Id pointer, root_kind &kind) {
+				for (auto it = access_chains.find(pointer); it != access_chains.end(); it = access_chains.find(pointer))
+					pointer = resolve(it->second->operands[0]);
+
+				kind = root_kind::other;
+				if (local_variables.count(pointer))
+				{
+					kind = root_kind::local;
+				}
+				else if (const spirv_instruction *const variable = find_global(pointer); variable != nullptr && variable->op == spv::OpVariable)
+				{
+					switch (variable->operands[0])
+					{
+					case spv::StorageClassUniformConstant:
+					case spv::StorageClassInput:
+					case spv::StorageClassUniform:
+						kind = root_kind::read_only;
+						break;
+					default:
+						kind = root_kind::global;
+						break;
+					}
+				}
+				return pointer;
+			};
+
+			struct available_value { spv::Id value, root; root_kind kind; };
+			std::unordered_map<spv::Id, available_value> available;
+
+			// Passing zero as root invalidates all writable memory (e.g. after a function call, which may write through any pointer passed to it)
+			const auto invalidate = [&](spv::Id root, root_kind kind) {
+				for (auto it = available.begin(); it != available.end();)
+				{
+					// Local variables cannot be referenced by anything else, but global variables and function parameters may alias each other
+					const bool may_alias = it->second.kind != root_kind::read_only && (root == 0 || (kind == root_kind::local || it->second.kind == root_kind::local ? it->second.root == root : true));
+					if (may_alias)
+						it = available.erase(it);
+					else
+						++it;
+				}
+			};
+
+			for (spirv_basic_block &block : function.blocks)
+			{
+				available.clear();
+
+				for (spirv_instruction &inst : block.instructions)
+				{
+					switch (inst.op)
+					{
+					case spv::OpLoad:
+					{
+						const spv::Id pointer = resolve(inst.operands[0]);
+						if (const auto it = available.find(pointer); it != available.end())
+						{
+							replace(inst.result, it->second.value);
+							inst.op = spv::OpNop;
+							break;
+						}
+
+						root_kind kind;
+						const spv::Id root = find_root(pointer, kind);
+						available[pointer] = { inst.result, root, kind };
+						break;
+					}
+					case spv::OpStore:
+					{
+						const spv::Id pointer = resolve(inst.operands[0]);
+
+						root_kind kind;
+						const spv::Id root = find_root(pointer, kind);
+						invalidate(root, kind);
+						available[pointer] = { resolve(inst.operands[1]), root, kind };
+						break;
+					}
+					case spv::OpFunctionCall:
+						invalidate(0, root_kind::other);
+						break;
+					case spv::OpExtInst:
+						if (!is_removable_if_unused(inst))
+							invalidate(0, root_kind::other);
+						break;
+					default:
+						break;
+					}
+				}
+			}
+		}
+
+		void apply_replacements(spirv_function &function)
+		{
+			const auto resolve_id = [this](uint32_t &id) { id = resolve(id); };
+
+			for (spirv_basic_block &block : function.blocks)
+				for (spirv_instruction &inst : block.instructions)
+					for_each_id(inst, resolve_id);
+		}
+
+		/// <summary>
+		/// Walk the dominator tree to evaluate constant expressions and reuse values that were already computed in a dominating block.
+		/// </summary>
+		void fold_and_reuse_values(spirv_function &function, const spirv_control_flow &cfg)
+		{
+			std::vector<const spirv_instruction *> local_defs(_next_id);
+			for (const spirv_basic_block &block : function.blocks)
+				for (const spirv_instruction &inst : block.instructions)
+					local_defs[inst.result] = &inst;
+			local_defs[0] = nullptr;
+
+			// Loads can only be reused if nothing may write to the memory they read from
+			const auto is_read_only_pointer = [&](spv::Id pointer) {
+				while (pointer < local_defs.size() && local_defs[pointer] != nullptr && local_defs[pointer]->op == spv::OpAccessChain)
+					pointer = local_defs[pointer]->operands[0];
+
+				const spirv_instruction *const variable = find_global(pointer);
+				return variable != nullptr && variable->op == spv::OpVariable && (
+					variable->operands[0] == spv::StorageClassUniformConstant ||
+					variable->operands[0] == spv::StorageClassInput ||
+					variable->operands[0] == spv::StorageClassUniform);
+			};
+
+			std::unordered_map<std::vector<uint32_t>, spv::Id, words_hash> available;
+			std::vector<std::vector<uint32_t>> undo_log;
+			std::vector<uint32_t> key;
+
+			struct stack_entry { size_t block, next_child, undo_mark; };
+			std::vector<stack_entry> stack;
+			stack.push_back({ 0, 0, 0 });
+
+			const auto resolve_id = [this](uint32_t &id) { id = resolve(id); };
+
+			while (!stack.empty())
+			{
+				stack_entry &entry = stack.back();
+
+				if (entry.next_child == 0 && entry.undo_mark == 0)
+				{
+					entry.undo_mark = undo_log.size() + 1;
+
+					for (spirv_instruction &inst : function.blocks[entry.block].instructions)
+					{
+						if (inst.op == spv::OpNop || inst.op == spv::OpPhi)
+							continue;
+
+						for_each_id(inst, resolve_id);
+
+						if (!is_removable_if_unused(inst))
+							continue;
+
+						if (const spv::Id value = fold(inst, local_defs); value != 0)
+						{
+							replace(inst.result, value);
+							inst.op = spv::OpNop;
+							continue;
+						}
+
+						if (inst.op == spv::OpLoad && !is_read_only_pointer(inst.operands[0]))
+							continue;
+
+						key.clear();
+						key.push_back(inst.op);
+						key.push_back(inst.type);
+						key.insert(key.end(), inst.operands.begin(), inst.operands.end());
+						if (const auto it = available.emplace(key, inst.result); !it.second)
+						{
+							replace(inst.result, it.first->second);
+							inst.op = spv::OpNop;
+						}
+						else
+						{
+							undo_log.push_back(key);
+						}
+					}
+				}
+
+				if (entry.next_child < cfg.children[entry.block].size())
+				{
+					const size_t child = cfg.children[entry.block][entry.next_child++];
+					stack.push_back({ child, 0, 0 });
+					continue;
+				}
+
+				for (size_t i = undo_log.size(); i-- > entry.undo_mark - 1;)
+					available.erase(undo_log[i]);
+				undo_log.resize(entry.undo_mark - 1);
+
+				stack.pop_back();
+			}
+		}
+
+		/// <summary>
+		/// Remove local variables that are never read from and all instructions whose results are not used by anything with side effects.
+		/// </summary>
+		void remove_dead_code(spirv_function &function)
+		{
+			std::vector<spirv_instruction *> local_defs(_next_id);
+			// Only uses of pointers are needed, so only track those
+			std::unordered_map<spv::Id, std::vector<spirv_instruction *>> uses;
+			for (spirv_basic_block &block : function.blocks)
+			{
+				for (spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpNop)
+						continue;
+					if (inst.result != 0)
+						local_defs[inst.result] = &inst;
+					if (inst.op == spv::OpVariable || inst.op == spv::OpAccessChain)
+						uses[inst.result];
+				}
+			}
+			for (spirv_basic_block &block : function.blocks)
+			{
+				for (spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpNop)
+						continue;
+					for_each_id(inst, [&](uint32_t id) {
+						if (const auto it = uses.find(id); it != uses.end())
+							it->second.push_back(&inst);
+					});
+				}
+			}
+
+			// Find local variables (and access chains into them) that are only ever stored to
+			std::unordered_map<spv::Id, bool> write_only;
+			const auto is_write_only = [&](spv::Id pointer, const auto &is_write_only) -> bool {
+				if (const auto it = write_only.find(pointer); it != write_only.end())
+					return it->second;
+
+				bool result = true;
+				if (const auto it = uses.find(pointer); it != uses.end())
+				{
+					for (const spirv_instruction *const use : it->second)
+					{
+						if (use->op == spv::OpStore && use->operands[0] == pointer && use->operands[1] != pointer)
+							continue;
+						if (use->op == spv::OpAccessChain && use->operands[0] == pointer && is_write_only(use->result, is_write_only))
+							continue;
+						result = false;
+						break;
+					}
+				}
+
+				write_only[pointer] = result;
+				return result;
+			};
+
+			const auto remove_writes = [&](spv::Id pointer, const auto &remove_writes) -> void {
+				if (const auto it = uses.find(pointer); it != uses.end())
+				{
+					for (spirv_instruction *const use : it->second)
+					{
+						if (use->op == spv::OpAccessChain)
+							remove_writes(use->result, remove_writes);
+						use->op = spv::OpNop;
+					}
+				}
+			};
+
+			for (spirv_instruction &inst : function.blocks[0].instructions)
+			{
+				if (inst.op == spv::OpVariable && inst.operands[0] == spv::StorageClassFunction && is_write_only(inst.result, is_write_only))
+				{
+					remove_writes(inst.result, remove_writes);
+					inst.op = spv::OpNop;
+				}
+			}
+
+			// Mark everything that is transitively used by instructions with side effects
+			std::vector<bool> live(_next_id);
+			std::vector<spirv_instruction *> worklist;
+			const auto mark = [&](uint32_t id) {
+				if (local_defs[id] != nullptr && local_defs[id]->op != spv::OpNop && !live[id])
+					live[id] = true, worklist.push_back(local_defs[id]);
+			};
+
+			for (spirv_basic_block &block : function.blocks)
+			{
+				for (spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpNop || is_removable_if_unused(inst))
+						continue;
+					if (inst.result != 0)
+						live[inst.result] = true;
+					for_each_id(inst, mark);
+				}
+			}
+
+			while (!worklist.empty())
+			{
+				spirv_instruction &inst = *worklist.back();
+				worklist.pop_back();
+				for_each_id(inst, mark);
+			}
+
+			for (spirv_basic_block &block : function.blocks)
+			{
+				spirv_instruction *previous_line = nullptr;
+
+				for (spirv_instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpNop)
+						continue;
+
+					if (is_removable_if_unused(inst) && !live[inst.result])
+					{
+						inst.op = spv::OpNop;
+						continue;
+					}
+
+					// Remove debug line instructions that no longer apply to anything
+					if (inst.op == spv::OpLine)
+					{
+						if (previous_line != nullptr)
+							previous_line->op = spv::OpNop;
+						previous_line = &inst;
+					}
+					else
+					{
+						previous_line = nullptr;
+					}
+				}
+			}
+		}
+
+		/// <summary>
+		/// Remove constants that are no longer referenced and any debug or annotation instructions targeting IDs that no longer exist.
+		/// </summary>
+		void remove_dead_globals()
+		{
+			std::vector<bool> live(_next_id);
+			std::vector<spv::Id> worklist;
+			const auto mark = [&](uint32_t id) {
+				if (!live[id])
+					live[id] = true, worklist.push_back(id);
+			};
+
+			for (spirv_function &function : _functions)
+			{
+				for (spirv_instruction &inst : function.declaration)
+					for_each_id(inst, mark);
+				for (spirv_basic_block &block : function.blocks)
+					for (spirv_instruction &inst : block.instructions)
+						if (inst.op != spv::OpNop)
+							for_each_id(inst, mark);
+			}
+
+			const auto is_removable_constant = [](spv::Op op) {
+				return op == spv::OpConstantTrue || op == spv::OpConstantFalse || op == spv::OpConstant || op == spv::OpConstantComposite || op == spv::OpConstantNull || op == spv::OpUndef;
+			};
+
+			for (spirv_instruction &inst : _globals)
+			{
+				switch (inst.op)
+				{
+				case spv::OpName:
+				case spv::OpMemberName:
+				case spv::OpDecorate:
+				case spv::OpMemberDecorate:
+					break; // These do not keep their target alive
+				default:
+					if (!is_removable_constant(inst.op))
+						for_each_id(inst, mark);
+					break;
+				}
+			}
+
+			while (!worklist.empty())
+			{
+				const spv::Id id = worklist.back();
+				worklist.pop_back();
+
+				if (_global_lookup[id] != npos)
+					for_each_id(_globals[_global_lookup[id]], mark);
+			}
+
+			std::vector<bool> defined(_next_id);
+			for (spirv_instruction &inst : _globals)
+			{
+				if (is_removable_constant(inst.op) && !live[inst.result])
+					inst.op = spv::OpNop;
+				else
+					defined[inst.result] = true;
+			}
+			for (const spirv_function &function : _functions)
+			{
+				for (const spirv_instruction &inst : function.declaration)
+					defined[inst.result] = true;
+				for (const spirv_basic_block &block : function.blocks)
+				{
+					defined[block.label] = true;
+					for (const spirv_instruction &inst : block.instructions)
+						if (inst.op != spv::OpNop)
+							defined[inst.result] = true;
+				}
+			}
+
+			for (spirv_instruction &inst : _globals)
+			{
+				switch (inst.op)
+				{
+				case spv::OpName:
+				case spv::OpMemberName:
+				case spv::OpDecorate:
+				case spv::OpMemberDecorate:
+					if (!defined[inst.operands[0]])
+						inst.op = spv::OpNop;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		uint32_t _header[5] = {};
+		spv::Id _next_id = 0;
+		std::vector<spirv_instruction> _globals;
+		std::vector<spirv_function> _functions;
+		std::vector<size_t> _global_lookup;
+		std::unordered_map<std::vector<uint32_t>, spv::Id, words_hash> _constant_lookup;
+		std::unordered_map<spv::Id, spv::Id> _undef_lookup;
+		std::vector<spv::Id> _replacements;
+	};
+}
+
+bool reshadefx::optimize_spirv(std::vector<uint32_t> &spirv)
+{
+	spirv_optimizer optimizer;
+	if (!optimizer.parse(spirv))
+		return false;
+
+	optimizer.run();
+	optimizer.write(spirv);
+
+	return true;
+}
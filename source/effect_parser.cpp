@@ -7,6 +7,7 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
+#include <cstring> // std::memcpy
 #include <algorithm>
 #include <functional>
 
@@ -25,15 +26,52 @@ reshadefx::parser::~parser()
 {
 }
 
-bool reshadefx::parser::parse(std::string input, codegen *backend)
+bool reshadefx::parser::parse(std::string input, codegen *backend, const source_line_map *line_map)
 {
-	_lexer.reset(new lexer(std::move(input)));
-	_lexer_backup.reset();
+	// Locations from the line map refer to its file table, so continue with that one
+	if (line_map != nullptr)
+		_source_files = line_map->source_files;
+
+	_lexer.reset(new lexer(
+		std::move(input),
+		true  /* ignore_comments */,
+		true  /* ignore_whitespace */,
+		true  /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		false /* ignore_keywords */,
+		true  /* escape_string_literals */,
+		location(),
+		&_source_files,
+		line_map));
+
+	_token_ids.clear();
+	_token_locations.clear();
+	_token_literals.clear();
+	_token_strings.clear();
+	_token_escapes.clear();
+
+	// Lex the entire input, including the terminating end of file token
+	token tok;
+	do
+	{
+		tok = _lexer->lex();
+
+		uint64_t literal;
+		std::memcpy(&literal, &tok.literal_as_double, sizeof(literal));
+
+		_token_ids.push_back(tok.id);
+		_token_locations.push_back(tok.location);
+		_token_literals.push_back(literal);
+		_token_strings.push_back(tok.literal_as_string);
+		_token_escapes.push_back(tok.escape_literal);
+	} while (tok.id != tokenid::end_of_file);
 
 	// Set backend for subsequent code-generation
 	_codegen = backend;
+	_codegen->set_source_files(&_source_files);
 
-	consume();
+	_token_next_index = 0;
+	read_token(_token_next_index, _token_next);
 
 	bool parse_success = true;
 
@@ -43,9 +81,39 @@ bool reshadefx::parser::parse(std::string input, codegen *backend)
 			parse_success = false;
 	}
 
+	// Release memory that was only needed during parsing
+	assert(_expression_list_depth == 0);
+	_expression_lists.clear();
+
 	return parse_success;
 }
 
+// -- Expression List Pool -- //
+
+class reshadefx::parser::scoped_expression_list
+{
+public:
+	explicit scoped_expression_list(parser &parser) : _parser(parser)
+	{
+		if (_parser._expression_list_depth == _parser._expression_lists.size())
+			_parser._expression_lists.push_back(std::make_unique<std::vector<expression>>());
+
+		_list = _parser._expression_lists[_parser._expression_list_depth++].get();
+		_list->clear();
+	}
+	~scoped_expression_list()
+	{
+		_list->clear();
+		_parser._expression_list_depth--;
+	}
+
+	std::vector<expression> &operator*() { return *_list; }
+
+private:
+	parser &_parser;
+	std::vector<expression> *_list;
+};
+
 // -- Error Handling -- //
 
 void reshadefx::parser::error(const location &location, unsigned int code, const std::string &message)
@@ -53,7 +121,7 @@ void reshadefx::parser::error(const location &location, unsigned int code, const
 	if (_errors.size() > 1000)
 		return; // Stop printing any more errors after a certain amount
 
-	_errors += location.source;
+	_errors += _source_files.path(location.source_id);
 	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": error";
 	_errors += (code == 0) ? ": " : " X" + std::to_string(code) + ": ";
 	_errors += message;
@@ -61,7 +129,7 @@ void reshadefx::parser::error(const location &location, unsigned int code, const
 }
 void reshadefx::parser::warning(const location &location, unsigned int code, const std::string &message)
 {
-	_errors += location.source;
+	_errors += _source_files.path(location.source_id);
 	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": warning";
 	_errors += (code == 0) ? ": " : " X" + std::to_string(code) + ": ";
 	_errors += message;
@@ -72,20 +140,32 @@ void reshadefx::parser::warning(const location &location, unsigned int code, con
 
 void reshadefx::parser::backup()
 {
-	_lexer.swap(_lexer_backup);
-	_lexer.reset(new lexer(*_lexer_backup));
-	_token_backup = _token_next;
+	_token_backup_index = _token_next_index;
 }
 void reshadefx::parser::restore()
 {
-	_lexer.swap(_lexer_backup);
-	_token_next = _token_backup;
+	_token_next_index = _token_backup_index;
+	read_token(_token_next_index, _token_next);
+}
+void reshadefx::parser::read_token(size_t index, token &tok) const
+{
+	tok.id = _token_ids[index];
+	tok.location = _token_locations[index];
+	tok.offset = 0;
+	tok.length = 0;
+	std::memcpy(&tok.literal_as_double, &_token_literals[index], sizeof(tok.literal_as_double));
+	tok.literal_as_string = _token_strings[index];
+	tok.escape_literal = _token_escapes[index];
 }
 
 void reshadefx::parser::consume()
 {
 	_token = std::move(_token_next);
-	_token_next = _lexer->lex();
+
+	// Keep returning the end of file token once it was reached
+	if (_token_next_index + 1 < _token_ids.size())
+		_token_next_index++;
+	read_token(_token_next_index, _token_next);
 }
 void reshadefx::parser::consume_until(tokenid tokid)
 {
@@ -131,18 +211,19 @@ bool reshadefx::parser::accept_symbol(std::string &identifier, scope &scope, sym
 		return false;
 	}
 
-	identifier = std::move(_token.literal_as_string);
+	identifier = _token.literal_as_string;
 
 	// Can concatenate multiple '::' to force symbol search for a specific namespace level
 	while (accept(tokenid::colon_colon))
 	{
 		if (!expect(tokenid::identifier))
 			return false;
-		identifier += "::" + std::move(_token.literal_as_string);
+		identifier += "::";
+		identifier += _token.literal_as_string;
 	}
 
 	// Figure out which scope to start searching in
-	scope = { "::", 0, 0 };
+	scope = { 0, 0, 0 };
 	if (!exclusive) scope = current_scope();
 
 	// Lookup name in the symbol table
@@ -626,7 +707,8 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	else if (accept('{'))
 	{
 		bool is_constant = true;
-		std::vector<expression> elements;
+		scoped_expression_list elements_list(*this);
+		std::vector<expression> &elements = *elements_list;
 		type composite_type = { type::t_void, 1, 1 };
 
 		while (!peek('}'))
@@ -661,7 +743,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			for (expression &element : elements)
 			{
 				element.add_cast_operation(composite_type);
-				res.array_data.push_back(element.constant);
+				res.array_data.push_back(element.constant, composite_type.components());
 			}
 
 			composite_type.array_length = static_cast<int>(elements.size());
@@ -714,11 +796,11 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	}
 	else if (accept(tokenid::string_literal))
 	{
-		std::string value = std::move(_token.literal_as_string);
+		std::string value = _token.unescape_literal();
 
 		// Multiple string literals in sequence are concatenated into a single string literal
 		while (accept(tokenid::string_literal))
-			value += _token.literal_as_string;
+			value += _token.unescape_literal();
 
 		exp.reset_to_rvalue_constant(location, std::move(value));
 	}
@@ -736,7 +818,8 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 		// Parse entire argument expression list
 		bool is_constant = true;
 		unsigned int num_components = 0;
-		std::vector<expression> arguments;
+		scoped_expression_list arguments_list(*this);
+		std::vector<expression> &arguments = *arguments_list;
 
 		while (!peek(')'))
 		{
@@ -842,7 +925,8 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return error(location, 3005, "identifier '" + identifier + "' represents a variable, not a function"), false;
 
 			// Parse entire argument expression list
-			std::vector<expression> arguments;
+			scoped_expression_list arguments_list(*this);
+			std::vector<expression> &arguments = *arguments_list;
 
 			while (!peek(')'))
 			{
@@ -875,7 +959,9 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 
 			assert(symbol.function != nullptr);
 
-			std::vector<expression> parameters(arguments.size());
+			scoped_expression_list parameters_list(*this);
+			std::vector<expression> &parameters = *parameters_list;
+			parameters.resize(arguments.size());
 
 			// We need to allocate some temporary variables to pass in and load results from pointer parameters
 			for (size_t i = 0; i < arguments.size(); ++i)
@@ -990,7 +1076,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return false;
 
 			location = std::move(_token.location);
-			const auto subscript = std::move(_token.literal_as_string);
+			const std::string subscript(_token.literal_as_string);
 
 			if (accept('(')) // Methods (function calls on types) are not supported right now
 			{
@@ -1488,7 +1574,7 @@ bool reshadefx::parser::parse_annotations(std::vector<annotation> &annotations)
 		if (!expect(tokenid::identifier))
 			return consume_until('>'), false;
 
-		auto name = std::move(_token.literal_as_string);
+		std::string name(_token.literal_as_string);
 
 		if (expression expression; !expect('=') || !parse_expression_multary(expression) || !expect(';'))
 			return consume_until('>'), false;
@@ -1523,7 +1609,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			dont_flatten = 0x8,
 		};
 
-		const auto attribute = std::move(_token_next.literal_as_string);
+		const std::string attribute(_token_next.literal_as_string);
 
 		if (!expect(tokenid::identifier) || !expect(']'))
 			return false;
@@ -1737,7 +1823,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 				do { // There may be multiple declarations behind a type, so loop through them
 					if (count++ > 0 && !expect(','))
 						return false;
-					if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+					if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 						return false;
 				} while (!peek(';'));
 			}
@@ -2059,7 +2145,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			if (count++ > 0 && !expect(','))
 				// Try to consume the rest of the declaration so that parsing may continue despite the error
 				return consume_until(';'), false;
-			if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+			if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 				return consume_until(';'), false;
 		} while (!peek(';'));
 
@@ -2131,7 +2217,7 @@ bool reshadefx::parser::parse_top()
 		if (!expect(tokenid::identifier))
 			return false;
 
-		const auto name = std::move(_token.literal_as_string);
+		const std::string name(_token.literal_as_string);
 
 		if (!expect('{'))
 			return false;
@@ -2168,7 +2254,7 @@ bool reshadefx::parser::parse_top()
 
 		if (peek('('))
 		{
-			const auto name = std::move(_token.literal_as_string);
+			const std::string name(_token.literal_as_string);
 			// This is definitely a function declaration, so parse it
 			if (!parse_function(type, name)) {
 				// Insert dummy function into symbol table, so later references can be resolved despite the error
@@ -2183,7 +2269,7 @@ bool reshadefx::parser::parse_top()
 			do {
 				if (count++ > 0 && !(expect(',') && expect(tokenid::identifier)))
 					return false;
-				const auto name = std::move(_token.literal_as_string);
+				const std::string name(_token.literal_as_string);
 				if (!parse_variable(type, name, true)) {
 					// Insert dummy variable into symbol table, so later references can be resolved despite the error
 					insert_symbol(name, { symbol_type::variable, ~0u, type }, true);
@@ -2212,11 +2298,11 @@ bool reshadefx::parser::parse_struct()
 	struct_info info;
 	// The structure name is optional
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 	else
 		info.name = "_anonymous_struct_" + std::to_string(location.line) + '_' + std::to_string(location.column);
 
-	info.unique_name = 'S' + current_scope().name + info.name;
+	info.unique_name = 'S' + current_namespace_name() + info.name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	if (!expect('{'))
@@ -2245,7 +2331,7 @@ bool reshadefx::parser::parse_struct()
 			if (!expect(tokenid::identifier))
 				return consume_until('}'), false;
 
-			member.name = std::move(_token.literal_as_string);
+			member.name = _token.literal_as_string;
 			member.location = std::move(_token.location);
 
 			// Modify member specific type, so that following members in the declaration list are not affected by this
@@ -2260,7 +2346,7 @@ bool reshadefx::parser::parse_struct()
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), false;
 
-				member.semantic = std::move(_token.literal_as_string);
+				member.semantic = _token.literal_as_string;
 				// Make semantic upper case to simplify comparison later on
 				std::transform(member.semantic.begin(), member.semantic.end(), member.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 			}
@@ -2300,7 +2386,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 
 	function_info info;
 	info.name = name;
-	info.unique_name = 'F' + current_scope().name + name;
+	info.unique_name = 'F' + current_namespace_name() + name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	info.return_type = type;
@@ -2341,7 +2427,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 			break;
 		}
 
-		param.name = std::move(_token.literal_as_string);
+		param.name = _token.literal_as_string;
 		param.location = std::move(_token.location);
 
 		if (param.type.is_void())
@@ -2387,7 +2473,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 				break;
 			}
 
-			param.semantic = std::move(_token.literal_as_string);
+			param.semantic = _token.literal_as_string;
 			// Make semantic upper case to simplify comparison later on
 			std::transform(param.semantic.begin(), param.semantic.end(), param.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -2413,7 +2499,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 		if (type.is_void())
 			return error(_token.location, 3076, '\'' + name + "': void function cannot have a semantic"), false;
 
-		info.return_semantic = std::move(_token.literal_as_string);
+		info.return_semantic = _token.literal_as_string;
 		// Make semantic upper case to simplify comparison later on
 		std::transform(info.return_semantic.begin(), info.return_semantic.end(), info.return_semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 	}
@@ -2513,7 +2599,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 			return error(_token.location, 3043, '\'' + name + "': local variables cannot have semantics"), false;
 
 		std::string &semantic = texture_info.semantic;
-		semantic = std::move(_token.literal_as_string);
+		semantic = _token.literal_as_string;
 
 		// Make semantic upper case to simplify comparison later on
 		std::transform(semantic.begin(), semantic.end(), semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
@@ -2566,7 +2652,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), false;
 
-				const auto property_name = std::move(_token.literal_as_string);
+				const std::string property_name(_token.literal_as_string);
 				const auto property_location = std::move(_token.location);
 
 				if (!expect('='))
@@ -2579,7 +2665,8 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (accept(tokenid::identifier)) // Handle special enumeration names for property values
 				{
 					// Transform identifier to uppercase to do case-insensitive comparison
-					std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+					std::string value(_token.literal_as_string);
+					std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 					static const std::unordered_map<std::string, uint32_t> s_values = {
 						{ "NONE", 0 }, { "POINT", 0 },
@@ -2603,7 +2690,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					};
 
 					// Look up identifier in list of possible enumeration names
-					if (const auto it = s_values.find(_token.literal_as_string);
+					if (const auto it = s_values.find(value);
 						it != s_values.end())
 						expression.reset_to_rvalue_constant(_token.location, it->second);
 					else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -2693,7 +2780,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 		assert(global);
 
 		// Add namespace scope to avoid name clashes
-		texture_info.unique_name = 'V' + current_scope().name + name;
+		texture_info.unique_name = 'V' + current_namespace_name() + name;
 		std::replace(texture_info.unique_name.begin(), texture_info.unique_name.end(), ':', '_');
 
 		texture_info.annotations = std::move(sampler_info.annotations);
@@ -2712,7 +2799,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 			return error(location, 4582, '\'' + name + "': texture does not support sRGB sampling (only textures with RGBA8 format do)"), false;
 
 		// Add namespace scope to avoid name clashes
-		sampler_info.unique_name = 'V' + current_scope().name + name;
+		sampler_info.unique_name = 'V' + current_namespace_name() + name;
 		std::replace(sampler_info.unique_name.begin(), sampler_info.unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
@@ -2739,7 +2826,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 	else
 	{
 		// Update global variable names to contain the namespace scope to avoid name clashes
-		std::string unique_name = global ? 'V' + current_scope().name + name : name;
+		std::string unique_name = global ? 'V' + current_namespace_name() + name : name;
 		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
@@ -2759,7 +2846,7 @@ bool reshadefx::parser::parse_technique()
 		return false;
 
 	technique_info info;
-	info.name = std::move(_token.literal_as_string);
+	info.name = _token.literal_as_string;
 
 	bool parse_success = parse_annotations(info.annotations);
 
@@ -2806,7 +2893,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			return consume_until('}'), false;
 
 		auto location = std::move(_token.location);
-		const auto state = std::move(_token.literal_as_string);
+		const std::string state(_token.literal_as_string);
 
 		if (!expect('='))
 			return consume_until('}'), false;
@@ -2902,7 +2989,8 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			if (accept(tokenid::identifier)) // Handle special enumeration names for pass states
 			{
 				// Transform identifier to uppercase to do case-insensitive comparison
-				std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+				std::string value(_token.literal_as_string);
+				std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 				static const std::unordered_map<std::string, uint32_t> s_enum_values = {
 					{ "NONE", 0 }, { "ZERO", 0 }, { "ONE", 1 },
@@ -2945,7 +3033,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				};
 
 				// Look up identifier in list of possible enumeration names
-				if (const auto it = s_enum_values.find(_token.literal_as_string);
+				if (const auto it = s_enum_values.find(value);
 					it != s_enum_values.end())
 					expression.reset_to_rvalue_constant(_token.location, it->second);
 				else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -25,8 +25,9 @@ namespace reshadefx
 		/// </summary>
 		/// <param name="source">The string to analyze.</param>
 		/// <param name="backend">The code generation implementation to use.</param>
+		/// <param name="line_map">An optional map of the source locations in the input string, used instead of '#line' directives (see <see cref="preprocessor::set_compact_output"/>). It only has to stay alive for the duration of this call.</param>
 		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
-		bool parse(std::string source, class codegen *backend);
+		bool parse(std::string source, class codegen *backend, const source_line_map *line_map = nullptr);
 
 		/// <summary>
 		/// Get the list of error messages.
@@ -40,6 +41,7 @@ namespace reshadefx
 
 		void backup();
 		void restore();
+		void read_token(size_t index, token &tok) const;
 
 		bool peek(char tok) const { return _token_next.id == static_cast<tokenid>(tok); }
 		bool peek(tokenid tokid) const { return _token_next.id == tokid; }
@@ -75,12 +77,26 @@ namespace reshadefx
 		bool parse_statement(bool scoped);
 		bool parse_statement_block(bool scoped);
 
+		class scoped_expression_list;
+
 		codegen *_codegen = nullptr;
 		std::string _errors;
-		token _token, _token_next, _token_backup;
-		std::unique_ptr<class lexer> _lexer, _lexer_backup;
+		token _token, _token_next;
+		std::unique_ptr<class lexer> _lexer;
+		// The input is lexed once up front into a structure of arrays (with only the token data the parser needs), so that backup and restore only have to save an index
+		std::vector<tokenid> _token_ids;
+		std::vector<location> _token_locations;
+		std::vector<uint64_t> _token_literals;
+		std::vector<std::string_view> _token_strings;
+		std::vector<bool> _token_escapes;
+		size_t _token_next_index = 0;
+		size_t _token_backup_index = 0;
+		source_file_table _source_files;
 		reshadefx::type _current_return_type;
 		std::vector<uint32_t> _loop_break_target_stack;
 		std::vector<uint32_t> _loop_continue_target_stack;
+		// Argument and initializer lists are taken from this pool in stack order and keep their memory for reuse until parsing has finished
+		std::vector<std::unique_ptr<std::vector<expression>>> _expression_lists;
+		size_t _expression_list_depth = 0;
 	};
 }
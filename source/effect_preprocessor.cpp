@@ -6,6 +6,7 @@
 #include "effect_lexer.hpp"
 #include "effect_preprocessor.hpp"
 #include <cassert>
+#include <algorithm>
 
 #ifndef _WIN32
 	// On Linux systems the native path encoding is UTF-8 already, so no conversion necessary
@@ -62,39 +63,112 @@ static const int precedence_lookup[] = {
 	11, 11, 11, 11 // unary operators
 };
 
-static bool read_file(const std::filesystem::path &path, std::string &data)
+static std::shared_ptr<const std::string> read_file(const std::filesystem::path &path, uintmax_t file_size)
 {
 #ifdef _WIN32
 	FILE *file = nullptr;
 	if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
-		return false;
+		return nullptr;
 #else
 	FILE *const file = fopen(path.c_str(), "rb");
 	if (file == nullptr)
-		return false;
+		return nullptr;
 #endif
 
-	// Read file contents into memory
-	std::vector<char> file_mem(static_cast<size_t>(std::filesystem::file_size(path) + 1));
-	const size_t eof = fread(file_mem.data(), 1, file_mem.size() - 1, file);
+	// Read file contents directly into the string that is handed to the lexer later
+	std::string data(static_cast<size_t>(file_size + 1), '\0');
+	const size_t eof = fread(data.data(), 1, data.size() - 1, file);
 
 	// Append a new line feed to the end of the input string to avoid issues with parsing
-	file_mem[eof] = '\n';
+	data[eof] = '\n';
+	data.resize(eof + 1);
 
 	// No longer need to have a handle open to the file, since all data was read, so can safely close it
 	fclose(file);
 
-	std::string_view file_data(file_mem.data(), file_mem.size());
-
 	// Remove BOM (0xefbbbf means 0xfeff)
-	if (file_data.size() >= 3 &&
-		static_cast<unsigned char>(file_data[0]) == 0xef &&
-		static_cast<unsigned char>(file_data[1]) == 0xbb &&
-		static_cast<unsigned char>(file_data[2]) == 0xbf)
-		file_data = std::string_view(file_data.data() + 3, file_data.size() - 3);
+	if (data.size() >= 3 &&
+		static_cast<unsigned char>(data[0]) == 0xef &&
+		static_cast<unsigned char>(data[1]) == 0xbb &&
+		static_cast<unsigned char>(data[2]) == 0xbf)
+		data.erase(0, 3);
 
-	data = file_data;
-	return true;
+	return std::make_shared<const std::string>(std::move(data));
+}
+
+static bool is_identifier_char(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Check whether the lexer could produce a different token than the specified one if its raw data was directly followed by the specified character
+static bool may_merge_with(reshadefx::tokenid id, std::string_view raw_data, char next)
+{
+	switch (id)
+	{
+	case reshadefx::tokenid::space:
+		return false;
+	case reshadefx::tokenid::identifier:
+		return is_identifier_char(next);
+	case reshadefx::tokenid::int_literal:
+	case reshadefx::tokenid::uint_literal:
+	case reshadefx::tokenid::float_literal:
+	case reshadefx::tokenid::double_literal:
+		return is_identifier_char(next) || next == '.' || ((next == '+' || next == '-') && (raw_data.back() == 'e' || raw_data.back() == 'E'));
+	case reshadefx::tokenid::string_literal:
+		// Unterminated string literals continue to the end of the line
+		return raw_data.size() < 2 || raw_data.back() != '\"' || raw_data[raw_data.size() - 2] == '\\';
+	default:
+		break;
+	}
+
+	if (raw_data.size() == 1)
+	{
+		switch (raw_data[0])
+		{
+		case '!':
+		case '%':
+		case '*':
+		case '=':
+		case '^':
+			return next == '=';
+		case '&':
+			return next == '&' || next == '=';
+		case '+':
+			return next == '+' || next == '=';
+		case '-':
+			return next == '-' || next == '=' || next == '>';
+		case '.':
+			return next == '.' || (next >= '0' && next <= '9');
+		case '/':
+			return next == '/' || next == '*' || next == '=';
+		case ':':
+			return next == ':';
+		case '<':
+			return next == '<' || next == '=';
+		case '>':
+			return next == '>' || next == '=';
+		case '|':
+			return next == '|' || next == '=';
+		}
+	}
+	else if (raw_data == "<<" || raw_data == ">>")
+	{
+		return next == '=';
+	}
+
+	return false;
+}
+
+static std::string directory_index_key(const std::filesystem::path &path)
+{
+	std::string key = path.u8string();
+#ifdef _WIN32
+	// File names are not case-sensitive on Windows
+	std::transform(key.begin(), key.end(), key.begin(),
+		[](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; });
+#endif
+	return key;
 }
 
 static std::string escape_string(std::string s)
@@ -104,6 +178,142 @@ static std::string escape_string(std::string s)
 	return '\"' + s + '\"';
 }
 
+std::shared_ptr<const std::string> reshadefx::source_cache::load(const std::filesystem::path &path)
+{
+	std::error_code ec;
+	const auto last_write_time = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return nullptr;
+	const uintmax_t file_size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return nullptr;
+
+	const std::string key = path.lexically_normal().u8string();
+
+	{ const std::lock_guard<std::mutex> lock(_mutex);
+		// Only reuse cached contents if the file was not modified since it was read
+		if (const auto it = _files.find(key);
+			it != _files.end() && it->second.last_write_time == last_write_time && it->second.size == file_size)
+		{
+			_cache_hits++;
+			return it->second.data;
+		}
+	}
+
+	// Read the file without holding the lock, so that other threads can continue to look up files in the meantime
+	std::shared_ptr<const std::string> data = read_file(path, file_size);
+	if (data == nullptr)
+		return nullptr;
+
+	_files_read++;
+	_bytes_read += static_cast<size_t>(file_size);
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_files[key] = { data, last_write_time, file_size };
+
+	return data;
+}
+
+bool reshadefx::source_cache::exists(const std::filesystem::path &path)
+{
+	const std::filesystem::path normal_path = path.lexically_normal();
+	if (!normal_path.has_filename())
+	{
+		std::error_code ec;
+		return std::filesystem::exists(normal_path, ec);
+	}
+
+	return list_directory(normal_path.parent_path())->names.count(directory_index_key(normal_path.filename())) != 0;
+}
+std::vector<std::filesystem::path> reshadefx::source_cache::find_files(const std::filesystem::path &directory, std::initializer_list<std::filesystem::path> extensions)
+{
+	const std::shared_ptr<const directory_listing> listing = list_directory(directory);
+
+	std::vector<std::filesystem::path> files;
+	for (const auto &[name, is_directory] : listing->entries)
+		if (!is_directory &&
+			std::find(extensions.begin(), extensions.end(), name.extension()) != extensions.end())
+			files.push_back(directory / name);
+	return files;
+}
+void reshadefx::source_cache::refresh_directories()
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_directory_generation++;
+}
+
+std::shared_ptr<const reshadefx::source_cache::directory_listing> reshadefx::source_cache::list_directory(const std::filesystem::path &path)
+{
+	const std::filesystem::path directory = path.empty() ? std::filesystem::path(".") : path.lexically_normal();
+	const std::string key = directory_index_key(directory);
+
+	std::shared_ptr<const directory_listing> listing;
+	unsigned int generation;
+	{ const std::lock_guard<std::mutex> lock(_mutex);
+		generation = _directory_generation;
+		if (const auto it = _directories.find(key); it != _directories.end())
+		{
+			if (it->second.generation == generation)
+				return it->second.listing;
+			listing = it->second.listing;
+		}
+	}
+
+	std::error_code ec;
+	const auto last_write_time = std::filesystem::last_write_time(directory, ec);
+
+	// Adding, removing or renaming files changes the modification time of the directory, so only need to enumerate it again when that changed
+	if (listing == nullptr || listing->exists == !!ec || (!ec && listing->last_write_time != last_write_time))
+	{
+		const auto new_listing = std::make_shared<directory_listing>();
+		if (!ec)
+		{
+			new_listing->exists = true;
+			new_listing->last_write_time = last_write_time;
+
+			for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied, ec))
+			{
+				new_listing->entries.emplace_back(entry.path().filename(), entry.is_directory(ec));
+				new_listing->names.insert(directory_index_key(entry.path().filename()));
+			}
+		}
+
+		listing = new_listing;
+	}
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_directories[key] = { listing, generation };
+
+	return listing;
+}
+
+std::shared_ptr<const reshadefx::include_snapshot> reshadefx::source_cache::find_snapshot(const std::string &key)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	if (const auto it = _snapshots.find(key); it != _snapshots.end())
+	{
+		_snapshot_hits++;
+		return it->second;
+	}
+	return nullptr;
+}
+void reshadefx::source_cache::store_snapshot(const std::string &key, std::shared_ptr<const include_snapshot> snapshot)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	// Predefined macros change with the back buffer size and other settings, so throw away old snapshots once too many accumulated
+	if (_snapshots.size() >= 256 && _snapshots.find(key) == _snapshots.end())
+		_snapshots.clear();
+	_snapshots[key] = std::move(snapshot);
+}
+
+void reshadefx::source_cache::clear()
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_files.clear();
+	_snapshots.clear();
+	_directories.clear();
+}
+
 reshadefx::preprocessor::preprocessor()
 {
 }
@@ -124,15 +334,52 @@ bool reshadefx::preprocessor::add_macro_definition(const std::string &name, cons
 
 bool reshadefx::preprocessor::append_file(const std::filesystem::path &path)
 {
-	std::string data;
-	if (!read_file(path, data))
+	std::shared_ptr<const std::string> data = load_file(path);
+	if (data == nullptr)
 		return false;
 
 	_success = true; // Clear success flag before parsing a new file
 
+	// Snapshots can only be shared if nothing was parsed before, since the state would depend on that otherwise
+	if (_source_cache != nullptr && _output.empty())
+	{
+		_include_prefix = true;
+		_include_prefix_files.clear();
+
+		// Everything that influences how the leading includes are processed has to be part of the key
+		_include_prefix_key = _compact_output ? "compact\n" : "\n";
+		for (const std::filesystem::path &include_path : _include_paths)
+			_include_prefix_key += include_path.u8string() + '\n';
+
+		std::vector<std::pair<std::string_view, const macro *>> macros;
+		macros.reserve(_macros.size());
+		for (const auto &it : _macros)
+			macros.emplace_back(it.first.view(), &it.second);
+		std::sort(macros.begin(), macros.end(),
+			[](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+
+		for (const auto &[name, macro] : macros)
+		{
+			_include_prefix_key += name;
+			if (macro->is_function_like)
+			{
+				_include_prefix_key += '(';
+				for (const std::string &parameter : macro->parameters)
+					_include_prefix_key += parameter + ',';
+				if (macro->is_variadic)
+					_include_prefix_key += "...";
+				_include_prefix_key += ')';
+			}
+			_include_prefix_key += '=' + macro->replacement_list + '\n';
+		}
+	}
+
 	push(std::move(data), path.u8string());
 	parse();
 
+	_include_prefix = false;
+	_pending_snapshot.reset();
+
 	return _success;
 }
 bool reshadefx::preprocessor::append_string(const std::string &source_code)
@@ -156,37 +403,192 @@ std::vector<std::filesystem::path> reshadefx::preprocessor::included_files() con
 		files.push_back(std::filesystem::u8path(it.first));
 	return files;
 }
+std::vector<std::filesystem::path> reshadefx::preprocessor::missing_files() const
+{
+	std::vector<std::filesystem::path> files;
+	files.reserve(_missing_files.size());
+	for (const std::string &file : _missing_files)
+		files.push_back(std::filesystem::u8path(file));
+	std::sort(files.begin(), files.end());
+	return files;
+}
 std::vector<std::pair<std::string, std::string>> reshadefx::preprocessor::used_macro_definitions() const
 {
 	std::vector<std::pair<std::string, std::string>> defines;
 	defines.reserve(_used_macros.size());
-	for (const std::string &name : _used_macros)
+	for (const macro_name &name : _used_macros)
 		if (const auto it = _macros.find(name);
 			// Do not include function-like macros, since they are more likely to contain a complex replacement list
 			it != _macros.end() && !it->second.is_function_like)
-			defines.push_back({ name, it->second.replacement_list });
+			defines.push_back({ std::string(name.view()), it->second.replacement_list });
 	return defines;
 }
 
 void reshadefx::preprocessor::error(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
+	_errors += _source_files.path(location.source_id) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
 	_success = false; // Unset success flag
 }
 void reshadefx::preprocessor::warning(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+	_errors += _source_files.path(location.source_id) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+}
+
+std::shared_ptr<const std::string> reshadefx::preprocessor::load_file(const std::filesystem::path &path)
+{
+	if (_source_cache != nullptr)
+	{
+		std::shared_ptr<const std::string> data = _source_cache->load(path);
+		// Remember which file contents the pending snapshot depends on
+		if (_pending_snapshot != nullptr && data != nullptr)
+			_pending_snapshot->files.emplace_back(path.u8string(), data);
+		return data;
+	}
+
+	std::error_code ec;
+	const uintmax_t file_size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return nullptr;
+
+	return read_file(path, file_size);
+}
+
+bool reshadefx::preprocessor::restore_include_snapshot(const std::string &key)
+{
+	const std::shared_ptr<const include_snapshot> snapshot = _source_cache->find_snapshot(key);
+	if (snapshot == nullptr)
+		return false;
+
+	// The state depends on all files read since the start of the include sequence, not just the last included one
+	if (snapshot->files.size() < _include_prefix_files.size() ||
+		!std::equal(_include_prefix_files.begin(), _include_prefix_files.end(), snapshot->files.begin()))
+		return false;
+
+	// The source cache returns the same contents for a file for as long as it is not modified, so can simply compare pointers
+	for (size_t i = _include_prefix_files.size(); i < snapshot->files.size(); ++i)
+		if (_source_cache->load(std::filesystem::u8path(snapshot->files[i].first)) != snapshot->files[i].second)
+			return false;
+	// A file that was created since could be found first on the include paths now, which would change the output
+	for (const std::string &file : snapshot->missing_files)
+		if (_source_cache->exists(std::filesystem::u8path(file)))
+			return false;
+
+	for (const auto &[offset, source, line, column] : snapshot->output_line_map)
+		_line_map.push_back({ _output.size() + offset, location(_source_files.intern(source), line, column) });
+
+	_output += snapshot->output;
+	// This causes the next token from the main file to emit a #line directive again, just like after returning from the include normally
+	_output_location.source_id = _source_files.intern(snapshot->output_source);
+
+	_used_macros = snapshot->used_macros;
+	_macros = snapshot->macros;
+	_macro_tokens.clear();
+	_file_cache = snapshot->file_cache;
+	_include_guards = snapshot->include_guards;
+	_include_prefix_files = snapshot->files;
+	_missing_files.insert(snapshot->missing_files.begin(), snapshot->missing_files.end());
+
+	return true;
+}
+void reshadefx::preprocessor::store_include_snapshot()
+{
+	std::unique_ptr<include_snapshot> snapshot = std::move(_pending_snapshot);
+
+	// Only store the state if the include was processed without any diagnostics, since those are not part of the snapshot
+	if (_errors.size() != _snapshot_errors_offset || !_if_stack.empty())
+	{
+		_include_prefix = false;
+		return;
+	}
+
+	_include_prefix_files = snapshot->files;
+
+	snapshot->output = _output.substr(_snapshot_output_offset);
+	snapshot->output_source = _source_files.path(_output_location.source_id);
+	for (auto it = std::lower_bound(_line_map.begin(), _line_map.end(), _snapshot_output_offset,
+			[](const source_line_map::entry &entry, size_t offset) { return entry.offset < offset; }); it != _line_map.end(); ++it)
+		snapshot->output_line_map.emplace_back(it->offset - _snapshot_output_offset, _source_files.path(it->location.source_id), it->location.line, it->location.column);
+	snapshot->used_macros = _used_macros;
+	snapshot->macros = _macros;
+	snapshot->file_cache = _file_cache;
+	snapshot->include_guards = _include_guards;
+	snapshot->missing_files.assign(_missing_files.begin(), _missing_files.end());
+
+	_source_cache->store_snapshot(_include_prefix_key, std::move(snapshot));
+}
+
+void reshadefx::preprocessor::token_list::append(const token &tok, std::string_view raw_data, bool check_merge)
+{
+	// Only identifiers and string literals have a literal value that references the raw data (see 'consume')
+	if (!tok.literal_as_string.empty() && tok != tokenid::identifier && tok != tokenid::string_literal)
+		requires_lexing = true;
+
+	list_token list_tok;
+	list_tok.id = tok.id;
+	list_tok.length = static_cast<uint32_t>(tok.length);
+	list_tok.literal_length = static_cast<uint32_t>(tok.literal_as_string.size());
+	list_tok.literal_as_double = tok.literal_as_double;
+
+	append(list_tok, raw_data, check_merge);
+}
+void reshadefx::preprocessor::token_list::append(const list_token &tok, std::string_view raw_data, bool check_merge)
+{
+	if (raw_data.empty())
+		return;
+
+	if (!requires_lexing)
+	{
+		if (check_merge && !tokens.empty())
+		{
+			list_token &prev = tokens.back();
+
+			// The lexer combines consecutive whitespace into a single token, which decides what is emitted for a function-like macro name that is not followed by arguments
+			if (prev.id == tokenid::space && tok.id == tokenid::space)
+			{
+				prev.length += static_cast<uint32_t>(raw_data.size());
+				text += raw_data;
+				return;
+			}
+
+			requires_lexing = may_merge_with(prev.id, std::string_view(text).substr(prev.offset, prev.length), raw_data[0]);
+		}
+
+		// Line breaks affect the location and interpretation of following tokens, so leave those to the lexer
+		if (tok.id == tokenid::end_of_line || (tok.id == tokenid::string_literal && raw_data.find('\n') != std::string_view::npos))
+			requires_lexing = true;
+	}
+
+	// Only the text is needed once the tokens have to be lexed again anyway
+	if (!requires_lexing)
+		tokens.push_back(tok), tokens.back().offset = static_cast<uint32_t>(text.size());
+
+	text += raw_data;
+}
+
+bool reshadefx::preprocessor::input_level::is_hidden(std::string_view name) const
+{
+	for (const hidden_macro *it = hidden_macros.get(); it != nullptr; it = it->parent.get())
+		if (it->name == name)
+			return true;
+	return false;
+}
+const std::string &reshadefx::preprocessor::input_level::input_string() const
+{
+	return lexer != nullptr ? lexer->input_string() : tokens->text;
 }
 
-void reshadefx::preprocessor::push(std::string input, const std::string &name)
+void reshadefx::preprocessor::push(std::shared_ptr<const std::string> input, const std::string &name)
 {
-	location start_location = !name.empty() ?
+	const uint32_t source_id = _source_files.intern(name);
+
+	location start_location = source_id != 0 ?
 		// Start at the beginning of the file when pushing a new file
-		location(name, 1) :
+		location(source_id, 1) :
 		// Start with last known token location when pushing an unnamed string
 		_token.location;
 
-	input_level level = { name };
+	input_level level = {};
+	level.source_id = source_id;
 	level.lexer.reset(new lexer(
 		std::move(input),
 		true  /* ignore_comments */,
@@ -195,10 +597,52 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 		false /* ignore_line_directives */,
 		true  /* ignore_keywords */,
 		false /* escape_string_literals */,
-		start_location));
+		start_location,
+		&_source_files));
 	level.next_token.id = tokenid::unknown;
 	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
 
+	if (source_id != 0)
+		level.include_guard = include_guard_state::before;
+
+	// Inherit hidden macros from parent
+	if (!_input_stack.empty())
+		level.hidden_macros = _input_stack.back().hidden_macros;
+
+	_input_stack.push_back(std::move(level));
+	_next_input_index = _input_stack.size() - 1;
+
+	// Advance into the input stack to update next token
+	consume();
+}
+void reshadefx::preprocessor::push(std::unique_ptr<token_list> input)
+{
+	// Start with last known token location, like when pushing an unnamed string
+	const location start_location = _token.location;
+
+	// The lexer skips whitespace at the beginning of a line and would parse a preprocessor directive there
+	size_t first_token_index = 0;
+	if (start_location.column <= 1 && !input->requires_lexing)
+	{
+		while (first_token_index < input->tokens.size() && input->tokens[first_token_index].id == tokenid::space)
+			first_token_index++;
+		if (first_token_index < input->tokens.size() && input->tokens[first_token_index].id == tokenid::hash)
+			input->requires_lexing = true;
+	}
+
+	if (input->requires_lexing)
+	{
+		push(std::move(input->text));
+		return;
+	}
+
+	input_level level = {};
+	level.tokens = std::move(input);
+	level.next_token_index = first_token_index;
+	level.tokens_location = start_location;
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location = start_location;
+
 	// Inherit hidden macros from parent
 	if (!_input_stack.empty())
 		level.hidden_macros = _input_stack.back().hidden_macros;
@@ -210,6 +654,52 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 	consume();
 }
 
+bool reshadefx::preprocessor::file_exists(const std::filesystem::path &path)
+{
+	// Look up files in the directory listings of the source cache, to avoid querying the file system for every include path
+	bool exists;
+	if (_source_cache != nullptr)
+	{
+		exists = _source_cache->exists(path);
+	}
+	else
+	{
+		std::error_code ec;
+		exists = std::filesystem::exists(path, ec);
+	}
+
+	if (!exists)
+		_missing_files.insert(path.u8string());
+
+	return exists;
+}
+
+void reshadefx::preprocessor::pop()
+{
+	// Keep the memory of token lists around, so that it can be reused by following macro expansions
+	if (_input_stack.back().tokens != nullptr)
+		release_token_list(std::move(*_input_stack.back().tokens));
+
+	_input_stack.pop_back();
+}
+
+reshadefx::preprocessor::token_list reshadefx::preprocessor::create_token_list()
+{
+	if (_token_list_pool.empty())
+		return token_list();
+
+	token_list list = std::move(_token_list_pool.back());
+	_token_list_pool.pop_back();
+	list.text.clear();
+	list.tokens.clear();
+	list.requires_lexing = false;
+	return list;
+}
+void reshadefx::preprocessor::release_token_list(token_list &&list)
+{
+	_token_list_pool.push_back(std::move(list));
+}
+
 bool reshadefx::preprocessor::peek(tokenid token) const
 {
 	return _input_stack[_next_input_index].next_token == token;
@@ -227,23 +717,59 @@ bool reshadefx::preprocessor::consume()
 
 	// Clear out input stack, now that the current token is overwritten
 	while (_input_stack.size() > (_current_input_index + 1))
-		_input_stack.pop_back();
+		pop();
+
+	// Returning to the main file means a leading include was processed completely, so can store its snapshot now (before the output location is updated)
+	if (_pending_snapshot != nullptr && _current_input_index == 0)
+		store_include_snapshot();
 
 	// Update location information after switching input levels
 	input_level &input = _input_stack[_current_input_index];
-	if (!input.name.empty() && input.name != _output_location.source)
+	if (input.source_id != 0 && input.source_id != _output_location.source_id)
 	{
-		_output += "#line " + std::to_string(input.next_token.location.line) + " \"" + input.name + "\"\n";
 		_output_location.line = input.next_token.location.line;
-		_output_location.source = input.name;
+		_output_location.source_id = input.source_id;
+		emit_line_location(_output_location, true);
+		// The directive sets the line number of the next line appended to the output, but the output location is incremented before a line is appended, so it has to be one less
+		// Otherwise a line that does not produce any output right after (e.g. a '#define') would shift the following lines by one
+		_output_location.line--;
 	}
 
 	// Set current token
 	_token = std::move(input.next_token);
-	_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
+	_current_token_raw_data = std::string_view(input.input_string()).substr(_token.offset, _token.length);
 
 	// Get the next token
-	input.next_token = input.lexer->lex();
+	if (input.lexer != nullptr)
+	{
+		input.next_token = input.lexer->lex();
+	}
+	else if (input.next_token_index < input.tokens->tokens.size())
+	{
+		const token_list::list_token &tok = input.tokens->tokens[input.next_token_index++];
+
+		// Reconstruct the token the lexer would have produced (all tokens are on the same line, since line breaks force lexing)
+		input.next_token.id = tok.id;
+		input.next_token.location = input.tokens_location;
+		input.next_token.location.column += tok.offset;
+		input.next_token.offset = tok.offset;
+		input.next_token.length = tok.length;
+		input.next_token.literal_as_double = tok.literal_as_double;
+
+		if (tok.id == tokenid::identifier)
+			input.next_token.literal_as_string = std::string_view(input.tokens->text).substr(tok.offset, tok.length);
+		else if (tok.id == tokenid::string_literal)
+			input.next_token.literal_as_string = std::string_view(input.tokens->text).substr(tok.offset + 1, tok.literal_length);
+		else
+			input.next_token.literal_as_string = {};
+	}
+	else
+	{
+		input.next_token.id = tokenid::end_of_file;
+		input.next_token.offset = input.tokens->text.size();
+		input.next_token.length = 0;
+		input.next_token.literal_as_string = {};
+	}
 
 	// Verify string literals (since the lexer cannot throw errors itself)
 	if (_token == tokenid::string_literal && _current_token_raw_data.back() != '\"')
@@ -257,10 +783,15 @@ bool reshadefx::preprocessor::consume()
 		for (; !_if_stack.empty() && _if_stack.back().input_index >= _next_input_index; _if_stack.pop_back())
 			error(_if_stack.back().pp_token.location, "unterminated #if");
 
+		// Remember the include guard of a file once it was processed completely
+		if (const input_level &input = _input_stack[_next_input_index];
+			input.include_guard == include_guard_state::after && !input.include_guard_name.empty())
+			_include_guards.emplace(_source_files.path(input.source_id), input.include_guard_name);
+
 		if (_next_input_index == 0)
 		{
 			// End of input has been reached, so cannot pop further and this is the last token
-			_input_stack.pop_back();
+			pop();
 			return false;
 		}
 		else
@@ -299,10 +830,10 @@ bool reshadefx::preprocessor::expect(tokenid token)
 	if (!accept(token))
 	{
 		auto actual_token = _input_stack[_next_input_index].next_token;
-		actual_token.location.source = _output_location.source;
+		actual_token.location.source_id = _output_location.source_id;
 
 		error(actual_token.location, "syntax error: unexpected token '" +
-			_input_stack[_next_input_index].lexer->input_string().substr(actual_token.offset, actual_token.length) + '\'');
+			_input_stack[_next_input_index].input_string().substr(actual_token.offset, actual_token.length) + '\'');
 
 		return false;
 	}
@@ -310,9 +841,54 @@ bool reshadefx::preprocessor::expect(tokenid token)
 	return true;
 }
 
+void reshadefx::preprocessor::emit_line_location(const location &location, bool include_file)
+{
+	if (_compact_output)
+	{
+		// Lines are only appended to the output once they are complete, so the current output size is the offset of the next line
+		if (!_line_map.empty() && _line_map.back().offset == _output.size())
+			_line_map.back().location = location;
+		else
+			_line_map.push_back({ _output.size(), location });
+		return;
+	}
+
+	_output += "#line " + std::to_string(location.line);
+	if (include_file)
+		_output += " \"" + _source_files.path(location.source_id) + '\"';
+	_output += '\n';
+}
+
 void reshadefx::preprocessor::parse()
 {
 	std::string line;
+	// The last token appended to the line, which decides whether a collapsed space before the next token is still needed in compact output mode
+	tokenid last_token = tokenid::unknown;
+	size_t last_token_length = 0;
+	bool pending_space = false;
+	// Length the line would have if whitespace was not collapsed, and the offsets in the line where tokens start at a column that differs from that because of it
+	// These columns are recorded in the line map, so that compact output reports the same locations as the default output
+	size_t full_line_length = 0;
+	size_t column_difference = 0;
+	std::vector<std::pair<size_t, unsigned int>> line_columns;
+
+	const auto append_line = [this, &line, &full_line_length, &column_difference, &line_columns](unsigned int line_number) {
+		for (const auto &[line_offset, column] : line_columns)
+		{
+			const size_t offset = _output.size() + line_offset;
+			if (!_line_map.empty() && _line_map.back().offset == offset)
+				_line_map.back().location.column = column;
+			else
+				_line_map.push_back({ offset, location(_output_location.source_id, line_number, column) });
+		}
+
+		_output += line;
+		_output += '\n';
+		line.clear();
+		full_line_length = 0;
+		column_difference = 0;
+		line_columns.clear();
+	};
 
 	while (consume())
 	{
@@ -320,6 +896,38 @@ void reshadefx::preprocessor::parse()
 
 		const bool skip = !_if_stack.empty() && _if_stack.back().skipping;
 
+		// Anything other than #include directives in the main file ends the sequence of includes that snapshots are created for
+		if (_include_prefix && _current_input_index == 0 && _token != tokenid::hash_include && _token != tokenid::end_of_line && _token != tokenid::space)
+			_include_prefix = false;
+
+		// Detect whether the current file is wrapped in an include guard, which requires the first and last directive in it to be the '#ifndef' and matching '#endif'
+		const size_t input_index = _current_input_index;
+		if (input_level &input = _input_stack[input_index];
+			input.include_guard != include_guard_state::none && _token != tokenid::end_of_line && _token != tokenid::space)
+		{
+			switch (input.include_guard)
+			{
+			case include_guard_state::before:
+				input.include_guard = _token == tokenid::hash_ifndef ? include_guard_state::inside : include_guard_state::none;
+				input.include_guard_if_index = _if_stack.size();
+				break;
+			case include_guard_state::inside:
+				if (_if_stack.size() == input.include_guard_if_index + 1)
+				{
+					if (_token == tokenid::hash_endif)
+						input.include_guard = include_guard_state::after;
+					else if (_token == tokenid::hash_else || _token == tokenid::hash_elif)
+						input.include_guard = include_guard_state::none;
+				}
+				break;
+			case include_guard_state::after:
+				input.include_guard = include_guard_state::none;
+				break;
+			case include_guard_state::none:
+				break;
+			}
+		}
+
 		switch (_token)
 		{
 		case tokenid::hash_if:
@@ -334,6 +942,9 @@ void reshadefx::preprocessor::parse()
 			continue;
 		case tokenid::hash_ifndef:
 			parse_ifndef();
+			if (input_level &input = _input_stack[input_index];
+				input.include_guard == include_guard_state::inside && input.include_guard_name.empty() && _token == tokenid::identifier)
+				input.include_guard_name = _token.literal_as_string;
 			if (!expect(tokenid::end_of_line))
 				consume_until(tokenid::end_of_line);
 			continue;
@@ -391,7 +1002,7 @@ void reshadefx::preprocessor::parse()
 			parse_include();
 			continue;
 		case tokenid::hash_unknown:
-			error(_token.location, "unrecognized preprocessing directive '" + _token.literal_as_string + '\'');
+			error(_token.location, "unrecognized preprocessing directive '" + std::string(_token.literal_as_string) + '\'');
 			consume_until(tokenid::end_of_line);
 			continue;
 		case tokenid::end_of_line:
@@ -400,26 +1011,51 @@ void reshadefx::preprocessor::parse()
 			_output_location.line++;
 			if (_output_location.line != _token.location.line)
 			{
-				_output += "#line " + std::to_string(_token.location.line) + '\n';
 				_output_location.line  = _token.location.line;
+				emit_line_location(_output_location, false);
 			}
-			_output += line;
-			_output += '\n';
-			line.clear();
+			append_line(_output_location.line);
+			pending_space = false;
 			continue;
+		case tokenid::space:
+			if (_compact_output)
+			{
+				pending_space = !line.empty();
+				full_line_length += _current_token_raw_data.size();
+				continue;
+			}
+			line += _current_token_raw_data;
+			break;
 		case tokenid::identifier:
 			if (evaluate_identifier_as_macro())
 				continue;
 			// fall through
 		default:
+			if (pending_space)
+			{
+				pending_space = false;
+				if (may_merge_with(last_token, std::string_view(line).substr(line.size() - last_token_length), _current_token_raw_data[0]))
+					line += ' ';
+			}
+			if (_compact_output)
+			{
+				// Only need to record a column where the amount of whitespace removed before it changed
+				if (full_line_length - line.size() != column_difference)
+				{
+					column_difference = full_line_length - line.size();
+					line_columns.emplace_back(line.size(), static_cast<unsigned int>(full_line_length + 1));
+				}
+				full_line_length += _current_token_raw_data.size();
+			}
+			last_token = _token.id;
+			last_token_length = _current_token_raw_data.size();
 			line += _current_token_raw_data;
 			break;
 		}
 	}
 
 	// Append the last line after the EOF was reached to the output
-	_output += line;
-	_output += '\n';
+	append_line(_output_location.line + 1);
 }
 
 void reshadefx::preprocessor::parse_def()
@@ -431,11 +1067,11 @@ void reshadefx::preprocessor::parse_def()
 
 	macro m;
 	const auto location = std::move(_token.location);
-	const auto macro_name = std::move(_token.literal_as_string);
+	const std::string macro_name(_token.literal_as_string);
 	const auto macro_name_end_offset = _token.offset + _token.length;
 
 	// Check input string here directly to ensure the parenthesis follows the macro name without any whitespace between
-	if (_input_stack[_current_input_index].lexer->input_string()[macro_name_end_offset] == '(')
+	if (_input_stack[_current_input_index].input_string()[macro_name_end_offset] == '(')
 	{
 		accept(tokenid::parenthesis_open);
 
@@ -443,7 +1079,7 @@ void reshadefx::preprocessor::parse_def()
 
 		while (accept(tokenid::identifier))
 		{
-			m.parameters.push_back(_token.literal_as_string);
+			m.parameters.emplace_back(_token.literal_as_string);
 
 			if (!accept(tokenid::comma))
 				break;
@@ -475,7 +1111,11 @@ void reshadefx::preprocessor::parse_undef()
 	else if (_token.literal_as_string == "defined")
 		return warning(_token.location, "macro name 'defined' is reserved");
 
-	_macros.erase(_token.literal_as_string);
+	if (const auto it = _macros.find(macro_name::lookup(_token.literal_as_string)); it != _macros.end())
+	{
+		_macro_tokens.erase(&it->second);
+		_macros.erase(it);
+	}
 }
 
 void reshadefx::preprocessor::parse_if()
@@ -501,7 +1141,7 @@ void reshadefx::preprocessor::parse_ifdef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) != _macros.end() ||
+	level.value = _macros.find(macro_name::lookup(_token.literal_as_string)) != _macros.end() ||
 		// Check built-in macros as well
 		_token.literal_as_string == "__LINE__" ||
 		_token.literal_as_string == "__FILE__" ||
@@ -512,8 +1152,9 @@ void reshadefx::preprocessor::parse_ifdef()
 	level.skipping = parent_skipping || !level.value;
 
 	_if_stack.push_back(std::move(level));
-	if (!parent_skipping) // Only add if this #ifdef is active
-		_used_macros.emplace(_token.literal_as_string);
+	// Only add if this #ifdef is active, and avoid allocating a copy of the name if it was added before already
+	if (!parent_skipping && _used_macros.find(macro_name::lookup(_token.literal_as_string)) == _used_macros.end())
+		_used_macros.emplace(std::string(_token.literal_as_string));
 }
 void reshadefx::preprocessor::parse_ifndef()
 {
@@ -524,7 +1165,7 @@ void reshadefx::preprocessor::parse_ifndef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) == _macros.end() &&
+	level.value = _macros.find(macro_name::lookup(_token.literal_as_string)) == _macros.end() &&
 		_token.literal_as_string != "__LINE__" &&
 		_token.literal_as_string != "__FILE__" &&
 		_token.literal_as_string != "__FILE_NAME__" &&
@@ -534,8 +1175,9 @@ void reshadefx::preprocessor::parse_ifndef()
 	level.skipping = parent_skipping || !level.value;
 
 	_if_stack.push_back(std::move(level));
-	if (!parent_skipping) // Only add if this #ifndef is active
-		_used_macros.emplace(_token.literal_as_string);
+	// Only add if this #ifndef is active, and avoid allocating a copy of the name if it was added before already
+	if (!parent_skipping && _used_macros.find(macro_name::lookup(_token.literal_as_string)) == _used_macros.end())
+		_used_macros.emplace(std::string(_token.literal_as_string));
 }
 void reshadefx::preprocessor::parse_elif()
 {
@@ -586,14 +1228,14 @@ void reshadefx::preprocessor::parse_error()
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	error(keyword_location, _token.literal_as_string);
+	error(keyword_location, _token.unescape_literal());
 }
 void reshadefx::preprocessor::parse_warning()
 {
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	warning(keyword_location, _token.literal_as_string);
+	warning(keyword_location, _token.unescape_literal());
 }
 
 void reshadefx::preprocessor::parse_pragma()
@@ -602,7 +1244,7 @@ void reshadefx::preprocessor::parse_pragma()
 	if (!expect(tokenid::identifier))
 		return;
 
-	std::string pragma = std::move(_token.literal_as_string);
+	std::string pragma(_token.literal_as_string);
 
 	while (!peek(tokenid::end_of_line) && !peek(tokenid::end_of_file))
 	{
@@ -616,8 +1258,9 @@ void reshadefx::preprocessor::parse_pragma()
 
 	if (pragma == "once")
 	{
-		if (const auto it = _file_cache.find(_output_location.source); it != _file_cache.end())
-			it->second.clear();
+		// Replace the file contents with an empty string, so that any further includes of this file are skipped
+		if (const auto it = _file_cache.find(_source_files.path(_output_location.source_id)); it != _file_cache.end())
+			it->second = std::make_shared<const std::string>();
 		return;
 	}
 
@@ -628,6 +1271,10 @@ void reshadefx::preprocessor::parse_include()
 {
 	const auto keyword_location = std::move(_token.location);
 
+	// Only continue the include sequence if this directive is processed successfully
+	const bool include_prefix = _include_prefix && _current_input_index == 0 && _if_stack.empty();
+	_include_prefix = false;
+
 	while (accept(tokenid::identifier))
 	{
 		if (evaluate_identifier_as_macro())
@@ -644,34 +1291,51 @@ void reshadefx::preprocessor::parse_include()
 		return;
 	}
 
-	std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
-	std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
+	std::filesystem::path file_name = std::filesystem::u8path(_token.unescape_literal());
+	std::filesystem::path file_path = std::filesystem::u8path(_source_files.path(_output_location.source_id));
 	file_path.replace_filename(file_name);
 
-	if (std::error_code ec; !std::filesystem::exists(file_path, ec))
+	if (!file_exists(file_path))
 		for (const std::filesystem::path &include_path : _include_paths)
-			if (std::filesystem::exists(file_path = include_path / file_name, ec))
+			if (file_exists(file_path = include_path / file_name))
 				break;
 
 	const std::string file_path_string = file_path.u8string();
+	const uint32_t file_source_id = _source_files.intern(file_path_string);
 
 	// Detect recursive include and abort to avoid infinite loop
 	if (std::find_if(_input_stack.begin(), _input_stack.end(),
-		[&file_path_string](const input_level &level) { return level.name == file_path_string; }) != _input_stack.end())
+		[file_source_id](const input_level &level) { return level.source_id == file_source_id; }) != _input_stack.end())
 	{
 		error(_token.location, "recursive #include");
 		return;
 	}
 
-	std::string data;
+	// Skip the file without reading it if it is wrapped in an include guard that is defined already, since processing it would not have any effect
+	if (const auto it = _include_guards.find(file_path_string);
+		it != _include_guards.end() && _macros.find(macro_name::lookup(it->second)) != _macros.end())
+	{
+		_skipped_includes++;
+
+		if (include_prefix)
+		{
+			_include_prefix = true;
+			_include_prefix_key += '\n' + file_path_string;
+		}
+		return;
+	}
+
+	std::shared_ptr<const std::string> data;
+	bool data_from_file_cache = false;
 	if (auto it = _file_cache.find(file_path_string);
 		it != _file_cache.end())
 	{
 		data = it->second;
+		data_from_file_cache = true;
 	}
 	else
 	{
-		if (!read_file(file_path, data))
+		if ((data = load_file(file_path)) == nullptr)
 		{
 			error(keyword_location, "could not open included file '" + file_path_string + '\'');
 			consume_until(tokenid::end_of_line);
@@ -681,9 +1345,27 @@ void reshadefx::preprocessor::parse_include()
 		_file_cache.emplace(file_path_string, data);
 	}
 
+	if (include_prefix)
+	{
+		_include_prefix = true;
+		_include_prefix_key += '\n' + file_path_string;
+
+		// Skip processing the included file altogether if another preprocessor got to the same point already
+		if (restore_include_snapshot(_include_prefix_key))
+			return;
+
+		_pending_snapshot = std::make_unique<include_snapshot>();
+		_pending_snapshot->files = _include_prefix_files;
+		// Files that were included before are part of the list already
+		if (!data_from_file_cache)
+			_pending_snapshot->files.emplace_back(file_path_string, data);
+		_snapshot_output_offset = _output.size();
+		_snapshot_errors_offset = _errors.size();
+	}
+
 	// Clear out input stack before pushing include so that hidden macros do not bleed into the include
 	while (_input_stack.size() > (_next_input_index + 1))
-		_input_stack.pop_back();
+		pop();
 	push(std::move(data), file_path_string);
 }
 
@@ -848,19 +1530,18 @@ bool reshadefx::preprocessor::evaluate_expression()
 				}
 				if (!expect(tokenid::string_literal))
 					return false;
-				std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
+				std::filesystem::path file_name = std::filesystem::u8path(_token.unescape_literal());
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
-				std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
+				std::filesystem::path file_path = std::filesystem::u8path(_source_files.path(_output_location.source_id));
 				file_path.replace_filename(file_name);
 
-				std::error_code ec;
-				if (!std::filesystem::exists(file_path, ec))
+				if (!file_exists(file_path))
 					for (const std::filesystem::path &include_path : _include_paths)
-						if (std::filesystem::exists(file_path = include_path / file_name, ec))
+						if (file_exists(file_path = include_path / file_name))
 							break;
 
-				rpn[rpn_index++] = { std::filesystem::exists(file_path, ec) ? 1 : 0, false };
+				rpn[rpn_index++] = { file_exists(file_path) ? 1 : 0, false };
 				continue;
 			}
 			if (_token.literal_as_string == "defined")
@@ -868,11 +1549,11 @@ bool reshadefx::preprocessor::evaluate_expression()
 				const bool has_parentheses = accept(tokenid::parenthesis_open);
 				if (!expect(tokenid::identifier))
 					return false;
-				const std::string macro_name = std::move(_token.literal_as_string);
+				const std::string_view name = _token.literal_as_string;
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
 
-				rpn[rpn_index++] = { _macros.find(macro_name) != _macros.end() ? 1 : 0, false };
+				rpn[rpn_index++] = { _macros.find(macro_name::lookup(name)) != _macros.end() ? 1 : 0, false };
 				continue;
 			}
 
@@ -1035,28 +1716,27 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	}
 	if (_token.literal_as_string == "__FILE__")
 	{
-		push(escape_string(_token.location.source));
+		push(escape_string(_source_files.path(_token.location.source_id)));
 		return true;
 	}
 	if (_token.literal_as_string == "__FILE_STEM__")
 	{
-		const std::filesystem::path file_stem = std::filesystem::u8path(_token.location.source).stem();
+		const std::filesystem::path file_stem = std::filesystem::u8path(_source_files.path(_token.location.source_id)).stem();
 		push(escape_string(file_stem.u8string()));
 		return true;
 	}
 	if (_token.literal_as_string == "__FILE_NAME__")
 	{
-		const std::filesystem::path file_name = std::filesystem::u8path(_token.location.source).filename();
+		const std::filesystem::path file_name = std::filesystem::u8path(_source_files.path(_token.location.source_id)).filename();
 		push(escape_string(file_name.u8string()));
 		return true;
 	}
 
-	const auto it = _macros.find(_token.literal_as_string);
+	const auto it = _macros.find(macro_name::lookup(_token.literal_as_string));
 	if (it == _macros.end())
 		return false;
 
-	const std::unordered_set<std::string> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
-	if (hidden_macros.find(_token.literal_as_string) != hidden_macros.end())
+	if (_input_stack[_current_input_index].is_hidden(_token.literal_as_string))
 		return false;
 
 	if (_recursion_count++ >= 256)
@@ -1065,7 +1745,7 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 		return false;
 	}
 
-	std::vector<std::string> arguments;
+	std::vector<token_list> arguments;
 	if (it->second.is_function_like)
 	{
 		if (!accept(tokenid::parenthesis_open))
@@ -1074,7 +1754,7 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 		while (true)
 		{
 			int parentheses_level = 0;
-			std::string argument;
+			token_list &argument = arguments.emplace_back(create_token_list());
 
 			while (true)
 			{
@@ -1087,78 +1767,292 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 					(_token == tokenid::comma && parentheses_level == 0))
 					break;
 
-				argument += _current_token_raw_data;
+				argument.append(_token, _current_token_raw_data);
 			}
 
 			// Trim whitespace from argument
-			if (!argument.empty() && argument.back() == ' ')
-				argument.pop_back();
-			if (!argument.empty() && argument.front() == ' ')
-				argument.erase(0, 1);
+			if (!argument.text.empty() && argument.text.back() == ' ')
+			{
+				argument.text.pop_back();
 
-			arguments.push_back(std::move(argument));
+				if (!argument.requires_lexing && argument.tokens.back().id == tokenid::space)
+				{
+					if (--argument.tokens.back().length == 0)
+						argument.tokens.pop_back();
+				}
+				else
+				{
+					argument.requires_lexing = true;
+				}
+			}
+			if (!argument.text.empty() && argument.text.front() == ' ')
+			{
+				argument.text.erase(0, 1);
+
+				if (!argument.requires_lexing && argument.tokens.front().id == tokenid::space)
+				{
+					if (--argument.tokens.front().length == 0)
+						argument.tokens.erase(argument.tokens.begin());
+					for (token_list::list_token &tok : argument.tokens)
+						if (tok.offset != 0)
+							tok.offset--;
+				}
+				else
+				{
+					argument.requires_lexing = true;
+				}
+			}
 
 			if (parentheses_level < 0)
 				break;
 		}
 	}
 
-	std::string input;
-	expand_macro(it->first, it->second, arguments, input);
+	auto input = std::make_unique<token_list>(create_token_list());
+	expand_macro(it->first.view(), it->second, arguments, *input);
+
+	for (token_list &argument : arguments)
+		release_token_list(std::move(argument));
 
-	if (!input.empty())
+	if (!input->text.empty())
 	{
 		push(std::move(input));
 
-		_input_stack[_current_input_index].hidden_macros.insert(it->first);
+		input_level &level = _input_stack[_current_input_index];
+		level.hidden_macros = std::make_shared<const hidden_macro>(hidden_macro { std::string(it->first.view()), std::move(level.hidden_macros) });
+	}
+	else
+	{
+		release_token_list(std::move(*input));
 	}
 
 	return true;
 }
 
-void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out)
+void reshadefx::preprocessor::expand_macro(std::string_view name, const macro &macro, const std::vector<token_list> &arguments, token_list &out)
 {
-	for (auto it = macro.replacement_list.begin(); it != macro.replacement_list.end(); ++it)
+	const macro_tokens &replacement = lex_macro_replacement_list(macro);
+
+	// Each argument is only expanded once, even if it is referenced multiple times in the replacement list
+	std::vector<argument_expansion> expanded_arguments(arguments.size());
+
+	for (const macro_tokens::part &part : replacement.parts)
 	{
-		if (*it != macro_replacement_start)
+		if (part.type == macro_replacement_start)
 		{
-			out += *it;
+			if (replacement.tokens.requires_lexing || out.requires_lexing)
+			{
+				out.requires_lexing = true;
+				out.text.append(macro.replacement_list, part.text_offset, part.text_length);
+				continue;
+			}
+
+			for (size_t i = part.first_token; i < part.last_token; ++i)
+			{
+				const token_list::list_token &tok = replacement.tokens.tokens[i];
+				out.append(tok, std::string_view(replacement.tokens.text).substr(tok.offset, tok.length));
+			}
 			continue;
 		}
 
 		// This is a special replacement sequence
-		const auto type = *++it;
-		if (type == macro_replacement_concat)
+		if (part.type == macro_replacement_concat)
 			continue;
 
-		const auto index = *++it;
+		const auto index = part.index;
 		if (static_cast<size_t>(index) >= arguments.size())
 		{
-			warning(_token.location, "not enough arguments for function-like macro invocation '" + name + "'");
+			warning(_token.location, "not enough arguments for function-like macro invocation '" + std::string(name) + "'");
 			continue;
 		}
 
-		switch (type)
+		switch (part.type)
 		{
 		case macro_replacement_stringize:
-			out += '"';
-			out += arguments[index];
-			out += '"';
+			if (std::string literal = '"' + arguments[index].text + '"'; !out.requires_lexing)
+			{
+				lexer literal_lexer(std::move(literal), true, false, false, false, true, false, location(0, 1, 2));
+				const token tok = literal_lexer.lex();
+				// Only use the token if the argument did not contain anything that would end the string literal early
+				if (tok == tokenid::string_literal && tok.length == literal_lexer.input_string().size())
+					out.append(tok, literal_lexer.input_string());
+				else
+					out.requires_lexing = true,
+					out.text += literal_lexer.input_string();
+			}
+			else
+			{
+				out.text += literal;
+			}
 			break;
 		case macro_replacement_argument:
-			push(arguments[index] + static_cast<char>(macro_replacement_argument));
-			while (!accept(tokenid::unknown))
+			if (argument_expansion &expanded = expanded_arguments[index];
+				// The expansion depends on the current location (e.g. through __LINE__ or line breaks), so can only reuse it if that is the same
+				expanded.valid && expanded.line == _token.location.line && expanded.source_id == _token.location.source_id && expanded.at_line_begin == (_token.location.column <= 1))
 			{
-				consume();
-				if (_token == tokenid::identifier && evaluate_identifier_as_macro())
-					continue;
-				out += _current_token_raw_data;
+				// Copy the previous expansion from earlier in the output (reserve memory first, so that it is not reallocated while copying)
+				out.text.reserve(out.text.size() + expanded.text_length);
+
+				if (out.requires_lexing)
+				{
+					out.text.append(out.text, expanded.text_offset, expanded.text_length);
+				}
+				else
+				{
+					out.tokens.reserve(out.tokens.size() + (expanded.last_token - expanded.first_token));
+
+					for (size_t i = expanded.first_token; i < expanded.last_token; ++i)
+					{
+						const token_list::list_token tok = out.tokens[i];
+						out.append(tok, std::string_view(out.text).substr(tok.offset, tok.length));
+					}
+				}
+
+				// Update location like it would have been after expanding the argument again
+				_token.location.column += static_cast<unsigned int>(arguments[index].text.size());
+			}
+			else
+			{
+				expanded.line = _token.location.line;
+				expanded.source_id = _token.location.source_id;
+				expanded.at_line_begin = _token.location.column <= 1;
+				expanded.first_token = out.tokens.size();
+				expanded.text_offset = out.text.size();
+				const size_t errors_length = _errors.size();
+				expand_macro_argument(arguments[index], out);
+				expanded.last_token = out.tokens.size();
+				expanded.text_length = out.text.size() - expanded.text_offset;
+				// Diagnostics have to be reported again for every reference, so cannot reuse expansions that emitted any
+				expanded.valid = arguments[index].text.find('\n') == std::string::npos && _errors.size() == errors_length;
+				// Leading whitespace may have been merged into the token before the expansion, in which case its token range does not cover all of its text
+				if (!out.requires_lexing && (expanded.first_token < out.tokens.size() ? out.tokens[expanded.first_token].offset != expanded.text_offset : expanded.text_length != 0))
+					expanded.valid = false;
 			}
-			assert(_current_token_raw_data[0] == macro_replacement_argument);
 			break;
 		}
 	}
 }
+void reshadefx::preprocessor::expand_macro_argument(const token_list &argument, token_list &out)
+{
+	// Arguments that do not reference any macros expand to themselves (without whitespace), so can build that directly instead of going through the input stack
+	bool requires_expansion = argument.requires_lexing;
+	for (size_t i = 0; i < argument.tokens.size() && !requires_expansion; ++i)
+	{
+		const token_list::list_token &tok = argument.tokens[i];
+		const std::string_view raw_data = std::string_view(argument.text).substr(tok.offset, tok.length);
+
+		switch (tok.id)
+		{
+		case tokenid::identifier:
+			// Names starting with two underscores may be built-in macros like '__LINE__'
+			requires_expansion = raw_data.compare(0, 2, "__") == 0 || _macros.find(macro_name::lookup(raw_data)) != _macros.end();
+			break;
+		case tokenid::string_literal:
+			// Unterminated string literals report an error when consumed
+			requires_expansion = raw_data.back() != '\"';
+			break;
+		case tokenid::hash:
+		case tokenid::unknown:
+			requires_expansion = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (!requires_expansion)
+	{
+		for (const token_list::list_token &tok : argument.tokens)
+			if (tok.id != tokenid::space)
+				out.append(tok, std::string_view(argument.text).substr(tok.offset, tok.length));
+
+		// Update location like it would have been after consuming the argument
+		_token.location.column += static_cast<unsigned int>(argument.text.size());
+		return;
+	}
+
+	auto input = std::make_unique<token_list>(create_token_list());
+	input->text = argument.text;
+	input->tokens = argument.tokens;
+	input->requires_lexing = argument.requires_lexing;
+
+	token marker_token = {};
+	marker_token.id = tokenid::unknown;
+	marker_token.length = 1;
+	const char marker = static_cast<char>(macro_replacement_argument);
+	input->append(marker_token, std::string_view(&marker, 1));
+
+	push(std::move(input));
+
+	while (!accept(tokenid::unknown))
+	{
+		consume();
+		if (_token == tokenid::identifier && evaluate_identifier_as_macro())
+			continue;
+		out.append(_token, _current_token_raw_data);
+	}
+
+	assert(_current_token_raw_data[0] == macro_replacement_argument);
+}
+const reshadefx::preprocessor::macro_tokens &reshadefx::preprocessor::lex_macro_replacement_list(const macro &macro)
+{
+	const auto insert = _macro_tokens.try_emplace(&macro);
+	macro_tokens &result = insert.first->second;
+	if (!insert.second)
+		return result;
+
+	const std::string &replacement_list = macro.replacement_list;
+
+	for (size_t offset = 0; offset < replacement_list.size();)
+	{
+		macro_tokens::part part = {};
+
+		if (replacement_list[offset] != macro_replacement_start)
+		{
+			part.type = macro_replacement_start;
+			part.text_offset = offset;
+			part.text_length = std::min(replacement_list.find(macro_replacement_start, offset), replacement_list.size()) - offset;
+			part.first_token = result.tokens.tokens.size();
+
+			// Start past the first column, so that the lexer does not treat this as the beginning of a line
+			lexer segment_lexer(replacement_list.substr(part.text_offset, part.text_length), true, false, false, false, true, false, location(0, 1, 2));
+
+			size_t lexed_length = 0;
+			for (token tok = segment_lexer.lex(); tok != tokenid::end_of_file; tok = segment_lexer.lex())
+			{
+				// Tokens are combined with other text later, so only check for merges within this part of the replacement list
+				result.tokens.append(tok, std::string_view(segment_lexer.input_string()).substr(tok.offset, tok.length), tok.offset != 0);
+				lexed_length += tok.length;
+			}
+
+			// Some characters were skipped (e.g. comments in a definition added via 'add_macro_definition'), which could affect text that follows
+			if (lexed_length != part.text_length)
+				result.tokens.requires_lexing = true;
+
+			part.last_token = result.tokens.tokens.size();
+			offset += part.text_length;
+		}
+		else
+		{
+			if (offset + 1 >= replacement_list.size())
+				break;
+
+			part.type = replacement_list[offset + 1];
+			if (part.type != macro_replacement_concat)
+			{
+				if (offset + 2 >= replacement_list.size())
+					break;
+				part.index = replacement_list[offset + 2];
+				offset++;
+			}
+			offset += 2;
+		}
+
+		result.parts.push_back(part);
+	}
+
+	return result;
+}
 void reshadefx::preprocessor::create_macro_replacement_list(macro &macro)
 {
 	// Since the number of parameters is encoded in the string, it may not exceed the available size of a char
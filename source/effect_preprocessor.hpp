@@ -6,13 +6,118 @@
 #pragma once
 
 #include "effect_token.hpp"
-#include <memory> // std::unique_ptr
+#include <memory> // std::unique_ptr, std::shared_ptr
+#include <mutex>
+#include <atomic>
+#include <tuple>
 #include <filesystem>
 #include <unordered_set>
 #include <unordered_map>
 
 namespace reshadefx
 {
+	struct include_snapshot;
+
+	/// <summary>
+	/// A thread-safe cache of source file contents, directory listings and of preprocessor states after common include sequences, which can be shared between multiple preprocessor instances.
+	/// </summary>
+	class source_cache
+	{
+	public:
+		/// <summary>
+		/// Get the contents of the specified file, reading it from disk only if it was not loaded before or has changed since.
+		/// </summary>
+		/// <param name="path">The path to the file to load.</param>
+		/// <returns>The immutable file contents (with any BOM removed and a line feed appended), or <c>nullptr</c> if the file could not be read.</returns>
+		std::shared_ptr<const std::string> load(const std::filesystem::path &path);
+
+		/// <summary>
+		/// Check whether the specified file or directory exists, by looking it up in a cached listing of its parent directory.
+		/// </summary>
+		/// <param name="path">The path to check.</param>
+		bool exists(const std::filesystem::path &path);
+		/// <summary>
+		/// Get a list of all files in the specified directory that have one of the specified extensions, based on a cached listing of it.
+		/// </summary>
+		/// <param name="directory">The path to the directory to search.</param>
+		/// <param name="extensions">The file extensions to look for (including the leading dot).</param>
+		std::vector<std::filesystem::path> find_files(const std::filesystem::path &directory, std::initializer_list<std::filesystem::path> extensions);
+		/// <summary>
+		/// Mark all cached directory listings as potentially outdated, so that they are checked against the modification time of their directory again on next access.
+		/// Until this is called, lookups are answered from the listings without querying the file system.
+		/// </summary>
+		void refresh_directories();
+
+		/// <summary>
+		/// Look up the preprocessor state that was stored for the specified include sequence.
+		/// </summary>
+		/// <param name="key">The key identifying the predefined macros, include paths and sequence of included files.</param>
+		/// <returns>The snapshot, or <c>nullptr</c> if none was stored for this key yet. It still has to be validated against the current file contents before use.</returns>
+		std::shared_ptr<const include_snapshot> find_snapshot(const std::string &key);
+		/// <summary>
+		/// Store the preprocessor state after the specified include sequence, replacing any previous snapshot for it.
+		/// </summary>
+		/// <param name="key">The key identifying the predefined macros, include paths and sequence of included files.</param>
+		/// <param name="snapshot">The snapshot to store.</param>
+		void store_snapshot(const std::string &key, std::shared_ptr<const include_snapshot> snapshot);
+
+		/// <summary>
+		/// Remove all files, directory listings and snapshots from the cache.
+		/// </summary>
+		void clear();
+
+		/// <summary>
+		/// Get the number of files that were read from disk since this cache was created.
+		/// </summary>
+		size_t files_read() const { return _files_read; }
+		/// <summary>
+		/// Get the number of bytes that were read from disk since this cache was created.
+		/// </summary>
+		size_t bytes_read() const { return _bytes_read; }
+		/// <summary>
+		/// Get the number of requests that were served from memory since this cache was created.
+		/// </summary>
+		size_t cache_hits() const { return _cache_hits; }
+		/// <summary>
+		/// Get the number of include snapshots that were found since this cache was created.
+		/// </summary>
+		size_t snapshot_hits() const { return _snapshot_hits; }
+
+	private:
+		struct file_entry
+		{
+			std::shared_ptr<const std::string> data;
+			std::filesystem::file_time_type last_write_time;
+			uintmax_t size;
+		};
+		struct directory_listing
+		{
+			bool exists = false;
+			std::filesystem::file_time_type last_write_time;
+			// File names and whether they are a directory, in the order they were enumerated
+			std::vector<std::pair<std::filesystem::path, bool>> entries;
+			std::unordered_set<std::string> names;
+		};
+		struct directory_entry
+		{
+			std::shared_ptr<const directory_listing> listing;
+			// Listings are only compared against the file system again after 'refresh_directories' was called
+			unsigned int generation;
+		};
+
+		std::shared_ptr<const directory_listing> list_directory(const std::filesystem::path &path);
+
+		std::mutex _mutex;
+		std::unordered_map<std::string, file_entry> _files;
+		std::unordered_map<std::string, std::shared_ptr<const include_snapshot>> _snapshots;
+		std::atomic<size_t> _files_read = 0;
+		std::atomic<size_t> _bytes_read = 0;
+		std::atomic<size_t> _cache_hits = 0;
+		std::atomic<size_t> _snapshot_hits = 0;
+		std::unordered_map<std::string, directory_entry> _directories;
+		unsigned int _directory_generation = 0;
+	};
+
 	/// <summary>
 	/// A C-style preprocessor implementation.
 	/// </summary>
@@ -27,6 +132,43 @@ namespace reshadefx
 			bool is_function_like = false;
 		};
 
+		/// <summary>
+		/// Key type of the macro tables. Stored keys own their name, while keys created with <see cref="lookup"/> only reference it, so that looking up a token does not allocate.
+		/// </summary>
+		class macro_name
+		{
+		public:
+			macro_name(std::string name) : _storage(std::move(name)), _name(_storage) {}
+			macro_name(const macro_name &other) : _storage(other._name), _name(_storage) {}
+
+			macro_name &operator=(const macro_name &other)
+			{
+				_storage = other._name;
+				_name = _storage;
+				return *this;
+			}
+
+			/// <summary>
+			/// Create a key that references the specified name without copying it. It must not outlive the referenced string.
+			/// </summary>
+			static macro_name lookup(std::string_view name) { return macro_name(name); }
+
+			const std::string_view &view() const { return _name; }
+
+			bool operator==(const macro_name &other) const { return _name == other._name; }
+
+			struct hash
+			{
+				size_t operator()(const macro_name &key) const { return std::hash<std::string_view>()(key._name); }
+			};
+
+		private:
+			explicit macro_name(std::string_view name) : _name(name) {}
+
+			std::string _storage;
+			std::string_view _name;
+		};
+
 		// Define constructor explicitly because lexer class is not included here
 		preprocessor();
 		~preprocessor();
@@ -37,6 +179,19 @@ namespace reshadefx
 		/// <param name="path">The path to the directory to add.</param>
 		void add_include_path(const std::filesystem::path &path);
 
+		/// <summary>
+		/// Set a source cache that is used to look up the contents of the main file and all included files, instead of reading them from disk every time.
+		/// The preprocessor state after each #include directive at the start of the main file is stored in it too, so that other instances including the same files can resume from there.
+		/// </summary>
+		/// <param name="cache">The cache to use. It has to stay alive as long as this preprocessor instance is in use.</param>
+		void set_source_cache(source_cache *cache) { _source_cache = cache; }
+		/// <summary>
+		/// Enable or disable compact output, which collapses whitespace between tokens wherever it is not needed to separate them and records source locations in a separate line map instead of emitting '#line' directives.
+		/// This has to be set before any input is appended.
+		/// </summary>
+		/// <param name="compact"><c>true</c> to produce compact output, <c>false</c> to keep the whitespace of the input and emit '#line' directives.</param>
+		void set_compact_output(bool compact) { _compact_output = compact; }
+
 		/// <summary>
 		/// Add a new macro definition. This is equal to appending '#define name macro' to this preprocessor instance.
 		/// </summary>
@@ -75,11 +230,20 @@ namespace reshadefx
 		/// </summary>
 		std::string &output() { return _output; }
 		const std::string &output() const { return _output; }
+		/// <summary>
+		/// Get the source locations of the lines in the output string, which need to be passed on to the parser in compact output mode.
+		/// </summary>
+		source_line_map line_map() const { return { _source_files, _line_map }; }
 
 		/// <summary>
 		/// Get a list of all included files.
 		/// </summary>
 		std::vector<std::filesystem::path> included_files() const;
+		/// <summary>
+		/// Get a list of all files that were looked for, but did not exist (e.g. while searching the include paths for an #include, or in an 'exists' check).
+		/// The output depends on these not existing, so it is outdated as soon as any of them is created.
+		/// </summary>
+		std::vector<std::filesystem::path> missing_files() const;
 
 		/// <summary>
 		/// Get a list of all defines that were used in #ifdef and #ifndef lines
@@ -87,6 +251,11 @@ namespace reshadefx
 		/// <returns></returns>
 		std::vector<std::pair<std::string, std::string>> used_macro_definitions() const;
 
+		/// <summary>
+		/// Get the number of #include directives that were skipped because the file is wrapped in an include guard whose macro was already defined.
+		/// </summary>
+		size_t skipped_includes() const { return _skipped_includes; }
+
 	private:
 		struct if_level
 		{
@@ -95,18 +264,102 @@ namespace reshadefx
 			token pp_token;
 			size_t input_index;
 		};
-		struct input_level
+		struct token_list
+		{
+			// Compact version of a token, the location and literal string are reconstructed from the list when it is consumed
+			struct list_token
+			{
+				tokenid id;
+				uint32_t offset, length;
+				uint32_t literal_length;
+				union
+				{
+					int literal_as_int;
+					unsigned int literal_as_uint;
+					float literal_as_float;
+					double literal_as_double;
+				};
+			};
+
+			std::string text;
+			std::vector<list_token> tokens;
+			// Set if the tokens may differ from what lexing the concatenated text would produce (e.g. because two tokens merge into one)
+			bool requires_lexing = false;
+
+			void append(const token &tok, std::string_view raw_data, bool check_merge = true);
+			void append(const list_token &tok, std::string_view raw_data, bool check_merge = true);
+		};
+		struct macro_tokens
+		{
+			struct part
+			{
+				char type;
+				char index;
+				size_t first_token, last_token;
+				size_t text_offset, text_length;
+			};
+
+			token_list tokens;
+			std::vector<part> parts;
+		};
+		struct argument_expansion
+		{
+			// Range in the output the argument was expanded into
+			size_t first_token = 0, last_token = 0;
+			size_t text_offset = 0, text_length = 0;
+			bool valid = false;
+			bool at_line_begin = false;
+			unsigned int line = 0;
+			uint32_t source_id = 0;
+		};
+		struct hidden_macro
 		{
 			std::string name;
+			std::shared_ptr<const hidden_macro> parent;
+		};
+		enum class include_guard_state
+		{
+			none,
+			before,
+			inside,
+			after
+		};
+		struct input_level
+		{
+			uint32_t source_id = 0;
 			std::unique_ptr<class lexer> lexer;
+			// Macro expansions are not lexed again, but read from a list of existing tokens instead
+			std::unique_ptr<token_list> tokens;
+			size_t next_token_index = 0;
+			location tokens_location;
 			token next_token;
-			std::unordered_set<std::string> hidden_macros;
+			std::shared_ptr<const hidden_macro> hidden_macros;
+			// Files that are entirely wrapped in an '#ifndef' block do not need to be processed again while its macro is defined
+			include_guard_state include_guard = include_guard_state::none;
+			std::string include_guard_name;
+			size_t include_guard_if_index = 0;
+
+			bool is_hidden(std::string_view name) const;
+			const std::string &input_string() const;
 		};
 
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
-		void push(std::string input, const std::string &name = std::string());
+		void push(std::string input, const std::string &name = std::string()) { push(std::make_shared<const std::string>(std::move(input)), name); }
+		void push(std::shared_ptr<const std::string> input, const std::string &name = std::string());
+		void push(std::unique_ptr<token_list> input);
+		void pop();
+
+		bool file_exists(const std::filesystem::path &path);
+
+		token_list create_token_list();
+		void release_token_list(token_list &&list);
+
+		std::shared_ptr<const std::string> load_file(const std::filesystem::path &path);
+
+		bool restore_include_snapshot(const std::string &key);
+		void store_include_snapshot();
 
 		bool peek(tokenid token) const;
 		bool consume();
@@ -128,15 +381,19 @@ namespace reshadefx
 		void parse_pragma();
 		void parse_include();
 
+		void emit_line_location(const location &location, bool include_file);
+
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
 
-		void expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out);
+		void expand_macro(std::string_view name, const macro &macro, const std::vector<token_list> &arguments, token_list &out);
+		void expand_macro_argument(const token_list &argument, token_list &out);
 		void create_macro_replacement_list(macro &macro);
+		const macro_tokens &lex_macro_replacement_list(const macro &macro);
 
 		bool _success = true;
 		std::string _output, _errors;
-		std::string _current_token_raw_data;
+		std::string_view _current_token_raw_data;
 		reshadefx::token _token;
 		std::vector<if_level> _if_stack;
 		std::vector<input_level> _input_stack;
@@ -144,9 +401,55 @@ namespace reshadefx
 		size_t _current_input_index = 0;
 		unsigned short _recursion_count = 0;
 		location _output_location;
-		std::unordered_set<std::string> _used_macros;
-		std::unordered_map<std::string, macro> _macros;
+		source_file_table _source_files;
+		bool _compact_output = false;
+		std::vector<source_line_map::entry> _line_map;
+		std::unordered_set<macro_name, macro_name::hash> _used_macros;
+		std::unordered_map<macro_name, macro, macro_name::hash> _macros;
+		std::unordered_map<const macro *, macro_tokens> _macro_tokens;
+		std::vector<token_list> _token_list_pool;
 		std::vector<std::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _file_cache;
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> _file_cache;
+		std::unordered_map<std::string, std::string> _include_guards;
+		std::unordered_set<std::string> _missing_files;
+		size_t _skipped_includes = 0;
+		source_cache *_source_cache = nullptr;
+		bool _include_prefix = false;
+		std::string _include_prefix_key;
+		std::vector<std::pair<std::string, std::shared_ptr<const std::string>>> _include_prefix_files;
+		size_t _snapshot_output_offset = 0;
+		size_t _snapshot_errors_offset = 0;
+		std::unique_ptr<include_snapshot> _pending_snapshot;
+	};
+
+	/// <summary>
+	/// The preprocessor state after processing an #include directive at the start of a file, before any other code.
+	/// </summary>
+	struct include_snapshot
+	{
+		/// <summary>
+		/// The output generated for the included file.
+		/// </summary>
+		std::string output;
+		/// <summary>
+		/// The file the last #line directive in the output refers to.
+		/// </summary>
+		std::string output_source;
+		/// <summary>
+		/// The source locations of the output in compact output mode, as offsets relative to its start and the file path, line and column they map to.
+		/// </summary>
+		std::vector<std::tuple<size_t, std::string, unsigned int, unsigned int>> output_line_map;
+		/// <summary>
+		/// The files that were read since the start of the include sequence, used to verify they did not change since.
+		/// </summary>
+		std::vector<std::pair<std::string, std::shared_ptr<const std::string>>> files;
+		/// <summary>
+		/// The files that were looked for since the start of the include sequence, but did not exist, used to verify they were not created since.
+		/// </summary>
+		std::vector<std::string> missing_files;
+		std::unordered_set<preprocessor::macro_name, preprocessor::macro_name::hash> used_macros;
+		std::unordered_map<preprocessor::macro_name, preprocessor::macro, preprocessor::macro_name::hash> macros;
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> file_cache;
+		std::unordered_map<std::string, std::string> include_guards;
 	};
 }
@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_serialization.hpp"
+#include "effect_cache.hpp" // Checksum
+#include <cstring> // std::memcpy
+#include <algorithm> // std::stable_sort, std::unique
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Layout of the container header, with all values stored in little-endian byte order:
+//   4 bytes   Magic "RFXO"
+//   4 bytes   Format version (see 'module_format_version')
+//   4 bytes   Target code generator (see 'module_target')
+//   4 bytes   Shader model
+//   4 bytes   Flags (bit 0 = uniforms converted to specialization constants, bit 1 = inverted Y axis)
+//   4 bytes   Reserved (zero)
+//   8 bytes   Hash of the macro definitions the source was preprocessed with (see 'hash_macro_definitions')
+//   8 bytes   Size of the data following the header
+//   8 bytes   64-bit FNV-1a hash of the preceding header fields and the data following the header
+// The header is followed by the list of included files, the list of used macro definitions and then the module data.
+static constexpr uint32_t s_module_magic = 0x4F584652; // "RFXO"
+static constexpr size_t s_module_header_size = 4 * 6 + 8 + 8 + 8;
+
+uint64_t reshadefx::hash_macro_definitions(std::vector<std::pair<std::string, std::string>> macros)
+{
+	std::stable_sort(macros.begin(), macros.end(),
+		[](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+	macros.erase(std::unique(macros.begin(), macros.end(),
+		[](const auto &lhs, const auto &rhs) { return lhs.first == rhs.first; }), macros.end());
+
+	effect_cache::key key;
+	for (const auto &macro : macros)
+		key.add(macro.first).add(macro.second);
+	return key.value();
+}
+
+void reshadefx::binary_writer::write(uint32_t value)
+{
+	const char bytes[4] = {
+		static_cast<char>(value), static_cast<char>(value >> 8), static_cast<char>(value >> 16), static_cast<char>(value >> 24) };
+	_data.append(bytes, 4);
+}
+void reshadefx::binary_writer::write(uint64_t value)
+{
+	write(static_cast<uint32_t>(value));
+	write(static_cast<uint32_t>(value >> 32));
+}
+void reshadefx::binary_writer::write(std::string_view value)
+{
+	write(static_cast<uint32_t>(value.size()));
+	_data.append(value);
+}
+
+void reshadefx::binary_writer::write(const type &value)
+{
+	write(static_cast<uint32_t>(value.base));
+	write(static_cast<uint32_t>(value.rows));
+	write(static_cast<uint32_t>(value.cols));
+	write(static_cast<uint32_t>(value.qualifiers));
+	write(static_cast<uint32_t>(value.array_length));
+	write(value.definition);
+}
+void reshadefx::binary_writer::write(const constant &value)
+{
+	// Trailing zeros are not stored, since most constants only use a few components
+	uint32_t num_values = 16;
+	while (num_values != 0 && value.as_uint[num_values - 1] == 0)
+		--num_values;
+
+	write(num_values);
+	for (uint32_t i = 0; i < num_values; ++i)
+		write(value.as_uint[i]);
+
+	write(value.string_data);
+
+	write(static_cast<uint32_t>(value.array_data.size()));
+	write(static_cast<uint32_t>(value.array_data.stride()));
+	for (size_t i = 0, num_array_values = value.array_data.size() * value.array_data.stride(); i < num_array_values; ++i)
+		write(value.array_data.data()[i]);
+}
+void reshadefx::binary_writer::write(const std::vector<annotation> &value)
+{
+	write(static_cast<uint32_t>(value.size()));
+	for (const annotation &annotation : value)
+	{
+		write(annotation.type);
+		write(annotation.name);
+		write(annotation.value);
+	}
+}
+void reshadefx::binary_writer::write(const module &value)
+{
+	write(value.hlsl);
+
+	write(static_cast<uint32_t>(value.spirv.size()));
+	for (const uint32_t word : value.spirv)
+		write(word);
+
+	write(static_cast<uint32_t>(value.entry_points.size()));
+	for (const entry_point &entry_point : value.entry_points)
+	{
+		write(entry_point.name);
+		write(static_cast<uint32_t>(entry_point.is_pixel_shader));
+		write(entry_point.hlsl);
+	}
+
+	write(static_cast<uint32_t>(value.textures.size()));
+	for (const texture_info &texture : value.textures)
+	{
+		write(texture.id);
+		write(texture.binding);
+		write(texture.semantic);
+		write(texture.unique_name);
+		write(texture.annotations);
+		write(texture.width);
+		write(texture.height);
+		write(texture.levels);
+		write(static_cast<uint32_t>(texture.format));
+	}
+
+	write(static_cast<uint32_t>(value.samplers.size()));
+	for (const sampler_info &sampler : value.samplers)
+	{
+		uint32_t lod_values[3];
+		std::memcpy(&lod_values[0], &sampler.min_lod, 4);
+		std::memcpy(&lod_values[1], &sampler.max_lod, 4);
+		std::memcpy(&lod_values[2], &sampler.lod_bias, 4);
+
+		write(sampler.id);
+		write(sampler.binding);
+		write(sampler.texture_binding);
+		write(sampler.unique_name);
+		write(sampler.texture_name);
+		write(sampler.annotations);
+		write(static_cast<uint32_t>(sampler.filter));
+		write(static_cast<uint32_t>(sampler.address_u));
+		write(static_cast<uint32_t>(sampler.address_v));
+		write(static_cast<uint32_t>(sampler.address_w));
+		write(lod_values[0]);
+		write(lod_values[1]);
+		write(lod_values[2]);
+		write(static_cast<uint32_t>(sampler.srgb));
+	}
+
+	for (const std::vector<uniform_info> *uniforms : { &value.uniforms, &value.spec_constants })
+	{
+		write(static_cast<uint32_t>(uniforms->size()));
+		for (const uniform_info &uniform : *uniforms)
+		{
+			write(uniform.name);
+			write(uniform.type);
+			write(uniform.size);
+			write(uniform.offset);
+			write(uniform.annotations);
+			write(static_cast<uint32_t>(uniform.has_initializer_value));
+			write(uniform.initializer_value);
+		}
+	}
+
+	write(static_cast<uint32_t>(value.techniques.size()));
+	for (const technique_info &technique : value.techniques)
+	{
+		write(technique.name);
+		write(technique.annotations);
+
+		write(static_cast<uint32_t>(technique.passes.size()));
+		for (const pass_info &pass : technique.passes)
+		{
+			for (const std::string &render_target_name : pass.render_target_names)
+				write(render_target_name);
+			write(pass.vs_entry_point);
+			write(pass.ps_entry_point);
+
+			const uint8_t state[] = {
+				pass.clear_render_targets,
+				pass.srgb_write_enable,
+				pass.blend_enable,
+				pass.stencil_enable,
+				pass.color_write_mask,
+				pass.stencil_read_mask,
+				pass.stencil_write_mask,
+				static_cast<uint8_t>(pass.blend_op),
+				static_cast<uint8_t>(pass.blend_op_alpha),
+				static_cast<uint8_t>(pass.src_blend),
+				static_cast<uint8_t>(pass.dest_blend),
+				static_cast<uint8_t>(pass.src_blend_alpha),
+				static_cast<uint8_t>(pass.dest_blend_alpha),
+				static_cast<uint8_t>(pass.stencil_comparison_func),
+				static_cast<uint8_t>(pass.stencil_op_pass),
+				static_cast<uint8_t>(pass.stencil_op_fail),
+				static_cast<uint8_t>(pass.stencil_op_depth_fail),
+				static_cast<uint8_t>(pass.topology),
+			};
+			write(std::string_view(reinterpret_cast<const char *>(state), sizeof(state)));
+
+			write(pass.stencil_reference_value);
+			write(pass.num_vertices);
+			write(pass.viewport_width);
+			write(pass.viewport_height);
+		}
+	}
+
+	write(value.total_uniform_size);
+	write(value.num_sampler_bindings);
+	write(value.num_texture_bindings);
+}
+
+uint32_t reshadefx::binary_reader::read_uint32()
+{
+	if (_failed || _data.size() < 4)
+		return _failed = true, 0;
+
+	const auto bytes = reinterpret_cast<const uint8_t *>(_data.data());
+	_data.remove_prefix(4);
+
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+uint64_t reshadefx::binary_reader::read_uint64()
+{
+	const uint32_t low = read_uint32();
+	return low | (static_cast<uint64_t>(read_uint32()) << 32);
+}
+std::string_view reshadefx::binary_reader::read_string()
+{
+	const size_t size = read_count(1);
+	const std::string_view value = _data.substr(0, size);
+	_data.remove_prefix(size);
+	return value;
+}
+
+size_t reshadefx::binary_reader::read_count(size_t min_element_size)
+{
+	const uint32_t count = read_uint32();
+	if (_failed || count > _data.size() / min_element_size)
+		return _failed = true, 0;
+	return count;
+}
+
+void reshadefx::binary_reader::read(type &value)
+{
+	value.base = static_cast<type::datatype>(read_uint32());
+	value.rows = read_uint32();
+	value.cols = read_uint32();
+	value.qualifiers = read_uint32();
+	value.array_length = static_cast<int>(read_uint32());
+	value.definition = read_uint32();
+}
+void reshadefx::binary_reader::read(constant &value)
+{
+	value = {};
+
+	const uint32_t num_values = read_uint32();
+	if (num_values > 16)
+		_failed = true;
+	for (uint32_t i = 0; i < num_values && !_failed; ++i)
+		value.as_uint[i] = read_uint32();
+
+	value.string_data = read_string();
+
+	const size_t num_elements = read_count(1);
+	const uint32_t stride = read_uint32();
+	if (stride > 16)
+		_failed = true;
+
+	for (size_t i = 0; i < num_elements && !_failed; ++i)
+	{
+		constant element = {};
+		for (uint32_t k = 0; k < stride; ++k)
+			element.as_uint[k] = read_uint32();
+		value.array_data.push_back(element, stride);
+	}
+}
+void reshadefx::binary_reader::read(std::vector<annotation> &value)
+{
+	value.resize(read_count(4 * 6 + 4 + 4 + 4 + 4 + 4));
+	for (annotation &annotation : value)
+	{
+		read(annotation.type);
+		annotation.name = read_string();
+		read(annotation.value);
+	}
+}
+void reshadefx::binary_reader::read(module &value)
+{
+	value = {};
+
+	value.hlsl = read_string();
+
+	value.spirv.resize(read_count(4));
+	for (uint32_t &word : value.spirv)
+		word = read_uint32();
+
+	value.entry_points.resize(read_count(4 + 4 + 4));
+	for (entry_point &entry_point : value.entry_points)
+	{
+		entry_point.name = read_string();
+		entry_point.is_pixel_shader = read_uint32() != 0;
+		entry_point.hlsl = read_string();
+	}
+
+	value.textures.resize(read_count(4 * 9));
+	for (texture_info &texture : value.textures)
+	{
+		texture.id = read_uint32();
+		texture.binding = read_uint32();
+		texture.semantic = read_string();
+		texture.unique_name = read_string();
+		read(texture.annotations);
+		texture.width = read_uint32();
+		texture.height = read_uint32();
+		texture.levels = read_uint32();
+		texture.format = static_cast<texture_format>(read_uint32());
+	}
+
+	value.samplers.resize(read_count(4 * 14));
+	for (sampler_info &sampler : value.samplers)
+	{
+		sampler.id = read_uint32();
+		sampler.binding = read_uint32();
+		sampler.texture_binding = read_uint32();
+		sampler.unique_name = read_string();
+		sampler.texture_name = read_string();
+		read(sampler.annotations);
+		sampler.filter = static_cast<texture_filter>(read_uint32());
+		sampler.address_u = static_cast<texture_address_mode>(read_uint32());
+		sampler.address_v = static_cast<texture_address_mode>(read_uint32());
+		sampler.address_w = static_cast<texture_address_mode>(read_uint32());
+
+		const uint32_t lod_values[3] = { read_uint32(), read_uint32(), read_uint32() };
+		std::memcpy(&sampler.min_lod, &lod_values[0], 4);
+		std::memcpy(&sampler.max_lod, &lod_values[1], 4);
+		std::memcpy(&sampler.lod_bias, &lod_values[2], 4);
+
+		sampler.srgb = static_cast<uint8_t>(read_uint32());
+	}
+
+	for (std::vector<uniform_info> *uniforms : { &value.uniforms, &value.spec_constants })
+	{
+		uniforms->resize(read_count(4 + 4 * 6 + 4 + 4 + 4 + 4 + 4));
+		for (uniform_info &uniform : *uniforms)
+		{
+			uniform.name = read_string();
+			read(uniform.type);
+			uniform.size = read_uint32();
+			uniform.offset = read_uint32();
+			read(uniform.annotations);
+			uniform.has_initializer_value = read_uint32() != 0;
+			read(uniform.initializer_value);
+		}
+	}
+
+	value.techniques.resize(read_count(4 + 4 + 4));
+	for (technique_info &technique : value.techniques)
+	{
+		technique.name = read_string();
+		read(technique.annotations);
+
+		technique.passes.resize(read_count(4 * 10 + 4 + 18 + 4 * 4));
+		for (pass_info &pass : technique.passes)
+		{
+			for (std::string &render_target_name : pass.render_target_names)
+				render_target_name = read_string();
+			pass.vs_entry_point = read_string();
+			pass.ps_entry_point = read_string();
+
+			const std::string_view state = read_string();
+			if (state.size() != 18)
+				return (void)(_failed = true);
+
+			pass.clear_render_targets = state[0];
+			pass.srgb_write_enable = state[1];
+			pass.blend_enable = state[2];
+			pass.stencil_enable = state[3];
+			pass.color_write_mask = state[4];
+			pass.stencil_read_mask = state[5];
+			pass.stencil_write_mask = state[6];
+			pass.blend_op = static_cast<pass_blend_op>(state[7]);
+			pass.blend_op_alpha = static_cast<pass_blend_op>(state[8]);
+			pass.src_blend = static_cast<pass_blend_func>(state[9]);
+			pass.dest_blend = static_cast<pass_blend_func>(state[10]);
+			pass.src_blend_alpha = static_cast<pass_blend_func>(state[11]);
+			pass.dest_blend_alpha = static_cast<pass_blend_func>(state[12]);
+			pass.stencil_comparison_func = static_cast<pass_stencil_func>(state[13]);
+			pass.stencil_op_pass = static_cast<pass_stencil_op>(state[14]);
+			pass.stencil_op_fail = static_cast<pass_stencil_op>(state[15]);
+			pass.stencil_op_depth_fail = static_cast<pass_stencil_op>(state[16]);
+			pass.topology = static_cast<primitive_topology>(state[17]);
+
+			pass.stencil_reference_value = read_uint32();
+			pass.num_vertices = read_uint32();
+			pass.viewport_width = read_uint32();
+			pass.viewport_height = read_uint32();
+		}
+	}
+
+	value.total_uniform_size = read_uint32();
+	value.num_sampler_bindings = read_uint32();
+	value.num_texture_bindings = read_uint32();
+}
+
+void reshadefx::write_module(std::string &data, const module &module, const module_info &info, const module_source_info &source_info)
+{
+	const size_t header_offset = data.size();
+	data.resize(header_offset + s_module_header_size); // Reserve space for the header, which is filled in once the size and hash of the module data are known
+
+	binary_writer data_writer(data);
+	data_writer.write(static_cast<uint32_t>(source_info.included_files.size()));
+	for (const std::filesystem::path &file : source_info.included_files)
+		data_writer.write(file.u8string());
+	data_writer.write(static_cast<uint32_t>(source_info.definitions.size()));
+	for (const auto &definition : source_info.definitions)
+	{
+		data_writer.write(definition.first);
+		data_writer.write(definition.second);
+	}
+	data_writer.write(module);
+
+	const std::string_view module_data = std::string_view(data).substr(header_offset + s_module_header_size);
+
+	std::string header;
+	header.reserve(s_module_header_size);
+	binary_writer writer(header);
+	writer.write(s_module_magic);
+	writer.write(module_format_version);
+	writer.write(static_cast<uint32_t>(info.target));
+	writer.write(static_cast<uint32_t>(info.shader_model));
+	writer.write(static_cast<uint32_t>((info.uniforms_to_spec_constants ? 0x1 : 0) | (info.invert_y ? 0x2 : 0)));
+	writer.write(static_cast<uint32_t>(0));
+	writer.write(source_info.macro_hash);
+	writer.write(static_cast<uint64_t>(module_data.size()));
+	writer.write(effect_cache::key().add(header.data(), header.size()).add(module_data.data(), module_data.size()).value());
+
+	data.replace(header_offset, s_module_header_size, header);
+}
+
+bool reshadefx::read_module(std::string_view data, module &module, module_info &info, module_source_info &source_info)
+{
+	module = {};
+	source_info = {};
+
+	binary_reader header(data.substr(0, s_module_header_size));
+	if (header.read_uint32() != s_module_magic || header.read_uint32() != module_format_version)
+		return false;
+
+	info.target = static_cast<module_target>(header.read_uint32());
+	info.shader_model = header.read_uint32();
+	const uint32_t flags = header.read_uint32();
+	info.uniforms_to_spec_constants = (flags & 0x1) != 0;
+	info.invert_y = (flags & 0x2) != 0;
+	header.read_uint32();
+	const uint64_t macro_hash = header.read_uint64();
+
+	const uint64_t module_size = header.read_uint64();
+	const uint64_t module_hash = header.read_uint64();
+	if (header.failed() || module_size != data.size() - s_module_header_size)
+		return false;
+
+	const std::string_view module_data = data.substr(s_module_header_size);
+	if (module_hash != effect_cache::key().add(data.data(), s_module_header_size - 8).add(module_data.data(), module_data.size()).value())
+		return false;
+
+	binary_reader reader(module_data);
+
+	std::vector<std::filesystem::path> included_files(reader.read_count(4));
+	for (size_t i = 0; i < included_files.size() && !reader.failed(); ++i)
+		included_files[i] = std::filesystem::u8path(reader.read_string());
+
+	std::vector<std::pair<std::string, std::string>> definitions(reader.read_count(4 + 4));
+	for (size_t i = 0; i < definitions.size() && !reader.failed(); ++i)
+	{
+		definitions[i].first = reader.read_string();
+		definitions[i].second = reader.read_string();
+	}
+
+	reader.read(module);
+
+	if (reader.failed())
+	{
+		module = {};
+		return false;
+	}
+
+	source_info.macro_hash = macro_hash;
+	source_info.included_files = std::move(included_files);
+	source_info.definitions = std::move(definitions);
+	return true;
+}
+
+reshadefx::mapped_file::mapped_file(const std::filesystem::path &path)
+{
+#ifdef _WIN32
+	const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	if (LARGE_INTEGER size; GetFileSizeEx(file, &size) && size.QuadPart > 0 && static_cast<uint64_t>(size.QuadPart) <= SIZE_MAX)
+	{
+		// The mapping keeps the file open, so the handle can be closed right away
+		if (_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr); _mapping != nullptr)
+		{
+			if (_data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0); _data != nullptr)
+				_size = static_cast<size_t>(size.QuadPart);
+			else
+				CloseHandle(_mapping), _mapping = nullptr;
+		}
+	}
+
+	CloseHandle(file);
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return;
+
+	if (struct stat st; fstat(file, &st) == 0 && st.st_size > 0)
+	{
+		// The mapping keeps the file open, so the descriptor can be closed right away
+		if (void *const data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, file, 0); data != MAP_FAILED)
+			_data = data, _size = static_cast<size_t>(st.st_size);
+	}
+
+	close(file);
+#endif
+}
+reshadefx::mapped_file::~mapped_file()
+{
+	if (_data == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+#else
+	munmap(const_cast<void *>(_data), _size);
+#endif
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "effect_module.hpp"
+#include <string_view>
+#include <filesystem>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// The version of the binary module format, which has to be increased whenever the layout of serialized data changes.
+	/// Data written with a different version is rejected when reading it.
+	/// </summary>
+	constexpr uint32_t module_format_version = 2;
+
+	/// <summary>
+	/// A list of code generators a module can be compiled with.
+	/// </summary>
+	enum class module_target : uint32_t
+	{
+		hlsl,
+		glsl,
+		spirv,
+	};
+
+	/// <summary>
+	/// The code generator settings a module was compiled with, which have to match the backend that uses it.
+	/// </summary>
+	struct module_info
+	{
+		module_target target = module_target::spirv;
+		unsigned int shader_model = 0; // Only used for HLSL
+		bool uniforms_to_spec_constants = false;
+		bool invert_y = false; // Only used for SPIR-V
+
+		friend inline bool operator==(const module_info &lhs, const module_info &rhs)
+		{
+			return lhs.target == rhs.target && lhs.shader_model == rhs.shader_model && lhs.uniforms_to_spec_constants == rhs.uniforms_to_spec_constants && lhs.invert_y == rhs.invert_y;
+		}
+		friend inline bool operator!=(const module_info &lhs, const module_info &rhs)
+		{
+			return !operator==(lhs, rhs);
+		}
+	};
+
+	/// <summary>
+	/// The preprocessor inputs and results of the source file a module was compiled from, which are stored along with it.
+	/// </summary>
+	struct module_source_info
+	{
+		/// <summary>
+		/// The hash of the macro definitions the source file was preprocessed with (see <see cref="hash_macro_definitions"/>), since the module is only valid for those.
+		/// </summary>
+		uint64_t macro_hash = 0;
+		/// <summary>
+		/// The files that were included, relative to the directory of the source file (unless there is no relative path to them), so that they can be watched for changes.
+		/// </summary>
+		std::vector<std::filesystem::path> included_files;
+		/// <summary>
+		/// The macro definitions that were used in #ifdef and #ifndef lines (see preprocessor::used_macro_definitions).
+		/// </summary>
+		std::vector<std::pair<std::string, std::string>> definitions;
+	};
+
+	/// <summary>
+	/// Hash a list of macro definitions independent of their order.
+	/// Macros that are defined multiple times only count with their first definition, which is the one the preprocessor keeps.
+	/// </summary>
+	/// <param name="macros">The names and replacement lists of the macros.</param>
+	uint64_t hash_macro_definitions(std::vector<std::pair<std::string, std::string>> macros);
+
+	/// <summary>
+	/// Appends values to a string in a compact little-endian binary format that does not depend on the platform.
+	/// </summary>
+	class binary_writer
+	{
+	public:
+		explicit binary_writer(std::string &data) : _data(data) { }
+
+		void write(uint32_t value);
+		void write(uint64_t value);
+		void write(std::string_view value);
+
+		void write(const type &value);
+		void write(const constant &value);
+		void write(const std::vector<annotation> &value);
+		void write(const module &value);
+
+	private:
+		std::string &_data;
+	};
+
+	/// <summary>
+	/// Reads values that were written by a <see cref="binary_writer"/>, directly from the data without copying it first (so it may point into a memory-mapped file).
+	/// Reading past the end of the data or encountering invalid values puts the reader into a failed state, in which all further reads return default values.
+	/// </summary>
+	class binary_reader
+	{
+	public:
+		explicit binary_reader(std::string_view data) : _data(data) { }
+
+		bool failed() const { return _failed; }
+
+		uint32_t read_uint32();
+		uint64_t read_uint64();
+		std::string_view read_string();
+		/// <summary>
+		/// Read a count of elements that each take up at least the specified number of bytes, so that corrupt counts cannot cause huge allocations.
+		/// </summary>
+		size_t read_count(size_t min_element_size);
+
+		void read(type &value);
+		void read(constant &value);
+		void read(std::vector<annotation> &value);
+		void read(module &value);
+
+	private:
+		std::string_view _data;
+		bool _failed = false;
+	};
+
+	/// <summary>
+	/// Serialize a module into a self-contained container, which starts with a header describing the format version and code generator settings and protects the contents with a checksum.
+	/// </summary>
+	/// <param name="data">The string to append the container to.</param>
+	/// <param name="module">The module to serialize.</param>
+	/// <param name="info">The code generator settings the module was compiled with.</param>
+	/// <param name="source_info">The preprocessor inputs and results of the source file the module was compiled from.</param>
+	void write_module(std::string &data, const module &module, const module_info &info, const module_source_info &source_info);
+	/// <summary>
+	/// Deserialize a module from a container written by <see cref="write_module"/>.
+	/// </summary>
+	/// <param name="data">The container data, which can be a view of a memory-mapped file.</param>
+	/// <param name="module">Receives the module. This is left empty if the container is invalid.</param>
+	/// <param name="info">Receives the code generator settings the module was compiled with.</param>
+	/// <param name="source_info">Receives the preprocessor inputs and results of the source file the module was compiled from.</param>
+	/// <returns><c>true</c> if the container was intact and has the current format version, <c>false</c> otherwise.</returns>
+	bool read_module(std::string_view data, module &module, module_info &info, module_source_info &source_info);
+
+	/// <summary>
+	/// A read-only memory mapping of an entire file.
+	/// </summary>
+	class mapped_file
+	{
+	public:
+		explicit mapped_file(const std::filesystem::path &path);
+		~mapped_file();
+
+		mapped_file(const mapped_file &) = delete;
+		mapped_file &operator=(const mapped_file &) = delete;
+
+		/// <summary>
+		/// Return whether the file was opened and mapped successfully.
+		/// </summary>
+		bool is_open() const { return _data != nullptr; }
+
+		/// <summary>
+		/// Get the contents of the file, which stay valid as long as this object exists.
+		/// </summary>
+		std::string_view data() const { return std::string_view(static_cast<const char *>(_data), _size); }
+
+	private:
+		const void *_data = nullptr;
+		size_t _size = 0;
+#ifdef _WIN32
+		void *_mapping = nullptr;
+#endif
+	};
+}
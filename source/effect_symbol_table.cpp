@@ -13,17 +13,18 @@ using namespace reshadefx;
 
 struct intrinsic
 {
-	intrinsic(const char *name, unsigned int id, const type &ret_type, std::initializer_list<type> arg_types) : id(id)
+	constexpr intrinsic(const char *name, unsigned int id, const type &ret_type, std::initializer_list<type> arg_types) :
+		name(name), id(id), ret_type(ret_type), num_args(static_cast<unsigned int>(arg_types.size())), arg_types()
 	{
-		function.name = name;
-		function.return_type = ret_type;
-		function.parameter_list.reserve(arg_types.size());
-		for (const type &arg_type : arg_types)
-			function.parameter_list.push_back({ arg_type, {}, {}, {} });
+		for (size_t i = 0; i < arg_types.size(); ++i)
+			this->arg_types[i] = arg_types.begin()[i];
 	}
 
+	std::string_view name;
 	unsigned int id;
-	function_info function;
+	type ret_type;
+	unsigned int num_args;
+	type arg_types[4];
 };
 
 // Import intrinsic callback functions
@@ -60,7 +61,7 @@ enum {
 
 // Import intrinsic function definitions
 #define DEFINE_INTRINSIC(name, i, ret_type, ...) intrinsic(#name, name##i, ret_type, { __VA_ARGS__ }),
-static const intrinsic s_intrinsics[] = {
+static constexpr intrinsic s_intrinsics[] = {
 #include "effect_symbol_table_intrinsics.inl"
 };
 
@@ -90,6 +91,72 @@ static const intrinsic s_intrinsics[] = {
 #undef out_float4
 #undef sampler
 
+// Compile-time generated hash table which translates an intrinsic name to the range of its overloads in the intrinsic list
+// This requires all overloads of an intrinsic to be defined next to each other
+struct intrinsic_overloads
+{
+	std::string_view name;
+	unsigned int first = 0, count = 0;
+};
+
+static constexpr uint32_t hash_intrinsic(std::string_view name)
+{
+	// FNV-1a hash
+	uint32_t hash = 2166136261u;
+	for (const char c : name)
+		hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+	return hash;
+}
+
+template <size_t TABLE_SIZE>
+class intrinsic_table
+{
+	static_assert((TABLE_SIZE & (TABLE_SIZE - 1)) == 0, "table size has to be a power of two");
+
+public:
+	template <size_t N>
+	constexpr intrinsic_table(const intrinsic (&intrinsics)[N]) : _slots(), _split_overloads(false)
+	{
+		for (unsigned int i = 0, count = 0; i < N; i += count)
+		{
+			for (count = 1; i + count < N && intrinsics[i + count].name == intrinsics[i].name; ++count)
+				continue;
+
+			// Resolve collisions with linear probing (the load factor is kept low enough so that this rarely happens)
+			size_t slot = hash_intrinsic(intrinsics[i].name) & (TABLE_SIZE - 1);
+			for (; !_slots[slot].name.empty(); slot = (slot + 1) & (TABLE_SIZE - 1))
+				_split_overloads |= _slots[slot].name == intrinsics[i].name;
+			_slots[slot] = { intrinsics[i].name, i, count };
+		}
+	}
+
+	/// <summary>
+	/// Look up the overloads of the intrinsic with the specified name.
+	/// </summary>
+	/// <returns>The range of overloads in the intrinsic list, which is empty if there is no intrinsic with this name.</returns>
+	constexpr intrinsic_overloads find(std::string_view name) const
+	{
+		for (size_t slot = hash_intrinsic(name) & (TABLE_SIZE - 1); !_slots[slot].name.empty(); slot = (slot + 1) & (TABLE_SIZE - 1))
+			if (_slots[slot].name == name)
+				return _slots[slot];
+		return {};
+	}
+
+	/// <summary>
+	/// Check whether the overloads of an intrinsic were not defined next to each other, in which case only part of them can be found.
+	/// </summary>
+	constexpr bool has_split_overloads() const { return _split_overloads; }
+
+private:
+	intrinsic_overloads _slots[TABLE_SIZE];
+	bool _split_overloads;
+};
+
+static constexpr intrinsic_table<256> s_intrinsic_lookup(s_intrinsics);
+
+static_assert(!s_intrinsic_lookup.has_split_overloads(), "overloads of an intrinsic have to be defined next to each other");
+static_assert(s_intrinsic_lookup.find("tex2D").count != 0 && s_intrinsic_lookup.find("texture2D").count == 0);
+
 #pragma endregion
 
 unsigned int reshadefx::type::rank(const type &src, const type &dst)
@@ -129,9 +196,12 @@ unsigned int reshadefx::type::rank(const type &src, const type &dst)
 
 reshadefx::symbol_table::symbol_table()
 {
-	_current_scope.name = "::";
+	_current_scope.namespace_id = 0;
 	_current_scope.level = 0;
 	_current_scope.namespace_level = 0;
+
+	_namespaces.push_back({ "::", 0 });
+	_namespace_lookup.emplace("::", 0);
 }
 
 void reshadefx::symbol_table::enter_scope()
@@ -140,7 +210,15 @@ void reshadefx::symbol_table::enter_scope()
 }
 void reshadefx::symbol_table::enter_namespace(const std::string &name)
 {
-	_current_scope.name += name + "::";
+	const uint32_t parent_id = _current_scope.namespace_id;
+	std::string qualified_name = _namespaces[parent_id].name + name + "::";
+
+	// Namespaces can be entered multiple times, so reuse the existing index if possible
+	const auto it = _namespace_lookup.emplace(qualified_name, static_cast<uint32_t>(_namespaces.size()));
+	if (it.second)
+		_namespaces.push_back({ std::move(qualified_name), parent_id });
+
+	_current_scope.namespace_id = it.first->second;
 	_current_scope.level++;
 	_current_scope.namespace_level++;
 }
@@ -148,20 +226,21 @@ void reshadefx::symbol_table::leave_scope()
 {
 	assert(_current_scope.level > 0);
 
-	for (auto &symbol : _symbol_stack)
+	// Remove all local symbols that were declared in this scope (or any child scopes)
+	for (; !_scope_log.empty() && _scope_log.back().level >= _current_scope.level; _scope_log.pop_back())
 	{
-		std::vector<scoped_symbol> &scope_list = symbol.second;
+		std::vector<scoped_symbol> &scope_list = _symbol_stack[_scope_log.back().name_id];
 
-		for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
+		// The symbol list is sorted by namespace level, so the local symbol is not necessarily the last one in there
+		for (auto scope_it = scope_list.end(); scope_it != scope_list.begin();)
 		{
+			--scope_it;
+
 			if (scope_it->scope.level > scope_it->scope.namespace_level &&
 				scope_it->scope.level >= _current_scope.level)
 			{
-				scope_it = scope_list.erase(scope_it);
-			}
-			else
-			{
-				++scope_it;
+				scope_list.erase(scope_it);
+				break;
 			}
 		}
 	}
@@ -173,7 +252,7 @@ void reshadefx::symbol_table::leave_namespace()
 	assert(_current_scope.level > 0);
 	assert(_current_scope.namespace_level > 0);
 
-	_current_scope.name.erase(_current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
+	_current_scope.namespace_id = _namespaces[_current_scope.namespace_id].parent_id;
 	_current_scope.level--;
 	_current_scope.namespace_level--;
 }
@@ -195,29 +274,42 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 				}), item);
 	};
 
+	// Look up the symbol stack for a name, creating a new one if it does not exist yet
+	const auto symbol_stack = [this](const std::string &symbol_name) -> std::pair<uint32_t, std::vector<scoped_symbol> &> {
+		const auto it = _name_lookup.emplace(symbol_name, static_cast<uint32_t>(_symbol_stack.size()));
+		if (it.second)
+			_symbol_stack.emplace_back();
+		return { it.first->second, _symbol_stack[it.first->second] };
+	};
+
 	// Global symbols are accessible from every scope
 	if (global)
 	{
-		scope scope = { "", 0, 0 };
+		const std::string &current_name = _namespaces[_current_scope.namespace_id].name;
 
 		// Walk scope chain from global scope back to current one
-		for (size_t pos = 0; pos != std::string::npos; pos = _current_scope.name.find("::", pos))
+		for (unsigned int namespace_level = 0; namespace_level <= _current_scope.namespace_level; ++namespace_level)
 		{
-			// Extract scope name
-			scope.name = _current_scope.name.substr(0, pos += 2);
-			const auto previous_scope_name = _current_scope.name.substr(pos);
+			uint32_t namespace_id = _current_scope.namespace_id;
+			for (unsigned int i = namespace_level; i < _current_scope.namespace_level; ++i)
+				namespace_id = _namespaces[namespace_id].parent_id;
 
-			// Insert symbol into this scope
-			insert_sorted(_symbol_stack[previous_scope_name + name], scoped_symbol { symbol, scope });
+			// Symbol is accessible in this namespace with the names of all child namespaces down to the current one prepended
+			const std::string qualified_name = current_name.substr(_namespaces[namespace_id].name.size()) + name;
 
-			// Continue walking up the scope chain
-			scope.level = ++scope.namespace_level;
+			// Insert symbol into this scope
+			insert_sorted(symbol_stack(qualified_name).second, scoped_symbol { symbol, { namespace_id, namespace_level, namespace_level } });
 		}
 	}
 	else
 	{
 		// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-		insert_sorted(_symbol_stack[name], scoped_symbol { symbol, _current_scope });
+		const auto stack = symbol_stack(name);
+		insert_sorted(stack.second, scoped_symbol { symbol, _current_scope });
+
+		// Remember local symbols, so they can be removed again when leaving their scope
+		if (_current_scope.level > _current_scope.namespace_level)
+			_scope_log.push_back({ stack.first, _current_scope.level });
 	}
 
 	return true;
@@ -228,21 +320,28 @@ reshadefx::symbol reshadefx::symbol_table::find_symbol(const std::string &name)
 	// Default to start search with current scope and walk back the scope chain
 	return find_symbol(name, _current_scope, false);
 }
+const std::vector<reshadefx::symbol_table::scoped_symbol> *reshadefx::symbol_table::find_symbol_stack(const std::string &name) const
+{
+	if (const auto it = _name_lookup.find(name); it != _name_lookup.end() && !_symbol_stack[it->second].empty())
+		return &_symbol_stack[it->second];
+	return nullptr;
+}
+
 reshadefx::symbol reshadefx::symbol_table::find_symbol(const std::string &name, const scope &scope, bool exclusive) const
 {
-	const auto stack_it = _symbol_stack.find(name);
+	const auto stack = find_symbol_stack(name);
 
 	// Check if symbol does exist
-	if (stack_it == _symbol_stack.end() || stack_it->second.empty())
+	if (stack == nullptr)
 		return {};
 
 	// Walk up the scope chain starting at the requested scope level and find a matching symbol
 	symbol result = {};
 
-	for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+	for (auto it = stack->rbegin(), end = stack->rend(); it != end; ++it)
 	{
 		if (it->scope.level > scope.level ||
-			it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+			it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.namespace_id != scope.namespace_id))
 			continue;
 		if (exclusive && it->scope.level < scope.level)
 			continue;
@@ -256,7 +355,17 @@ reshadefx::symbol reshadefx::symbol_table::find_symbol(const std::string &name,
 	return result;
 }
 
-static int compare_functions(const std::vector<reshadefx::expression> &arguments, const reshadefx::function_info *function1, const reshadefx::function_info *function2)
+static inline const reshadefx::type &parameter_type(const reshadefx::function_info *function, size_t index)
+{
+	return function->parameter_list[index].type;
+}
+static inline const reshadefx::type &parameter_type(const intrinsic *function, size_t index)
+{
+	return function->arg_types[index];
+}
+
+template <typename T>
+static int compare_functions(const std::vector<reshadefx::expression> &arguments, const T *function1, const T *function2)
 {
 	const size_t num_arguments = arguments.size();
 
@@ -264,7 +373,7 @@ static int compare_functions(const std::vector<reshadefx::expression> &arguments
 	bool function1_viable = true;
 	const auto function1_ranks = static_cast<unsigned int *>(alloca(num_arguments * sizeof(unsigned int)));
 	for (size_t i = 0; i < num_arguments; ++i)
-		if ((function1_ranks[i] = reshadefx::type::rank(arguments[i].type, function1->parameter_list[i].type)) == 0)
+		if ((function1_ranks[i] = reshadefx::type::rank(arguments[i].type, parameter_type(function1, i))) == 0)
 		{
 			function1_viable = false;
 			break;
@@ -278,7 +387,7 @@ static int compare_functions(const std::vector<reshadefx::expression> &arguments
 	bool function2_viable = true;
 	const auto function2_ranks = static_cast<unsigned int *>(alloca(num_arguments * sizeof(unsigned int)));
 	for (size_t i = 0; i < num_arguments; ++i)
-		if ((function2_ranks[i] = reshadefx::type::rank(arguments[i].type, function2->parameter_list[i].type)) == 0)
+		if ((function2_ranks[i] = reshadefx::type::rank(arguments[i].type, parameter_type(function2, i))) == 0)
 		{
 			function2_viable = false;
 			break;
@@ -310,16 +419,14 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	unsigned int overload_namespace = scope.namespace_level;
 
 	// Look up function name in the symbol stack and loop through the associated symbols
-	const auto stack_it = _symbol_stack.find(name);
-
-	if (stack_it != _symbol_stack.end() && !stack_it->second.empty())
+	if (const auto stack = find_symbol_stack(name); stack != nullptr)
 	{
-		for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+		for (auto it = stack->rbegin(), end = stack->rend(); it != end; ++it)
 		{
 			if (it->op != symbol_type::function)
 				continue;
 			if (it->scope.level > scope.level ||
-				it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+				it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.namespace_id != scope.namespace_id))
 				continue;
 
 			const function_info *const function = it->function;
@@ -368,21 +475,25 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	// Try matching against intrinsic functions if no matching user-defined function was found up to this point
 	if (num_overloads == 0)
 	{
-		for (const intrinsic &intrinsic : s_intrinsics)
+		const intrinsic *result_intrinsic = nullptr;
+
+		// Only the overloads with a matching name have to be ranked
+		const intrinsic_overloads overloads = s_intrinsic_lookup.find(name);
+
+		for (const intrinsic *overload = s_intrinsics + overloads.first, *end = overload + overloads.count; overload != end; ++overload)
 		{
-			if (intrinsic.function.name != name || intrinsic.function.parameter_list.size() != arguments.size())
+			if (overload->num_args != arguments.size())
 				continue;
 
 			// A new possibly-matching intrinsic function was found, compare it against the current result
-			const int comparison = compare_functions(arguments, &intrinsic.function, result);
+			const int comparison = compare_functions(arguments, overload, result_intrinsic);
 
 			if (comparison < 0) // The new function is a better match
 			{
 				out_data.op = symbol_type::intrinsic;
-				out_data.id = intrinsic.id;
-				out_data.type = intrinsic.function.return_type;
-				out_data.function = &intrinsic.function;
-				result = out_data.function;
+				out_data.id = overload->id;
+				out_data.type = overload->ret_type;
+				result_intrinsic = overload;
 				num_overloads = 1;
 			}
 			else if (comparison == 0 && overload_namespace == 0) // Both functions are equally viable, so the call is ambiguous (intrinsics are always in the global namespace)
@@ -390,6 +501,23 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 				++num_overloads;
 			}
 		}
+
+		// The parser expects a function description for the resolved overload, which is only created on demand for intrinsics
+		if (result_intrinsic != nullptr)
+		{
+			const auto it = _intrinsic_functions.try_emplace(static_cast<unsigned int>(result_intrinsic - s_intrinsics));
+			if (it.second)
+			{
+				function_info &function = it.first->second;
+				function.name = result_intrinsic->name;
+				function.return_type = result_intrinsic->ret_type;
+				function.parameter_list.reserve(result_intrinsic->num_args);
+				for (unsigned int i = 0; i < result_intrinsic->num_args; ++i)
+					function.parameter_list.push_back({ result_intrinsic->arg_types[i], {}, {}, {} });
+			}
+
+			out_data.function = &it.first->second;
+		}
 	}
 
 	is_ambiguous = num_overloads > 1;
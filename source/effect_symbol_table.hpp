@@ -15,7 +15,7 @@ namespace reshadefx
 	/// </summary>
 	struct scope
 	{
-		std::string name;
+		uint32_t namespace_id; // Index of the namespace this scope is in (zero is the global namespace)
 		unsigned int level, namespace_level;
 	};
 
@@ -74,6 +74,10 @@ namespace reshadefx
 		/// </summary>
 		/// <returns></returns>
 		const scope &current_scope() const { return _current_scope; }
+		/// <summary>
+		/// Get the fully qualified name of the namespace the symbol table currently operates in (e.g. "::" or "::a::b::").
+		/// </summary>
+		const std::string &current_namespace_name() const { return _namespaces[_current_scope.namespace_id].name; }
 
 		/// <summary>
 		/// Insert an new symbol in the symbol table. Returns <c>false</c> if a symbol by that name and type already exists.
@@ -95,9 +99,25 @@ namespace reshadefx
 		struct scoped_symbol : symbol {
 			struct scope scope; // Store scope with symbol data
 		};
+		struct namespace_info
+		{
+			std::string name;
+			uint32_t parent_id;
+		};
+		struct scope_log_entry
+		{
+			uint32_t name_id;
+			unsigned int level;
+		};
+
+		const std::vector<scoped_symbol> *find_symbol_stack(const std::string &name) const;
 
 		scope _current_scope;
-		std::unordered_map<std::string, // Lookup table from name to matching symbols
-			std::vector<scoped_symbol>> _symbol_stack;
+		std::vector<namespace_info> _namespaces;
+		std::unordered_map<std::string, uint32_t> _namespace_lookup; // Lookup table from fully qualified namespace name to its index
+		std::unordered_map<std::string, uint32_t> _name_lookup; // Lookup table from symbol name to its index in the symbol stack
+		std::vector<std::vector<scoped_symbol>> _symbol_stack; // List of symbols per name, sorted by namespace level
+		std::vector<scope_log_entry> _scope_log; // Local symbols in the order they were inserted, so that leaving a scope only has to touch the symbols it declared
+		mutable std::unordered_map<unsigned int, function_info> _intrinsic_functions; // Function descriptions of intrinsics that were resolved so far, indexed by their position in the intrinsic list
 	};
 }
@@ -5,8 +5,11 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 
 namespace reshadefx
 {
@@ -15,14 +18,79 @@ namespace reshadefx
 	/// </summary>
 	struct location
 	{
-		location() : line(1), column(1) { }
-		explicit location(unsigned int line, unsigned int column = 1) : line(line), column(column) { }
-		explicit location(std::string source, unsigned int line, unsigned int column = 1) : source(std::move(source)), line(line), column(column) { }
+		location() : source_id(0), line(1), column(1) { }
+		explicit location(uint32_t source_id, unsigned int line, unsigned int column = 1) : source_id(source_id), line(line), column(column) { }
 
-		std::string source;
+		/// <summary>
+		/// Index of the source file in the <see cref="source_file_table"/> of the current compilation (zero if there is no source file).
+		/// </summary>
+		uint32_t source_id;
 		unsigned int line, column;
 	};
 
+	/// <summary>
+	/// A table of source file paths referenced by locations, so that these only need to store a small index instead of the full path.
+	/// </summary>
+	class source_file_table
+	{
+	public:
+		source_file_table() : _paths(1) { }
+
+		/// <summary>
+		/// Get the index of the specified source file path, adding it to the table if it does not exist yet.
+		/// </summary>
+		/// <param name="path">The source file path to look up.</param>
+		/// <returns>The index of the path in this table, or zero if it is empty.</returns>
+		uint32_t intern(const std::string &path)
+		{
+			if (path.empty())
+				return 0;
+
+			const auto it = _ids.emplace(path, static_cast<uint32_t>(_paths.size()));
+			if (it.second)
+				_paths.push_back(path);
+			return it.first->second;
+		}
+
+		/// <summary>
+		/// Get the source file path associated with the specified index.
+		/// </summary>
+		/// <param name="source_id">The index previously returned by <see cref="intern"/>.</param>
+		/// <returns>A constant reference to the path, which is empty for index zero.</returns>
+		const std::string &path(uint32_t source_id) const { return _paths[source_id]; }
+
+	private:
+		std::vector<std::string> _paths;
+		std::unordered_map<std::string, uint32_t> _ids;
+	};
+
+	/// <summary>
+	/// A table mapping offsets in a preprocessed output string back to the source locations the code there originates from, which replaces '#line' directives in the output.
+	/// </summary>
+	struct source_line_map
+	{
+		struct entry
+		{
+			/// <summary>
+			/// Offset of the first character of a line in the output string, or of a token in it whose column differs from its offset in the line (because whitespace before it was collapsed).
+			/// </summary>
+			size_t offset;
+			/// <summary>
+			/// Location that offset maps to. Subsequent characters and lines continue counting from here up to the next entry.
+			/// </summary>
+			reshadefx::location location;
+		};
+
+		/// <summary>
+		/// The source files referenced by the locations in this map.
+		/// </summary>
+		source_file_table source_files;
+		/// <summary>
+		/// The list of mappings, sorted by offset.
+		/// </summary>
+		std::vector<entry> entries;
+	};
+
 	/// <summary>
 	/// A collection of identifiers for various possible tokens.
 	/// </summary>
@@ -199,10 +267,18 @@ namespace reshadefx
 			float literal_as_float;
 			double literal_as_double;
 		};
-		std::string literal_as_string;
+		// View into the input string of the lexer (identifier name or raw contents of a string literal)
+		std::string_view literal_as_string;
+		// Set if escape sequences in the raw contents of a string literal should be resolved
+		bool escape_literal = false;
 
 		inline operator tokenid() const { return id; }
 
+		/// <summary>
+		/// Create a copy of the value of a string literal, with line continuations removed and escape sequences resolved.
+		/// </summary>
+		std::string unescape_literal() const;
+
 		static std::string id_to_name(tokenid id);
 	};
 }
@@ -367,8 +367,11 @@ bool reshade::opengl::runtime_gl::init_effect(size_t index)
 			defines += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code
 			defines += effect.preamble;
 
-			GLsizei lengths[] = { static_cast<GLsizei>(defines.size()), static_cast<GLsizei>(effect.module.hlsl.size()) };
-			const GLchar *sources[] = { defines.c_str(), effect.module.hlsl.c_str() };
+			// Only compile the code this entry point actually uses if the code generator provided it
+			const std::string &glsl = entry_point.hlsl.empty() ? effect.module.hlsl : entry_point.hlsl;
+
+			GLsizei lengths[] = { static_cast<GLsizei>(defines.size()), static_cast<GLsizei>(glsl.size()) };
+			const GLchar *sources[] = { defines.c_str(), glsl.c_str() };
 			glShaderSource(shader_id, 2, sources, lengths);
 			glCompileShader(shader_id);
 		}
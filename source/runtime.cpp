@@ -11,8 +11,11 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include "effect_preprocessor.hpp"
+#include "effect_cache.hpp"
+#include "effect_serialization.hpp"
 #include "input.hpp"
 #include "input_freepie.hpp"
+#include "worker_pool.hpp"
 #include <thread>
 #include <cassert>
 #include <algorithm>
@@ -47,37 +50,335 @@ bool resolve_preset_path(std::filesystem::path &path)
 	return !resolve_path(path) || reshade::ini_file::load_cache(path).has({}, "Techniques");
 }
 
-static bool find_file(const std::vector<std::filesystem::path> &search_paths, std::filesystem::path &path)
+static bool find_file(reshadefx::source_cache &cache, const std::vector<std::filesystem::path> &search_paths, std::filesystem::path &path)
 {
-	std::error_code ec;
 	// Do not have to perform a search if the path is already absolute
 	if (path.is_absolute())
-		return std::filesystem::exists(path, ec);
+		return cache.exists(path);
 	for (std::filesystem::path search_path : search_paths)
 		// Append relative file path to absolute search path
-		if (search_path /= path; resolve_path(search_path))
-			return path = std::move(search_path), true;
+		if (resolve_path(search_path) && cache.exists(search_path /= path))
+			return path = search_path.lexically_normal(), true;
 	return false;
 }
-static std::vector<std::filesystem::path> find_files(const std::vector<std::filesystem::path> &search_paths, std::initializer_list<std::filesystem::path> extensions)
+static std::vector<std::filesystem::path> find_files(reshadefx::source_cache &cache, const std::vector<std::filesystem::path> &search_paths, std::initializer_list<std::filesystem::path> extensions)
 {
-	std::error_code ec;
 	std::vector<std::filesystem::path> files;
 	for (std::filesystem::path search_path : search_paths)
 		if (resolve_path(search_path))
-			for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(search_path, std::filesystem::directory_options::skip_permission_denied, ec))
-				if (!entry.is_directory(ec) &&
-					std::find(extensions.begin(), extensions.end(), entry.path().extension()) != extensions.end())
-					files.emplace_back(entry); // Construct path from directory entry in-place
+			for (std::filesystem::path &file : cache.find_files(search_path, extensions))
+				files.push_back(std::move(file));
 	return files;
 }
 
+// Increase this whenever the data stored for effects in the effect cache changes
+static constexpr uint32_t s_effect_cache_version = 2;
+
+static void write_cached_effect(std::string &data, const reshade::effect &effect)
+{
+	reshadefx::binary_writer writer(data);
+	writer.write(effect.errors);
+
+	writer.write(static_cast<uint32_t>(effect.definitions.size()));
+	for (const auto &definition : effect.definitions)
+	{
+		writer.write(definition.first);
+		writer.write(definition.second);
+	}
+
+	writer.write(static_cast<uint32_t>(effect.included_files.size()));
+	for (const std::filesystem::path &file : effect.included_files)
+		writer.write(file.u8string());
+
+	writer.write(effect.module);
+}
+static bool read_cached_effect(std::string_view data, reshade::effect &effect)
+{
+	reshadefx::binary_reader reader(data);
+	std::string errors(reader.read_string());
+
+	std::vector<std::pair<std::string, std::string>> definitions(reader.read_count(4 + 4));
+	for (size_t i = 0; i < definitions.size() && !reader.failed(); ++i)
+	{
+		definitions[i].first = reader.read_string();
+		definitions[i].second = reader.read_string();
+	}
+
+	std::vector<std::filesystem::path> included_files(reader.read_count(4));
+	for (size_t i = 0; i < included_files.size() && !reader.failed(); ++i)
+		included_files[i] = std::filesystem::u8path(reader.read_string());
+
+	reshadefx::module module;
+	reader.read(module);
+
+	// Only modify the effect if the entire entry could be read
+	if (reader.failed())
+		return false;
+
+	effect.errors = std::move(errors);
+	effect.definitions = std::move(definitions);
+	effect.included_files = std::move(included_files);
+	effect.module = std::move(module);
+	return true;
+}
+
+static void add_used_definitions(reshade::effect &effect, const std::vector<std::pair<std::string, std::string>> &definitions)
+{
+	for (const auto &definition : definitions)
+	{
+		if (definition.first.size() <= 10 || definition.first[0] == '_' || !definition.first.compare(0, 8, "RESHADE_") || !definition.first.compare(0, 7, "BUFFER_"))
+			continue;
+
+		effect.definitions.push_back({ definition.first, trim(definition.second) });
+	}
+}
+
+static bool is_newer_than_files(const std::filesystem::path &file, const std::filesystem::path &source_file, const std::vector<std::filesystem::path> &included_files)
+{
+	std::error_code ec;
+	const std::filesystem::file_time_type time = std::filesystem::last_write_time(file, ec);
+	if (ec)
+		return false;
+
+	// Check the error of every query separately, so that a file that cannot be queried (e.g. because it was deleted) never counts as unchanged
+	const auto is_older = [time](const std::filesystem::path &other_file) {
+		std::error_code other_ec;
+		const std::filesystem::file_time_type other_time = std::filesystem::last_write_time(other_file, other_ec);
+		return !other_ec && other_time <= time;
+	};
+
+	return is_older(source_file) && std::all_of(included_files.begin(), included_files.end(), is_older);
+}
+
+static uint64_t file_time_value(std::filesystem::file_time_type time)
+{
+	return static_cast<uint64_t>(time.time_since_epoch().count());
+}
+static void store_cached_file_times(reshadefx::effect_cache &cache, uint64_t effect_key, uint64_t source_key, const std::filesystem::path &path, const std::vector<std::filesystem::path> &included_files, const std::vector<std::filesystem::path> &include_paths, const std::vector<std::filesystem::path> &missing_files, std::filesystem::file_time_type compile_time)
+{
+	std::string data;
+	reshadefx::binary_writer writer(data);
+	writer.write(source_key);
+	writer.write(static_cast<uint32_t>(1 + included_files.size() + include_paths.size()));
+
+	const auto write_file = [&writer, compile_time](const std::filesystem::path &file) {
+		std::error_code time_ec, size_ec;
+		const std::filesystem::file_time_type time = std::filesystem::last_write_time(file, time_ec);
+		const uintmax_t size = std::filesystem::is_regular_file(file, size_ec) ? std::filesystem::file_size(file, size_ec) : 0;
+
+		writer.write(file.u8string());
+		// A time of zero never matches, so that files that may have changed while they were read are checked again on the next load
+		writer.write(time_ec || time >= compile_time ? 0 : file_time_value(time));
+		writer.write(static_cast<uint64_t>(size_ec ? 0 : size));
+	};
+
+	write_file(path);
+	for (const std::filesystem::path &file : included_files)
+		write_file(file);
+	for (const std::filesystem::path &include_path : include_paths)
+		write_file(include_path);
+
+	// Creating any of the files the include search or an 'exists' check did not find can change which file is included, which the times above would not catch (e.g. for a file in a subdirectory of an include path)
+	writer.write(static_cast<uint32_t>(missing_files.size()));
+	for (const std::filesystem::path &file : missing_files)
+		writer.write(file.u8string());
+
+	cache.store(effect_key, data);
+}
+static bool check_file_times(reshadefx::binary_reader &reader)
+{
+	for (size_t i = 0, num_files = reader.read_count(4 + 8 + 8); i < num_files && !reader.failed(); ++i)
+	{
+		const std::filesystem::path file = std::filesystem::u8path(reader.read_string());
+		const uint64_t time = reader.read_uint64();
+		const uint64_t size = reader.read_uint64();
+
+		std::error_code time_ec, size_ec;
+		const std::filesystem::file_time_type current_time = std::filesystem::last_write_time(file, time_ec);
+		const uintmax_t current_size = std::filesystem::is_regular_file(file, size_ec) ? std::filesystem::file_size(file, size_ec) : 0;
+		if (time_ec || size_ec || time == 0 || time != file_time_value(current_time) || size != current_size)
+			return false;
+	}
+
+	for (size_t i = 0, num_missing_files = reader.read_count(4); i < num_missing_files && !reader.failed(); ++i)
+	{
+		const std::filesystem::path file = std::filesystem::u8path(reader.read_string());
+
+		std::error_code ec;
+		if (std::filesystem::exists(file, ec) || ec)
+			return false;
+	}
+
+	return !reader.failed();
+}
+
+static bool load_cached_effect(reshadefx::effect_cache *cache, uint64_t effect_key, reshade::effect &effect)
+{
+	// Skip pre-processing and compilation entirely if none of the files the cached module was compiled from changed since
+	std::string data;
+	if (cache == nullptr || !cache->load(effect_key, data))
+		return false;
+
+	reshadefx::binary_reader reader(data);
+	const uint64_t source_key = reader.read_uint64();
+
+	std::string source_data;
+	return check_file_times(reader) && cache->load(source_key, source_data) && read_cached_effect(source_data, effect);
+}
+static void compile_effect(reshadefx::preprocessor &pp, const reshadefx::module_info &module_info, bool debug_info, bool optimize_spirv, reshadefx::effect_cache *cache, reshadefx::effect_cache::key cache_key, uint64_t effect_key, const std::vector<std::filesystem::path> &include_paths, reshade::effect &effect)
+{
+	const std::filesystem::path &path = effect.source_file;
+	// Files changed after this point may already have been read in their previous state, so they must not be considered up-to-date on the next load
+	const std::filesystem::file_time_type compile_time = std::filesystem::file_time_type::clock::now();
+
+	if (!pp.append_file(path))
+		effect.compile_sucess = false;
+
+	const reshadefx::source_line_map line_map = pp.line_map();
+
+	// Identify the module by the pre-processed source code, so that touching or editing files in ways that do not affect the output does not cause a recompile
+	cache_key.add(pp.output()).add(pp.errors());
+	for (const reshadefx::source_line_map::entry &entry : line_map.entries)
+		cache_key.add(entry.offset).add(line_map.source_files.path(entry.location.source_id)).add(entry.location.line).add(entry.location.column);
+
+	const uint64_t source_key = cache_key.value();
+
+	if (std::string source_data; effect.compile_sucess && cache != nullptr && cache->load(source_key, source_data) && read_cached_effect(source_data, effect))
+	{
+		store_cached_file_times(*cache, effect_key, source_key, path, effect.included_files, include_paths, pp.missing_files(), compile_time);
+		return;
+	}
+
+	std::unique_ptr<reshadefx::codegen> codegen;
+	if (module_info.target == reshadefx::module_target::hlsl)
+		codegen.reset(reshadefx::create_codegen_hlsl(module_info.shader_model, debug_info, module_info.uniforms_to_spec_constants, true));
+	else if (module_info.target == reshadefx::module_target::glsl)
+		codegen.reset(reshadefx::create_codegen_glsl(debug_info, module_info.uniforms_to_spec_constants, true));
+	else
+		codegen.reset(reshadefx::create_codegen_spirv(true, debug_info, module_info.uniforms_to_spec_constants, module_info.invert_y, optimize_spirv));
+
+	reshadefx::parser parser;
+
+	// Compile the pre-processed source code (try the compile even if the preprocessor step failed to get additional error information)
+	if (!parser.parse(std::move(pp.output()), codegen.get(), &line_map) || !effect.compile_sucess)
+	{
+		LOG(ERROR) << "Failed to compile " << path << ":\n" << pp.errors() << parser.errors();
+		effect.compile_sucess = false;
+	}
+
+	// Append preprocessor and parser errors to the error list
+	effect.errors = std::move(pp.errors()) + std::move(parser.errors());
+
+	// Keep track of used preprocessor definitions (so they can be displayed in the GUI)
+	add_used_definitions(effect, pp.used_macro_definitions());
+
+	// Keep track of included files
+	effect.included_files = pp.included_files();
+	std::sort(effect.included_files.begin(), effect.included_files.end()); // Sort file names alphabetically
+
+	// Write result to effect module
+	codegen->write_result(effect.module);
+
+	// Only cache modules that compiled successfully, since failing effects are likely to be edited anyway
+	if (cache != nullptr && effect.compile_sucess)
+	{
+		std::string source_data;
+		write_cached_effect(source_data, effect);
+
+		if (cache->store(source_key, source_data))
+			store_cached_file_times(*cache, effect_key, source_key, path, effect.included_files, include_paths, pp.missing_files(), compile_time);
+	}
+}
+static bool load_precompiled_effect(reshadefx::source_cache &source_cache, const reshadefx::module_info &module_info, const std::vector<std::pair<std::string, std::string>> &macros, reshade::effect &effect)
+{
+	const std::filesystem::path &path = effect.source_file;
+
+	// A precompiled module is only used as long as neither the source file nor any included file changed since and it was compiled for this renderer and with the same macro definitions
+	std::filesystem::path precompiled_path = path;
+	if (!source_cache.exists(precompiled_path.replace_extension(L".fxo")))
+		return false;
+
+	const reshadefx::mapped_file file(precompiled_path);
+
+	reshadefx::module_info precompiled_info;
+	reshadefx::module_source_info precompiled_source_info;
+	if (!file.is_open() || !reshadefx::read_module(file.data(), effect.module, precompiled_info, precompiled_source_info))
+	{
+		LOG(WARN) << "Ignoring precompiled " << precompiled_path << " because it is invalid or was written by a different version.";
+		effect.module = {};
+		return false;
+	}
+
+	// The machine and application identifiers are left out, since a precompiled module could never match otherwise
+	std::vector<std::pair<std::string, std::string>> compared_macros;
+	for (const auto &macro : macros)
+		if (macro.first != "__VENDOR__" && macro.first != "__DEVICE__" && macro.first != "__APPLICATION__")
+			compared_macros.push_back(macro);
+	const uint64_t macro_hash = reshadefx::hash_macro_definitions(std::move(compared_macros));
+
+	std::vector<std::filesystem::path> included_files;
+	for (const std::filesystem::path &included_file : precompiled_source_info.included_files)
+		included_files.push_back((path.parent_path() / included_file).lexically_normal());
+	std::sort(included_files.begin(), included_files.end()); // Sort file names alphabetically
+
+	if (precompiled_info != module_info)
+	{
+		LOG(WARN) << "Ignoring precompiled " << precompiled_path << " because it was compiled for a different renderer.";
+	}
+	else if (precompiled_source_info.macro_hash != macro_hash)
+	{
+		// Print both hashes, so that they can be compared to the one the effect compiler prints when writing the module
+		LOG(WARN) << "Ignoring precompiled " << precompiled_path << " because it was compiled with different preprocessor definitions (macro hash " << std::hex << precompiled_source_info.macro_hash << ", expected " << macro_hash << std::dec << ").";
+	}
+	else if (!is_newer_than_files(precompiled_path, path, included_files))
+	{
+		LOG(WARN) << "Ignoring precompiled " << precompiled_path << " because the source file or one of its included files changed since.";
+	}
+	else
+	{
+		LOG(INFO) << "Using precompiled " << precompiled_path << '.';
+
+		add_used_definitions(effect, precompiled_source_info.definitions);
+		effect.included_files = std::move(included_files);
+		return true;
+	}
+
+	effect.module = {};
+	return false;
+}
+
+static void log_worker_statistics(const reshade::worker_pool::statistics &stats, size_t num_effects, std::chrono::high_resolution_clock::duration longest_load_time)
+{
+	using std::chrono::milliseconds;
+	using std::chrono::duration_cast;
+
+	size_t num_jobs = 0;
+	for (const reshade::worker_pool::worker_statistics &worker : stats.workers)
+		num_jobs += worker.jobs;
+	if (num_jobs == 0)
+		return; // Nothing was loaded on the worker threads (e.g. when a single effect was reloaded from the overlay)
+
+	// The reload cannot finish faster than the most expensive effect, so compare against that to see how well the work was spread out
+	// Loading an effect splits off a job for each of its shaders, so the workers execute more jobs than there are effects
+	auto message = LOG(INFO);
+	message << "Loaded " << num_effects << " effect(s) in " << static_cast<int>(duration_cast<milliseconds>(stats.wall_time).count()) << " ms using " << num_jobs << " job(s) on " << stats.workers.size() << " worker thread(s), the longest effect took " << static_cast<int>(duration_cast<milliseconds>(longest_load_time).count()) << " ms:";
+
+	for (size_t i = 0; i < stats.workers.size(); ++i)
+	{
+		const reshade::worker_pool::worker_statistics &worker = stats.workers[i];
+		const int utilization = stats.wall_time.count() > 0 ? static_cast<int>(100 * worker.busy_time.count() / stats.wall_time.count()) : 0;
+
+		message << "\n  Worker " << i << ": " << worker.jobs << " job(s) (" << worker.stolen_jobs << " taken from other threads), busy for " << static_cast<int>(duration_cast<milliseconds>(worker.busy_time).count()) << " ms (" << utilization << "% utilization)";
+	}
+}
+
 reshade::runtime::runtime() :
 	_start_time(std::chrono::high_resolution_clock::now()),
 	_last_present_time(std::chrono::high_resolution_clock::now()),
 	_last_frame_duration(std::chrono::milliseconds(1)),
 	_effect_search_paths({ L".\\" }),
 	_texture_search_paths({ L".\\" }),
+	_effect_source_cache(std::make_unique<reshadefx::source_cache>()),
 	_reload_key_data(),
 	_effects_key_data(),
 	_screenshot_key_data(),
@@ -91,6 +392,10 @@ reshade::runtime::runtime() :
 	// Default shortcut PrtScrn
 	_screenshot_key_data[0] = 0x2C;
 
+	// Default to a directory in the temporary folder for the effect cache
+	std::error_code ec;
+	_effect_cache_path = std::filesystem::temp_directory_path(ec) / L"ReShade";
+
 #if RESHADE_GUI
 	init_ui();
 #endif
@@ -98,7 +403,6 @@ reshade::runtime::runtime() :
 }
 reshade::runtime::~runtime()
 {
-	assert(_worker_threads.empty());
 	assert(!_is_initialized && _techniques.empty());
 
 #if RESHADE_GUI
@@ -233,33 +537,86 @@ void reshade::runtime::on_present()
 	_drawcalls = _vertices = 0;
 }
 
-bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t index)
+bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t index, bool precompile)
 {
-	effect &effect = _effects[index]; // Safe to access this multi-threaded, since this is the only call working on this effect
+	// During a background reload the previous version of this effect is still rendering, so compile the new one separately
+	effect background_effect;
+	effect &effect = _reload_in_background ? background_effect : _effects[index]; // Safe to access this multi-threaded, since this is the only call working on this effect
 	effect.source_file = path;
 	effect.compile_sucess = true;
 
 	{ // Load, pre-process and compile the source file
 		reshadefx::preprocessor pp;
+		// Share file contents between all effects, so that common headers are only read once (and again only when they change)
+		pp.set_source_cache(_effect_source_cache.get());
+		// The output is only consumed by the parser below, so can strip it down and keep track of source locations separately
+		pp.set_compact_output(true);
+
+		// Select the code generator settings that match this renderer
+		reshadefx::module_info module_info;
+		module_info.uniforms_to_spec_constants = _performance_mode;
+
+		if ((_renderer_id & 0xF0000) == 0)
+		{
+			module_info.target = reshadefx::module_target::hlsl;
+
+			if (_renderer_id == 0x9000)     // D3D9
+				module_info.shader_model = 30;
+			else if (_renderer_id < 0xa100) // D3D10
+				module_info.shader_model = 40;
+			else if (_renderer_id < 0xb000) // D3D11
+				module_info.shader_model = 41;
+			else if (_renderer_id < 0xc000) // D3D12
+				module_info.shader_model = 50;
+			else
+				module_info.shader_model = 60;
+		}
+		else if (_renderer_id < 0x20000)
+		{
+			module_info.target = reshadefx::module_target::glsl;
+		}
+		else // Vulkan uses SPIR-V input
+		{
+			module_info.target = reshadefx::module_target::spirv;
+			module_info.invert_y = true;
+		}
+
+		// Everything the compiled module depends on besides the contents of the source files has to be part of the key identifying it in the effect cache
+		reshadefx::effect_cache::key cache_key;
+		cache_key.add(s_effect_cache_version).add(reshadefx::module_format_version).add(VERSION_STRING_FILE);
+		cache_key.add(path.u8string());
+		cache_key.add(_renderer_id).add(module_info.shader_model).add(_no_debug_info).add(_performance_mode).add(_optimize_spirv);
+
+		// Keep track of the directories files are searched in, so that adding a file that would now be included instead invalidates the cached module
+		std::vector<std::filesystem::path> include_paths;
+
 		if (path.is_absolute())
-			pp.add_include_path(path.parent_path());
+			include_paths.push_back(path.parent_path());
 
 		for (std::filesystem::path include_path : _effect_search_paths)
 			if (resolve_path(include_path))
-				pp.add_include_path(include_path);
-
-		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-		pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
-		pp.add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
-		pp.add_macro_definition("__DEVICE__", std::to_string(_device_id));
-		pp.add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
-		pp.add_macro_definition("__APPLICATION__", std::to_string( // Truncate hash to 32-bit, since lexer currently only supports 32-bit numbers anyway
-			std::hash<std::string>()(g_target_executable_path.stem().u8string()) & 0xFFFFFFFF));
-		pp.add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
-		pp.add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
-		pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-		pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
-		pp.add_macro_definition("BUFFER_COLOR_BIT_DEPTH", std::to_string(_color_bit_depth));
+				include_paths.push_back(std::move(include_path));
+
+		for (const std::filesystem::path &include_path : include_paths)
+		{
+			pp.add_include_path(include_path);
+			cache_key.add(include_path.u8string());
+		}
+
+		std::vector<std::pair<std::string, std::string>> macros = {
+			{ "__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION) },
+			{ "__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0" },
+			{ "__VENDOR__", std::to_string(_vendor_id) },
+			{ "__DEVICE__", std::to_string(_device_id) },
+			{ "__RENDERER__", std::to_string(_renderer_id) },
+			{ "__APPLICATION__", std::to_string( // Truncate hash to 32-bit, since lexer currently only supports 32-bit numbers anyway
+				std::hash<std::string>()(g_target_executable_path.stem().u8string()) & 0xFFFFFFFF) },
+			{ "BUFFER_WIDTH", std::to_string(_width) },
+			{ "BUFFER_HEIGHT", std::to_string(_height) },
+			{ "BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)" },
+			{ "BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)" },
+			{ "BUFFER_COLOR_BIT_DEPTH", std::to_string(_color_bit_depth) },
+		};
 
 		std::vector<std::string> preprocessor_definitions = _global_preprocessor_definitions;
 		preprocessor_definitions.insert(preprocessor_definitions.end(), _preset_preprocessor_definitions.begin(), _preset_preprocessor_definitions.end());
@@ -271,63 +628,27 @@ bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t ind
 
 			const size_t equals_index = definition.find('=');
 			if (equals_index != std::string::npos)
-				pp.add_macro_definition(
+				macros.emplace_back(
 					definition.substr(0, equals_index),
 					definition.substr(equals_index + 1));
 			else
-				pp.add_macro_definition(definition);
+				macros.emplace_back(definition, "1");
 		}
 
-		if (!pp.append_file(path))
-			effect.compile_sucess = false;
-
-		unsigned shader_model;
-		if (_renderer_id == 0x9000)     // D3D9
-			shader_model = 30;
-		else if (_renderer_id < 0xa100) // D3D10
-			shader_model = 40;
-		else if (_renderer_id < 0xb000) // D3D11
-			shader_model = 41;
-		else if (_renderer_id < 0xc000) // D3D12
-			shader_model = 50;
-		else
-			shader_model = 60;
-
-		std::unique_ptr<reshadefx::codegen> codegen;
-		if ((_renderer_id & 0xF0000) == 0)
-			codegen.reset(reshadefx::create_codegen_hlsl(shader_model, !_no_debug_info, _performance_mode));
-		else if (_renderer_id < 0x20000)
-			codegen.reset(reshadefx::create_codegen_glsl(!_no_debug_info, _performance_mode));
-		else // Vulkan uses SPIR-V input
-			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, true));
-
-		reshadefx::parser parser;
-
-		// Compile the pre-processed source code (try the compile even if the preprocessor step failed to get additional error information)
-		if (!parser.parse(std::move(pp.output()), codegen.get()) || !effect.compile_sucess)
+		for (const auto &macro : macros)
 		{
-			LOG(ERROR) << "Failed to compile " << path << ":\n" << pp.errors() << parser.errors();
-			effect.compile_sucess = false;
+			pp.add_macro_definition(macro.first, macro.second);
+			cache_key.add(macro.first).add(macro.second);
 		}
 
-		// Append preprocessor and parser errors to the error list
-		effect.errors = std::move(pp.errors()) + std::move(parser.errors());
-
-		// Keep track of used preprocessor definitions (so they can be displayed in the GUI)
-		for (const auto &definition : pp.used_macro_definitions())
+		// Use a module that was precompiled into a file next to the source file instead if possible, then one from the effect cache, and only compile the source file if neither exists
+		if (!load_precompiled_effect(*_effect_source_cache, module_info, macros, effect))
 		{
-			if (definition.first.size() <= 10 || definition.first[0] == '_' || !definition.first.compare(0, 8, "RESHADE_") || !definition.first.compare(0, 7, "BUFFER_"))
-				continue;
+			const uint64_t effect_key = cache_key.value();
 
-			effect.definitions.push_back({ definition.first, trim(definition.second) });
+			if (!load_cached_effect(_effect_cache.get(), effect_key, effect))
+				compile_effect(pp, module_info, !_no_debug_info, _optimize_spirv, _effect_cache.get(), cache_key, effect_key, include_paths, effect);
 		}
-
-		// Keep track of included files
-		effect.included_files = pp.included_files();
-		std::sort(effect.included_files.begin(), effect.included_files.end()); // Sort file names alphabetically
-
-		// Write result to effect module
-		codegen->write_result(effect.module);
 	}
 
 	// Fill all specialization constants with values from the current preset
@@ -391,9 +712,6 @@ bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t ind
 	{
 		var.effect_index = index;
 
-		// Copy initial data into uniform storage area
-		reset_uniform_value(var);
-
 		const std::string_view special = var.annotation_as_string("source");
 		if (special.empty()) /* Ignore if annotation is missing */;
 		else if (special == "frametime")
@@ -426,6 +744,42 @@ bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t ind
 		effect.uniforms.push_back(std::move(var));
 	}
 
+	if (_reload_in_background)
+	{
+		// Compile shaders right here on the worker thread, so that the effect can be rendered as soon as it is swapped in
+		if (precompile && effect.compile_sucess)
+			compile_shaders(effect, true);
+
+		const bool success = effect.compile_sucess;
+
+		// The effect is swapped in from the render thread in 'update_and_render_effects', since it may share textures with effects that are currently rendering
+		const std::lock_guard<std::mutex> lock(_reload_mutex);
+		_reload_staged_effects.emplace_back(index, std::move(effect));
+		_reload_remaining_effects--;
+
+		return success;
+	}
+
+	register_effect(index);
+
+	{	const std::lock_guard<std::mutex> lock(_reload_mutex);
+		_last_reload_successful &= effect.compile_sucess;
+		_reload_remaining_effects--;
+	}
+
+	return effect.compile_sucess;
+}
+void reshade::runtime::register_effect(size_t index)
+{
+	effect &effect = _effects[index];
+
+	// Protect access to global texture and technique lists, since effects may be registered from multiple threads at once
+	const std::lock_guard<std::mutex> lock(_reload_mutex);
+
+	// Copy initial data into uniform storage area
+	for (uniform &var : effect.uniforms)
+		reset_uniform_value(var);
+
 	std::vector<texture> new_textures;
 	new_textures.reserve(effect.module.textures.size());
 	std::vector<technique> new_techniques;
@@ -435,38 +789,33 @@ bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t ind
 	{
 		texture.effect_index = index;
 
-		{	const std::lock_guard<std::mutex> lock(_reload_mutex); // Protect access to global texture list
-
-			// Try to share textures with the same name across effects
-			if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
-				[&texture](const auto &item) { return item.unique_name == texture.unique_name; });
-				existing_texture != _textures.end())
+		// Try to share textures with the same name across effects
+		if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
+			[&texture](const auto &item) { return item.unique_name == texture.unique_name; });
+			existing_texture != _textures.end())
+		{
+			// Cannot share texture if this is a normal one, but the existing one is a reference and vice versa
+			if (texture.semantic.empty() != (existing_texture->impl_reference == texture_reference::none))
 			{
-				// Cannot share texture if this is a normal one, but the existing one is a reference and vice versa
-				if (texture.semantic.empty() != (existing_texture->impl_reference == texture_reference::none))
-				{
-					effect.errors += "error: " + texture.unique_name + ": another effect (";
-					effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
-					effect.errors += ") already created a texture with the same name but different usage; rename the variable to fix this error\n";
-					effect.compile_sucess = false;
-					break;
-				}
-				else if (texture.semantic.empty() && !existing_texture->matches_description(texture))
-				{
-					effect.errors += "warning: " + texture.unique_name + ": another effect (";
-					effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
-					effect.errors += ") already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match\n";
-				}
-
-				existing_texture->shared = true;
-				continue;
+				effect.errors += "error: " + texture.unique_name + ": another effect (";
+				effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
+				effect.errors += ") already created a texture with the same name but different usage; rename the variable to fix this error\n";
+				effect.compile_sucess = false;
+				break;
 			}
+			else if (texture.semantic.empty() && !existing_texture->matches_description(texture))
+			{
+				effect.errors += "warning: " + texture.unique_name + ": another effect (";
+				effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
+				effect.errors += ") already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match\n";
+			}
+
+			existing_texture->shared = true;
+			continue;
 		}
 
 		if (texture.annotation_as_int("pooled"))
 		{
-			const std::lock_guard<std::mutex> lock(_reload_mutex);
-
 			// Try to find another pooled texture to share with
 			if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
 				[&texture](const auto &item) { return item.annotation_as_int("pooled") && item.matches_description(texture); });
@@ -513,29 +862,19 @@ bool reshade::runtime::load_effect(const std::filesystem::path &path, size_t ind
 
 	if (effect.compile_sucess)
 		if (effect.errors.empty())
-			LOG(INFO) << "Successfully loaded " << path << '.';
+			LOG(INFO) << "Successfully loaded " << effect.source_file << '.';
 		else
-			LOG(WARN) << "Successfully loaded " << path << " with warnings:\n" << effect.errors;
+			LOG(WARN) << "Successfully loaded " << effect.source_file << " with warnings:\n" << effect.errors;
 
-	{	const std::lock_guard<std::mutex> lock(_reload_mutex);
-		std::move(new_textures.begin(), new_textures.end(), std::back_inserter(_textures));
-		std::move(new_techniques.begin(), new_techniques.end(), std::back_inserter(_techniques));
-
-		_last_reload_successful &= effect.compile_sucess;
-		_reload_remaining_effects--;
-	}
-
-	return effect.compile_sucess;
+	std::move(new_textures.begin(), new_textures.end(), std::back_inserter(_textures));
+	std::move(new_techniques.begin(), new_techniques.end(), std::back_inserter(_techniques));
 }
 void reshade::runtime::load_effects()
 {
-	// Clear out any previous effects
-	unload_effects();
-
-#if RESHADE_GUI
-	_show_splash = true; // Always show splash bar when reloading everything
-#endif
-	_last_reload_successful = true;
+	// Make sure no effects of an earlier reload are still loading, since they would be swapped in afterwards otherwise
+	if (_worker_pool != nullptr)
+		_worker_pool->wait();
+	_reload_staged_effects.clear();
 
 	// Reload preprocessor definitions from current preset before compiling
 	if (!_current_preset_path.empty())
@@ -546,9 +885,68 @@ void reshade::runtime::load_effects()
 		preset.get({}, "PreprocessorDefinitions", _preset_preprocessor_definitions);
 	}
 
+	// Pick up any files that were added or removed since the last reload
+	_effect_source_cache->refresh_directories();
+
+	// Open the effect cache again if its configuration changed since the last reload
+	std::filesystem::path effect_cache_path = _effect_cache_path;
+	resolve_path(effect_cache_path); // The directory does not have to exist yet, it is created on demand
+	const uint64_t effect_cache_size = _effect_cache_size * 1024ull * 1024ull;
+
+	if (effect_cache_size == 0)
+		_effect_cache.reset();
+	else if (_effect_cache == nullptr || _effect_cache->directory() != effect_cache_path || _effect_cache->max_size() != effect_cache_size)
+		_effect_cache = std::make_unique<reshadefx::effect_cache>(effect_cache_path, effect_cache_size);
+
 	// Build a list of effect files by walking through the effect search paths
 	const std::vector<std::filesystem::path> effect_files =
-		find_files(_effect_search_paths, { L".fx" });
+		find_files(*_effect_source_cache, _effect_search_paths, { L".fx" });
+
+	// Keep rendering the previous effects while the new ones are loading, unless some were removed, since effects are identified by their position in the effect list
+	_reload_in_background = _progressive_reload && !_effects.empty() && std::all_of(_effects.begin(), _effects.end(),
+		[&effect_files](const effect &effect) { return std::find(effect_files.begin(), effect_files.end(), effect.source_file) != effect_files.end(); });
+
+	std::vector<size_t> effect_indices(effect_files.size());
+	std::vector<bool> effect_precompile(effect_files.size());
+
+	if (_reload_in_background)
+	{
+#if RESHADE_GUI
+		_selected_effect = std::numeric_limits<size_t>::max();
+		_preview_texture = nullptr;
+		_effect_filter[0] = '\0';
+#endif
+
+		// Each effect replaces its previous version, new ones are added to the end of the list
+		for (size_t i = 0; i < effect_files.size(); ++i)
+		{
+			const auto it = std::find_if(_effects.begin(), _effects.end(),
+				[&path = effect_files[i]](const effect &effect) { return effect.source_file == path; });
+			effect_indices[i] = it - _effects.begin();
+
+			// Effects that were compiled for rendering before are likely to be rendered again, so compile their shaders as part of loading them
+			if (it != _effects.end())
+				effect_precompile[i] = it->shaders != nullptr;
+			else
+				_effects.emplace_back().source_file = effect_files[i];
+		}
+	}
+	else
+	{
+		// Clear out any previous effects
+		unload_effects();
+
+		// Allocate space for effects which are placed in this array during the 'load_effect' call
+		_effects.resize(effect_files.size());
+
+		for (size_t i = 0; i < effect_files.size(); ++i)
+			effect_indices[i] = i;
+	}
+
+#if RESHADE_GUI
+	_show_splash = true; // Always show splash bar when reloading everything
+#endif
+	_last_reload_successful = true;
 
 	_reload_total_effects = effect_files.size();
 	_reload_remaining_effects = _reload_total_effects;
@@ -556,82 +954,127 @@ void reshade::runtime::load_effects()
 	if (_reload_total_effects == 0)
 		return; // No effect files found, so nothing more to do
 
-	// Allocate space for effects which are placed in this array during the 'load_effect' call
-	_effects.resize(_reload_total_effects);
+	// Estimate how long each effect is going to take to load, using the time it took during the previous reload
+	// Effects that were not loaded before are estimated from their file size, scaled to match the effects with a known load time
+	std::vector<double> effect_costs(effect_files.size());
+	double known_load_time = 0.0, known_file_size = 0.0;
 
-	// Now that we have a list of files, load them in parallel
-	// Split workload into batches instead of launching a thread for every file to avoid launch overhead and stutters due to too many threads being in flight
-	const size_t num_splits = std::min<size_t>(effect_files.size(), std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
+	for (size_t i = 0; i < effect_files.size(); ++i)
+	{
+		std::error_code ec;
+		effect_costs[i] = static_cast<double>(std::filesystem::file_size(effect_files[i], ec));
+		if (ec)
+			effect_costs[i] = 0.0;
+
+		if (const auto it = _effect_load_times.find(effect_files[i].wstring()); it != _effect_load_times.end())
+		{
+			known_load_time += static_cast<double>(it->second.count());
+			known_file_size += effect_costs[i];
+		}
+	}
+
+	const double load_time_per_byte = known_file_size > 0.0 ? known_load_time / known_file_size : 1.0;
 
-	// Keep track of the spawned threads, so the runtime cannot be destroyed while they are still running
-	for (size_t n = 0; n < num_splits; ++n)
-		_worker_threads.emplace_back([this, effect_files, num_splits, n]() {
+	for (size_t i = 0; i < effect_files.size(); ++i)
+	{
+		if (const auto it = _effect_load_times.find(effect_files[i].wstring()); it != _effect_load_times.end())
+			effect_costs[i] = static_cast<double>(it->second.count());
+		else
+			effect_costs[i] *= load_time_per_byte;
+	}
+
+	// Start the most expensive effects first, so that the cheaper ones can fill up the gaps on the remaining threads while they finish
+	std::vector<size_t> effect_order(effect_files.size());
+	for (size_t i = 0; i < effect_files.size(); ++i)
+		effect_order[i] = i;
+	std::stable_sort(effect_order.begin(), effect_order.end(),
+		[&effect_costs](size_t lhs, size_t rhs) { return effect_costs[lhs] > effect_costs[rhs]; });
+
+	// Now that we have a list of files, load them in parallel
+	// Threads are kept alive between reloads to avoid launch overhead, one is left over for the render thread
+	if (_worker_pool == nullptr)
+		_worker_pool = std::make_unique<worker_pool>(std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
+
+	std::vector<std::function<void()>> jobs;
+	jobs.reserve(effect_files.size());
+	for (const size_t i : effect_order)
+		jobs.push_back([this, path = effect_files[i], index = effect_indices[i], precompile = static_cast<bool>(effect_precompile[i])]() {
 			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
-			for (size_t i = 0; i < effect_files.size() && _is_initialized; ++i)
-				if (i * num_splits / effect_files.size() == n)
-					load_effect(effect_files[i], i);
+			if (!_is_initialized)
+				return;
+
+			const auto load_start = std::chrono::high_resolution_clock::now();
+			load_effect(path, index, precompile);
+			const auto load_time = std::chrono::high_resolution_clock::now() - load_start;
+
+			const std::lock_guard<std::mutex> lock(_reload_mutex);
+			_effect_load_times[path.wstring()] = load_time;
 		});
+
+	_worker_pool->submit(std::move(jobs));
 }
 void reshade::runtime::load_textures()
 {
 	LOG(INFO) << "Loading image files for textures ...";
 
 	for (const texture &texture : _textures)
-	{
-		if (texture.impl == nullptr || texture.impl_reference != texture_reference::none)
-			continue; // Ignore textures that are not created yet and those that are handled in the runtime implementation
+		load_texture(texture);
 
-		std::filesystem::path source_path = std::filesystem::u8path(
-			texture.annotation_as_string("source"));
-		// Ignore textures that have no image file attached to them (e.g. plain render targets)
-		if (source_path.empty())
-			continue;
+	_textures_loaded = true;
+}
+void reshade::runtime::load_texture(const texture &texture)
+{
+	if (texture.impl == nullptr || texture.impl_reference != texture_reference::none)
+		return; // Ignore textures that are not created yet and those that are handled in the runtime implementation
 
-		// Search for image file using the provided search paths unless the path provided is already absolute
-		if (!find_file(_texture_search_paths, source_path)) {
-			LOG(ERROR) << "Source " << source_path << " for texture '" << texture.unique_name << "' could not be found in any of the texture search paths.";
-			continue;
-		}
+	std::filesystem::path source_path = std::filesystem::u8path(
+		texture.annotation_as_string("source"));
+	// Ignore textures that have no image file attached to them (e.g. plain render targets)
+	if (source_path.empty())
+		return;
 
-		unsigned char *filedata = nullptr;
-		int width = 0, height = 0, channels = 0;
+	// Search for image file using the provided search paths unless the path provided is already absolute
+	if (!find_file(*_effect_source_cache, _texture_search_paths, source_path)) {
+		LOG(ERROR) << "Source " << source_path << " for texture '" << texture.unique_name << "' could not be found in any of the texture search paths.";
+		return;
+	}
 
-		if (FILE *file; _wfopen_s(&file, source_path.c_str(), L"rb") == 0)
-		{
-			// Read texture data into memory in one go since that is faster than reading chunk by chunk
-			std::vector<uint8_t> mem(static_cast<size_t>(std::filesystem::file_size(source_path)));
-			fread(mem.data(), 1, mem.size(), file);
-			fclose(file);
+	unsigned char *filedata = nullptr;
+	int width = 0, height = 0, channels = 0;
 
-			if (stbi_dds_test_memory(mem.data(), static_cast<int>(mem.size())))
-				filedata = stbi_dds_load_from_memory(mem.data(), static_cast<int>(mem.size()), &width, &height, &channels, STBI_rgb_alpha);
-			else
-				filedata = stbi_load_from_memory(mem.data(), static_cast<int>(mem.size()), &width, &height, &channels, STBI_rgb_alpha);
-		}
+	if (FILE *file; _wfopen_s(&file, source_path.c_str(), L"rb") == 0)
+	{
+		// Read texture data into memory in one go since that is faster than reading chunk by chunk
+		std::vector<uint8_t> mem(static_cast<size_t>(std::filesystem::file_size(source_path)));
+		fread(mem.data(), 1, mem.size(), file);
+		fclose(file);
 
-		if (filedata == nullptr) {
-			LOG(ERROR) << "Source " << source_path << " for texture '" << texture.unique_name << "' could not be loaded! Make sure it is of a compatible file format.";
-			continue;
-		}
+		if (stbi_dds_test_memory(mem.data(), static_cast<int>(mem.size())))
+			filedata = stbi_dds_load_from_memory(mem.data(), static_cast<int>(mem.size()), &width, &height, &channels, STBI_rgb_alpha);
+		else
+			filedata = stbi_load_from_memory(mem.data(), static_cast<int>(mem.size()), &width, &height, &channels, STBI_rgb_alpha);
+	}
 
-		// Need to potentially resize image data to the texture dimensions
-		if (texture.width != uint32_t(width) || texture.height != uint32_t(height))
-		{
-			LOG(INFO) << "Resizing image data for texture '" << texture.unique_name << "' from " << width << "x" << height << " to " << texture.width << "x" << texture.height << " ...";
+	if (filedata == nullptr) {
+		LOG(ERROR) << "Source " << source_path << " for texture '" << texture.unique_name << "' could not be loaded! Make sure it is of a compatible file format.";
+		return;
+	}
 
-			std::vector<uint8_t> resized(texture.width * texture.height * 4);
-			stbir_resize_uint8(filedata, width, height, 0, resized.data(), texture.width, texture.height, 0, 4);
-			upload_texture(texture, resized.data());
-		}
-		else
-		{
-			upload_texture(texture, filedata);
-		}
+	// Need to potentially resize image data to the texture dimensions
+	if (texture.width != uint32_t(width) || texture.height != uint32_t(height))
+	{
+		LOG(INFO) << "Resizing image data for texture '" << texture.unique_name << "' from " << width << "x" << height << " to " << texture.width << "x" << texture.height << " ...";
 
-		stbi_image_free(filedata);
+		std::vector<uint8_t> resized(texture.width * texture.height * 4);
+		stbir_resize_uint8(filedata, width, height, 0, resized.data(), texture.width, texture.height, 0, 4);
+		upload_texture(texture, resized.data());
+	}
+	else
+	{
+		upload_texture(texture, filedata);
 	}
 
-	_textures_loaded = true;
+	stbi_image_free(filedata);
 }
 
 void reshade::runtime::unload_effect(size_t index)
@@ -669,6 +1112,7 @@ void reshade::runtime::unload_effect(size_t index)
 	effect.included_files.clear();
 	effect.definitions.clear();
 	effect.assembly.clear();
+	effect.shaders.reset(); // Any compile jobs still running keep their own reference
 	effect.uniforms.clear();
 	effect.uniform_data_storage.clear();
 }
@@ -681,10 +1125,12 @@ void reshade::runtime::unload_effects()
 #endif
 
 	// Make sure no threads are still accessing effect data
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
+	if (_worker_pool != nullptr)
+		_worker_pool->wait();
+
+	// Drop effects that were loaded in the background, but not swapped in yet
+	_reload_staged_effects.clear();
+	_reload_in_background = false;
 
 	// Destroy all textures
 	for (texture &tex : _textures)
@@ -698,19 +1144,211 @@ void reshade::runtime::unload_effects()
 	_effects.clear();
 }
 
+void reshade::runtime::compile_shader(shader_compile_job &job)
+{
+	if (std::string data; _effect_cache != nullptr && _effect_cache->load(job.cache_key, data))
+	{
+		reshadefx::binary_reader reader(data);
+		job.code = reader.read_string();
+		job.errors = reader.read_string();
+		job.assembly = reader.read_string();
+
+		if (!reader.failed())
+		{
+			job.success = true;
+			return;
+		}
+	}
+
+	job.code.clear();
+	job.errors.clear();
+	job.assembly.clear();
+
+	job.success = compile_entry_point(job);
+
+	if (_effect_cache != nullptr && job.success)
+	{
+		std::string data;
+		reshadefx::binary_writer writer(data);
+		writer.write(job.code);
+		writer.write(job.errors);
+		writer.write(job.assembly);
+
+		_effect_cache->store(job.cache_key, data);
+	}
+}
+void reshade::runtime::compile_shaders(effect &effect, bool wait)
+{
+	const auto shaders = std::make_shared<effect_shaders>();
+	init_compile_jobs(effect, shaders->jobs);
+
+	// Threads are created when effects are loaded, which always happens before they are compiled
+	assert(_worker_pool != nullptr);
+
+	effect_shaders::compile(shaders, *_worker_pool, [this](shader_compile_job &job) {
+		// Abort compiling when initialization state changes (indicating that 'on_reset' was called in the meantime)
+		if (_is_initialized)
+			compile_shader(job);
+	}, wait);
+
+	// Only publish the shaders after the number of remaining jobs was set, so that they are never considered finished before that
+	effect.shaders = shaders;
+}
+
+void reshade::runtime::replace_effect(size_t index, effect &&new_effect)
+{
+	// Put the techniques of the new version where those of the old version were, so that effects keep being rendered in the same order
+	const size_t technique_position = std::find_if(_techniques.begin(), _techniques.end(),
+		[index](const technique &tech) { return tech.effect_index == index; }) - _techniques.begin();
+
+	unload_effect(index);
+
+	_effects[index] = std::move(new_effect);
+
+	const size_t num_techniques = _techniques.size();
+	register_effect(index);
+	std::rotate(_techniques.begin() + std::min(technique_position, num_techniques), _techniques.begin() + num_techniques, _techniques.end());
+
+	_last_reload_successful &= _effects[index].compile_sucess;
+
+	// Enable the techniques that were enabled in the preset, which queues the effect for compilation if any are
+	load_current_preset(index);
+
+	// Create the effect right away instead of waiting for the compile queue, so that there is no frame in which neither the old nor the new version is rendered
+	// This is only possible if its shaders were compiled while loading it, otherwise it stays in the queue until they are
+	if (const auto it = std::find(_reload_compile_queue.begin(), _reload_compile_queue.end(), index);
+		it != _reload_compile_queue.end() && _effects[index].shaders != nullptr && _effects[index].shaders->finished())
+	{
+		_reload_compile_queue.erase(it);
+
+		std::vector<size_t> new_textures;
+		for (size_t i = 0; i < _textures.size(); ++i)
+			if (_textures[i].impl == nullptr)
+				new_textures.push_back(i);
+
+		// Only the textures that were just created need image data, all others still have theirs
+		if (create_effect(index))
+			for (const size_t i : new_textures)
+				load_texture(_textures[i]);
+	}
+}
+bool reshade::runtime::create_effect(size_t index)
+{
+	effect &effect = _effects[index];
+	assert(effect.shaders != nullptr && effect.shaders->finished());
+
+	// Collect the results of compiling the shaders on the worker threads
+	const bool compile_success = effect.shaders->collect_results(effect);
+
+	// Create textures now, since they are referenced when building samplers in the 'init_effect' call below
+	// No need to setup resources if any of the shaders failed to compile though
+	bool success = true;
+	for (texture &texture : _textures)
+	{
+		if (compile_success && texture.impl == nullptr && (texture.effect_index == index || texture.shared))
+		{
+			if (!init_texture(texture))
+			{
+				success = false;
+				effect.errors += "Failed to create texture " + texture.unique_name;
+				break;
+			}
+		}
+	}
+
+	// Create the back-end objects for the effect from the compiled shaders
+	if (success && (!compile_success || !init_effect(index)))
+	{
+		// De-duplicate error lines (D3DCompiler sometimes repeats the same error multiple times)
+		for (size_t cur_line_offset = 0, next_line_offset, end_offset;
+			(next_line_offset = effect.errors.find('\n', cur_line_offset)) != std::string::npos && (end_offset = effect.errors.find('\n', next_line_offset + 1)) != std::string::npos; cur_line_offset = next_line_offset + 1)
+		{
+			const std::string_view cur_line(effect.errors.c_str() + cur_line_offset, next_line_offset - cur_line_offset);
+			const std::string_view next_line(effect.errors.c_str() + next_line_offset + 1, end_offset - next_line_offset - 1);
+
+			if (cur_line == next_line)
+			{
+				effect.errors.erase(next_line_offset, end_offset - next_line_offset);
+				next_line_offset = cur_line_offset - 1;
+			}
+		}
+
+		if (effect.errors.empty())
+			LOG(ERROR) << "Failed initializing " << effect.source_file << '.';
+		else
+			LOG(ERROR) << "Failed initializing " << effect.source_file << ":\n" << effect.errors;
+
+		success = false;
+	}
+
+	if (!success) // Something went wrong, do clean up
+	{
+		// Destroy all textures belonging to this effect
+		for (texture &tex : _textures)
+			if (tex.effect_index == index && !tex.shared)
+				destroy_texture(tex);
+		// Disable all techniques belonging to this effect
+		for (technique &tech : _techniques)
+			if (tech.effect_index == index)
+				disable_technique(tech);
+
+		effect.compile_sucess = false;
+		_last_reload_successful = false;
+	}
+
+	return success;
+}
+
 void reshade::runtime::update_and_render_effects()
 {
 	// Delay first load to the first render call to avoid loading while the application is still initializing
 	if (_framecount == 0 && !_no_reload_on_init)
 		load_effects();
 
-	if (_reload_remaining_effects == 0)
+	// Limit the time spent on creating effects in a single frame, so that loading them does not stall the application for long
+	// Always work on at least one effect per frame though, so that loading makes progress regardless of how long that takes
+	const auto frame_start_time = std::chrono::high_resolution_clock::now();
+	const auto frame_budget_left = [this, frame_start_time]() {
+		return std::chrono::high_resolution_clock::now() - frame_start_time < _reload_frame_budget;
+	};
+
+	if (_reload_in_background)
+	{
+		// Swap in effects that finished loading, while the previous version of the others keeps being rendered
+		do
+		{
+			std::pair<size_t, effect> staged_effect;
+
+			{	const std::lock_guard<std::mutex> lock(_reload_mutex);
+				if (_reload_staged_effects.empty())
+					break;
+				staged_effect = std::move(_reload_staged_effects.back());
+				_reload_staged_effects.pop_back();
+			}
+
+			replace_effect(staged_effect.first, std::move(staged_effect.second));
+		} while (frame_budget_left());
+	}
+
+	// The list of staged effects is only accessed from this thread once all effects were loaded
+	// Also hold off while shaders are still compiling, so that waiting for the worker threads below does not block rendering
+	if (_reload_remaining_effects == 0 && _reload_staged_effects.empty() && std::none_of(_effects.begin(), _effects.end(),
+		[](const effect &effect) { return effect.shaders != nullptr && !effect.shaders->finished(); }))
 	{
-		// Clear the thread list now that they all have finished
-		for (std::thread &thread : _worker_threads)
-			if (thread.joinable())
-				thread.join(); // Threads have exited, but still need to join them prior to destruction
-		_worker_threads.clear();
+		// The last effect was loaded, but the thread that loaded it may still be busy recording its load time
+		if (_worker_pool != nullptr)
+		{
+			const worker_pool::statistics stats = _worker_pool->wait();
+
+			auto longest_load_time = std::chrono::high_resolution_clock::duration::zero();
+			for (const effect &effect : _effects)
+				if (const auto it = _effect_load_times.find(effect.source_file.wstring()); it != _effect_load_times.end())
+					longest_load_time = std::max(longest_load_time, it->second);
+
+			log_worker_statistics(stats, _effects.size(), longest_load_time);
+		}
+
+		_reload_in_background = false;
 
 		// Finished loading effects, so apply preset to figure out which ones need compiling
 		load_current_preset();
@@ -727,7 +1365,7 @@ void reshade::runtime::update_and_render_effects()
 		_reload_total_effects = 0;
 		_reload_remaining_effects = std::numeric_limits<size_t>::max();
 	}
-	else if (_reload_remaining_effects != std::numeric_limits<size_t>::max())
+	else if (_reload_remaining_effects != std::numeric_limits<size_t>::max() && !_reload_in_background)
 	{
 		return; // Cannot render while effects are still being loaded
 	}
@@ -735,68 +1373,34 @@ void reshade::runtime::update_and_render_effects()
 	{
 		if (!_reload_compile_queue.empty())
 		{
-			// Pop an effect from the queue
-			const size_t effect_index = _reload_compile_queue.back();
-			_reload_compile_queue.pop_back();
-			effect &effect = _effects[effect_index];
-
-			// Create textures now, since they are referenced when building samplers in the 'init_effect' call below
-			bool success = true;
-			for (texture &texture : _textures)
+			// Shaders are compiled on the worker threads, only the objects that need the device are created here once that finished
+			for (size_t i = 0, num_processed = 0; i < _reload_compile_queue.size() && (num_processed == 0 || frame_budget_left());)
 			{
-				if (texture.impl == nullptr && (texture.effect_index == effect_index || texture.shared))
+				const size_t effect_index = _reload_compile_queue[i];
+				effect &effect = _effects[effect_index];
+
+				if (effect.shaders == nullptr)
 				{
-					if (!init_texture(texture))
-					{
-						success = false;
-						effect.errors += "Failed to create texture " + texture.unique_name;
-						break;
-					}
+					compile_shaders(effect, false);
+					num_processed++;
+					i++;
 				}
-			}
-
-			// Compile the effect with the back-end implementation
-			if (success && !init_effect(effect_index))
-			{
-				// De-duplicate error lines (D3DCompiler sometimes repeats the same error multiple times)
-				for (size_t cur_line_offset = 0, next_line_offset, end_offset;
-					(next_line_offset = effect.errors.find('\n', cur_line_offset)) != std::string::npos && (end_offset = effect.errors.find('\n', next_line_offset + 1)) != std::string::npos; cur_line_offset = next_line_offset + 1)
+				else if (effect.shaders->finished())
 				{
-					const std::string_view cur_line(effect.errors.c_str() + cur_line_offset, next_line_offset - cur_line_offset);
-					const std::string_view next_line(effect.errors.c_str() + next_line_offset + 1, end_offset - next_line_offset - 1);
+					// Pop the effect from the queue
+					_reload_compile_queue.erase(_reload_compile_queue.begin() + i);
+					num_processed++;
 
-					if (cur_line == next_line)
-					{
-						effect.errors.erase(next_line_offset, end_offset - next_line_offset);
-						next_line_offset = cur_line_offset - 1;
-					}
-				}
+					create_effect(effect_index);
 
-				if (effect.errors.empty())
-					LOG(ERROR) << "Failed initializing " << effect.source_file << '.';
+					// An effect has changed, need to reload textures
+					_textures_loaded = false;
+				}
 				else
-					LOG(ERROR) << "Failed initializing " << effect.source_file << ":\n" << effect.errors;
-
-				success = false;
-			}
-
-			if (!success) // Something went wrong, do clean up
-			{
-				// Destroy all textures belonging to this effect
-				for (texture &tex : _textures)
-					if (tex.effect_index == effect_index && !tex.shared)
-						destroy_texture(tex);
-				// Disable all techniques belonging to this effect
-				for (technique &tech : _techniques)
-					if (tech.effect_index == effect_index)
-						disable_technique(tech);
-
-				effect.compile_sucess = false;
-				_last_reload_successful = false;
+				{
+					i++;
+				}
 			}
-
-			// An effect has changed, need to reload textures
-			_textures_loaded = false;
 		}
 		else if (!_textures_loaded)
 		{
@@ -1093,8 +1697,12 @@ void reshade::runtime::load_config()
 	config.get("GENERAL", "ScreenshotIncludePreset", _screenshot_include_preset);
 	config.get("GENERAL", "ScreenshotClearAlpha", _screenshot_clear_alpha);
 
+	config.get("GENERAL", "EffectCachePath", _effect_cache_path);
+	config.get("GENERAL", "EffectCacheSize", _effect_cache_size);
 	config.get("GENERAL", "NoDebugInfo", _no_debug_info);
+	config.get("GENERAL", "OptimizeSPIRV", _optimize_spirv);
 	config.get("GENERAL", "NoReloadOnInit", _no_reload_on_init);
+	config.get("GENERAL", "ProgressiveReload", _progressive_reload);
 
 	// Check if the preset uses the new preset path option
 	if (!config.get("GENERAL", "CurrentPresetPath", _current_preset_path))
@@ -1140,15 +1748,21 @@ void reshade::runtime::save_config() const
 	config.set("GENERAL", "ScreenshotIncludePreset", _screenshot_include_preset);
 	config.set("GENERAL", "ScreenshotClearAlpha", _screenshot_clear_alpha);
 
+	config.set("GENERAL", "EffectCachePath", _effect_cache_path);
+	config.set("GENERAL", "EffectCacheSize", _effect_cache_size);
 	config.set("GENERAL", "NoDebugInfo", _no_debug_info);
+	config.set("GENERAL", "OptimizeSPIRV", _optimize_spirv);
 	config.set("GENERAL", "NoReloadOnInit", _no_reload_on_init);
+	config.set("GENERAL", "ProgressiveReload", _progressive_reload);
 
 	for (const auto &callback : _save_config_callables)
 		callback(config);
 }
 
-void reshade::runtime::load_current_preset()
+void reshade::runtime::load_current_preset(size_t effect_index)
 {
+	const bool all_effects = effect_index == std::numeric_limits<size_t>::max();
+
 	_preset_save_success = true;
 
 	ini_file config = ini_file::load_cache(_configuration_path); // Copy config, because reference becomes invalid in the next line
@@ -1162,7 +1776,7 @@ void reshade::runtime::load_current_preset()
 	preset.get({}, "PreprocessorDefinitions", preset_preprocessor_definitions);
 
 	// Recompile effects if preprocessor definitions have changed or running in performance mode (in which case all preset values are compile-time constants)
-	if (_reload_remaining_effects != 0 && // ... unless this is the 'load_current_preset' call in 'update_and_render_effects'
+	if (_reload_remaining_effects != 0 && all_effects && // ... unless this is the 'load_current_preset' call in 'update_and_render_effects'
 		(_performance_mode || preset_preprocessor_definitions != _preset_preprocessor_definitions))
 	{
 		_preset_preprocessor_definitions = std::move(preset_preprocessor_definitions);
@@ -1175,12 +1789,13 @@ void reshade::runtime::load_current_preset()
 	if (sorted_technique_list.empty())
 		sorted_technique_list = technique_list;
 
-	// Reorder techniques
-	std::sort(_techniques.begin(), _techniques.end(),
-		[&sorted_technique_list](const technique &lhs, const technique &rhs) {
-			return (std::find(sorted_technique_list.begin(), sorted_technique_list.end(), lhs.name) - sorted_technique_list.begin()) <
-			       (std::find(sorted_technique_list.begin(), sorted_technique_list.end(), rhs.name) - sorted_technique_list.begin());
-		});
+	// Reorder techniques (which is skipped when only a single effect is updated, since it then keeps the position of its previous version)
+	if (all_effects)
+		std::sort(_techniques.begin(), _techniques.end(),
+			[&sorted_technique_list](const technique &lhs, const technique &rhs) {
+				return (std::find(sorted_technique_list.begin(), sorted_technique_list.end(), lhs.name) - sorted_technique_list.begin()) <
+				       (std::find(sorted_technique_list.begin(), sorted_technique_list.end(), rhs.name) - sorted_technique_list.begin());
+			});
 
 	// Compute times since the transition has started and how much is left till it should end
 	auto transition_time = std::chrono::duration_cast<std::chrono::microseconds>(_last_present_time - _last_preset_switching_time).count();
@@ -1192,6 +1807,9 @@ void reshade::runtime::load_current_preset()
 
 	for (effect &effect : _effects)
 	{
+		if (!all_effects && &effect != &_effects[effect_index])
+			continue;
+
 		for (uniform &variable : effect.uniforms)
 		{
 			if (variable.special != special_uniform::none)
@@ -1244,6 +1862,9 @@ void reshade::runtime::load_current_preset()
 
 	for (technique &technique : _techniques)
 	{
+		if (!all_effects && technique.effect_index != effect_index)
+			continue;
+
 		// Ignore preset if "enabled" annotation is set
 		if (technique.annotation_as_int("enabled") ||
 			std::find(technique_list.begin(), technique_list.end(), technique.name) != technique_list.end())
@@ -10,6 +10,7 @@
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <unordered_map>
 #include <filesystem>
 
 #if RESHADE_GUI
@@ -19,13 +20,21 @@ struct ImDrawData;
 struct ImGuiContext;
 #endif
 
+namespace reshadefx
+{
+	class source_cache; // Forward declarations to avoid excessive #include
+	class effect_cache;
+}
+
 namespace reshade
 {
 	class ini_file; // Forward declarations to avoid excessive #include
+	class worker_pool;
 	struct effect;
 	struct uniform;
 	struct texture;
 	struct technique;
+	struct shader_compile_job;
 
 	/// <summary>
 	/// Platform independent base class for the main ReShade runtime.
@@ -153,16 +162,18 @@ namespace reshade
 
 		/// <summary>
 		/// Compile effect from the specified source file and initialize textures, uniforms and techniques.
+		/// During a background reload the effect is only compiled and then queued, to be swapped in by <see cref="update_and_render_effects"/>.
 		/// </summary>
 		/// <param name="path">The path to an effect source code file.</param>
 		/// <param name="index">The ID of the effect.</param>
-		bool load_effect(const std::filesystem::path &path, size_t index);
+		/// <param name="precompile">Set to <c>true</c> to compile the shaders of the effect before it is swapped in during a background reload, so that it can be rendered right away.</param>
+		bool load_effect(const std::filesystem::path &path, size_t index, bool precompile = false);
 		/// <summary>
 		/// Load all effects found in the effect search paths.
 		/// </summary>
 		void load_effects();
 		/// <summary>
-		/// Initialize resources for the effect and load the effect module.
+		/// Initialize resources for the effect and create back-end objects from the shaders compiled in <see cref="effect::shaders"/>.
 		/// </summary>
 		/// <param name="index">The ID of the effect.</param>
 		virtual bool init_effect(size_t index) = 0;
@@ -176,10 +187,36 @@ namespace reshade
 		/// </summary>
 		virtual void unload_effects();
 
+		/// <summary>
+		/// Add a job for every entry point of an effect that compiles its shader code to backend byte code, by filling in the target profile, source code and cache key.
+		/// Back-ends that create objects directly from the generated code do not add any jobs. This may be called on any thread, so must not access the device.
+		/// </summary>
+		/// <param name="effect">The effect to compile.</param>
+		/// <param name="jobs">The list to add the jobs to.</param>
+		virtual void init_compile_jobs(const effect &, std::vector<shader_compile_job> &) const {}
+		/// <summary>
+		/// Compile the shader code of a single entry point to backend byte code and disassemble it.
+		/// This is called on the worker threads for multiple jobs at once, so must not access the device.
+		/// </summary>
+		/// <param name="job">The job to execute, which receives the byte code and the warnings and errors reported by the compiler.</param>
+		/// <returns><c>true</c> if the shader code compiled successfully, <c>false</c> otherwise.</returns>
+		virtual bool compile_entry_point(shader_compile_job &) const { return false; }
+
+		/// <summary>
+		/// Execute a compile job, or get the result of an earlier one with the same inputs from the effect cache.
+		/// </summary>
+		/// <param name="job">The job to execute.</param>
+		void compile_shader(shader_compile_job &job);
+
 		/// <summary>
 		/// Load image files and update textures with image data.
 		/// </summary>
 		void load_textures();
+		/// <summary>
+		/// Load the image file referenced by the specified texture and update it with the image data.
+		/// </summary>
+		/// <param name="texture">The texture to update.</param>
+		void load_texture(const texture &texture);
 
 		/// <summary>
 		/// Apply post-processing effects to the frame.
@@ -231,6 +268,30 @@ namespace reshade
 		/// </summary>
 		bool is_loading() const { return _reload_remaining_effects != std::numeric_limits<size_t>::max(); }
 
+		/// <summary>
+		/// Create textures, uniforms and techniques for an effect whose module was compiled and add them to the global lists.
+		/// </summary>
+		/// <param name="index">The ID of the effect.</param>
+		void register_effect(size_t index);
+		/// <summary>
+		/// Replace an effect with a new version of it that was loaded in the background, so that the old version is rendered up to the point the new one is ready.
+		/// </summary>
+		/// <param name="index">The ID of the effect.</param>
+		/// <param name="new_effect">The new version of the effect.</param>
+		void replace_effect(size_t index, effect &&new_effect);
+		/// <summary>
+		/// Create textures and back-end objects for an effect, which are needed before any of its techniques can be rendered.
+		/// </summary>
+		/// <param name="index">The ID of the effect.</param>
+		/// <returns><c>true</c> on success, <c>false</c> if the effect failed to initialize and was disabled.</returns>
+		bool create_effect(size_t index);
+		/// <summary>
+		/// Start compiling the shaders of an effect on the worker threads, with one job per entry point so that they are compiled in parallel.
+		/// </summary>
+		/// <param name="effect">The effect to compile, whose <see cref="effect::shaders"/> member receives the jobs.</param>
+		/// <param name="wait">Set to <c>true</c> to wait for the jobs to finish. The calling thread helps executing them, so this can be used from within a job.</param>
+		void compile_shaders(effect &effect, bool wait);
+
 		/// <summary>
 		/// Enable a technique so it is rendered.
 		/// </summary>
@@ -250,7 +311,8 @@ namespace reshade
 		/// <summary>
 		/// Load the selected preset and apply it.
 		/// </summary>
-		void load_current_preset();
+		/// <param name="effect_index">The ID of an effect to apply the preset to, or all effects if not specified.</param>
+		void load_current_preset(size_t effect_index = std::numeric_limits<size_t>::max());
 		/// <summary>
 		/// Save the current value configuration to the currently selected preset.
 		/// </summary>
@@ -289,16 +351,26 @@ namespace reshade
 
 		// === Effect Loading ===
 		bool _no_debug_info = 0;
+		bool _optimize_spirv = false;
 		bool _no_reload_on_init = false;
 		bool _last_reload_successful = true;
 		bool _textures_loaded = false;
 		bool _performance_mode = false;
+		bool _progressive_reload = true;
+		bool _reload_in_background = false;
 		unsigned int _reload_key_data[4];
+		std::chrono::high_resolution_clock::duration _reload_frame_budget = std::chrono::milliseconds(2);
 		size_t _reload_total_effects = 1;
 		std::vector<size_t> _reload_compile_queue;
 		std::atomic<size_t> _reload_remaining_effects = 0;
 		std::mutex _reload_mutex;
-		std::vector<std::thread> _worker_threads;
+		std::vector<std::pair<size_t, effect>> _reload_staged_effects;
+		std::unique_ptr<worker_pool> _worker_pool;
+		std::unordered_map<std::wstring, std::chrono::high_resolution_clock::duration> _effect_load_times;
+		std::unique_ptr<reshadefx::source_cache> _effect_source_cache;
+		std::unique_ptr<reshadefx::effect_cache> _effect_cache;
+		std::filesystem::path _effect_cache_path;
+		unsigned int _effect_cache_size = 256; // In MiB, zero disables the cache
 		std::vector<std::string> _global_preprocessor_definitions;
 		std::vector<std::string> _preset_preprocessor_definitions;
 		std::vector<std::filesystem::path> _effect_search_paths;
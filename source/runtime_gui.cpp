@@ -10,6 +10,7 @@
 #include "runtime.hpp"
 #include "runtime_config.hpp"
 #include "runtime_objects.hpp"
+#include "effect_preprocessor.hpp"
 #include "input.hpp"
 #include "imgui_widgets.hpp"
 #include <cassert>
@@ -540,10 +541,16 @@ void reshade::runtime::draw_ui()
 
 			if (_reload_remaining_effects != 0 && _reload_remaining_effects != std::numeric_limits<size_t>::max())
 			{
-				ImGui::Text(
-					"Loading (%zu effects remaining) ... "
-					"This might take a while. The application could become unresponsive for some time.",
-					_reload_remaining_effects.load());
+				if (_reload_in_background)
+					ImGui::Text(
+						"Loading (%zu effects remaining) ... "
+						"Effects are updated one after another as soon as they finished loading.",
+						_reload_remaining_effects.load());
+				else
+					ImGui::Text(
+						"Loading (%zu effects remaining) ... "
+						"This might take a while. The application could become unresponsive for some time.",
+						_reload_remaining_effects.load());
 			}
 			else if (!_reload_compile_queue.empty())
 			{
@@ -1716,6 +1723,7 @@ void reshade::runtime::draw_code_editor()
 			// Reload effect file
 			_reload_total_effects = 1;
 			_reload_remaining_effects = 1;
+			_effect_source_cache->refresh_directories();
 			unload_effect(_selected_effect);
 			load_effect(_effects[_selected_effect].source_file, _selected_effect);
 
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "runtime_objects.hpp"
+#include "worker_pool.hpp"
+#include <cassert>
+
+void reshade::effect_shaders::compile(const std::shared_ptr<effect_shaders> &shaders, worker_pool &pool, std::function<void(shader_compile_job &)> compile, bool wait)
+{
+	assert(shaders != nullptr);
+
+	shaders->remaining_jobs = shaders->jobs.size();
+
+	// The jobs hold a reference to the shaders, since the effect they belong to may be unloaded before they finish
+	const auto shared_compile = std::make_shared<std::function<void(shader_compile_job &)>>(std::move(compile));
+
+	std::vector<std::function<void()>> jobs;
+	jobs.reserve(shaders->jobs.size());
+	for (shader_compile_job &job : shaders->jobs)
+		jobs.push_back([shaders, shared_compile, &job]() {
+			(*shared_compile)(job);
+
+			// Free the source code as soon as possible, since it is not needed anymore
+			job.source = std::string();
+
+			shaders->remaining_jobs--;
+		});
+
+	if (wait)
+		pool.execute(std::move(jobs));
+	else
+		pool.submit(std::move(jobs));
+}
+
+bool reshade::effect_shaders::collect_results(effect &effect) const
+{
+	assert(finished());
+
+	bool success = true;
+	for (const shader_compile_job &job : jobs)
+	{
+		// Append warnings to the output error string as well
+		effect.errors += job.errors;
+
+		if (job.success)
+			effect.assembly[job.entry_point] = job.assembly;
+		else
+			success = false;
+	}
+
+	return success;
+}
@@ -6,9 +6,19 @@
 #pragma once
 
 #include "effect_module.hpp"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
 
 namespace reshade
 {
+	class worker_pool;
+	struct effect;
+
 	enum class special_uniform
 	{
 		none,
@@ -182,6 +192,50 @@ namespace reshade
 		moving_average<uint64_t, 60> average_gpu_duration;
 	};
 
+	/// <summary>
+	/// The input and output of compiling the shader code of a single entry point to backend byte code.
+	/// </summary>
+	struct shader_compile_job final
+	{
+		std::string entry_point;
+		bool is_pixel_shader = false;
+		std::string profile;
+		std::string source;
+		uint64_t cache_key = 0;
+
+		bool success = false;
+		std::string code;
+		std::string errors;
+		std::string assembly;
+	};
+
+	/// <summary>
+	/// The compile jobs for all entry points of an effect, which are shared with the worker threads executing them, so that unloading the effect does not have to wait for them.
+	/// </summary>
+	struct effect_shaders final
+	{
+		bool finished() const { return remaining_jobs == 0; }
+
+		/// <summary>
+		/// Execute the compile jobs on the worker threads.
+		/// The jobs keep the shaders alive until they finished, so the effect may be unloaded while they are still running.
+		/// </summary>
+		/// <param name="shaders">The shaders to compile, whose jobs must not change until all of them finished.</param>
+		/// <param name="pool">The worker threads to execute the jobs on.</param>
+		/// <param name="compile">The function that fills in the results of a job.</param>
+		/// <param name="wait">Set to <c>true</c> to wait for all jobs to finish before returning.</param>
+		static void compile(const std::shared_ptr<effect_shaders> &shaders, worker_pool &pool, std::function<void(shader_compile_job &)> compile, bool wait);
+
+		/// <summary>
+		/// Append the errors and warnings of all finished jobs to the error string of the effect and store the assembly of the ones that succeeded.
+		/// </summary>
+		/// <returns><c>true</c> if all jobs succeeded, <c>false</c> otherwise.</returns>
+		bool collect_results(effect &effect) const;
+
+		std::vector<shader_compile_job> jobs;
+		std::atomic<size_t> remaining_jobs = 0;
+	};
+
 	struct effect final
 	{
 		unsigned int rendering = 0;
@@ -193,6 +247,7 @@ namespace reshade
 		std::vector<std::filesystem::path> included_files;
 		std::vector<std::pair<std::string, std::string>> definitions;
 		std::unordered_map<std::string, std::string> assembly;
+		std::shared_ptr<effect_shaders> shaders;
 		std::vector<uniform> uniforms;
 		std::vector<unsigned char> uniform_data_storage;
 	};
@@ -479,6 +479,8 @@ void reshade::vulkan::runtime_vk::on_reset()
 	// Make sure none of the resources below are currently in use
 	wait_for_command_buffers();
 
+	release_retired_objects(std::numeric_limits<uint64_t>::max());
+
 	for (VkImageView view : _swapchain_views)
 		vk.DestroyImageView(_device, view, nullptr);
 	_swapchain_views.clear();
@@ -587,6 +589,10 @@ void reshade::vulkan::runtime_vk::on_present(VkQueue queue, uint32_t swapchain_i
 		vk.WaitForFences(_device, 1, &fence, VK_TRUE, UINT64_MAX);
 	}
 
+	// The command buffer of this frame index was last submitted that many frames ago, so that frame and all before it finished executing now
+	if (_framecount >= NUM_COMMAND_FRAMES)
+		release_retired_objects(_framecount - NUM_COMMAND_FRAMES);
+
 #if RESHADE_DEPTH
 	update_depth_image_bindings(_has_high_network_activity ? buffer_detection::depthstencil_info {} :
 		_buffer_detection->find_best_depth_texture(_use_aspect_ratio_heuristics ? VkExtent2D { _width, _height } : VkExtent2D { 0, 0 }, _depth_image_override));
@@ -1367,9 +1373,7 @@ bool reshade::vulkan::runtime_vk::init_effect(size_t index)
 }
 void reshade::vulkan::runtime_vk::unload_effect(size_t index)
 {
-	// Make sure no effect resources are currently in use
-	wait_for_command_buffers();
-
+	// Frames that are still executing may use the effect resources, so destroy them once those finished instead of waiting for the device here
 	for (technique &tech : _techniques)
 	{
 		if (tech.effect_index != index)
@@ -1379,17 +1383,19 @@ void reshade::vulkan::runtime_vk::unload_effect(size_t index)
 		if (impl == nullptr)
 			continue;
 
-		for (vulkan_pass_data &pass_data : impl->passes)
-		{
-			if (pass_data.begin_info.renderPass != _default_render_pass[0] &&
-				pass_data.begin_info.renderPass != _default_render_pass[1])
-				vk.DestroyRenderPass(_device, pass_data.begin_info.renderPass, nullptr);
-			if (pass_data.begin_info.framebuffer != VK_NULL_HANDLE)
-				vk.DestroyFramebuffer(_device, pass_data.begin_info.framebuffer, nullptr);
-			vk.DestroyPipeline(_device, pass_data.pipeline, nullptr);
-		}
+		retire_object([this, impl]() {
+			for (vulkan_pass_data &pass_data : impl->passes)
+			{
+				if (pass_data.begin_info.renderPass != _default_render_pass[0] &&
+					pass_data.begin_info.renderPass != _default_render_pass[1])
+					vk.DestroyRenderPass(_device, pass_data.begin_info.renderPass, nullptr);
+				if (pass_data.begin_info.framebuffer != VK_NULL_HANDLE)
+					vk.DestroyFramebuffer(_device, pass_data.begin_info.framebuffer, nullptr);
+				vk.DestroyPipeline(_device, pass_data.pipeline, nullptr);
+			}
 
-		delete impl;
+			delete impl;
+		});
 		tech.impl = nullptr;
 	}
 
@@ -1399,13 +1405,16 @@ void reshade::vulkan::runtime_vk::unload_effect(size_t index)
 	{
 		vulkan_effect_data &effect_data = _effect_data[index];
 
-		vk.DestroyQueryPool(_device, effect_data.query_pool, nullptr);
+		retire_object([this, query_pool = effect_data.query_pool, pipeline_layout = effect_data.pipeline_layout, set_layout = effect_data.set_layout, ubo = effect_data.ubo, ubo_mem = effect_data.ubo_mem]() {
+			vk.DestroyQueryPool(_device, query_pool, nullptr);
+			vk.DestroyPipelineLayout(_device, pipeline_layout, nullptr);
+			vk.DestroyDescriptorSetLayout(_device, set_layout, nullptr);
+			vmaDestroyBuffer(_alloc, ubo, ubo_mem);
+		});
+
 		effect_data.query_pool = VK_NULL_HANDLE;
-		vk.DestroyPipelineLayout(_device, effect_data.pipeline_layout, nullptr);
 		effect_data.pipeline_layout = VK_NULL_HANDLE;
-		vk.DestroyDescriptorSetLayout(_device, effect_data.set_layout, nullptr);
 		effect_data.set_layout = VK_NULL_HANDLE;
-		vmaDestroyBuffer(_alloc, effect_data.ubo, effect_data.ubo_mem);
 		effect_data.ubo = VK_NULL_HANDLE;
 		effect_data.ubo_mem = VK_NULL_HANDLE;
 	}
@@ -1437,6 +1446,9 @@ void reshade::vulkan::runtime_vk::unload_effects()
 
 	runtime::unload_effects();
 
+	// Nothing was submitted since waiting above, so the textures that were just retired can be destroyed right away
+	release_retired_objects(std::numeric_limits<uint64_t>::max());
+
 	if (_effect_descriptor_pool != VK_NULL_HANDLE)
 	{
 		vk.ResetDescriptorPool(_device, _effect_descriptor_pool, 0);
@@ -1674,24 +1686,24 @@ void reshade::vulkan::runtime_vk::destroy_texture(texture &texture)
 		return;
 	auto impl = static_cast<vulkan_tex_data *>(texture.impl);
 
-	// Make sure texture is not still in use before destroying it
-	wait_for_command_buffers();
-
-	vmaDestroyImage(_alloc, impl->image, impl->image_mem);
-	if (impl->view[0] != VK_NULL_HANDLE)
-		vk.DestroyImageView(_device, impl->view[0], nullptr);
-	if (impl->view[1] != impl->view[0])
-		vk.DestroyImageView(_device, impl->view[1], nullptr);
-	if (impl->view[2] != impl->view[0])
-		vk.DestroyImageView(_device, impl->view[2], nullptr);
-	if (impl->view[3] != impl->view[2] && impl->view[3] != impl->view[1])
-		vk.DestroyImageView(_device, impl->view[3], nullptr);
+	// The texture may still be in use by frames that are executing, so only destroy it once those finished
+	retire_object([this, impl]() {
+		vmaDestroyImage(_alloc, impl->image, impl->image_mem);
+		if (impl->view[0] != VK_NULL_HANDLE)
+			vk.DestroyImageView(_device, impl->view[0], nullptr);
+		if (impl->view[1] != impl->view[0])
+			vk.DestroyImageView(_device, impl->view[1], nullptr);
+		if (impl->view[2] != impl->view[0])
+			vk.DestroyImageView(_device, impl->view[2], nullptr);
+		if (impl->view[3] != impl->view[2] && impl->view[3] != impl->view[1])
+			vk.DestroyImageView(_device, impl->view[3], nullptr);
 #if RESHADE_GUI
-	if (impl->descriptor_set != VK_NULL_HANDLE)
-		vk.FreeDescriptorSets(_device, _imgui.descriptor_pool, 1, &impl->descriptor_set);
+		if (impl->descriptor_set != VK_NULL_HANDLE)
+			vk.FreeDescriptorSets(_device, _imgui.descriptor_pool, 1, &impl->descriptor_set);
 #endif
 
-	delete impl;
+		delete impl;
+	});
 	texture.impl = nullptr;
 }
 void reshade::vulkan::runtime_vk::generate_mipmaps(const texture &texture)
@@ -1932,6 +1944,21 @@ void reshade::vulkan::runtime_vk::wait_for_command_buffers()
 		// Do this after waiting for idle, since it should run after all work by the application is done and is synchronous anyway
 		execute_command_buffer();
 }
+void reshade::vulkan::runtime_vk::retire_object(std::function<void()> destroy)
+{
+	// Commands referencing the object may still be recorded into the command buffer of the current frame, which is submitted at the end of it
+	_retired_objects.emplace_back(_framecount, std::move(destroy));
+}
+void reshade::vulkan::runtime_vk::release_retired_objects(uint64_t last_completed_frame)
+{
+	const auto first_in_use = std::stable_partition(_retired_objects.begin(), _retired_objects.end(),
+		[last_completed_frame](const std::pair<uint64_t, std::function<void()>> &object) { return object.first <= last_completed_frame; });
+
+	for (auto it = _retired_objects.begin(); it != first_in_use; ++it)
+		it->second();
+
+	_retired_objects.erase(_retired_objects.begin(), first_in_use);
+}
 
 VkImage reshade::vulkan::runtime_vk::create_image(uint32_t width, uint32_t height, uint32_t levels, VkFormat format,
 	VkImageUsageFlags usage, VmaMemoryUsage mem_usage,
@@ -48,6 +48,8 @@ namespace reshade::vulkan
 		bool begin_command_buffer() const;
 		void execute_command_buffer() const;
 		void wait_for_command_buffers();
+		void retire_object(std::function<void()> destroy);
+		void release_retired_objects(uint64_t last_completed_frame);
 
 		VkImage create_image(uint32_t width, uint32_t height, uint32_t levels, VkFormat format,
 			VkImageUsageFlags usage, VmaMemoryUsage mem_usage,
@@ -71,6 +73,8 @@ namespace reshade::vulkan
 		mutable std::pair<VkCommandBuffer, bool> _cmd_buffers[NUM_COMMAND_FRAMES] = {};
 		uint32_t _cmd_index = 0;
 		uint32_t _swap_index = 0;
+		// Objects that frames which are still executing may reference, along with the last frame that may do so and how to destroy them afterwards
+		std::vector<std::pair<uint64_t, std::function<void()>>> _retired_objects;
 
 		VkFormat _backbuffer_format = VK_FORMAT_UNDEFINED;
 		VkExtent2D _render_area = {};
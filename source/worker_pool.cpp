@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "worker_pool.hpp"
+#include <cassert>
+#include <atomic>
+#include <utility> // std::exchange
+
+reshade::worker_pool::worker_pool(size_t num_threads)
+{
+	assert(num_threads != 0);
+
+	_workers.reserve(num_threads);
+	for (size_t i = 0; i < num_threads; ++i)
+		_workers.push_back(std::make_unique<worker>());
+
+	// Only start threads after all workers exist, since they access each others queues
+	for (size_t i = 0; i < num_threads; ++i)
+		_workers[i]->thread = std::thread(&worker_pool::run, this, i);
+}
+reshade::worker_pool::~worker_pool()
+{
+	{	const std::lock_guard<std::mutex> lock(_mutex);
+		_exit = true;
+	}
+
+	_work_available.notify_all();
+
+	// Threads finish all queued jobs before they exit
+	for (const std::unique_ptr<worker> &worker : _workers)
+		worker->thread.join();
+}
+
+void reshade::worker_pool::submit(std::vector<std::function<void()>> jobs)
+{
+	if (jobs.empty())
+		return;
+
+	push(jobs, 0, false);
+
+	_work_available.notify_all();
+}
+void reshade::worker_pool::execute(std::vector<std::function<void()>> jobs)
+{
+	if (jobs.empty())
+		return;
+
+	// Start with the own queue when called from a worker thread, so that its first job is executed right away
+	size_t index = 0;
+	while (index < _workers.size() && _workers[index]->thread.get_id() != std::this_thread::get_id())
+		index++;
+	const bool is_worker = index < _workers.size();
+	if (!is_worker)
+		index = 0;
+
+	// Track jobs that were not started yet separately from those that were not finished yet, so that this thread does not pick up unrelated jobs once all of these are running
+	// These live on the stack, which is fine since this function only returns after all jobs finished
+	std::atomic<size_t> queued(jobs.size());
+	std::atomic<size_t> remaining(jobs.size());
+
+	for (std::function<void()> &job : jobs)
+		job = [job = std::move(job), &queued, &remaining]() {
+			queued--;
+			job();
+			remaining--;
+		};
+
+	push(jobs, index, true);
+
+	_work_available.notify_all();
+
+	while (queued != 0)
+	{
+		bool stolen = false;
+		std::function<void()> job;
+
+		if (!pop(index, job, stolen))
+			break;
+
+		job();
+		job = nullptr;
+
+		// The time is already accounted for by the job this thread is executing in case it is a worker thread
+		finish(is_worker ? index : _workers.size(), stolen, std::chrono::high_resolution_clock::duration::zero(), std::chrono::high_resolution_clock::now());
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_work_finished.wait(lock, [&remaining]() { return remaining == 0; });
+}
+
+reshade::worker_pool::statistics reshade::worker_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_work_finished.wait(lock, [this]() { return _pending_jobs == 0; });
+
+	statistics stats;
+	if (_batch_active)
+		stats.wall_time = _batch_end - _batch_start;
+	_batch_active = false;
+
+	stats.workers.reserve(_workers.size());
+	for (const std::unique_ptr<worker> &worker : _workers)
+		stats.workers.push_back(std::exchange(worker->stats, worker_statistics()));
+
+	return stats;
+}
+
+void reshade::worker_pool::run(size_t index)
+{
+	while (true)
+	{
+		bool stolen = false;
+		std::function<void()> job;
+
+		if (!pop(index, job, stolen))
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_work_available.wait(lock, [this]() { return _exit || _queued_jobs != 0; });
+
+			if (_exit && _queued_jobs == 0)
+				break;
+			continue;
+		}
+
+		const auto start_time = std::chrono::high_resolution_clock::now();
+		job();
+		const auto end_time = std::chrono::high_resolution_clock::now();
+
+		// Destroy any state captured by the job before reporting it as finished
+		job = nullptr;
+
+		finish(index, stolen, end_time - start_time, end_time);
+	}
+}
+
+void reshade::worker_pool::push(std::vector<std::function<void()>> &jobs, size_t first_index, bool front)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_batch_active)
+	{
+		_batch_active = true;
+		_batch_start = std::chrono::high_resolution_clock::now();
+	}
+
+	_queued_jobs += jobs.size();
+	_pending_jobs += jobs.size();
+
+	// Deal jobs out in turn, so that the most expensive ones at the front of the list start on different threads
+	// When adding to the front of the queues, go through the list backwards so that the jobs keep their order
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		const size_t k = front ? jobs.size() - 1 - i : i;
+		worker &worker = *_workers[(first_index + k) % _workers.size()];
+
+		const std::lock_guard<std::mutex> worker_lock(worker.mutex);
+		if (front)
+			worker.jobs.push_front(std::move(jobs[k]));
+		else
+			worker.jobs.push_back(std::move(jobs[k]));
+	}
+}
+
+bool reshade::worker_pool::pop(size_t index, std::function<void()> &job, bool &stolen)
+{
+	// Take jobs from the front of the own queue first and otherwise from the front of the queue of another thread
+	// The front always holds the most expensive job that was not started yet, so the remaining work is balanced out
+	for (size_t i = 0; i < _workers.size() && !job; ++i)
+	{
+		worker &worker = *_workers[(index + i) % _workers.size()];
+
+		const std::lock_guard<std::mutex> worker_lock(worker.mutex);
+		if (worker.jobs.empty())
+			continue;
+
+		job = std::move(worker.jobs.front());
+		worker.jobs.pop_front();
+		stolen = i != 0;
+	}
+
+	if (!job)
+		return false;
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_queued_jobs--;
+
+	return true;
+}
+void reshade::worker_pool::finish(size_t index, bool stolen, std::chrono::high_resolution_clock::duration busy_time, std::chrono::high_resolution_clock::time_point end_time)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	// Jobs executed by threads outside the pool while they wait in 'execute' are not attributed to any worker
+	if (index < _workers.size())
+	{
+		worker_statistics &stats = _workers[index]->stats;
+		stats.jobs++;
+		stats.stolen_jobs += stolen ? 1 : 0;
+		stats.busy_time += busy_time;
+	}
+
+	if (--_pending_jobs == 0)
+		_batch_end = end_time;
+
+	// Always notify, since threads in 'execute' wait for their own jobs rather than for all of them
+	_work_finished.notify_all();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace reshade
+{
+	/// <summary>
+	/// A fixed set of threads that stay alive between batches of jobs. Every thread has its own queue of jobs and takes work from the queues of other threads once its own is empty.
+	/// </summary>
+	class worker_pool
+	{
+	public:
+		struct worker_statistics
+		{
+			size_t jobs = 0;
+			size_t stolen_jobs = 0;
+			std::chrono::high_resolution_clock::duration busy_time = {};
+		};
+		struct statistics
+		{
+			std::chrono::high_resolution_clock::duration wall_time = {};
+			std::vector<worker_statistics> workers;
+		};
+
+		explicit worker_pool(size_t num_threads);
+		~worker_pool();
+
+		worker_pool(const worker_pool &) = delete;
+		worker_pool &operator=(const worker_pool &) = delete;
+
+		size_t num_threads() const { return _workers.size(); }
+
+		/// <summary>
+		/// Add jobs to the queues of the worker threads and wake them up.
+		/// Jobs are dealt out in turn, so the first ones are started first. Pass them in order of decreasing cost to keep the time until the last one finishes short.
+		/// </summary>
+		/// <param name="jobs">The list of jobs to execute.</param>
+		void submit(std::vector<std::function<void()>> jobs);
+		/// <summary>
+		/// Add jobs to the front of the queues of the worker threads, so that they are started before any jobs that were queued earlier, and wait for just these to finish.
+		/// The calling thread executes jobs itself while it waits, so this can be used from within a job to split it up further without blocking a worker thread.
+		/// </summary>
+		/// <param name="jobs">The list of jobs to execute.</param>
+		void execute(std::vector<std::function<void()>> jobs);
+
+		/// <summary>
+		/// Wait for all submitted jobs to finish.
+		/// </summary>
+		/// <returns>How the jobs executed since the previous call were spread across the worker threads.</returns>
+		statistics wait();
+
+	private:
+		struct worker
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> jobs;
+			worker_statistics stats;
+			std::thread thread;
+		};
+
+		void run(size_t index);
+		void push(std::vector<std::function<void()>> &jobs, size_t first_index, bool front);
+		bool pop(size_t index, std::function<void()> &job, bool &stolen);
+		void finish(size_t index, bool stolen, std::chrono::high_resolution_clock::duration busy_time, std::chrono::high_resolution_clock::time_point end_time);
+
+		std::vector<std::unique_ptr<worker>> _workers;
+		std::mutex _mutex;
+		std::condition_variable _work_available;
+		std::condition_variable _work_finished;
+		bool _exit = false;
+		// Jobs that still wait in a queue and jobs that were not finished yet
+		size_t _queued_jobs = 0;
+		size_t _pending_jobs = 0;
+		bool _batch_active = false;
+		std::chrono::high_resolution_clock::time_point _batch_start;
+		std::chrono::high_resolution_clock::time_point _batch_end;
+	};
+}
@@ -0,0 +1,160 @@
+uniform float Time;
+uniform int Count = 3;
+uniform uint Flags = 5;
+uniform float4 Params = float4(0.5, 1.5, -2.0, 4.0);
+uniform float3x3 Transform;
+
+texture Noise { Width = 16; Height = 16; };
+sampler NoiseSampler { Texture = Noise; };
+
+struct Light
+{
+	float3 direction;
+	float intensity;
+};
+
+static const int Primes[6] = { 2, 3, 5, 7, 11, 13 };
+static const float Folded = (1.0 + 2.0) * 0.5 - 2.0 + 8.0 / 4.0;
+static const int FoldedInt = (7 * 6) / 4 - (15 % 4) + (1 << 3);
+
+static float accumulated_weight = 0.0;
+
+int collatz(int n)
+{
+	int steps = 0;
+	while (n != 1 && steps < 32)
+	{
+		n = (n % 2 == 0) ? n / 2 : 3 * n + 1;
+		steps++;
+	}
+	return steps;
+}
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 73244475u;
+	x ^= x >> 15;
+	x *= 2221982091u;
+	x ^= x >> 16;
+	return x;
+}
+
+void accumulate(inout float3 sum, Light light, float3 normal, out float weight)
+{
+	weight = saturate(dot(normal, -light.direction)) * light.intensity;
+	sum += weight * float3(1.0, 0.95, 0.9);
+	accumulated_weight += weight;
+}
+
+float3 shade(float3 normal)
+{
+	Light lights[3];
+	lights[0].direction = normalize(float3(1.0, -1.0, -0.5));
+	lights[0].intensity = 1.0;
+	lights[1].direction = normalize(float3(-0.5, 1.0, -0.25));
+	lights[1].intensity = 0.5;
+	lights[2].direction = float3(0.0, 0.0, -1.0);
+	lights[2].intensity = Params.x;
+
+	float3 sum = 0.0;
+	float total = 0.0;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (i >= Count)
+			break;
+
+		float weight;
+		accumulate(sum, lights[i], normal, weight);
+		if (weight <= 0.0)
+			continue;
+
+		total += weight;
+	}
+
+	return sum / max(total, 0.001) + reflect(-normal, float3(0.0, 0.0, 1.0)) * 0.1;
+}
+
+float2 rotate(float2 v, float angle)
+{
+	float s, c;
+	sincos(angle, s, c);
+	return mul(float2x2(c, -s, s, c), v);
+}
+
+void VS(uint id : SV_VertexID, out float4 pos : SV_Position, out float2 uv : TEXCOORD)
+{
+	uv.x = (id == 2) ? 2.0 : 0.0;
+	uv.y = (id == 1) ? 2.0 : 0.0;
+	pos = float4(rotate(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), Time * 0.0), 0.0, 1.0);
+}
+
+float4 PS_Arithmetic(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target
+{
+	const int index = int(uv.x * 5.0) % 6;
+	const int steps = collatz(Primes[index] + Count);
+	const uint h = hash(uint(pos.x * 100.0) + Flags * 31u);
+
+	const float noise = tex2D(NoiseSampler, uv).r;
+	const float3 n = normalize(float3(uv * 2.0 - 1.0, 1.0));
+	// Constant expressions, which only the optimizer can fold entirely after promoting the local variables
+	float scale = 0.75;
+	scale += 0.5;
+	scale = scale * scale - 0.25;
+	int shift = 3;
+	shift = (shift << 2) - 4 + FoldedInt % 3;
+	const float3 offset = float3(scale, 1.0, 0.5) * float3(2.0, 0.25, 0.5) + float(shift) / 8.0;
+
+	float3 color = shade(n) * Folded * scale + offset;
+	color = mul(Transform, color);
+	color += float3(steps, h & 0xFF, (h >> 8) & 0xFF) / float3(32.0, 255.0, 255.0);
+	color = lerp(color, smoothstep(0.0, 1.0, color), frac(Time));
+
+	float4 result = float4(color, noise + accumulated_weight * 0.01);
+	result.xy = abs(sin(result.yx * Params.zw)) + pow(abs(result.zw), 2.2);
+	result.z = clamp(result.z, -1.0, 1.0) * sign(Params.z) + step(0.5, uv.y) * FoldedInt;
+	result.w = asfloat(asint(result.w) & 0x7FFFFFFF);
+
+	int counter = 0;
+	do
+	{
+		counter += 1 + (Count & 1);
+	}
+	while (counter < 5);
+	result.x += counter * 0.125;
+
+	[branch]
+	if ((Flags & 1u) != 0)
+		return result;
+	else
+		return result.wzyx;
+}
+
+float4 PS_Matrix(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target
+{
+	float4x4 m = float4x4(
+		1.0, uv.x, 0.0, 0.0,
+		0.0, 1.0, uv.y, 0.0,
+		0.0, 0.0, 1.0, Time,
+		Params);
+	const float4 v = mul(mul(m, transpose(m)), float4(uv, 1.0, 0.5));
+
+	float values[4] = { v.x, v.y, v.z, v.w };
+	// The store to a dynamic index may overwrite the first element, so it has to be loaded again afterwards
+	values[0] = v.x * 2.0;
+	values[int(uv.x * 4.0) & 3] = -1.0;
+	float maximum = values[0];
+	[unroll]
+	for (int i = 1; i < 4; ++i)
+		maximum = max(maximum, values[i]);
+
+	const float d = determinant(float3x3(m[0].xyz, m[1].xyz, m[2].xyz));
+	const float3 c = cross(normalize(v.xyz), float3(0.0, 1.0, 0.0));
+	return float4(c * length(v) / max(maximum, 1.0), d + distance(v.xy, uv) + (v.w % 0.75) + atan2(v.y, v.x));
+}
+
+technique Arithmetic
+{
+	pass { VertexShader = VS; PixelShader = PS_Arithmetic; }
+	pass { VertexShader = VS; PixelShader = PS_Matrix; }
+}
@@ -0,0 +1,86 @@
+uniform float Strength < ui_type = "slider"; > = 0.75;
+uniform int Mode = 2;
+uniform float3 Tint = float3(1.0, 0.9, 0.8);
+
+texture Color { Width = 64; Height = 64; };
+texture Intermediate { Width = 32; Height = 32; Format = RGBA16F; };
+sampler ColorSampler { Texture = Color; };
+sampler IntermediateSampler { Texture = Intermediate; AddressU = MIRROR; };
+
+struct Sample
+{
+	float4 color;
+	float weight;
+};
+
+static const float Weights[5] = { 0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216 };
+static const float3 LumaCoefficients = float3(0.2126, 0.7152, 0.0722);
+
+float luma(float3 color) { return dot(color, LumaCoefficients); }
+
+Sample blur(sampler s, float2 uv, float2 direction)
+{
+	Sample result;
+	result.color = tex2D(s, uv) * Weights[0];
+	result.weight = Weights[0];
+
+	[unroll]
+	for (int i = 1; i < 5; ++i)
+	{
+		const float2 offset = direction * i;
+		result.color += tex2D(s, uv + offset) * Weights[i];
+		result.color += tex2D(s, uv - offset) * Weights[i];
+		result.weight += 2.0 * Weights[i];
+	}
+
+	return result;
+}
+
+float3 apply_mode(float3 color)
+{
+	switch (Mode)
+	{
+	case 0:
+		return color;
+	case 1:
+		return luma(color).xxx;
+	default:
+		break;
+	}
+
+	int iterations = 0;
+	while (luma(color) > 0.5 && iterations < 4)
+	{
+		color *= 0.9;
+		iterations++;
+	}
+
+	return lerp(color, color * Tint, saturate(Strength));
+}
+
+void VS(uint id : SV_VertexID, out float4 pos : SV_Position, out float2 uv : TEXCOORD)
+{
+	uv.x = (id == 2) ? 2.0 : 0.0;
+	uv.y = (id == 1) ? 2.0 : 0.0;
+	pos = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+float4 PS_Horizontal(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target
+{
+	const Sample s = blur(ColorSampler, uv, float2(1.0 / 64.0, 0.0));
+	return s.color / s.weight;
+}
+float4 PS_Vertical(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target
+{
+	const Sample s = blur(IntermediateSampler, uv, float2(0.0, 1.0 / 32.0));
+	float4 color = s.color / s.weight;
+	if (color.a < 0.01)
+		discard;
+	return float4(apply_mode(color.rgb), 1.0);
+}
+
+technique Blur
+{
+	pass { VertexShader = VS; PixelShader = PS_Horizontal; RenderTarget = Intermediate; }
+	pass { VertexShader = VS; PixelShader = PS_Vertical; }
+}
@@ -0,0 +1,34 @@
+uniform float UsedByA < ui_type = "slider"; > = 1.0;
+uniform float UsedByB = 2.0;
+uniform float Unused = 3.0;
+
+texture TexA { Width = 64; Height = 64; };
+texture TexB { Width = 32; Height = 32; Format = RGBA16F; };
+texture TexUnused { Width = 16; Height = 16; };
+sampler SampA { Texture = TexA; };
+sampler SampB { Texture = TexB; };
+sampler SampUnused { Texture = TexUnused; };
+
+struct OnlyB { float4 value; };
+
+static const float SharedConstant = 0.5;
+
+float3 shared_helper(float3 c) { return c * SharedConstant; }
+float4 helper_a(float2 uv) { return tex2D(SampA, uv) * UsedByA; }
+OnlyB helper_b(float2 uv) { OnlyB r; r.value = tex2D(SampB, uv) * UsedByB; return r; }
+float4 unused_helper() { return Unused; }
+
+void VS(uint id : SV_VertexID, out float4 pos : SV_Position, out float2 uv : TEXCOORD)
+{
+	uv.x = (id == 2) ? 2.0 : 0.0;
+	uv.y = (id == 1) ? 2.0 : 0.0;
+	pos = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+float4 PS_A(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target { return float4(shared_helper(helper_a(uv).rgb), 1.0); }
+float4 PS_B(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target { return float4(shared_helper(helper_b(uv).value.rgb), 1.0); }
+
+technique T
+{
+	pass { VertexShader = VS; PixelShader = PS_A; RenderTarget = TexB; }
+	pass { VertexShader = VS; PixelShader = PS_B; }
+}
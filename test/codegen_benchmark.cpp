@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <new>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace reshadefx;
+
+// Count all heap allocations, so that the number of allocations code generation makes can be reported
+static size_t s_num_allocations = 0;
+static size_t s_allocated_bytes = 0;
+
+void *operator new(size_t size)
+{
+	s_num_allocations++;
+	s_allocated_bytes += size;
+
+	if (void *const ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+struct codegen_mode
+{
+	const char *name;
+	codegen *(*create)();
+};
+
+static const codegen_mode s_modes[] = {
+	{ "GLSL", []() { return create_codegen_glsl(false, false); } },
+	{ "HLSL SM3", []() { return create_codegen_hlsl(30, false, false); } },
+	{ "HLSL SM5", []() { return create_codegen_hlsl(50, false, false); } },
+#ifdef RESHADEFX_TEST_SPIRV
+	{ "SPIR-V", []() { return create_codegen_spirv(true, false, false); } },
+#endif
+};
+
+// Generates an effect with the specified number of distinct literals, spread over scalar, vector and array constants like in large lookup tables
+static std::string generate_literals(size_t num_literals)
+{
+	std::string source;
+
+	for (size_t index = 0; index < num_literals / 8; ++index)
+	{
+		const std::string i = std::to_string(index);
+		const std::string a = std::to_string(index * 8);
+
+		source += "static const float4 C" + i + "[2] = { float4(" + a + ".125, " + a + ".25, " + a + ".375, " + a + ".5), float4(" + a + ".625, " + a + ".75, " + a + ".875, " + std::to_string(index * 8 + 1) + ".0) };\n";
+		source += "float4 F" + i + "(float4 x) { return x * C" + i + "[0] + C" + i + "[1] + float4(1.0, 0.5, 0.25, 0.0); }\n";
+	}
+
+	return source;
+}
+
+// Returns the time in seconds the fastest of a few runs took to parse and generate code for the source
+static double measure(const std::string &source, const codegen_mode &mode)
+{
+	double best_seconds = 0.0;
+	for (int run = 0; run < 3; ++run)
+	{
+		std::unique_ptr<codegen> codegen(mode.create());
+
+		parser parser;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		const bool success = parser.parse(source, codegen.get());
+		module module;
+		codegen->write_result(module);
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (!success)
+		{
+			std::printf("failed to parse:\n%s\n", parser.errors().c_str());
+			std::exit(1);
+		}
+
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+
+	return best_seconds;
+}
+
+struct codegen_statistics
+{
+	double seconds = 0.0;
+	size_t output_size = 0;
+	size_t num_allocations = 0;
+	size_t allocated_bytes = 0;
+};
+
+// Parses and generates code for all the preprocessed effects, returning the fastest of a few runs
+static codegen_statistics generate(const std::vector<std::string> &sources, const codegen_mode &mode, int num_runs)
+{
+	codegen_statistics best;
+	for (int run = 0; run < num_runs; ++run)
+	{
+		codegen_statistics stats;
+
+		for (const std::string &source : sources)
+		{
+			const size_t num_allocations_before = s_num_allocations;
+			const size_t allocated_bytes_before = s_allocated_bytes;
+			const auto start = std::chrono::high_resolution_clock::now();
+
+			std::unique_ptr<codegen> codegen(mode.create());
+
+			parser parser;
+			parser.parse(source, codegen.get());
+
+			module module;
+			codegen->write_result(module);
+
+			stats.seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			stats.num_allocations += s_num_allocations - num_allocations_before;
+			stats.allocated_bytes += s_allocated_bytes - allocated_bytes_before;
+			stats.output_size += module.hlsl.size() + module.spirv.size() * sizeof(uint32_t);
+		}
+
+		if (run == 0 || stats.seconds < best.seconds)
+			best = stats;
+	}
+
+	return best;
+}
+
+static int benchmark_literals()
+{
+	std::printf("backend   literals     ms  us/literal\n");
+
+	for (const codegen_mode &mode : s_modes)
+	{
+		for (size_t num_literals = 8000; num_literals <= 64000; num_literals *= 2)
+		{
+			const double milliseconds = measure(generate_literals(num_literals), mode) * 1000.0;
+
+			std::printf("%-8s  %8zu  %5.0f  %10.2f\n", mode.name, num_literals, milliseconds, milliseconds * 1000.0 / num_literals);
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::printf("usage: %s <effect directory> [number of runs]\n", argv[0]);
+		std::printf("       %s --literals\n\n", argv[0]);
+		std::printf("Preprocesses every effect in the directory once, then parses and generates code for all of them with each back-end and reports the amount of generated code per second and the heap allocations made.\n");
+		std::printf("With --literals, generates effects with thousands of distinct literals instead and reports the time per literal, which should not grow with their number.\n");
+		return 1;
+	}
+
+	if (std::strcmp(argv[1], "--literals") == 0)
+		return benchmark_literals();
+
+	const std::filesystem::path effect_directory = std::filesystem::u8path(argv[1]);
+	const int num_runs = argc > 2 ? std::atoi(argv[2]) : 3;
+
+	std::vector<std::filesystem::path> effect_files;
+	std::vector<std::filesystem::path> include_paths;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(effect_directory))
+	{
+		if (entry.is_directory())
+			include_paths.push_back(entry.path());
+		else if (entry.path().extension() == ".fx")
+			effect_files.push_back(entry.path());
+	}
+	include_paths.insert(include_paths.begin(), effect_directory);
+
+	// Preprocessing is not part of the measurement, so do it only once up front
+	std::vector<std::string> sources;
+	size_t input_size = 0;
+	for (const std::filesystem::path &path : effect_files)
+	{
+		preprocessor pp;
+		pp.add_macro_definition("BUFFER_WIDTH", "1920");
+		pp.add_macro_definition("BUFFER_HEIGHT", "1080");
+		pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+		pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+		for (const std::filesystem::path &include_path : include_paths)
+			pp.add_include_path(include_path);
+
+		if (!pp.append_file(path))
+			continue;
+
+		input_size += pp.output().size();
+		sources.push_back(std::move(pp.output()));
+	}
+
+	if (sources.empty())
+	{
+		std::printf("no effect files found\n");
+		return 1;
+	}
+
+	std::printf("%zu effects, %.2f MB of preprocessed input\n\n", sources.size(), input_size / (1024.0 * 1024.0));
+	std::printf("backend     ms  output MB  output MB/s  allocations/effect  allocated MB\n");
+
+	for (const codegen_mode &mode : s_modes)
+	{
+		const codegen_statistics stats = generate(sources, mode, num_runs);
+
+		std::printf("%-8s  %5.0f  %9.2f  %11.1f  %18zu  %12.1f\n", mode.name, stats.seconds * 1000.0,
+			stats.output_size / (1024.0 * 1024.0), stats.output_size / (1024.0 * 1024.0) / stats.seconds,
+			stats.num_allocations / sources.size(), stats.allocated_bytes / (1024.0 * 1024.0));
+	}
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <memory>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace reshadefx;
+
+struct codegen_mode
+{
+	const char *name;
+	codegen *(*create)();
+};
+
+static const codegen_mode s_modes[] = {
+	{ "GLSL", []() { return create_codegen_glsl(false, false, true); } },
+	{ "HLSL SM3", []() { return create_codegen_hlsl(30, false, false, true); } },
+	{ "HLSL SM5", []() { return create_codegen_hlsl(50, false, false, true); } },
+};
+
+struct entry_point_expectation
+{
+	const char *name;
+	std::vector<const char *> reachable;
+	std::vector<const char *> unreachable;
+};
+
+// Names are matched as substrings of the generated identifiers, since every code generator decorates them differently
+static const entry_point_expectation s_expectations[] = {
+	{ "VS", {}, { "UsedByA", "UsedByB", "Unused", "TexA", "TexB", "TexUnused", "SampA", "SampB", "SampUnused", "OnlyB", "shared_helper", "helper_a", "helper_b", "unused_helper" } },
+	{ "PS_A", { "UsedByA", "SampA", "shared_helper", "helper_a" }, { "UsedByB", "Unused", "TexB", "TexUnused", "SampB", "SampUnused", "OnlyB", "helper_b", "unused_helper", "PS_B" } },
+	{ "PS_B", { "UsedByB", "SampB", "OnlyB", "shared_helper", "helper_b" }, { "UsedByA", "Unused", "TexA", "TexUnused", "SampA", "SampUnused", "helper_a", "unused_helper", "PS_A" } },
+};
+
+static bool is_identifier_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Returns the line each identifier in the source first appears on
+static std::unordered_map<std::string, std::string> first_occurrences(const std::string &source)
+{
+	std::unordered_map<std::string, std::string> result;
+	for (size_t line_begin = 0; line_begin < source.size();)
+	{
+		size_t line_end = source.find('\n', line_begin);
+		if (line_end == std::string::npos)
+			line_end = source.size();
+		const std::string line = source.substr(line_begin, line_end - line_begin);
+
+		for (size_t i = 0; i < line.size();)
+		{
+			if (!is_identifier_char(line[i]))
+			{
+				++i;
+				continue;
+			}
+
+			size_t end = i;
+			while (end < line.size() && is_identifier_char(line[end]))
+				++end;
+			// Skip over numbers as a whole, so that suffixes are not mistaken for identifiers
+			if (line[i] < '0' || line[i] > '9')
+				result.emplace(line.substr(i, end - i), line);
+			i = end;
+		}
+
+		line_begin = line_end + 1;
+	}
+	return result;
+}
+
+// Global names are decorated by the code generators (functions, variables and structures) or are internal ("__" prefix), with the exception of uniforms
+static bool is_global_name(const std::string &name, const std::unordered_set<std::string> &uniform_names)
+{
+	return name.compare(0, 2, "F_") == 0 || name.compare(0, 2, "V_") == 0 || name.compare(0, 2, "S_") == 0 || name.compare(0, 2, "__") == 0 || uniform_names.count(name) != 0;
+}
+
+int main()
+{
+	for (const codegen_mode &mode : s_modes)
+	{
+		preprocessor pp;
+		pp.add_macro_definition("BUFFER_WIDTH", "800");
+		pp.add_macro_definition("BUFFER_HEIGHT", "600");
+		CHECK(pp.append_file("codegen/trim.fx"));
+
+		std::unique_ptr<codegen> codegen(mode.create());
+
+		parser parser;
+		CHECK(parser.parse(pp.output(), codegen.get()));
+
+		module module;
+		codegen->write_result(module);
+
+		std::unordered_set<std::string> uniform_names;
+		for (const uniform_info &uniform : module.uniforms)
+			uniform_names.insert(uniform.name);
+
+		const std::unordered_map<std::string, std::string> full_declarations = first_occurrences(module.hlsl);
+
+		size_t num_entry_points = 0;
+		for (const entry_point_expectation &expected : s_expectations)
+		{
+			// The code generators decorate entry point names, so compare only the end of them
+			const auto entry_point = std::find_if(module.entry_points.begin(), module.entry_points.end(),
+				[&expected](const reshadefx::entry_point &candidate) {
+					const size_t length = std::strlen(expected.name);
+					return candidate.name.size() >= length && candidate.name.compare(candidate.name.size() - length, length, expected.name) == 0;
+				});
+			if (entry_point == module.entry_points.end())
+			{
+				std::fprintf(stderr, "%s: entry point %s is missing\n", mode.name, expected.name);
+				test_failures()++;
+				continue;
+			}
+
+			num_entry_points++;
+
+			const std::string &source = entry_point->hlsl;
+			CHECK(!source.empty());
+
+			for (const char *name : expected.reachable)
+			{
+				if (source.find(name) == std::string::npos)
+				{
+					std::fprintf(stderr, "%s: %s is reachable from %s, but missing from its source:\n%s\n", mode.name, name, expected.name, source.c_str());
+					test_failures()++;
+				}
+			}
+			for (const char *name : expected.unreachable)
+			{
+				if (source.find(name) != std::string::npos)
+				{
+					std::fprintf(stderr, "%s: %s is not reachable from %s, but in its source:\n%s\n", mode.name, name, expected.name, source.c_str());
+					test_failures()++;
+				}
+			}
+
+			// The source has to compile on its own, so every global it uses has to be declared in it as well
+			// The first line a global appears on in the full module code is its declaration, which therefore has to be the first line it appears on in the trimmed source too
+			for (const auto &[name, line] : first_occurrences(source))
+			{
+				if (!is_global_name(name, uniform_names))
+					continue;
+
+				if (const auto it = full_declarations.find(name); it == full_declarations.end() || it->second != line)
+				{
+					std::fprintf(stderr, "%s: %s is used in %s without being declared first:\n%s\n", mode.name, name.c_str(), expected.name, source.c_str());
+					test_failures()++;
+				}
+			}
+		}
+
+		CHECK(num_entry_points == std::size(s_expectations));
+	}
+
+	return test_result();
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_cache.hpp"
+#include "effect_preprocessor.hpp"
+#include <chrono>
+#include <fstream>
+
+using reshadefx::effect_cache;
+
+static void write_file(const std::filesystem::path &path, const std::string &data)
+{
+	std::filesystem::create_directories(path.parent_path());
+	std::ofstream(path, std::ios::binary) << data;
+}
+
+static std::vector<std::filesystem::path> list_files(const std::filesystem::path &directory)
+{
+	std::vector<std::filesystem::path> files;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory))
+		files.push_back(entry.path());
+	return files;
+}
+
+static void test_key()
+{
+	// Keys are stored on disk, so they have to be the same in every run and on every platform
+	CHECK(effect_cache::key().value() == 14695981039346656037ull);
+	CHECK(effect_cache::key().add("a", 1).value() == 0xaf63dc4c8601ec8cull);
+	CHECK(effect_cache::key().add(uint64_t(0x0102030405060708)).value() == effect_cache::key().add("\x08\x07\x06\x05\x04\x03\x02\x01", 8).value());
+	CHECK(effect_cache::key().add("effect").add(uint64_t(42)).value() == effect_cache::key().add("effect").add(uint64_t(42)).value());
+
+	// Different inputs and different splits of the same input have to result in different keys
+	CHECK(effect_cache::key().add("effect").value() != effect_cache::key().add("effecT").value());
+	CHECK(effect_cache::key().add("ab").add("c").value() != effect_cache::key().add("a").add("bc").value());
+	CHECK(effect_cache::key().add("").value() != effect_cache::key().value());
+}
+
+static void test_round_trip(const std::filesystem::path &root)
+{
+	effect_cache cache(root, 1024 * 1024);
+
+	std::string data;
+	CHECK(!cache.load(1, data));
+	CHECK(cache.misses() == 1);
+
+	const std::string binary_data("\0\x01\xFF\r\n\0data", 10);
+	CHECK(cache.store(1, binary_data));
+	CHECK(cache.load(1, data) && data == binary_data);
+	CHECK(cache.hits() == 1);
+
+	// Storing again replaces the entry
+	CHECK(cache.store(1, "replaced"));
+	CHECK(cache.load(1, data) && data == "replaced");
+	CHECK(cache.store(2, std::string_view()));
+	CHECK(cache.load(2, data) && data.empty());
+
+	// Another instance (e.g. the next run) reads the same entries, and no temporary files are left behind
+	effect_cache other_cache(root, 1024 * 1024);
+	CHECK(other_cache.load(1, data) && data == "replaced");
+	for (const std::filesystem::path &file : list_files(root))
+		CHECK(file.extension() == ".cache");
+	CHECK(list_files(root).size() == 2);
+
+	// A damaged entry is rejected and removed
+	const std::filesystem::path entry_path = list_files(root)[0];
+	{
+		std::fstream file(entry_path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-1, std::ios::end);
+		file.put('X');
+	}
+	CHECK(!cache.load(1, data) || !cache.load(2, data));
+	CHECK(list_files(root).size() == 1);
+
+	std::filesystem::remove_all(root);
+}
+
+static void test_eviction(const std::filesystem::path &root)
+{
+	const std::string entry_data(100, 'x');
+	const uint64_t entry_size = 32 + entry_data.size();
+
+	effect_cache cache(root, entry_size * 3 + 4);
+	CHECK(cache.store(1, entry_data));
+	CHECK(cache.store(2, entry_data));
+	CHECK(cache.store(3, entry_data));
+	CHECK(list_files(root).size() == 3);
+
+	// Age the entries explicitly, so that the order does not depend on the resolution of file times
+	const auto now = std::filesystem::file_time_type::clock::now();
+	for (const std::filesystem::path &file : list_files(root))
+	{
+		const int age = file.stem() == "0000000000000001" ? 3 : file.stem() == "0000000000000002" ? 2 : 1;
+		std::filesystem::last_write_time(file, now - std::chrono::hours(age));
+	}
+
+	// Loading an entry marks it as recently used, so the next least recently used ones are evicted instead
+	std::string data;
+	CHECK(cache.load(1, data));
+	CHECK(cache.store(4, entry_data));
+
+	CHECK(list_files(root).size() == 2);
+	CHECK(cache.load(1, data) && data == entry_data);
+	CHECK(!cache.load(2, data));
+	CHECK(!cache.load(3, data));
+	CHECK(cache.load(4, data) && data == entry_data);
+
+	std::filesystem::remove_all(root);
+}
+
+static void test_missing_include(const std::filesystem::path &root)
+{
+	write_file(root / "effect" / "main.fx", "#include \"header.fxh\"\n");
+	write_file(root / "effect" / "second" / "header.fxh", "second\n");
+
+	effect_cache cache(root / "cache", 1024 * 1024);
+
+	// Identify the entry by the pre-processed source code like the runtime does
+	const auto source_key = [&root]() {
+		reshadefx::preprocessor pp;
+		pp.add_include_path(root / "effect" / "first");
+		pp.add_include_path(root / "effect" / "second");
+		CHECK(pp.append_file(root / "effect" / "main.fx"));
+		return effect_cache::key().add(pp.output()).add(pp.errors()).value();
+	};
+
+	const uint64_t key = source_key();
+	CHECK(cache.store(key, "second"));
+
+	std::string data;
+	CHECK(source_key() == key);
+	CHECK(cache.load(source_key(), data) && data == "second");
+
+	// A header appearing earlier on the search path takes precedence, so the entry compiled with the other one must not be used anymore
+	write_file(root / "effect" / "first" / "header.fxh", "first\n");
+	CHECK(source_key() != key);
+	CHECK(!cache.load(source_key(), data));
+
+	std::filesystem::remove_all(root);
+}
+
+int main()
+{
+	const std::filesystem::path root = std::filesystem::temp_directory_path() / "reshadefx_effect_cache_test";
+	std::filesystem::remove_all(root);
+
+	test_key();
+	test_round_trip(root);
+	test_eviction(root);
+	test_missing_include(root);
+
+	return test_result();
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_lexer.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+using namespace reshadefx;
+
+static void append_file(const std::filesystem::path &path, std::string &corpus)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::stringstream data;
+	data << file.rdbuf();
+	corpus += data.str();
+	corpus += '\n';
+}
+
+struct measurement
+{
+	double megabytes_per_second;
+	double megatokens_per_second;
+};
+
+static measurement measure(const std::string &corpus, bool preprocessor_mode, bool copy_tokens = false)
+{
+	// Same options as the preprocessor and parser use
+	const auto input = std::make_shared<const std::string>(corpus);
+
+	// Tokens used to own a copy of their text and of the path of their source file, so copying both gives the cost of the old token representation for comparison
+	const std::string source_path = "C:\\Program Files\\Game\\reshade-shaders\\Shaders\\Effect.fx";
+	size_t copied_size = 0;
+
+	size_t num_tokens = 0;
+	double best_seconds = 0.0;
+	for (int run = 0; run < 5; ++run)
+	{
+		lexer lexer = preprocessor_mode ?
+			reshadefx::lexer(input, true, false, false, false, true, false) :
+			reshadefx::lexer(input, true, true, true, false, false, true);
+
+		num_tokens = 0;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		if (copy_tokens)
+		{
+			for (token tok; (tok = lexer.lex()).id != tokenid::end_of_file; ++num_tokens)
+			{
+				const std::string literal(tok.literal_as_string);
+				const std::string source(source_path);
+				copied_size += literal.size() + source.size();
+			}
+		}
+		else
+		{
+			while (lexer.lex().id != tokenid::end_of_file)
+				++num_tokens;
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+
+	// Use the copies, so that they cannot be optimized away
+	if (copied_size == 1)
+		std::printf(" ");
+
+	return { corpus.size() / (1024.0 * 1024.0) / best_seconds, num_tokens / 1000000.0 / best_seconds };
+}
+
+// Reduce the shaders to just the identifiers and keywords in them, to measure keyword classification in isolation
+static std::string extract_words(const std::string &corpus, std::unordered_map<std::string, tokenid> &keywords)
+{
+	std::string words;
+
+	lexer lexer(corpus);
+	for (token tok; (tok = lexer.lex()).id != tokenid::end_of_file;)
+	{
+		const char first = corpus[tok.offset];
+		if (!(first == '_' || (first >= 'a' && first <= 'z') || (first >= 'A' && first <= 'Z')))
+			continue;
+
+		const std::string word = corpus.substr(tok.offset, tok.length);
+		if (tok.id != tokenid::identifier)
+			keywords.emplace(word, tok.id);
+
+		words += word;
+		words += (words.size() % 64) < 8 ? '\n' : ' ';
+	}
+
+	return words;
+}
+
+static double measure_classification(const std::string &words, bool classify_keywords, const std::unordered_map<std::string, tokenid> *keyword_map = nullptr)
+{
+	const auto input = std::make_shared<const std::string>(words);
+
+	size_t num_words = 0;
+	size_t num_keywords = 0;
+	double best_seconds = 0.0;
+	for (int run = 0; run < 5; ++run)
+	{
+		lexer lexer(input, true, true, true, false, !classify_keywords, true);
+
+		num_words = 0;
+		num_keywords = 0;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (token tok; (tok = lexer.lex()).id != tokenid::end_of_file; ++num_words)
+		{
+			// This is how keywords used to be looked up, by hashing a string built from every identifier
+			if (keyword_map != nullptr && keyword_map->find(std::string(tok.literal_as_string)) != keyword_map->end())
+				num_keywords++;
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+
+	// Use the result, so that the lookups cannot be optimized away
+	if (num_keywords == 1)
+		std::printf(" ");
+
+	return best_seconds * 1e9 / num_words;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::printf("usage: %s [--tokens] <shader file or directory>...\n\n", argv[0]);
+		std::printf("  --tokens    Report tokens per second instead of bytes per second, both for the tokens referencing the input and when copying their text like they used to.\n");
+		std::printf("  --keywords  Report the time it takes to classify identifiers as keywords, on just the identifiers and keywords from the shaders.\n");
+		return 1;
+	}
+
+	bool token_rate = false;
+	bool keyword_classification = false;
+
+	std::string corpus;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--tokens") == 0)
+		{
+			token_rate = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--keywords") == 0)
+		{
+			keyword_classification = true;
+			continue;
+		}
+
+		const std::filesystem::path path = std::filesystem::u8path(argv[i]);
+		if (std::filesystem::is_directory(path))
+		{
+			for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(path))
+				if (entry.is_regular_file() && (entry.path().extension() == ".fx" || entry.path().extension() == ".fxh"))
+					append_file(entry.path(), corpus);
+		}
+		else
+		{
+			append_file(path, corpus);
+		}
+	}
+
+	if (corpus.size() <= 1)
+	{
+		std::printf("no shader files found\n");
+		return 1;
+	}
+
+	if (keyword_classification)
+	{
+		std::unordered_map<std::string, tokenid> keywords;
+		std::string words = extract_words(corpus, keywords);
+
+		const size_t words_size = words.size();
+		while (words.size() < 16 * 1024 * 1024)
+			words.append(words, 0, words_size);
+
+		std::printf("corpus: %.1f MB of identifiers and keywords (%zu distinct keywords)\n\n", words.size() / (1024.0 * 1024.0), keywords.size());
+
+		const double without_classification = measure_classification(words, false);
+		const double with_classification = measure_classification(words, true);
+		const double with_string_lookup = measure_classification(words, false, &keywords);
+
+		std::printf("lexing without classification     %6.2f ns/identifier\n", without_classification);
+		std::printf("lexing with keyword tables        %6.2f ns/identifier (%+.2f ns)\n", with_classification, with_classification - without_classification);
+		std::printf("lexing with std::string hash map  %6.2f ns/identifier (%+.2f ns)\n", with_string_lookup, with_string_lookup - without_classification);
+		return 0;
+	}
+
+	// Repeat the shaders until the corpus is large enough to get stable timings
+	const size_t shader_size = corpus.size();
+	while (corpus.size() < 16 * 1024 * 1024)
+		corpus.append(corpus, 0, shader_size);
+
+	std::printf("corpus: %.1f MB (%.1f MB of unique shader code)\n\n", corpus.size() / (1024.0 * 1024.0), shader_size / (1024.0 * 1024.0));
+	const lexer::scan_kernel_set supported = lexer::supported_scan_kernels();
+	const char *const names[] = { "scalar", "SSE2", "AVX2" };
+
+	if (token_rate)
+	{
+		std::printf("kernels  preprocessor Mtok/s  (copying)  parser Mtok/s  (copying)\n");
+
+		for (int kernels = 0; kernels <= static_cast<int>(supported); ++kernels)
+		{
+			lexer::select_scan_kernels(static_cast<lexer::scan_kernel_set>(kernels));
+			const measurement preprocessor_speed = measure(corpus, true);
+			const measurement preprocessor_copy_speed = measure(corpus, true, true);
+			const measurement parser_speed = measure(corpus, false);
+			const measurement parser_copy_speed = measure(corpus, false, true);
+			std::printf("%-7s  %19.1f  %9.1f  %13.1f  %9.1f\n", names[kernels],
+				preprocessor_speed.megatokens_per_second, preprocessor_copy_speed.megatokens_per_second,
+				parser_speed.megatokens_per_second, parser_copy_speed.megatokens_per_second);
+		}
+	}
+	else
+	{
+		std::printf("kernels  preprocessor MB/s  parser MB/s\n");
+
+		for (int kernels = 0; kernels <= static_cast<int>(supported); ++kernels)
+		{
+			lexer::select_scan_kernels(static_cast<lexer::scan_kernel_set>(kernels));
+			const measurement preprocessor_speed = measure(corpus, true);
+			const measurement parser_speed = measure(corpus, false);
+			std::printf("%-7s  %17.0f  %11.0f\n", names[kernels], preprocessor_speed.megabytes_per_second, parser_speed.megabytes_per_second);
+		}
+	}
+
+	lexer::select_scan_kernels(supported);
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_lexer.hpp"
+#include <random>
+
+using namespace reshadefx;
+
+struct lexer_mode
+{
+	const char *name;
+	bool ignore_comments;
+	bool ignore_whitespace;
+	bool ignore_pp_directives;
+	bool ignore_keywords;
+	bool escape_string_literals;
+	// Call 'skip_to_next_line' after every other token, like the preprocessor does for skipped lines
+	bool skip_lines;
+};
+
+static const lexer_mode s_modes[] = {
+	{ "parser", true, true, true, false, true, false },
+	{ "preprocessor", true, false, false, true, false, false },
+	{ "comments", false, false, false, false, false, false },
+	{ "skip lines", true, false, false, true, false, true },
+};
+
+static const char *const s_kernel_set_names[] = { "scalar", "SSE2", "AVX2" };
+
+static std::string lex_all(const std::string &input, const lexer_mode &mode)
+{
+	lexer lexer(input, mode.ignore_comments, mode.ignore_whitespace, mode.ignore_pp_directives, false, mode.ignore_keywords, mode.escape_string_literals);
+
+	// Serialize everything the kernels could affect, so that the streams can be compared as a whole
+	std::string result;
+	for (size_t index = 0; index < 1000000; ++index)
+	{
+		const token tok = lexer.lex();
+		result += std::to_string(static_cast<int>(tok.id)) + ' ' +
+			std::to_string(tok.location.line) + ':' + std::to_string(tok.location.column) + ' ' +
+			std::to_string(tok.offset) + '+' + std::to_string(tok.length) + ' ' +
+			std::string(tok.literal_as_string) + '\n';
+		if (tok.id == tokenid::end_of_file)
+			break;
+		if (mode.skip_lines && (index % 2) != 0)
+			lexer.skip_to_next_line();
+	}
+	return result;
+}
+
+static std::string generate_input(std::mt19937 &rng)
+{
+	// Fragments covering the runs the kernels skip over, with lengths spanning multiple 16 and 32 byte blocks
+	static const char *const fragments[] = {
+		"//", "/*", "*/", "*", "/", "**/", "\n", "\r\n", "\\\n", "#define X 1\n", "#line 10 \"file.fx\"\n", "#include \"a.fxh\"\n",
+		"\"string literal\"", "1.5f", "0x1F", "42", "+=", "(", ")", "{", "}", ";", ".", "float4", "technique", "\xC3\xA4", "\xFF",
+	};
+	static const char whitespace[] = { ' ', '\t', '\v', '\f', '\r', '\n' };
+	static const char identifier[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
+	std::string input;
+	const size_t num_parts = std::uniform_int_distribution<size_t>(1, 200)(rng);
+	for (size_t part = 0; part < num_parts; ++part)
+	{
+		const size_t length = std::uniform_int_distribution<size_t>(1, 70)(rng);
+		switch (std::uniform_int_distribution<int>(0, 4)(rng))
+		{
+		case 0:
+			for (size_t i = 0; i < length; ++i)
+				input += whitespace[std::uniform_int_distribution<size_t>(0, i % 3 == 0 ? 5 : 1)(rng)];
+			break;
+		case 1:
+			input += identifier[std::uniform_int_distribution<size_t>(0, 52)(rng)];
+			for (size_t i = 1; i < length; ++i)
+				input += identifier[std::uniform_int_distribution<size_t>(0, sizeof(identifier) - 2)(rng)];
+			break;
+		case 2:
+			input += "//";
+			for (size_t i = 0; i < length; ++i)
+				input += i % 13 == 12 ? '*' : 'c';
+			if (part % 2 == 0)
+				input += '\n';
+			break;
+		case 3:
+			input += "/*";
+			for (size_t i = 0; i < length; ++i)
+				input += i % 7 == 6 ? '\n' : i % 5 == 4 ? '*' : 'c';
+			if (part % 4 != 3) // Leave some comments unterminated
+				input += "*/";
+			break;
+		case 4:
+			input += fragments[std::uniform_int_distribution<size_t>(0, std::size(fragments) - 1)(rng)];
+			break;
+		}
+	}
+	return input;
+}
+
+int main()
+{
+	const lexer::scan_kernel_set supported = lexer::supported_scan_kernels();
+	CHECK(lexer::active_scan_kernels() == supported);
+	if (supported == lexer::scan_kernel_set::scalar)
+		std::printf("No SIMD kernels are supported on this machine, only the scalar path is tested\n");
+
+	std::vector<std::string> inputs = {
+		"",
+		"uniform float4 Color < ui_type = \"color\"; > = float4(1.0, 0.5, 0.0, 1.0); // Comment\n"
+		"/* Multi-line\n   comment spanning\n   several lines */ texture2D BackBuffer : COLOR;\n"
+		"#define VERY_LONG_MACRO_NAME_THAT_SPANS_MORE_THAN_THIRTY_TWO_CHARACTERS(x) x\n"
+		"float4 PS_Main(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target { return tex2D(BackBufferSampler, uv) * Color; }\n"
+		"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t}\n",
+		std::string(100, ' ') + "x",
+		"/*" + std::string(100, '*') + "/",
+		"/*" + std::string(33, 'c') + "*",
+		"//" + std::string(64, 'c'),
+		std::string(100, 'a'),
+	};
+	std::mt19937 rng(1);
+	for (size_t i = 0; i < 2000; ++i)
+		inputs.push_back(generate_input(rng));
+
+	for (const lexer_mode &mode : s_modes)
+	{
+		for (const std::string &input : inputs)
+		{
+			CHECK(lexer::select_scan_kernels(lexer::scan_kernel_set::scalar));
+			const std::string expected = lex_all(input, mode);
+
+			for (int kernels = 1; kernels <= static_cast<int>(supported); ++kernels)
+			{
+				CHECK(lexer::select_scan_kernels(static_cast<lexer::scan_kernel_set>(kernels)));
+				if (lex_all(input, mode) != expected)
+				{
+					std::fprintf(stderr, "Token streams in %s mode differ between the scalar and %s kernels for input:\n%s\n", mode.name, s_kernel_set_names[kernels], input.c_str());
+					test_failures()++;
+				}
+			}
+		}
+	}
+
+	// Selecting an unsupported kernel set fails and keeps the current one
+	if (supported != lexer::scan_kernel_set::avx2)
+	{
+		CHECK(!lexer::select_scan_kernels(lexer::scan_kernel_set::avx2));
+		CHECK(lexer::active_scan_kernels() != lexer::scan_kernel_set::avx2);
+	}
+
+	lexer::select_scan_kernels(supported);
+
+	return test_result();
+}
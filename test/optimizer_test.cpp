@@ -0,0 +1,1287 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <map>
+#include <cmath>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <spirv.hpp>
+namespace spv {
+#include <GLSL.std.450.h>
+}
+
+static std::vector<uint32_t> compile(const std::filesystem::path &path, bool optimize = false)
+{
+	reshadefx::preprocessor pp;
+	CHECK(pp.append_file(path));
+
+	std::unique_ptr<reshadefx::codegen> codegen(reshadefx::create_codegen_spirv(true, false, false, false, optimize));
+
+	reshadefx::parser parser;
+	CHECK(parser.parse(pp.output(), codegen.get()));
+
+	reshadefx::module module;
+	codegen->write_result(module);
+	return module.spirv;
+}
+
+static float as_float(uint32_t word)
+{
+	float value;
+	std::memcpy(&value, &word, sizeof(value));
+	return value;
+}
+static uint32_t as_word(float value)
+{
+	uint32_t word;
+	std::memcpy(&word, &value, sizeof(word));
+	return word;
+}
+
+// Wrap operations on floats and signed integers so that they can be applied to the words of each component
+template <typename F>
+static auto float_op(F op)
+{
+	return [op](uint32_t a, uint32_t b, uint32_t c) { return as_word(op(as_float(a), as_float(b), as_float(c))); };
+}
+template <typename F>
+static auto float_test(F op)
+{
+	return [op](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(op(as_float(a), as_float(b))); };
+}
+template <typename F>
+static auto int_op(F op)
+{
+	return [op](uint32_t a, uint32_t b, uint32_t c) { return static_cast<uint32_t>(op(static_cast<int32_t>(a), static_cast<int32_t>(b), static_cast<int32_t>(c))); };
+}
+
+/// <summary>
+/// A minimal SPIR-V interpreter for the subset of instructions the SPIR-V code generation back-end emits, used to check that optimized modules are valid and compute the same results as unoptimized ones.
+/// Images are replaced with a smooth function of the coordinates, so that results only change a little if coordinates are computed slightly differently.
+/// </summary>
+class spirv_interpreter
+{
+	struct instruction
+	{
+		spv::Op op = spv::OpNop;
+		spv::Id type = 0;
+		spv::Id result = 0;
+		std::vector<uint32_t> operands;
+	};
+	struct basic_block
+	{
+		spv::Id label = 0;
+		std::vector<instruction> instructions;
+	};
+	struct function
+	{
+		std::vector<spv::Id> parameters;
+		std::vector<basic_block> blocks;
+		std::unordered_map<spv::Id, size_t> block_lookup;
+	};
+	struct frame
+	{
+		std::vector<std::vector<uint32_t>> values;
+		std::vector<bool> defined;
+	};
+
+public:
+	struct result
+	{
+		bool discarded = false;
+		std::string error;
+		// Values of all output variables, together with the kind of each of their words ('f' for floats, 'i' for integers, 'b' for booleans)
+		std::map<spv::Id, std::pair<std::string, std::vector<uint32_t>>> outputs;
+	};
+
+	/// <summary>
+	/// Decode a module and check its structure.
+	/// </summary>
+	/// <returns>A description of the first problem found, or an empty string if the module is valid.</returns>
+	std::string load(const std::vector<uint32_t> &spirv)
+	{
+		if (spirv.size() < 5 || spirv[0] != spv::MagicNumber || spirv[1] != 0x10300 || spirv[4] != 0)
+			return "invalid header";
+
+		const spv::Id bound = spirv[3];
+		_instructions.clear();
+		_functions.clear();
+		_defs.assign(bound, nullptr);
+		_constants.assign(bound, {});
+		_global_defined.assign(bound, false);
+
+		function *current_function = nullptr;
+		bool in_block = false;
+
+		// Every instruction takes up at least one word, so reserving that many keeps pointers to them valid
+		_instructions.reserve(spirv.size());
+
+		for (size_t offset = 5; offset < spirv.size();)
+		{
+			const uint32_t num_words = spirv[offset] >> spv::WordCountShift;
+			if (num_words == 0 || offset + num_words > spirv.size())
+				return "instruction at word " + std::to_string(offset) + " exceeds the module";
+
+			instruction &inst = _instructions.emplace_back();
+			inst.op = static_cast<spv::Op>(spirv[offset] & spv::OpCodeMask);
+
+			bool has_result, has_type;
+			describe(inst.op, has_result, has_type);
+			if (num_words < 1u + has_type + has_result)
+				return "instruction at word " + std::to_string(offset) + " is too short";
+
+			size_t word = offset + 1;
+			if (has_type)
+				inst.type = spirv[word++];
+			if (has_result)
+				inst.result = spirv[word++];
+			inst.operands.assign(spirv.begin() + word, spirv.begin() + offset + num_words);
+			offset += num_words;
+
+			const std::string location = "instruction " + std::to_string(inst.op) + " defining %" + std::to_string(inst.result);
+
+			if (has_result)
+			{
+				if (inst.result == 0 || inst.result >= bound)
+					return location + " has a result ID outside the bound";
+				if (_defs[inst.result] != nullptr)
+					return location + " redefines an existing ID";
+				_defs[inst.result] = &inst;
+			}
+			if (has_type && (inst.type >= bound || _defs[inst.type] == nullptr || !is_type(_defs[inst.type]->op)))
+				return location + " references a type that was not declared before";
+
+			if (current_function == nullptr)
+			{
+				if (inst.op == spv::OpFunction)
+				{
+					current_function = &_functions[inst.result];
+					continue;
+				}
+				if (!is_global(inst.op) && inst.op != spv::OpVariable)
+					return location + " is not allowed outside a function";
+
+				if (!evaluate_global(inst))
+					return location + " is not a valid constant";
+				continue;
+			}
+
+			if (inst.op == spv::OpFunctionEnd)
+			{
+				if (in_block || current_function->blocks.empty())
+					return "function ends without a terminator or body";
+				current_function = nullptr;
+				continue;
+			}
+			if (inst.op == spv::OpFunctionParameter)
+			{
+				if (!current_function->blocks.empty())
+					return location + " follows the first block of its function";
+				current_function->parameters.push_back(inst.result);
+				continue;
+			}
+			if (inst.op == spv::OpLabel)
+			{
+				if (in_block)
+					return location + " starts a block before the previous one was terminated";
+				current_function->block_lookup[inst.result] = current_function->blocks.size();
+				current_function->blocks.push_back({ inst.result, {} });
+				in_block = true;
+				continue;
+			}
+
+			if (!in_block || is_global(inst.op))
+				return location + " is not allowed outside a block";
+
+			std::vector<instruction> &instructions = current_function->blocks.back().instructions;
+			if (inst.op == spv::OpPhi && !instructions.empty() && instructions.back().op != spv::OpPhi)
+				return location + " is a phi that does not come first in its block";
+			if (inst.op == spv::OpVariable && (current_function->blocks.size() != 1 || (!instructions.empty() && instructions.back().op != spv::OpVariable)))
+				return location + " is a variable that does not come first in the function";
+
+			instructions.push_back(inst);
+			in_block = !is_terminator(inst.op);
+		}
+
+		if (current_function != nullptr)
+			return "module ends inside a function";
+
+		// Check that control flow only goes to blocks in the same function and calls only go to functions
+		for (const auto &[id, func] : _functions)
+		{
+			for (const basic_block &block : func.blocks)
+			{
+				const instruction &terminator = block.instructions.back();
+				std::vector<spv::Id> targets;
+				if (terminator.op == spv::OpBranch)
+					targets = { terminator.operands[0] };
+				else if (terminator.op == spv::OpBranchConditional)
+					targets = { terminator.operands[1], terminator.operands[2] };
+				else if (terminator.op == spv::OpSwitch)
+					for (size_t k = 1; k < terminator.operands.size(); k += 2)
+						targets.push_back(terminator.operands[k]);
+
+				for (const instruction &inst : block.instructions)
+				{
+					if (inst.op == spv::OpPhi)
+						for (size_t k = 1; k < inst.operands.size(); k += 2)
+							targets.push_back(inst.operands[k]);
+					if (inst.op == spv::OpLoopMerge)
+						targets.insert(targets.end(), { inst.operands[0], inst.operands[1] });
+					if (inst.op == spv::OpSelectionMerge)
+						targets.push_back(inst.operands[0]);
+					if (inst.op == spv::OpFunctionCall && _functions.find(inst.operands[0]) == _functions.end())
+						return "call to %" + std::to_string(inst.operands[0]) + ", which is not a function";
+				}
+
+				for (const spv::Id target : targets)
+					if (func.block_lookup.find(target) == func.block_lookup.end())
+						return "branch from %" + std::to_string(block.label) + " to %" + std::to_string(target) + ", which is not a block in the same function";
+			}
+		}
+
+		for (const instruction &inst : _instructions)
+			if (inst.op == spv::OpEntryPoint && _functions.find(inst.operands[1]) == _functions.end())
+				return "entry point refers to %" + std::to_string(inst.operands[1]) + ", which is not a function";
+
+		return std::string();
+	}
+
+	std::vector<std::string> entry_points() const
+	{
+		std::vector<std::string> names;
+		for (const instruction &inst : _instructions)
+			if (inst.op == spv::OpEntryPoint)
+				names.push_back(reinterpret_cast<const char *>(&inst.operands[2]));
+		return names;
+	}
+
+	/// <summary>
+	/// Execute an entry point with input and uniform values derived from the specified seed.
+	/// </summary>
+	result run(const std::string &entry_point, unsigned int seed)
+	{
+		_result = result();
+		_memory.clear();
+		_steps = 0;
+
+		const instruction *entry_point_inst = nullptr;
+		for (const instruction &inst : _instructions)
+			if (inst.op == spv::OpEntryPoint && entry_point == reinterpret_cast<const char *>(&inst.operands[2]))
+				entry_point_inst = &inst;
+		if (entry_point_inst == nullptr)
+		{
+			fail("entry point " + entry_point + " not found");
+			return std::move(_result);
+		}
+
+		// Every run starts with freshly initialized global variables
+		for (const instruction &inst : _instructions)
+		{
+			if (inst.op != spv::OpVariable || _global_defined[inst.result] == false)
+				continue;
+
+			const std::string kinds = layout(_defs[inst.type]->operands[1]);
+			std::vector<uint32_t> &memory = _memory.emplace_back(kinds.size());
+
+			if (inst.operands.size() > 1)
+				memory = _constants[inst.operands[1]];
+
+			for (size_t k = 0; k < kinds.size(); ++k)
+			{
+				const unsigned int n = static_cast<unsigned int>(seed + k + inst.result);
+
+				switch (inst.operands[0])
+				{
+				case spv::StorageClassInput:
+					memory[k] = kinds[k] == 'f' ? as_word(0.1f + 0.8f * std::fmod(n * 0.37f + k * 0.23f, 1.0f)) : n % (kinds[k] == 'b' ? 2 : 4);
+					break;
+				case spv::StorageClassUniform:
+				case spv::StorageClassPushConstant:
+					memory[k] = kinds[k] == 'f' ? as_word(0.25f + 0.125f * ((seed + k) % 7)) : (seed + k) % (kinds[k] == 'b' ? 2 : 3);
+					break;
+				case spv::StorageClassUniformConstant:
+					memory[k] = inst.result; // Images and samplers are identified by their variable, which the optimizer keeps
+					break;
+				}
+			}
+
+			_constants[inst.result] = { static_cast<uint32_t>(_memory.size() - 1), 0 };
+		}
+
+		call(entry_point_inst->operands[1], {});
+
+		// The interface of an entry point follows its name, which is a null-terminated string padded to a multiple of four bytes
+		std::vector<spv::Id> outputs;
+		for (size_t k = 3 + std::strlen(reinterpret_cast<const char *>(&entry_point_inst->operands[2])) / 4; k < entry_point_inst->operands.size(); ++k)
+			if (_defs[entry_point_inst->operands[k]]->operands[0] == spv::StorageClassOutput)
+				outputs.push_back(entry_point_inst->operands[k]);
+
+		if (_result.error.empty() && !_result.discarded)
+			for (const spv::Id output : outputs)
+				_result.outputs[output] = { layout(_defs[_defs[output]->type]->operands[1]), _memory[_constants[output][0]] };
+
+		return std::move(_result);
+	}
+
+private:
+	static void describe(spv::Op op, bool &has_result, bool &has_type)
+	{
+		switch (op)
+		{
+		case spv::OpNop:
+		case spv::OpSource:
+		case spv::OpSourceExtension:
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpLine:
+		case spv::OpExtension:
+		case spv::OpMemoryModel:
+		case spv::OpEntryPoint:
+		case spv::OpExecutionMode:
+		case spv::OpCapability:
+		case spv::OpFunctionEnd:
+		case spv::OpStore:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpLoopMerge:
+		case spv::OpSelectionMerge:
+		case spv::OpBranch:
+		case spv::OpBranchConditional:
+		case spv::OpSwitch:
+		case spv::OpKill:
+		case spv::OpReturn:
+		case spv::OpReturnValue:
+		case spv::OpUnreachable:
+			has_result = has_type = false;
+			break;
+		case spv::OpString:
+		case spv::OpExtInstImport:
+		case spv::OpLabel:
+			has_result = true;
+			has_type = false;
+			break;
+		default:
+			has_result = true;
+			has_type = !is_type(op);
+			break;
+		}
+	}
+
+	static bool is_type(spv::Op op)
+	{
+		return op >= spv::OpTypeVoid && op <= spv::OpTypeForwardPointer;
+	}
+	static bool is_global(spv::Op op)
+	{
+		switch (op)
+		{
+		case spv::OpNop:
+		case spv::OpSource:
+		case spv::OpSourceExtension:
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpString:
+		case spv::OpLine:
+		case spv::OpExtension:
+		case spv::OpExtInstImport:
+		case spv::OpMemoryModel:
+		case spv::OpEntryPoint:
+		case spv::OpExecutionMode:
+		case spv::OpCapability:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpConstantTrue:
+		case spv::OpConstantFalse:
+		case spv::OpConstant:
+		case spv::OpConstantComposite:
+		case spv::OpConstantNull:
+		case spv::OpSpecConstantTrue:
+		case spv::OpSpecConstantFalse:
+		case spv::OpSpecConstant:
+		case spv::OpSpecConstantComposite:
+		case spv::OpUndef:
+			return true;
+		case spv::OpVariable:
+			return false; // Allowed both inside and outside functions, which is checked separately
+		default:
+			return is_type(op);
+		}
+	}
+	static bool is_terminator(spv::Op op)
+	{
+		return op == spv::OpBranch || op == spv::OpBranchConditional || op == spv::OpSwitch || op == spv::OpReturn || op == spv::OpReturnValue || op == spv::OpKill || op == spv::OpUnreachable;
+	}
+
+	bool evaluate_global(const instruction &inst)
+	{
+		switch (inst.op)
+		{
+		case spv::OpConstantTrue:
+		case spv::OpSpecConstantTrue:
+			_constants[inst.result] = { 1 };
+			break;
+		case spv::OpConstantFalse:
+		case spv::OpSpecConstantFalse:
+			_constants[inst.result] = { 0 };
+			break;
+		case spv::OpConstant:
+		case spv::OpSpecConstant:
+			_constants[inst.result] = inst.operands;
+			break;
+		case spv::OpConstantComposite:
+		case spv::OpSpecConstantComposite:
+			for (const spv::Id element : inst.operands)
+			{
+				if (element >= _global_defined.size() || !_global_defined[element])
+					return false;
+				_constants[inst.result].insert(_constants[inst.result].end(), _constants[element].begin(), _constants[element].end());
+			}
+			break;
+		case spv::OpConstantNull:
+		case spv::OpUndef:
+			_constants[inst.result].assign(layout(inst.type).size(), 0);
+			break;
+		case spv::OpVariable:
+			if (inst.operands[0] == spv::StorageClassFunction || (inst.operands.size() > 1 && !_global_defined[inst.operands[1]]))
+				return false;
+			break;
+		default:
+			return true;
+		}
+
+		_global_defined[inst.result] = true;
+		return true;
+	}
+
+	/// <summary>
+	/// Get the kind of each word of a value of the specified type when it is flattened into a list of scalars.
+	/// </summary>
+	std::string layout(spv::Id type) const
+	{
+		const instruction &inst = *_defs[type];
+		switch (inst.op)
+		{
+		case spv::OpTypeBool:
+			return "b";
+		case spv::OpTypeInt:
+			return "i";
+		case spv::OpTypeFloat:
+			return "f";
+		case spv::OpTypePointer:
+			return "pp"; // Memory slot and word offset
+		case spv::OpTypeImage:
+		case spv::OpTypeSampler:
+		case spv::OpTypeSampledImage:
+			return "h";
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeArray:
+		{
+			const uint32_t count = inst.op == spv::OpTypeArray ? _constants[inst.operands[1]][0] : inst.operands[1];
+			std::string result;
+			for (uint32_t i = 0; i < count; ++i)
+				result += layout(inst.operands[0]);
+			return result;
+		}
+		case spv::OpTypeStruct:
+		{
+			std::string result;
+			for (const spv::Id member : inst.operands)
+				result += layout(member);
+			return result;
+		}
+		default:
+			return std::string();
+		}
+	}
+
+	/// <summary>
+	/// Get the type and word offset of an element in a composite type.
+	/// </summary>
+	bool element(spv::Id &type, uint32_t index, uint32_t &offset) const
+	{
+		const instruction &inst = *_defs[type];
+		switch (inst.op)
+		{
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeArray:
+			if (index >= (inst.op == spv::OpTypeArray ? _constants[inst.operands[1]][0] : inst.operands[1]))
+				return false;
+			type = inst.operands[0];
+			offset += index * static_cast<uint32_t>(layout(type).size());
+			return true;
+		case spv::OpTypeStruct:
+			if (index >= inst.operands.size())
+				return false;
+			for (uint32_t i = 0; i < index; ++i)
+				offset += static_cast<uint32_t>(layout(inst.operands[i]).size());
+			type = inst.operands[index];
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	spv::Id type_of(spv::Id id) const
+	{
+		return id < _defs.size() && _defs[id] != nullptr ? _defs[id]->type : 0;
+	}
+
+	bool fail(const std::string &message)
+	{
+		if (_result.error.empty())
+			_result.error = message;
+		return false;
+	}
+
+	const std::vector<uint32_t> &value(const frame &frame, spv::Id id)
+	{
+		static const std::vector<uint32_t> empty;
+		if (id < frame.defined.size() && frame.defined[id])
+			return frame.values[id];
+		if (id < _global_defined.size() && _global_defined[id])
+			return _constants[id];
+		fail("%" + std::to_string(id) + " is used before it was defined");
+		return empty;
+	}
+
+	std::vector<uint32_t> call(spv::Id function_id, const std::vector<std::vector<uint32_t>> &arguments)
+	{
+		const function &func = _functions.at(function_id);
+		if (arguments.size() != func.parameters.size())
+		{
+			fail("wrong number of arguments in call to %" + std::to_string(function_id));
+			return std::vector<uint32_t>();
+		}
+
+		frame frame;
+		frame.values.resize(_defs.size());
+		frame.defined.resize(_defs.size());
+		for (size_t i = 0; i < arguments.size(); ++i)
+		{
+			frame.values[func.parameters[i]] = arguments[i];
+			frame.defined[func.parameters[i]] = true;
+		}
+
+		size_t block_index = 0;
+		spv::Id previous_label = 0;
+
+		while (_result.error.empty())
+		{
+			const basic_block &block = func.blocks[block_index];
+
+			// All phis of a block are evaluated at the same time with the values from the block that was left
+			std::vector<std::pair<spv::Id, std::vector<uint32_t>>> phis;
+			for (const instruction &inst : block.instructions)
+			{
+				if (inst.op != spv::OpPhi)
+					break;
+
+				bool found = false;
+				for (size_t k = 0; k + 1 < inst.operands.size() && !found; k += 2)
+					if ((found = inst.operands[k + 1] == previous_label))
+						phis.emplace_back(inst.result, value(frame, inst.operands[k]));
+				if (!found)
+				{
+					fail("phi %" + std::to_string(inst.result) + " has no value for predecessor %" + std::to_string(previous_label));
+					return std::vector<uint32_t>();
+				}
+			}
+			for (auto &[id, phi_value] : phis)
+			{
+				frame.values[id] = std::move(phi_value);
+				frame.defined[id] = true;
+			}
+
+			spv::Id target = 0;
+
+			for (const instruction &inst : block.instructions)
+			{
+				if (++_steps > 10000000)
+				{
+					fail("execution does not terminate");
+					return std::vector<uint32_t>();
+				}
+
+				switch (inst.op)
+				{
+				case spv::OpPhi:
+				case spv::OpLine:
+				case spv::OpNop:
+				case spv::OpLoopMerge:
+				case spv::OpSelectionMerge:
+					continue;
+				case spv::OpBranch:
+					target = inst.operands[0];
+					break;
+				case spv::OpBranchConditional:
+					target = value(frame, inst.operands[0])[0] ? inst.operands[1] : inst.operands[2];
+					break;
+				case spv::OpSwitch:
+				{
+					const uint32_t selector = value(frame, inst.operands[0])[0];
+					target = inst.operands[1];
+					for (size_t k = 2; k + 1 < inst.operands.size(); k += 2)
+						if (inst.operands[k] == selector)
+							target = inst.operands[k + 1];
+					break;
+				}
+				case spv::OpReturn:
+					return std::vector<uint32_t>();
+				case spv::OpReturnValue:
+					return value(frame, inst.operands[0]);
+				case spv::OpKill:
+					_result.discarded = true;
+					fail("discarded");
+					return std::vector<uint32_t>();
+				case spv::OpStore:
+					store(frame, inst);
+					continue;
+				default:
+					if (!execute(frame, inst))
+						return std::vector<uint32_t>();
+					frame.defined[inst.result] = true;
+					continue;
+				}
+				break;
+			}
+
+			if (!_result.error.empty())
+				break;
+
+			previous_label = block.label;
+			block_index = func.block_lookup.at(target);
+		}
+
+		return std::vector<uint32_t>();
+	}
+
+	bool resolve_pointer(const frame &frame, spv::Id pointer, size_t count, std::vector<uint32_t> *&memory, uint32_t &offset)
+	{
+		const std::vector<uint32_t> &address = value(frame, pointer);
+		if (address.size() != 2 || address[0] >= _memory.size() || address[1] + count > _memory[address[0]].size())
+			return fail("invalid pointer %" + std::to_string(pointer));
+
+		memory = &_memory[address[0]];
+		offset = address[1];
+		return true;
+	}
+
+	void store(const frame &frame, const instruction &inst)
+	{
+		const std::vector<uint32_t> &data = value(frame, inst.operands[1]);
+
+		std::vector<uint32_t> *memory; uint32_t offset;
+		if (resolve_pointer(frame, inst.operands[0], data.size(), memory, offset))
+			std::copy(data.begin(), data.end(), memory->begin() + offset);
+	}
+
+	bool execute(frame &frame, const instruction &inst)
+	{
+		std::vector<uint32_t> &r = frame.values[inst.result];
+		r.assign(layout(inst.type).size(), 0);
+
+		const auto arg = [&](size_t i) -> const std::vector<uint32_t> & { return value(frame, inst.operands[i]); };
+		// Apply an operation to every component of up to three operands
+		const auto component_wise = [&](auto op, size_t first = 0) {
+			const std::vector<uint32_t> &a = arg(first);
+			const std::vector<uint32_t> &b = inst.operands.size() > first + 1 ? arg(first + 1) : a;
+			const std::vector<uint32_t> &c = inst.operands.size() > first + 2 ? arg(first + 2) : a;
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = op(a[i % a.size()], b[i % b.size()], c[i % c.size()]);
+			return _result.error.empty();
+		};
+		const auto dot = [](const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+			float sum = 0.0f;
+			for (size_t i = 0; i < a.size(); ++i)
+				sum += as_float(a[i]) * as_float(b[i]);
+			return sum;
+		};
+
+		switch (inst.op)
+		{
+		case spv::OpVariable:
+			_memory.emplace_back(layout(_defs[inst.type]->operands[1]).size());
+			if (inst.operands.size() > 1)
+				_memory.back() = arg(1);
+			r = { static_cast<uint32_t>(_memory.size() - 1), 0 };
+			return true;
+		case spv::OpUndef:
+			return true;
+		case spv::OpLoad:
+		{
+			std::vector<uint32_t> *memory; uint32_t offset;
+			if (!resolve_pointer(frame, inst.operands[0], r.size(), memory, offset))
+				return false;
+			std::copy_n(memory->begin() + offset, r.size(), r.begin());
+			return true;
+		}
+		case spv::OpAccessChain:
+		{
+			r = arg(0);
+			spv::Id type = _defs[type_of(inst.operands[0])]->operands[1];
+			for (size_t k = 1; k < inst.operands.size(); ++k)
+				if (!element(type, arg(k)[0], r[1]))
+					return fail("access chain %" + std::to_string(inst.result) + " is out of bounds");
+			return true;
+		}
+		case spv::OpFunctionCall:
+		{
+			std::vector<std::vector<uint32_t>> arguments;
+			for (size_t k = 1; k < inst.operands.size(); ++k)
+				arguments.push_back(arg(k));
+			r = call(inst.operands[0], arguments);
+			return _result.error.empty();
+		}
+		case spv::OpCompositeConstruct:
+			r.clear();
+			for (size_t k = 0; k < inst.operands.size(); ++k)
+				r.insert(r.end(), arg(k).begin(), arg(k).end());
+			return r.size() == layout(inst.type).size() || fail("composite %" + std::to_string(inst.result) + " has the wrong size");
+		case spv::OpCompositeExtract:
+		case spv::OpCompositeInsert:
+		{
+			const bool insert = inst.op == spv::OpCompositeInsert;
+			const std::vector<uint32_t> &composite = arg(insert);
+			spv::Id type = type_of(inst.operands[insert]);
+			uint32_t offset = 0;
+			for (size_t k = 1 + insert; k < inst.operands.size(); ++k)
+				if (!element(type, inst.operands[k], offset))
+					return fail("composite index in %" + std::to_string(inst.result) + " is out of bounds");
+
+			if (insert)
+			{
+				r = composite;
+				std::copy(arg(0).begin(), arg(0).end(), r.begin() + offset);
+			}
+			else
+			{
+				std::copy_n(composite.begin() + offset, r.size(), r.begin());
+			}
+			return true;
+		}
+		case spv::OpVectorExtractDynamic:
+			if (arg(1)[0] >= arg(0).size())
+				return fail("dynamic vector index is out of bounds");
+			r[0] = arg(0)[arg(1)[0]];
+			return true;
+		case spv::OpVectorShuffle:
+		{
+			std::vector<uint32_t> combined = arg(0);
+			combined.insert(combined.end(), arg(1).begin(), arg(1).end());
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = inst.operands[2 + i] < combined.size() ? combined[inst.operands[2 + i]] : 0;
+			return true;
+		}
+		case spv::OpTranspose:
+		{
+			const size_t rows = layout(_defs[inst.type]->operands[0]).size(), columns = r.size() / rows;
+			for (size_t j = 0; j < columns; ++j)
+				for (size_t i = 0; i < rows; ++i)
+					r[j * rows + i] = arg(0)[i * columns + j];
+			return true;
+		}
+		case spv::OpCopyObject:
+		case spv::OpBitcast:
+			r = arg(0);
+			return true;
+		case spv::OpSelect:
+			if (arg(0).size() == 1)
+			{
+				r = arg(0)[0] ? arg(1) : arg(2);
+				return true;
+			}
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = arg(0)[i] ? arg(1)[i] : arg(2)[i];
+			return true;
+		case spv::OpImage:
+			r = arg(0);
+			return true;
+		case spv::OpImageSampleImplicitLod:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageFetch:
+		case spv::OpImageGather:
+		{
+			const std::vector<uint32_t> &coords = arg(1);
+			const bool integer = inst.op == spv::OpImageFetch;
+			const float x = integer ? static_cast<int32_t>(coords[0]) / 16.0f : as_float(coords[0]);
+			const float y = integer ? static_cast<int32_t>(coords[1]) / 16.0f : as_float(coords[1]);
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = as_word(0.5f + 0.4f * std::sin(x * (i + 1) * 3.1f + y * (i + 2) * 1.7f + arg(0)[0]));
+			return true;
+		}
+		case spv::OpImageQuerySizeLod:
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = 16 << i;
+			return true;
+		case spv::OpDPdx:
+		case spv::OpDPdy:
+		case spv::OpFwidth:
+			return true;
+		case spv::OpConvertFToU:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { const float f = as_float(a); return f > 0.0f && f < 4294967040.0f ? static_cast<uint32_t>(f) : 0u; });
+		case spv::OpConvertFToS:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { const float f = as_float(a); return static_cast<uint32_t>(f > -2147483520.0f && f < 2147483520.0f ? static_cast<int32_t>(f) : 0); });
+		case spv::OpConvertSToF:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { return as_word(static_cast<float>(static_cast<int32_t>(a))); });
+		case spv::OpConvertUToF:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { return as_word(static_cast<float>(a)); });
+		case spv::OpSNegate:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { return 0u - a; });
+		case spv::OpFNegate:
+			return component_wise(float_op([](float a, float, float) { return -a; }));
+		case spv::OpIAdd:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a + b; });
+		case spv::OpISub:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a - b; });
+		case spv::OpIMul:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a * b; });
+		case spv::OpUDiv:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return b != 0 ? a / b : 0u; });
+		case spv::OpUMod:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return b != 0 ? a % b : 0u; });
+		case spv::OpSDiv:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return b != 0 && (b != -1 || a != INT32_MIN) ? a / b : 0; }));
+		case spv::OpSRem:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return b != 0 && (b != -1 || a != INT32_MIN) ? a % b : 0; }));
+		case spv::OpFAdd:
+			return component_wise(float_op([](float a, float b, float) { return a + b; }));
+		case spv::OpFSub:
+			return component_wise(float_op([](float a, float b, float) { return a - b; }));
+		case spv::OpFMul:
+			return component_wise(float_op([](float a, float b, float) { return a * b; }));
+		case spv::OpFDiv:
+			return component_wise(float_op([](float a, float b, float) { return a / b; }));
+		case spv::OpFRem:
+			return component_wise(float_op([](float a, float b, float) { return std::fmod(a, b); }));
+		case spv::OpVectorTimesScalar:
+		case spv::OpMatrixTimesScalar:
+		{
+			const float scalar = as_float(arg(1)[0]);
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = as_word(as_float(arg(0)[i]) * scalar);
+			return true;
+		}
+		case spv::OpVectorTimesMatrix:
+		case spv::OpMatrixTimesVector:
+		case spv::OpMatrixTimesMatrix:
+		{
+			// Matrices are stored as a list of columns, so multiply the rows of the left operand with the columns of the right one
+			const bool left_is_matrix = inst.op != spv::OpVectorTimesMatrix;
+			const bool right_is_matrix = inst.op != spv::OpMatrixTimesVector;
+			const std::vector<uint32_t> &a = arg(0), &b = arg(1);
+			const size_t rows = left_is_matrix ? layout(_defs[type_of(inst.operands[0])]->operands[0]).size() : 1;
+			const size_t inner = a.size() / rows;
+			const size_t columns = right_is_matrix ? b.size() / inner : 1;
+			for (size_t j = 0; j < columns; ++j)
+				for (size_t i = 0; i < rows; ++i)
+				{
+					float sum = 0.0f;
+					for (size_t k = 0; k < inner; ++k)
+						sum += as_float(a[k * rows + i]) * as_float(b[j * inner + k]);
+					r[j * rows + i] = as_word(sum);
+				}
+			return true;
+		}
+		case spv::OpDot:
+			r[0] = as_word(dot(arg(0), arg(1)));
+			return true;
+		case spv::OpAny:
+			r[0] = std::any_of(arg(0).begin(), arg(0).end(), [](uint32_t a) { return a != 0; });
+			return true;
+		case spv::OpAll:
+			r[0] = std::all_of(arg(0).begin(), arg(0).end(), [](uint32_t a) { return a != 0; });
+			return true;
+		case spv::OpIsNan:
+			return component_wise(float_test([](float a, float) { return std::isnan(a); }));
+		case spv::OpIsInf:
+			return component_wise(float_test([](float a, float) { return std::isinf(a); }));
+		case spv::OpLogicalEqual:
+		case spv::OpIEqual:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a == b); });
+		case spv::OpLogicalNotEqual:
+		case spv::OpINotEqual:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a != b); });
+		case spv::OpLogicalOr:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a || b); });
+		case spv::OpLogicalAnd:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a && b); });
+		case spv::OpLogicalNot:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { return static_cast<uint32_t>(!a); });
+		case spv::OpUGreaterThan:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a > b); });
+		case spv::OpUGreaterThanEqual:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a >= b); });
+		case spv::OpULessThan:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a < b); });
+		case spv::OpULessThanEqual:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return static_cast<uint32_t>(a <= b); });
+		case spv::OpSGreaterThan:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return a > b; }));
+		case spv::OpSGreaterThanEqual:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return a >= b; }));
+		case spv::OpSLessThan:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return a < b; }));
+		case spv::OpSLessThanEqual:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return a <= b; }));
+		case spv::OpFOrdEqual:
+			return component_wise(float_test([](float a, float b) { return a == b; }));
+		case spv::OpFOrdNotEqual:
+			return component_wise(float_test([](float a, float b) { return a != b && !std::isnan(a) && !std::isnan(b); }));
+		case spv::OpFOrdLessThan:
+			return component_wise(float_test([](float a, float b) { return a < b; }));
+		case spv::OpFOrdGreaterThan:
+			return component_wise(float_test([](float a, float b) { return a > b; }));
+		case spv::OpFOrdLessThanEqual:
+			return component_wise(float_test([](float a, float b) { return a <= b; }));
+		case spv::OpFOrdGreaterThanEqual:
+			return component_wise(float_test([](float a, float b) { return a >= b; }));
+		case spv::OpShiftRightLogical:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a >> (b & 31); });
+		case spv::OpShiftRightArithmetic:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return a >> (b & 31); }));
+		case spv::OpShiftLeftLogical:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a << (b & 31); });
+		case spv::OpBitwiseOr:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a | b; });
+		case spv::OpBitwiseXor:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a ^ b; });
+		case spv::OpBitwiseAnd:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return a & b; });
+		case spv::OpNot:
+			return component_wise([](uint32_t a, uint32_t, uint32_t) { return ~a; });
+		case spv::OpExtInst:
+			return execute_glsl(frame, inst, r, component_wise, dot) || fail("unsupported extended instruction " + std::to_string(inst.operands[1]));
+		default:
+			return fail("unsupported instruction " + std::to_string(inst.op));
+		}
+	}
+
+	template <typename C, typename D>
+	bool execute_glsl(frame &frame, const instruction &inst, std::vector<uint32_t> &r, const C &component_wise, const D &dot)
+	{
+		const auto arg = [&](size_t i) -> const std::vector<uint32_t> & { return value(frame, inst.operands[2 + i]); };
+		const auto unary = [&](float(*op)(float)) { return component_wise([op](uint32_t a, uint32_t, uint32_t) { return as_word(op(as_float(a))); }, 2); };
+		const auto binary = [&](float(*op)(float, float)) { return component_wise([op](uint32_t a, uint32_t b, uint32_t) { return as_word(op(as_float(a), as_float(b))); }, 2); };
+
+		switch (inst.operands[1])
+		{
+		case spv::GLSLstd450Round:
+			return unary(std::round);
+		case spv::GLSLstd450Trunc:
+			return unary(std::trunc);
+		case spv::GLSLstd450FAbs:
+			return unary(std::fabs);
+		case spv::GLSLstd450SAbs:
+			return component_wise(int_op([](int32_t a, int32_t, int32_t) { return a < 0 ? 0 - a : a; }), 2);
+		case spv::GLSLstd450FSign:
+			return unary([](float a) { return static_cast<float>((a > 0.0f) - (a < 0.0f)); });
+		case spv::GLSLstd450SSign:
+			return component_wise(int_op([](int32_t a, int32_t, int32_t) { return (a > 0) - (a < 0); }), 2);
+		case spv::GLSLstd450Floor:
+			return unary(std::floor);
+		case spv::GLSLstd450Ceil:
+			return unary(std::ceil);
+		case spv::GLSLstd450Fract:
+			return unary([](float a) { return a - std::floor(a); });
+		case spv::GLSLstd450Radians:
+			return unary([](float a) { return a * 0.0174532925f; });
+		case spv::GLSLstd450Degrees:
+			return unary([](float a) { return a * 57.2957795f; });
+		case spv::GLSLstd450Sin:
+			return unary(std::sin);
+		case spv::GLSLstd450Cos:
+			return unary(std::cos);
+		case spv::GLSLstd450Tan:
+			return unary(std::tan);
+		case spv::GLSLstd450Asin:
+			return unary(std::asin);
+		case spv::GLSLstd450Acos:
+			return unary(std::acos);
+		case spv::GLSLstd450Atan:
+			return unary(std::atan);
+		case spv::GLSLstd450Sinh:
+			return unary(std::sinh);
+		case spv::GLSLstd450Cosh:
+			return unary(std::cosh);
+		case spv::GLSLstd450Tanh:
+			return unary(std::tanh);
+		case spv::GLSLstd450Atan2:
+			return binary(std::atan2);
+		case spv::GLSLstd450Pow:
+			return binary(std::pow);
+		case spv::GLSLstd450Exp:
+			return unary(std::exp);
+		case spv::GLSLstd450Log:
+			return unary(std::log);
+		case spv::GLSLstd450Exp2:
+			return unary(std::exp2);
+		case spv::GLSLstd450Log2:
+			return unary(std::log2);
+		case spv::GLSLstd450Sqrt:
+			return unary(std::sqrt);
+		case spv::GLSLstd450InverseSqrt:
+			return unary([](float a) { return 1.0f / std::sqrt(a); });
+		case spv::GLSLstd450FMin:
+			return binary([](float a, float b) { return b < a ? b : a; });
+		case spv::GLSLstd450FMax:
+			return binary([](float a, float b) { return a < b ? b : a; });
+		case spv::GLSLstd450SMin:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return std::min(a, b); }), 2);
+		case spv::GLSLstd450SMax:
+			return component_wise(int_op([](int32_t a, int32_t b, int32_t) { return std::max(a, b); }), 2);
+		case spv::GLSLstd450UMin:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return std::min(a, b); }, 2);
+		case spv::GLSLstd450UMax:
+			return component_wise([](uint32_t a, uint32_t b, uint32_t) { return std::max(a, b); }, 2);
+		case spv::GLSLstd450FClamp:
+			return component_wise(float_op([](float x, float lo, float hi) { return std::min(std::max(x, lo), hi); }), 2);
+		case spv::GLSLstd450SClamp:
+			return component_wise(int_op([](int32_t x, int32_t lo, int32_t hi) { return std::min(std::max(x, lo), hi); }), 2);
+		case spv::GLSLstd450UClamp:
+			return component_wise([](uint32_t x, uint32_t lo, uint32_t hi) { return std::min(std::max(x, lo), hi); }, 2);
+		case spv::GLSLstd450FMix:
+			return component_wise(float_op([](float x, float y, float a) { return x * (1.0f - a) + y * a; }), 2);
+		case spv::GLSLstd450Step:
+			return binary([](float edge, float x) { return x < edge ? 0.0f : 1.0f; });
+		case spv::GLSLstd450SmoothStep:
+			return component_wise(float_op([](float edge0, float edge1, float x) { const float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f); return t * t * (3.0f - 2.0f * t); }), 2);
+		case spv::GLSLstd450Fma:
+			return component_wise(float_op([](float a, float b, float c) { return a * b + c; }), 2);
+		case spv::GLSLstd450Ldexp:
+			return component_wise([](uint32_t x, uint32_t exp, uint32_t) { return as_word(std::ldexp(as_float(x), static_cast<int32_t>(exp))); }, 2);
+		case spv::GLSLstd450Length:
+			r[0] = as_word(std::sqrt(dot(arg(0), arg(0))));
+			return true;
+		case spv::GLSLstd450Distance:
+		{
+			std::vector<uint32_t> difference(arg(0).size());
+			for (size_t i = 0; i < difference.size(); ++i)
+				difference[i] = as_word(as_float(arg(0)[i]) - as_float(arg(1)[i]));
+			r[0] = as_word(std::sqrt(dot(difference, difference)));
+			return true;
+		}
+		case spv::GLSLstd450Cross:
+			for (size_t i = 0; i < 3; ++i)
+				r[i] = as_word(as_float(arg(0)[(i + 1) % 3]) * as_float(arg(1)[(i + 2) % 3]) - as_float(arg(0)[(i + 2) % 3]) * as_float(arg(1)[(i + 1) % 3]));
+			return true;
+		case spv::GLSLstd450Normalize:
+		{
+			const float length = std::sqrt(dot(arg(0), arg(0)));
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = as_word(as_float(arg(0)[i]) / length);
+			return true;
+		}
+		case spv::GLSLstd450FaceForward:
+		{
+			const bool flip = dot(arg(2), arg(1)) >= 0.0f;
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = as_word(flip ? -as_float(arg(0)[i]) : as_float(arg(0)[i]));
+			return true;
+		}
+		case spv::GLSLstd450Reflect:
+		{
+			const float d = dot(arg(1), arg(0));
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = as_word(as_float(arg(0)[i]) - 2.0f * d * as_float(arg(1)[i]));
+			return true;
+		}
+		case spv::GLSLstd450Refract:
+		{
+			const float d = dot(arg(1), arg(0)), eta = as_float(arg(2)[0]);
+			const float k = 1.0f - eta * eta * (1.0f - d * d);
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i] = k < 0.0f ? as_word(0.0f) : as_word(eta * as_float(arg(0)[i]) - (eta * d + std::sqrt(k)) * as_float(arg(1)[i]));
+			return true;
+		}
+		case spv::GLSLstd450Determinant:
+		{
+			const size_t n = static_cast<size_t>(std::sqrt(static_cast<double>(arg(0).size())));
+			std::vector<float> m(n * n);
+			for (size_t i = 0; i < m.size(); ++i)
+				m[i] = as_float(arg(0)[i]);
+			r[0] = as_word(determinant(m, n));
+			return true;
+		}
+		case spv::GLSLstd450Modf:
+		case spv::GLSLstd450Frexp:
+		{
+			// The second result is written to the pointer in the second argument
+			std::vector<uint32_t> second(r.size());
+			for (size_t i = 0; i < r.size(); ++i)
+			{
+				const float x = as_float(arg(0)[i]);
+				if (inst.operands[1] == spv::GLSLstd450Modf)
+				{
+					float whole;
+					r[i] = as_word(std::modf(x, &whole));
+					second[i] = as_word(whole);
+				}
+				else
+				{
+					int exp;
+					r[i] = as_word(std::frexp(x, &exp));
+					second[i] = static_cast<uint32_t>(exp);
+				}
+			}
+
+			std::vector<uint32_t> *memory; uint32_t offset;
+			if (!resolve_pointer(frame, inst.operands[3], second.size(), memory, offset))
+				return false;
+			std::copy(second.begin(), second.end(), memory->begin() + offset);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	static float determinant(const std::vector<float> &m, size_t n)
+	{
+		if (n == 1)
+			return m[0];
+
+		float result = 0.0f;
+		for (size_t column = 0; column < n; ++column)
+		{
+			std::vector<float> minor;
+			for (size_t j = 1; j < n; ++j)
+				for (size_t i = 0; i < n; ++i)
+					if (i != column)
+						minor.push_back(m[j * n + i]);
+			result += (column % 2 ? -1.0f : 1.0f) * m[column] * determinant(minor, n - 1);
+		}
+		return result;
+	}
+
+	std::vector<instruction> _instructions;
+	std::vector<const instruction *> _defs;
+	std::vector<std::vector<uint32_t>> _constants;
+	std::vector<bool> _global_defined;
+	std::unordered_map<spv::Id, function> _functions;
+	std::vector<std::vector<uint32_t>> _memory;
+	size_t _steps = 0;
+	result _result;
+};
+
+static bool nearly_equal(float a, float b)
+{
+	return a == b || (std::isnan(a) && std::isnan(b)) || std::fabs(a - b) <= 1e-4f * std::max({ 1.0f, std::fabs(a), std::fabs(b) });
+}
+
+// Checks that the optimized module is valid and that every entry point computes the same outputs as in the unoptimized module for a few different inputs
+static void check_equivalence(const std::filesystem::path &path, const std::vector<uint32_t> &spirv, const std::vector<uint32_t> &optimized)
+{
+	spirv_interpreter reference, candidate;
+
+	const std::string reference_error = reference.load(spirv);
+	const std::string candidate_error = candidate.load(optimized);
+	if (!reference_error.empty() || !candidate_error.empty())
+	{
+		std::fprintf(stderr, "Invalid module for %s: %s%s\n", path.u8string().c_str(), reference_error.c_str(), candidate_error.c_str());
+		test_failures()++;
+		return;
+	}
+
+	CHECK(!reference.entry_points().empty());
+	CHECK(candidate.entry_points() == reference.entry_points());
+
+	for (const std::string &entry_point : reference.entry_points())
+	{
+		for (unsigned int seed = 0; seed < 8; ++seed)
+		{
+			const spirv_interpreter::result expected = reference.run(entry_point, seed);
+			const spirv_interpreter::result actual = candidate.run(entry_point, seed);
+
+			// A discarded pixel has no outputs, so both have to agree on discarding it
+			if (expected.discarded || actual.discarded)
+			{
+				CHECK(expected.discarded == actual.discarded);
+				continue;
+			}
+			if (!expected.error.empty() || !actual.error.empty())
+			{
+				std::fprintf(stderr, "Failed to run %s in %s (seed %u): %s%s\n", entry_point.c_str(), path.u8string().c_str(), seed, expected.error.c_str(), actual.error.c_str());
+				test_failures()++;
+				continue;
+			}
+
+			CHECK(!expected.outputs.empty());
+			CHECK(actual.outputs.size() == expected.outputs.size());
+
+			for (const auto &[id, output] : expected.outputs)
+			{
+				const auto it = actual.outputs.find(id);
+				if (it == actual.outputs.end())
+					continue;
+
+				const auto &[kinds, words] = output;
+				for (size_t i = 0; i < words.size(); ++i)
+				{
+					if (kinds[i] == 'f' ? nearly_equal(as_float(words[i]), as_float(it->second.second[i])) : words[i] == it->second.second[i])
+						continue;
+
+					std::fprintf(stderr, "Output %%%u[%zu] of %s in %s (seed %u) differs after optimization: %08x instead of %08x\n", id, i, entry_point.c_str(), path.u8string().c_str(), seed, it->second.second[i], words[i]);
+					test_failures()++;
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	for (const char *const path : { "codegen/spirv.fx", "codegen/optimizer.fx" })
+	{
+		const std::vector<uint32_t> spirv = compile(path);
+
+		std::vector<uint32_t> optimized = spirv;
+		CHECK(reshadefx::optimize_spirv(optimized));
+		CHECK(optimized.size() < spirv.size());
+
+		// The code generator runs the same optimization when asked to
+		CHECK(compile(path, true) == optimized);
+
+		check_equivalence(path, spirv, optimized);
+	}
+
+	// The optimizer refuses modules it does not fully understand and leaves them unchanged, so that they can still be used as they are
+	{
+		const std::vector<uint32_t> spirv = compile("codegen/optimizer.fx");
+
+		// Add an instruction the optimizer does not know about ('OpSourceExtension') in front of the first decoration
+		std::vector<uint32_t> unsupported = spirv;
+		for (size_t offset = 5; offset < unsupported.size(); offset += unsupported[offset] >> spv::WordCountShift)
+		{
+			if ((unsupported[offset] & spv::OpCodeMask) == spv::OpDecorate)
+			{
+				unsupported.insert(unsupported.begin() + offset, { (3u << spv::WordCountShift) | spv::OpSourceExtension, 0x74736574, 0 }); // "test"
+				break;
+			}
+		}
+		CHECK(unsupported.size() == spirv.size() + 3);
+
+		std::vector<uint32_t> result = unsupported;
+		CHECK(!reshadefx::optimize_spirv(result));
+		CHECK(result == unsupported);
+		check_equivalence("codegen/optimizer.fx", spirv, result);
+
+		// The same applies to modules that are cut off
+		const std::vector<uint32_t> truncated(spirv.begin(), spirv.end() - 1);
+		result = truncated;
+		CHECK(!reshadefx::optimize_spirv(result));
+		CHECK(result == truncated);
+	}
+
+	return test_result();
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace reshadefx;
+
+// Appends one self-contained unit of code, with names made unique by the index so that any number of units can be combined into a larger effect
+// Uses the constructs the parser has to look ahead and backtrack for (declarations of structure type, casts and expression statements)
+static void append_unit(std::string &source, size_t index)
+{
+	const std::string i = std::to_string(index);
+
+	source += "struct S" + i + "\n{\n\tfloat4 a;\n\tfloat b;\n};\n";
+	source += "uniform float U" + i + " = 1.0;\n";
+	source += "float4 F" + i + "(float4 x, S" + i + " s)\n{\n";
+	source += "\tS" + i + " t = s;\n";
+	source += "\tfloat4 r = (float4)t.b + x * (float)U" + i + ";\n";
+	source += "\tfor (int k = 0; k < 4; ++k)\n\t{\n";
+	source += "\t\tif (r.x > (float)k)\n\t\t\tr = r.yzwx;\n\t\telse\n\t\t\tr += t.a;\n";
+	source += "\t\t(r).x *= 0.5;\n";
+	source += "\t}\n\treturn r;\n}\n";
+}
+
+// Generates an effect that stresses the symbol table, with thousands of functions in namespaces, each with deeply nested blocks that declare and look up local variables
+static std::string generate_stress(size_t num_functions, size_t depth)
+{
+	std::string source;
+
+	for (size_t index = 0; index < num_functions; ++index)
+	{
+		const std::string i = std::to_string(index);
+
+		// Put functions into a few different namespaces, so that names are looked up through namespaces as well
+		source += "namespace N" + std::to_string(index % 16) + "\n{\n";
+		source += "float F" + i + "(float x)\n{\n";
+
+		std::string indent = "\t";
+		for (size_t level = 0; level < depth; ++level)
+		{
+			const std::string l = std::to_string(level);
+			source += indent + "float v" + l + " = x + " + l + ".0;\n";
+			source += indent + "if (v" + l + " > 0.0)\n" + indent + "{\n";
+			indent += '\t';
+		}
+
+		// Reference variables from every enclosing scope in the innermost block
+		source += indent + "x = v0";
+		for (size_t level = 1; level < depth; ++level)
+			source += " + v" + std::to_string(level);
+		source += ";\n";
+
+		for (size_t level = depth; level-- > 0;)
+		{
+			indent.pop_back();
+			source += indent + "}\n";
+		}
+
+		source += "\treturn x;\n}\n}\n";
+
+		// Call the previous function through its namespace, so that global lookups see all functions declared so far
+		if (index != 0)
+			source += "static const float G" + i + " = 1.0;\nfloat C" + i + "(float x) { return N" + std::to_string((index - 1) % 16) + "::F" + std::to_string(index - 1) + "(x) * G" + i + "; }\n";
+	}
+
+	return source;
+}
+
+// Returns the time in seconds the fastest of a few runs took to parse the source
+static double measure(const std::string &source)
+{
+	double best_seconds = 0.0;
+	for (int run = 0; run < 3; ++run)
+	{
+		std::unique_ptr<codegen> codegen(create_codegen_hlsl(50, false, false));
+
+		parser parser;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		const bool success = parser.parse(source, codegen.get());
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (!success)
+		{
+			std::printf("failed to parse:\n%s\n", parser.errors().c_str());
+			std::exit(1);
+		}
+
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+
+	return best_seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && std::strcmp(argv[1], "--stress") == 0)
+	{
+		// Leaving a scope should only cost as much as there are symbols declared in it, so the time per function should stay about the same regardless of how many there are
+		std::printf("functions  depth   size MB   parse ms  us/function\n");
+
+		for (const size_t depth : { 4, 16, 64 })
+		{
+			for (size_t num_functions = 1000; num_functions <= 8000; num_functions *= 2)
+			{
+				const std::string source = generate_stress(num_functions, depth);
+
+				const double milliseconds = measure(source) * 1000.0;
+
+				std::printf("%9zu  %5zu  %8.2f  %9.1f  %11.1f\n", num_functions, depth, source.size() / (1024.0 * 1024.0), milliseconds, milliseconds * 1000.0 / num_functions);
+			}
+		}
+		return 0;
+	}
+
+	// Parse time should grow linearly with the input, so the time per megabyte should stay about the same for every size
+	size_t num_units = 500;
+	size_t max_scale = 32;
+	if (argc > 1)
+		max_scale = std::strtoul(argv[1], nullptr, 10);
+
+	std::printf("scale  units   size MB   parse ms   ms/MB  relative\n");
+
+	double base_ms_per_megabyte = 0.0;
+	for (size_t scale = 1; scale <= max_scale; scale *= 2)
+	{
+		std::string source;
+		for (size_t index = 0; index < num_units * scale; ++index)
+			append_unit(source, index);
+
+		const double megabytes = source.size() / (1024.0 * 1024.0);
+		const double milliseconds = measure(source) * 1000.0;
+		const double ms_per_megabyte = milliseconds / megabytes;
+		if (scale == 1)
+			base_ms_per_megabyte = ms_per_megabyte;
+
+		std::printf("%5zu  %6zu  %8.2f  %9.1f  %6.1f  %8.2f\n", scale, num_units * scale, megabytes, milliseconds, ms_per_megabyte, ms_per_megabyte / base_ms_per_megabyte);
+	}
+}
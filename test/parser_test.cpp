@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <memory>
+#include <fstream>
+
+static void write_file(const std::filesystem::path &path, const std::string &data)
+{
+	std::filesystem::create_directories(path.parent_path());
+	std::ofstream(path, std::ios::binary) << data;
+}
+
+// Preprocesses and parses the file, returning all errors and warnings reported by the parser
+static std::string parse_file(const std::filesystem::path &path, bool compact_output, reshadefx::source_cache *cache = nullptr)
+{
+	reshadefx::preprocessor pp;
+	pp.set_source_cache(cache);
+	pp.set_compact_output(compact_output);
+	pp.add_include_path(path.parent_path());
+	CHECK(pp.append_file(path));
+
+	const reshadefx::source_line_map line_map = pp.line_map();
+
+	std::unique_ptr<reshadefx::codegen> codegen(reshadefx::create_codegen_hlsl(50, false, false));
+
+	reshadefx::parser parser;
+	parser.parse(std::move(pp.output()), codegen.get(), compact_output ? &line_map : nullptr);
+
+	return parser.errors();
+}
+
+int main()
+{
+	const std::filesystem::path root = std::filesystem::temp_directory_path() / "reshadefx_parser_test";
+	std::filesystem::remove_all(root);
+
+	// Errors are placed after runs of spaces and tabs, inside macro expansions and in included files, which are all places where compact output collapses whitespace
+	write_file(root / "common.fxh",
+		"#define SCALE(x)   ((x)  *  2.0)\n"
+		"static const float common_value =   1.0;\n"
+		"float common_function(float x)\n"
+		"{\n"
+		"\treturn   x  +  undeclared_in_header;\n"
+		"}\n");
+	write_file(root / "main.fx",
+		"#include \"common.fxh\"\n"
+		"\n"
+		"float after_spaces(float x)\n"
+		"{\n"
+		"    float y =   SCALE(x)   +   undeclared_after_spaces;\n"
+		"    return y;\n"
+		"}\n"
+		"float after_tabs(float x)\n"
+		"{\n"
+		"\t\tfloat z = x;   float w =\t\tundeclared_after_tabs;\n"
+		"\t\treturn z;\n"
+		"}\n"
+		"float in_argument(float x)\n"
+		"{\n"
+		"    return   x  *  x  +  SCALE(  undeclared_in_argument  );\n"
+		"}\n"
+		"\n"
+		"float4 at_end() { float4 v = 1; v.x   =   v.x   +   undeclared_at_end; return v; }");
+
+	const std::string expected_errors = parse_file(root / "main.fx", false);
+	CHECK(expected_errors.find("undeclared_in_header") != std::string::npos);
+	CHECK(expected_errors.find("undeclared_after_spaces") != std::string::npos);
+	CHECK(expected_errors.find("undeclared_after_tabs") != std::string::npos);
+	CHECK(expected_errors.find("undeclared_in_argument") != std::string::npos);
+	CHECK(expected_errors.find("undeclared_at_end") != std::string::npos);
+	// The '#define' on the first line of the header does not produce any output, which must not shift the lines after it
+	CHECK(expected_errors.find("common.fxh(5, ") != std::string::npos);
+
+	// Compact output has to report the same locations (including columns) as the default output
+	const std::string compact_errors = parse_file(root / "main.fx", true);
+	if (compact_errors != expected_errors)
+	{
+		std::fprintf(stderr, "Errors with compact output do not match:\n%s\nExpected:\n%s\n", compact_errors.c_str(), expected_errors.c_str());
+		test_failures()++;
+	}
+
+	// The same applies when the output of the leading include is restored from a snapshot
+	reshadefx::source_cache cache;
+	for (int run = 0; run < 2; ++run)
+	{
+		const std::string cached_errors = parse_file(root / "main.fx", true, &cache);
+		if (cached_errors != expected_errors)
+		{
+			std::fprintf(stderr, "Errors with compact output from a source cache do not match:\n%s\nExpected:\n%s\n", cached_errors.c_str(), expected_errors.c_str());
+			test_failures()++;
+		}
+	}
+
+	std::filesystem::remove_all(root);
+
+	return test_result();
+}
@@ -0,0 +1,9 @@
+// Reduced from randomly generated inputs where arguments referenced multiple times expanded differently in the past
+#define G(y, z)   z z z ## # y	y
+#define X(z, y, x) 	1	G	"s"
+int v0 = Y (  X ()Ev,)  H E	E;
+int v1 =v  - G (A	() F  ( C) -  E, X	+) v F;
+#undef X
+#define X(z)   E() ##	## 1	z	z
+#define B(x) x
+int v2 = C	() 1	--B(1,E,-	X (  X C ()	H  (),"q",)  v 1  1);
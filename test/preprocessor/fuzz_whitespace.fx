@@ -0,0 +1,11 @@
+// Reduced from randomly generated inputs whose whitespace differed in the past
+#define Y()   2
+#define F()		Y  ##  1
+#define G(y, x, z) z Y(1)  ) +	Y(z)  (
+#define C(z, x) z	2  ## z	x
+#define H(y)	C	##	E #	yy +
+#define X(z)   E() ##	## 1	z	z
+int v0 =  C (F (E)	X	Yv, F  (	-A,	1,  H ())F  ()  v  X	() G  (  1	E  H  (E,1, a ) + E,,  A	(1) A(,"q",(1,2))));
+int v1 = 1  F()  1;
+int v2 =	+H (  E	G () v 1 v,"q")	1;
+int v3 = C	() 1	--B(1,E,-	X (  X C ()	H  (),"q",)  v 1  1);
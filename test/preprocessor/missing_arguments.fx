@@ -0,0 +1,8 @@
+// Invocations with too few arguments have to report a warning for every reference to a missing parameter
+#define PAIR(a, b) a b b
+#define TWICE(x) x x
+#define THRICE(x) x x x
+
+int a = PAIR(1);
+int b = TWICE(PAIR(1)) TWICE(PAIR(2));
+int c = THRICE(TWICE(PAIR()));
@@ -0,0 +1,15 @@
+// Nested invocations, with arguments that are referenced multiple times and themselves contain macros
+#define ONE 1
+#define ADD(a, b) (a + b)
+#define TWICE(x) x x
+#define QUAD(x) TWICE(x) TWICE(x)
+#define APPLY(f, x) f(x)
+
+int a = ADD(ONE, ADD(ONE, 2));
+int b = TWICE(ADD( ONE ,ONE));
+int c = QUAD(ONE);
+int d = APPLY(TWICE, ONE) APPLY(QUAD, ADD(1, 2));
+int e = TWICE(	ADD	) (1, 2);
+int f = TWICE(__LINE__) TWICE(
+	ONE
+) ONE;
@@ -0,0 +1,10 @@
+// Pasting a function-like macro name that is then not followed by arguments
+#define A() F ## E
+#define F(x) 1
+int v = A() A();
+
+#define G() F	##	E
+int w = G() G();
+
+#define H(y) y  ##  1
+int x = H(F) H( F );
@@ -0,0 +1,14 @@
+// Token pasting between parameters, names and literals
+#define CAT(a, b) a ## b
+#define CAT3(a, b, c) a ## b ## c
+#define VALUE_1 100
+#define SUFFIX(x) x ## _1
+#define PREFIX(x) VALUE_ ## x
+
+int a = CAT(VALUE, _1);
+int b = CAT3(VAL, UE, _1);
+int c = SUFFIX(VALUE) PREFIX(1);
+int d = CAT(1, 2) CAT( 1.5 , f ) CAT(,x) CAT(y,);
+int e = CAT(CAT(1, 2), 3);
+#define EMPTY_PASTE(a) a ## ## a
+int f = EMPTY_PASTE(z);
@@ -0,0 +1,12 @@
+// Stringizing arguments with whitespace, quotes and macros in them
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define VALUE 42
+#define BOTH(x) #x x # x
+
+string a = STR(VALUE);
+string b = XSTR(VALUE);
+string c = STR(  a   b  );
+string d = STR("quoted") STR(STR(x));
+string e = BOTH(VALUE) BOTH( ( 1, 2 ) );
+string f = STR();
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_preprocessor.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace reshadefx;
+
+struct reload_statistics
+{
+	double seconds = 0.0;
+	size_t files_read = 0;
+	size_t bytes_read = 0;
+	size_t cache_hits = 0;
+};
+
+// Preprocesses every effect file on as many threads as the runtime would use to load them, either sharing a source cache between all of them or having each read its files on its own
+static reload_statistics reload(const std::vector<std::filesystem::path> &effect_files, const std::vector<std::filesystem::path> &include_paths, source_cache *cache)
+{
+	const size_t files_read_before = cache != nullptr ? cache->files_read() : 0;
+	const size_t bytes_read_before = cache != nullptr ? cache->bytes_read() : 0;
+	const size_t cache_hits_before = cache != nullptr ? cache->cache_hits() : 0;
+
+	// The runtime marks directory listings as outdated at the start of every reload, since files may have been added or removed in the meantime
+	if (cache != nullptr)
+		cache->refresh_directories();
+
+	std::atomic<size_t> next_index = 0;
+	std::atomic<size_t> files_read = 0;
+	std::atomic<size_t> bytes_read = 0;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> threads(std::max(std::thread::hardware_concurrency(), 1u));
+	for (std::thread &thread : threads)
+	{
+		thread = std::thread([&]() {
+			for (size_t index; (index = next_index++) < effect_files.size();)
+			{
+				preprocessor pp;
+				pp.set_source_cache(cache);
+				pp.add_macro_definition("BUFFER_WIDTH", "1920");
+				pp.add_macro_definition("BUFFER_HEIGHT", "1080");
+				pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+				pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+				for (const std::filesystem::path &include_path : include_paths)
+					pp.add_include_path(include_path);
+
+				if (!pp.append_file(effect_files[index]))
+					std::printf("failed to preprocess %s:\n%s\n", effect_files[index].u8string().c_str(), pp.errors().c_str());
+
+				// Without a cache every preprocessor reads the effect file and all the files it includes itself
+				if (cache == nullptr)
+				{
+					std::error_code ec;
+					files_read += 1;
+					bytes_read += static_cast<size_t>(std::filesystem::file_size(effect_files[index], ec));
+					for (const std::filesystem::path &path : pp.included_files())
+					{
+						files_read += 1;
+						bytes_read += static_cast<size_t>(std::filesystem::file_size(path, ec));
+					}
+				}
+			}
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+
+	reload_statistics result;
+	result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (cache != nullptr)
+	{
+		result.files_read = cache->files_read() - files_read_before;
+		result.bytes_read = cache->bytes_read() - bytes_read_before;
+		result.cache_hits = cache->cache_hits() - cache_hits_before;
+	}
+	else
+	{
+		result.files_read = files_read;
+		result.bytes_read = bytes_read;
+	}
+
+	return result;
+}
+
+// Generates code that uses nested function-like macros the way shader libraries do for vector and blending helpers
+static std::string generate_macro_heavy(size_t num_lines)
+{
+	std::string source =
+		"#define SWIZZLE(v, s) (v).s\n"
+		"#define MAD(a, b, c) ((a) * (b) + (c))\n"
+		"#define LERP(a, b, t) ((a) + ((b) - (a)) * (t))\n"
+		"#define SATURATE(x) clamp(x, 0.0, 1.0)\n"
+		"#define UNPACK(x) MAD(x, 2.0, -1.0)\n"
+		"#define BLEND(a, b, t) SATURATE(LERP(UNPACK(a), UNPACK(b), SATURATE(t)))\n"
+		"#define BLEND4(a, b, c, d, t) BLEND(BLEND(a, b, t), BLEND(c, d, t), t)\n"
+		"#define TO_FLOAT4(v) float4(SWIZZLE(v, x), SWIZZLE(v, y), SWIZZLE(v, z), SWIZZLE(v, w))\n";
+
+	for (size_t index = 0; index < num_lines; ++index)
+	{
+		const std::string i = std::to_string(index);
+		source += "float4 r" + i + " = TO_FLOAT4(BLEND4(c" + i + ", SWIZZLE(c" + i + ", yzwx), SWIZZLE(c" + i + ", zwxy), SWIZZLE(c" + i + ", wxyz), t));\n";
+	}
+
+	return source;
+}
+
+static int benchmark_macro_expansion(size_t num_lines)
+{
+	const std::string source = generate_macro_heavy(num_lines);
+
+	double best_seconds = 0.0;
+	size_t output_size = 0;
+	for (int run = 0; run < 5; ++run)
+	{
+		preprocessor pp;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		const bool success = pp.append_string(source);
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (!success)
+		{
+			std::printf("failed to preprocess:\n%s\n", pp.errors().c_str());
+			return 1;
+		}
+
+		output_size = pp.output().size();
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+
+	std::printf("lines  input MB  output MB     ms  output MB/s  us/line\n");
+	std::printf("%5zu  %8.2f  %9.2f  %5.0f  %11.1f  %7.2f\n", num_lines,
+		source.size() / (1024.0 * 1024.0), output_size / (1024.0 * 1024.0), best_seconds * 1000.0,
+		output_size / (1024.0 * 1024.0) / best_seconds, best_seconds * 1000000.0 / num_lines);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::printf("usage: %s <effect directory> [number of reloads]\n", argv[0]);
+		std::printf("       %s --macros [number of lines]\n\n", argv[0]);
+		std::printf("Preprocesses every effect in the directory like a reload of the runtime would, with and without a shared source cache, and reports the file I/O of each reload.\n");
+		std::printf("The file contents are read into a single buffer each, so the number of bytes read is also the number of bytes copied.\n");
+		std::printf("With --macros, preprocesses generated code made up of nested function-like macros instead and reports the expansion speed.\n");
+		return 1;
+	}
+
+	if (std::strcmp(argv[1], "--macros") == 0)
+		return benchmark_macro_expansion(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000);
+
+	const std::filesystem::path effect_directory = std::filesystem::u8path(argv[1]);
+	const int num_reloads = argc > 2 ? std::atoi(argv[2]) : 3;
+
+	std::vector<std::filesystem::path> effect_files;
+	std::vector<std::filesystem::path> include_paths;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(effect_directory))
+	{
+		if (entry.is_directory())
+			include_paths.push_back(entry.path());
+		else if (entry.path().extension() == ".fx")
+			effect_files.push_back(entry.path());
+	}
+	include_paths.insert(include_paths.begin(), effect_directory);
+
+	if (effect_files.empty())
+	{
+		std::printf("no effect files found\n");
+		return 1;
+	}
+
+	std::printf("%zu effects, %zu include paths\n\n", effect_files.size(), include_paths.size());
+	std::printf("cache   reload     ms  files read   MB read  cache hits\n");
+
+	for (int run = 0; run < num_reloads; ++run)
+	{
+		const reload_statistics stats = reload(effect_files, include_paths, nullptr);
+		std::printf("none    %6d  %5.0f  %10zu  %8.2f  %10zu\n", run + 1, stats.seconds * 1000.0, stats.files_read, stats.bytes_read / (1024.0 * 1024.0), stats.cache_hits);
+	}
+
+	source_cache cache;
+
+	for (int run = 0; run < num_reloads; ++run)
+	{
+		const reload_statistics stats = reload(effect_files, include_paths, &cache);
+		std::printf("shared  %6d  %5.0f  %10zu  %8.2f  %10zu\n", run + 1, stats.seconds * 1000.0, stats.files_read, stats.bytes_read / (1024.0 * 1024.0), stats.cache_hits);
+	}
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_preprocessor.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+static std::string read_file(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::stringstream data;
+	data << file.rdbuf();
+
+	// Ignore line ending conversions done by source control
+	std::string result = data.str();
+	result.erase(std::remove(result.begin(), result.end(), '\r'), result.end());
+	return result;
+}
+
+static void write_file(const std::filesystem::path &path, const std::string &data)
+{
+	std::filesystem::create_directories(path.parent_path());
+	std::ofstream(path, std::ios::binary) << data;
+}
+
+static void test_missing_files()
+{
+	const std::filesystem::path root = std::filesystem::temp_directory_path() / "reshadefx_preprocessor_test";
+	std::filesystem::remove_all(root);
+
+	// The header is included from another one, so that the include search happens while recording a snapshot of the leading include sequence
+	write_file(root / "main.fx", "#include \"common.fxh\"\n#if exists \"optional.fxh\"\n#error optional\n#endif\n");
+	write_file(root / "common.fxh", "#include \"sub/header.fxh\"\n");
+	write_file(root / "second" / "sub" / "header.fxh", "second\n");
+
+	reshadefx::source_cache cache;
+
+	const auto preprocess = [&root, &cache](reshadefx::preprocessor &pp) {
+		pp.set_source_cache(&cache);
+		pp.add_include_path(root / "first");
+		pp.add_include_path(root / "second");
+		CHECK(pp.append_file(root / "main.fx"));
+	};
+
+	{
+		reshadefx::preprocessor pp;
+		preprocess(pp);
+		CHECK(pp.output().find("second") != std::string::npos);
+
+		// Every location the header and the optional file were looked for in before finding them (or giving up) has to be reported
+		const std::vector<std::filesystem::path> missing_files = pp.missing_files();
+		const auto is_missing = [&missing_files](const std::filesystem::path &path) {
+			return std::find_if(missing_files.begin(), missing_files.end(),
+				[&path](const std::filesystem::path &file) { return file.lexically_normal() == path.lexically_normal(); }) != missing_files.end();
+		};
+		CHECK(is_missing(root / "sub" / "header.fxh"));
+		CHECK(is_missing(root / "first" / "sub" / "header.fxh"));
+		CHECK(!is_missing(root / "second" / "sub" / "header.fxh"));
+		CHECK(is_missing(root / "optional.fxh"));
+		CHECK(is_missing(root / "first" / "optional.fxh"));
+		CHECK(is_missing(root / "second" / "optional.fxh"));
+	}
+
+	// A header added earlier on the search path has to take precedence, even though the include sequence was stored as a snapshot in the source cache before
+	write_file(root / "first" / "sub" / "header.fxh", "first\n");
+	cache.refresh_directories();
+
+	{
+		reshadefx::preprocessor pp;
+		preprocess(pp);
+		CHECK(pp.output().find("first") != std::string::npos);
+		CHECK(pp.output().find("second") == std::string::npos);
+	}
+
+	std::filesystem::remove_all(root);
+}
+
+static void test_source_cache()
+{
+	const std::filesystem::path root = std::filesystem::temp_directory_path() / "reshadefx_source_cache_test";
+	std::filesystem::remove_all(root);
+
+	write_file(root / "a.fx", "#include \"common.fxh\"\nA\n");
+	write_file(root / "b.fx", "#include \"common.fxh\"\nB\n");
+	write_file(root / "common.fxh", "\xef\xbb\xbf" "COMMON\n");
+
+	reshadefx::source_cache cache;
+
+	// Preprocessors sharing a cache have to see the same contents, while every file is only read from disk once
+	{
+		reshadefx::preprocessor pp_a, pp_b;
+		pp_a.set_source_cache(&cache);
+		pp_b.set_source_cache(&cache);
+		CHECK(pp_a.append_file(root / "a.fx"));
+		CHECK(pp_b.append_file(root / "b.fx"));
+		CHECK(pp_a.output().find("COMMON") != std::string::npos && pp_a.output().find('A') != std::string::npos);
+		CHECK(pp_b.output().find("COMMON") != std::string::npos && pp_b.output().find('B') != std::string::npos);
+	}
+
+	CHECK(cache.files_read() == 3);
+	CHECK(cache.bytes_read() == std::filesystem::file_size(root / "a.fx") + std::filesystem::file_size(root / "b.fx") + std::filesystem::file_size(root / "common.fxh"));
+
+	const std::shared_ptr<const std::string> common = cache.load(root / "common.fxh");
+	CHECK(common != nullptr && *common == "COMMON\n\n"); // The BOM is removed and a line feed appended
+	CHECK(cache.load(root / "." / "common.fxh") == common); // Contents are shared, not copied
+	CHECK(cache.files_read() == 3);
+
+	// Modified files have to be read again, while references to the old contents stay valid
+	write_file(root / "common.fxh", "CHANGED COMMON\n");
+	std::filesystem::last_write_time(root / "common.fxh", std::filesystem::last_write_time(root / "common.fxh") + std::chrono::seconds(10));
+	const std::shared_ptr<const std::string> changed_common = cache.load(root / "common.fxh");
+	CHECK(changed_common != nullptr && *changed_common == "CHANGED COMMON\n\n");
+	CHECK(*common == "COMMON\n\n");
+	CHECK(cache.files_read() == 4);
+
+	// Directory listings are only updated after they were refreshed
+	CHECK(!cache.exists(root / "new.fxh"));
+	CHECK(cache.find_files(root, { ".fx" }).size() == 2);
+	write_file(root / "new.fxh", "NEW\n");
+	write_file(root / "c.fx", "C\n");
+	std::filesystem::last_write_time(root, std::filesystem::last_write_time(root) + std::chrono::seconds(10));
+	CHECK(!cache.exists(root / "new.fxh"));
+	cache.refresh_directories();
+	CHECK(cache.exists(root / "new.fxh"));
+	CHECK(cache.find_files(root, { ".fx" }).size() == 3);
+
+	std::filesystem::remove_all(root);
+}
+
+int main()
+{
+	test_missing_files();
+	test_source_cache();
+
+	// Each "<name>.fx" file in the directory is preprocessed and the output followed by all errors and warnings has to match "<name>.out" exactly
+	// These were generated with the string-based macro expansion the token-based one replaced, so that any difference in whitespace or diagnostics is caught
+	size_t num_cases = 0;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator("preprocessor"))
+	{
+		if (entry.path().extension() != ".fx")
+			continue;
+
+		std::filesystem::path expected_path = entry.path();
+		expected_path.replace_extension(".out");
+
+		reshadefx::preprocessor pp;
+		pp.append_string(read_file(entry.path()));
+
+		num_cases++;
+
+		if (const std::string actual = pp.output() + pp.errors(); actual != read_file(expected_path))
+		{
+			std::fprintf(stderr, "Output for %s does not match %s:\n%s\n", entry.path().u8string().c_str(), expected_path.u8string().c_str(), actual.c_str());
+			test_failures()++;
+		}
+	}
+
+	CHECK(num_cases != 0);
+
+	return test_result();
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include "effect_serialization.hpp"
+#include <memory>
+
+using namespace reshadefx;
+
+static std::string serialize(const module &module, const module_info &info, const module_source_info &source_info)
+{
+	std::string data;
+	write_module(data, module, info, source_info);
+	return data;
+}
+
+static void test_round_trip(codegen *codegen, const module_info &info)
+{
+	preprocessor pp;
+	pp.add_macro_definition("BUFFER_WIDTH", "800");
+	pp.add_macro_definition("BUFFER_HEIGHT", "600");
+	CHECK(pp.append_file("codegen/trim.fx"));
+
+	parser parser;
+	CHECK(parser.parse(pp.output(), codegen));
+
+	module module;
+	codegen->write_result(module);
+
+	module_source_info source_info;
+	source_info.macro_hash = hash_macro_definitions({ { "BUFFER_WIDTH", "800" }, { "BUFFER_HEIGHT", "600" } });
+	source_info.included_files = { "common.fxh", std::filesystem::path("sub") / "header.fxh" };
+	source_info.definitions = { { "QUALITY", "2" }, { "USE_FEATURE", "1" } };
+
+	const std::string data = serialize(module, info, source_info);
+
+	// Write -> read -> compare
+	{
+		reshadefx::module read_module;
+		module_info read_info;
+		module_source_info read_source_info;
+		CHECK(reshadefx::read_module(data, read_module, read_info, read_source_info));
+
+		CHECK(read_info == info);
+		CHECK(read_source_info.macro_hash == source_info.macro_hash);
+		CHECK(read_source_info.included_files == source_info.included_files);
+		CHECK(read_source_info.definitions == source_info.definitions);
+
+		CHECK(read_module.hlsl == module.hlsl);
+		CHECK(read_module.spirv == module.spirv);
+		CHECK(read_module.entry_points.size() == module.entry_points.size());
+		for (size_t i = 0; i < module.entry_points.size() && i < read_module.entry_points.size(); ++i)
+		{
+			CHECK(read_module.entry_points[i].name == module.entry_points[i].name);
+			CHECK(read_module.entry_points[i].is_pixel_shader == module.entry_points[i].is_pixel_shader);
+			CHECK(read_module.entry_points[i].hlsl == module.entry_points[i].hlsl);
+		}
+		CHECK(read_module.textures.size() == module.textures.size());
+		CHECK(read_module.samplers.size() == module.samplers.size());
+		CHECK(read_module.uniforms.size() == module.uniforms.size());
+		CHECK(read_module.techniques.size() == module.techniques.size());
+		CHECK(read_module.total_uniform_size == module.total_uniform_size);
+
+		// Everything else is compared through the serialized data, which covers all members of the module
+		CHECK(serialize(read_module, read_info, read_source_info) == data);
+	}
+
+	const auto rejects = [](std::string_view data) {
+		reshadefx::module read_module;
+		module_info read_info;
+		module_source_info read_source_info;
+		return !reshadefx::read_module(data, read_module, read_info, read_source_info) && read_module.hlsl.empty() && read_module.entry_points.empty() && read_source_info.included_files.empty();
+	};
+
+	// Truncated files
+	for (size_t size = 0; size < data.size(); size += (size < 128 ? 1 : 97))
+		CHECK(rejects(std::string_view(data).substr(0, size)));
+	CHECK(rejects(data + '\0'));
+
+	// Wrong version
+	{
+		std::string modified = data;
+		modified[4] ^= 0x7F;
+		CHECK(rejects(modified));
+	}
+
+	// Bad checksum, either because the checksum itself or any of the data it covers is corrupt
+	for (size_t offset : { size_t(8), size_t(24), size_t(32), data.size() - 32, data.size() - 40, data.size() / 2, data.size() - 1 })
+	{
+		std::string modified = data;
+		modified[offset] ^= 0x01;
+		CHECK(rejects(modified));
+	}
+}
+
+int main()
+{
+	module_info info;
+
+	info.target = module_target::hlsl;
+	info.shader_model = 30;
+	test_round_trip(std::unique_ptr<codegen>(create_codegen_hlsl(30, false, false, true)).get(), info);
+	info.shader_model = 50;
+	test_round_trip(std::unique_ptr<codegen>(create_codegen_hlsl(50, false, false, true)).get(), info);
+
+	info.target = module_target::glsl;
+	info.shader_model = 0;
+	info.uniforms_to_spec_constants = true;
+	test_round_trip(std::unique_ptr<codegen>(create_codegen_glsl(false, true, true)).get(), info);
+
+	// The macro hash does not depend on the order of definitions and only takes the first definition of each macro into account, like the preprocessor
+	CHECK(hash_macro_definitions({ { "A", "1" }, { "B", "2" } }) == hash_macro_definitions({ { "B", "2" }, { "A", "1" } }));
+	CHECK(hash_macro_definitions({ { "A", "1" }, { "B", "2" } }) == hash_macro_definitions({ { "A", "1" }, { "B", "2" }, { "A", "3" } }));
+	CHECK(hash_macro_definitions({ { "A", "1" }, { "B", "2" } }) != hash_macro_definitions({ { "A", "1" }, { "B", "3" } }));
+	CHECK(hash_macro_definitions({ { "A", "1" } }) != hash_macro_definitions({ { "A", "1" }, { "B", "2" } }));
+	CHECK(hash_macro_definitions({ { "AB", "" } }) != hash_macro_definitions({ { "A", "B" } }));
+
+	return test_result();
+}
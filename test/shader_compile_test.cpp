@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "runtime_objects.hpp"
+#include "worker_pool.hpp"
+
+using namespace reshade;
+
+static std::shared_ptr<effect_shaders> create_shaders(size_t num_jobs)
+{
+	const auto shaders = std::make_shared<effect_shaders>();
+	for (size_t i = 0; i < num_jobs; ++i)
+	{
+		shader_compile_job &job = shaders->jobs.emplace_back();
+		job.entry_point = "main" + std::to_string(i);
+		job.is_pixel_shader = (i % 2) != 0;
+		job.source = "source of " + job.entry_point;
+	}
+	return shaders;
+}
+
+// Stands in for the backend compiler, which fails for every entry point whose index is a multiple of the specified value
+static std::function<void(shader_compile_job &)> stub_compile(size_t fail_every)
+{
+	return [fail_every](shader_compile_job &job) {
+		const size_t index = std::stoul(job.entry_point.substr(4));
+
+		job.success = fail_every == 0 || index % fail_every != 0;
+		job.code = job.source;
+		job.assembly = "assembly of " + job.entry_point;
+		job.errors = job.success ? job.entry_point + ": warning: stub\n" : job.entry_point + ": error: stub\n";
+	};
+}
+
+static void test_completion(worker_pool &pool, bool wait)
+{
+	effect effect;
+	effect.shaders = create_shaders(64);
+
+	effect_shaders::compile(effect.shaders, pool, stub_compile(0), wait);
+	if (!wait)
+		pool.wait();
+
+	CHECK(effect.shaders->finished());
+
+	for (const shader_compile_job &job : effect.shaders->jobs)
+	{
+		CHECK(job.success);
+		CHECK(job.code == "source of " + job.entry_point);
+		// The source is freed once a job finished
+		CHECK(job.source.empty());
+	}
+
+	CHECK(effect.shaders->collect_results(effect));
+	CHECK(effect.assembly.size() == 64);
+	CHECK(effect.assembly["main5"] == "assembly of main5");
+	// Warnings are reported as well
+	CHECK(effect.errors.find("main5: warning: stub\n") != std::string::npos);
+}
+
+static void test_errors(worker_pool &pool)
+{
+	effect effect;
+	effect.errors = "preprocessor warning\n";
+	effect.shaders = create_shaders(16);
+
+	effect_shaders::compile(effect.shaders, pool, stub_compile(5), true);
+
+	CHECK(effect.shaders->finished());
+	CHECK(!effect.shaders->collect_results(effect));
+
+	// Errors of compile jobs are appended to the errors that were there already
+	CHECK(effect.errors.compare(0, 21, "preprocessor warning\n") == 0);
+	for (size_t i = 0; i < 16; ++i)
+	{
+		const std::string entry_point = "main" + std::to_string(i);
+		const bool failed = i % 5 == 0;
+
+		CHECK(effect.errors.find(entry_point + (failed ? ": error: stub\n" : ": warning: stub\n")) != std::string::npos);
+		// Only successful jobs contribute assembly
+		CHECK(effect.assembly.count(entry_point) == (failed ? 0 : 1));
+	}
+}
+
+static void test_unload_while_running(worker_pool &pool)
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool release = false;
+	size_t num_started = 0;
+	std::atomic<size_t> num_compiled = 0;
+
+	effect effect;
+	effect.shaders = create_shaders(8);
+
+	const std::weak_ptr<effect_shaders> weak_shaders = effect.shaders;
+
+	std::function<void(shader_compile_job &)> compile = stub_compile(0);
+	effect_shaders::compile(effect.shaders, pool, [&](shader_compile_job &job) {
+		{	std::unique_lock<std::mutex> lock(mutex);
+			num_started++;
+			condition.notify_all();
+			condition.wait(lock, [&release]() { return release; });
+		}
+
+		compile(job);
+		num_compiled++;
+	}, false);
+
+	// Wait until every worker thread is busy with a job, then unload the effect
+	{	std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [&]() { return num_started == pool.num_threads(); });
+	}
+
+	effect = {};
+
+	// The running jobs still hold on to the shaders, so they can write their results without touching freed memory
+	CHECK(!weak_shaders.expired());
+
+	{	const std::lock_guard<std::mutex> lock(mutex);
+		release = true;
+	}
+	condition.notify_all();
+
+	pool.wait();
+
+	CHECK(num_compiled == 8);
+	// And the last job to finish releases them
+	CHECK(weak_shaders.expired());
+}
+
+int main()
+{
+	worker_pool pool(4);
+
+	test_completion(pool, false);
+	test_completion(pool, true);
+	test_errors(pool);
+	test_unload_while_running(pool);
+
+	return test_result();
+}
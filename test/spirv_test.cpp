@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "test.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <spirv.hpp>
+
+static std::vector<uint32_t> compile(const std::filesystem::path &path, bool optimize = false)
+{
+	reshadefx::preprocessor pp;
+	CHECK(pp.append_file(path));
+
+	std::unique_ptr<reshadefx::codegen> codegen(reshadefx::create_codegen_spirv(true, false, false, false, optimize));
+
+	reshadefx::parser parser;
+	CHECK(parser.parse(pp.output(), codegen.get()));
+
+	reshadefx::module module;
+	codegen->write_result(module);
+	return module.spirv;
+}
+
+// Formats each instruction as its opcode followed by its operands on a separate line, so that differences are easy to spot
+// Capabilities are declared in hash set order, which depends on the standard library implementation, so they are sorted
+static std::string format(const std::vector<uint32_t> &spirv)
+{
+	std::vector<std::string> capabilities;
+	std::string text;
+
+	for (size_t i = 5; i < spirv.size();)
+	{
+		const uint32_t num_words = spirv[i] >> spv::WordCountShift;
+		const uint32_t opcode = spirv[i] & spv::OpCodeMask;
+		if (num_words == 0 || i + num_words > spirv.size())
+		{
+			std::fprintf(stderr, "Instruction at word %zu exceeds the module\n", i);
+			test_failures()++;
+			break;
+		}
+
+		std::string line = std::to_string(opcode);
+		for (uint32_t k = 1; k < num_words; ++k)
+			line += ' ' + std::to_string(spirv[i + k]);
+		line += '\n';
+
+		if (opcode == spv::OpCapability)
+			capabilities.push_back(std::move(line));
+		else
+			text += line;
+
+		i += num_words;
+	}
+
+	std::sort(capabilities.begin(), capabilities.end());
+
+	std::string result;
+	for (const std::string &line : capabilities)
+		result += line;
+	return result + text;
+}
+
+int main(int argc, char *argv[])
+{
+	const std::vector<uint32_t> spirv = compile("codegen/spirv.fx");
+
+	CHECK(spirv.size() > 5);
+	CHECK(spirv[0] == spv::MagicNumber);
+	CHECK(spirv[1] == 0x10300);
+
+	// Code generation has to be deterministic, otherwise modules could not be cached by their contents
+	CHECK(compile("codegen/spirv.fx") == spirv);
+
+	// The output has to match what was generated before exactly (pass "--update" to write the current output as the new expected one after an intended change)
+	const std::string actual = format(spirv);
+	if (argc > 1 && std::strcmp(argv[1], "--update") == 0)
+	{
+		std::ofstream("codegen/spirv.out", std::ios::binary) << actual;
+	}
+	else
+	{
+		std::ifstream file("codegen/spirv.out", std::ios::binary);
+		std::stringstream expected;
+		expected << file.rdbuf();
+
+		if (actual != expected.str())
+		{
+			std::fprintf(stderr, "Output for codegen/spirv.fx does not match codegen/spirv.out:\n%s\n", actual.c_str());
+			test_failures()++;
+		}
+	}
+
+	return test_result();
+}
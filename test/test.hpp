@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <cstdio>
+
+// The tests are plain executables that report failed checks to the console and return a non-zero exit code if any failed
+
+inline unsigned int &test_failures()
+{
+	static unsigned int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	((condition) ? (void)0 : (std::fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition), (void)++test_failures()))
+
+inline int test_result()
+{
+	if (test_failures() == 0)
+		return 0;
+	std::fprintf(stderr, "%u check(s) failed\n", test_failures());
+	return 1;
+}
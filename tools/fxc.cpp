@@ -6,8 +6,10 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include "effect_preprocessor.hpp"
+#include "effect_serialization.hpp"
 #include "version.h"
 #include <cstdlib>
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -25,7 +27,11 @@ Options:
   -P <path>                 Pre-process to file. If <path> is "-", then result is written to standard output instead.
 
   -Fo <file>                Output SPIR-V binary to the given file.
+  -Fm <file>                Output compiled effect module (code and reflection data) to the given file, which the runtime loads when placed next to the source file with the '.fxo' extension.
+                            It is only loaded if compiled with the same macros the runtime defines, so pass '-D __RENDERER__=<id>', '-D BUFFER_COLOR_BIT_DEPTH=<bits>' and all global and preset preprocessor definitions too.
+                            Prints the hash of the macro definitions, which the runtime logs together with the one it expected when it ignores a module.
   -Fe <file>                Output warnings and errors to the given file.
+  -E <name>                 Entry point to print code for. Only definitions it references are included.
 
   --glsl                    Print GLSL code for the previously specified entry point.
   --hlsl                    Print HLSL code for the previously specified entry point.
@@ -35,17 +41,29 @@ Options:
   --height                  Value of the 'BUFFER_HEIGHT' preprocessor macro.
   --invert-y                Insert code to invert the Y component of the output position in vertex shaders (only applies to SPIR-V).
   --spec-constants          Convert uniform variables to specialization constants.
+  -O                        Optimize generated SPIR-V and print instruction counts before and after.
 
   -Zi                       Enable debug information.
 	)", path);
 }
 
+static size_t count_instructions(const std::vector<uint32_t> &spirv)
+{
+	size_t count = 0;
+	// Skip the 5 word header, then walk the word count stored in the upper half of each instruction's first word
+	for (size_t offset = 5; offset < spirv.size() && (spirv[offset] >> 16) != 0; offset += spirv[offset] >> 16)
+		++count;
+	return count;
+}
+
 int main(int argc, char *argv[])
 {
 	const char *filename = nullptr;
 	const char *preprocess = nullptr;
 	const char *errorfile = nullptr;
 	const char *objectfile = nullptr;
+	const char *modulefile = nullptr;
+	const char *entry_point_name = nullptr;
 	const char *buffer_width = "800";
 	const char *buffer_height = "600";
 	bool print_glsl = false;
@@ -53,12 +71,15 @@ int main(int argc, char *argv[])
 	bool debug_info = false;
 	bool invert_y_axis = false;
 	bool spec_constants = false;
+	bool optimize = false;
 	unsigned int shader_model = 50;
 
 	reshadefx::parser parser;
 	reshadefx::preprocessor pp;
-	pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-	pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
+	// Keep track of all macro definitions, since module files are only used by the runtime with the same ones
+	std::vector<std::pair<std::string, std::string>> macros = {
+		{ "__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION) },
+	};
 
 	// Parse command-line arguments
 	for (int i = 1; i < argc; ++i)
@@ -81,7 +102,7 @@ int main(int argc, char *argv[])
 				char *macro = argv[++i];
 				char *value = std::strchr(macro, '=');
 				if (value) *value++ = '\0';
-				pp.add_macro_definition(macro, value ? value : "1");
+				macros.emplace_back(macro, value ? value : "1");
 				continue;
 			}
 
@@ -101,6 +122,8 @@ int main(int argc, char *argv[])
 				invert_y_axis = true;
 			else if (0 == std::strcmp(arg, "--spec-constants"))
 				spec_constants = true;
+			else if (0 == std::strcmp(arg, "-O"))
+				optimize = true;
 
 			if (i + 1 >= argc)
 				continue;
@@ -110,6 +133,10 @@ int main(int argc, char *argv[])
 				errorfile = argv[++i];
 			else if (0 == std::strcmp(arg, "-Fo"))
 				objectfile = argv[++i];
+			else if (0 == std::strcmp(arg, "-Fm"))
+				modulefile = argv[++i];
+			else if (0 == std::strcmp(arg, "-E"))
+				entry_point_name = argv[++i];
 			else if (0 == std::strcmp(arg, "--shader-model"))
 				shader_model = std::strtol(argv[++i], nullptr, 10);
 			else if (0 == std::strcmp(arg, "--width"))
@@ -135,10 +162,15 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	pp.add_macro_definition("BUFFER_WIDTH", buffer_width);
-	pp.add_macro_definition("BUFFER_HEIGHT", buffer_height);
-	pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-	pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+	// The runtime converts uniforms to specialization constants in performance mode
+	macros.emplace_back("__RESHADE_PERFORMANCE_MODE__", spec_constants ? "1" : "0");
+	macros.emplace_back("BUFFER_WIDTH", buffer_width);
+	macros.emplace_back("BUFFER_HEIGHT", buffer_height);
+	macros.emplace_back("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+	macros.emplace_back("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+
+	for (const auto &macro : macros)
+		pp.add_macro_definition(macro.first, macro.second);
 
 	if (!pp.append_file(filename))
 	{
@@ -158,13 +190,30 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	reshadefx::module_info module_info;
+	module_info.uniforms_to_spec_constants = spec_constants;
+
+	// The runtime compiles each entry point from only the code it references, so include that in module files too
+	const bool trim_entry_points = entry_point_name != nullptr || modulefile != nullptr;
+
 	std::unique_ptr<reshadefx::codegen> backend;
 	if (print_glsl)
-		backend.reset(reshadefx::create_codegen_glsl(debug_info, spec_constants));
+	{
+		module_info.target = reshadefx::module_target::glsl;
+		backend.reset(reshadefx::create_codegen_glsl(debug_info, spec_constants, trim_entry_points));
+	}
 	else if (print_hlsl)
-		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants));
+	{
+		module_info.target = reshadefx::module_target::hlsl;
+		module_info.shader_model = shader_model;
+		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants, trim_entry_points));
+	}
 	else
+	{
+		module_info.target = reshadefx::module_target::spirv;
+		module_info.invert_y = invert_y_axis;
 		backend.reset(reshadefx::create_codegen_spirv(true, debug_info, spec_constants, invert_y_axis));
+	}
 
 	if (!parser.parse(pp.output(), backend.get()))
 	{
@@ -178,11 +227,63 @@ int main(int argc, char *argv[])
 	reshadefx::module module;
 	backend->write_result(module);
 
-	if (print_glsl || print_hlsl)
+	if (optimize && !print_glsl && !print_hlsl)
 	{
-		std::cout << module.hlsl << std::endl;
+		const size_t num_instructions_before = count_instructions(module.spirv);
+
+		if (!reshadefx::optimize_spirv(module.spirv))
+			std::cout << "warning: SPIR-V module contains instructions the optimizer does not support and was left unchanged" << std::endl;
+
+		std::cout << "SPIR-V instructions: " << num_instructions_before << " -> " << count_instructions(module.spirv) << std::endl;
 	}
-	else if (objectfile != nullptr)
+
+	if (modulefile != nullptr)
+	{
+		reshadefx::module_source_info source_info;
+		source_info.macro_hash = reshadefx::hash_macro_definitions(macros);
+		source_info.definitions = pp.used_macro_definitions();
+
+		// Store included files relative to the source file, so that the runtime finds them wherever the effect is installed
+		const std::filesystem::path source_directory = std::filesystem::absolute(filename).parent_path();
+		for (const std::filesystem::path &file : pp.included_files())
+		{
+			const std::filesystem::path absolute_file = std::filesystem::absolute(file).lexically_normal();
+			const std::filesystem::path relative_file = absolute_file.lexically_relative(source_directory);
+			source_info.included_files.push_back(relative_file.empty() ? absolute_file : relative_file);
+		}
+
+		std::string data;
+		reshadefx::write_module(data, module, module_info, source_info);
+
+		std::ofstream(modulefile, std::ios::binary).write(data.data(), data.size());
+
+		// The runtime logs the hash it expected when it ignores the module because of different macro definitions, so print the one it is compared against along with what went into it
+		std::cout << "Macro hash: " << std::hex << source_info.macro_hash << std::dec << " (";
+		for (size_t i = 0; i < macros.size(); ++i)
+			std::cout << (i != 0 ? " " : "") << macros[i].first << '=' << macros[i].second;
+		std::cout << ')' << std::endl;
+	}
+	else if (print_glsl || print_hlsl)
+	{
+		if (entry_point_name != nullptr)
+		{
+			const auto entry_point = std::find_if(module.entry_points.begin(), module.entry_points.end(),
+				[entry_point_name](const reshadefx::entry_point &ep) { return ep.name == entry_point_name; });
+			if (entry_point == module.entry_points.end())
+			{
+				std::cout << "error: Entry point '" << entry_point_name << "' does not exist" << std::endl;
+				return 1;
+			}
+
+			std::cout << entry_point->hlsl << std::endl;
+		}
+		else
+		{
+			std::cout << module.hlsl << std::endl;
+		}
+	}
+
+	if (objectfile != nullptr && !print_glsl && !print_hlsl)
 	{
 		std::ofstream(objectfile, std::ios::binary).write(
 			reinterpret_cast<const char *>(module.spirv.data()), module.spirv.size() * sizeof(uint32_t));